@@ -0,0 +1,49 @@
+#include "catch2/catch_all.hpp"
+#include <inputtino/input.h>
+
+/*
+ * Same calls as benchDevices.cpp through the C bindings, the difference is the cost of the wrappers
+ */
+
+TEST_CASE("C API", "[BENCH]") {
+  InputtinoErrorHandler error_handler = {.eh = [](const char *message, void *_data) { FAIL(message); },
+                                         .user_data = nullptr};
+  InputtinoDeviceDefinition def = {};
+  int i = 0;
+
+  auto mouse = inputtino_mouse_create(&def, &error_handler);
+  REQUIRE(mouse != nullptr);
+  BENCHMARK("inputtino_mouse_move, uinput (3 ev)") {
+    inputtino_mouse_move(mouse, 1, (i++ & 1) ? 1 : -1);
+  };
+  inputtino_mouse_destroy(mouse);
+
+  auto keyboard = inputtino_keyboard_create(&def, &error_handler);
+  REQUIRE(keyboard != nullptr);
+  BENCHMARK("inputtino_keyboard_press + release, uinput (2x 3 ev)") {
+    inputtino_keyboard_press(keyboard, 0x41);
+    inputtino_keyboard_release(keyboard, 0x41);
+  };
+  inputtino_keyboard_destroy(keyboard);
+
+  auto trackpad = inputtino_trackpad_create(&def, &error_handler);
+  REQUIRE(trackpad != nullptr);
+  BENCHMARK("inputtino_trackpad_place_finger, uinput, 1 finger") {
+    inputtino_trackpad_place_finger(trackpad, 0, (i++ & 1) ? 0.1f : 0.2f, 0.5f, 0.5f, 0);
+  };
+  inputtino_trackpad_destroy(trackpad);
+
+  auto xone = inputtino_joypad_xone_create(&def, &error_handler);
+  REQUIRE(xone != nullptr);
+  BENCHMARK("inputtino_joypad_xone_set_pressed_buttons, uinput (3 ev)") {
+    inputtino_joypad_xone_set_pressed_buttons(xone, (i++ & 1) ? INPUTTINO_JOYPAD_BTN::A : INPUTTINO_JOYPAD_BTN::B);
+  };
+  inputtino_joypad_xone_destroy(xone);
+
+  auto ps5 = inputtino_joypad_ps5_create(&def, &error_handler);
+  REQUIRE(ps5 != nullptr);
+  BENCHMARK("inputtino_joypad_ps5_set_stick, uhid (1 report)") {
+    inputtino_joypad_ps5_set_stick(ps5, LS, (i++ & 1) ? 1000 : -1000, 0);
+  };
+  inputtino_joypad_ps5_destroy(ps5);
+}
@@ -0,0 +1,157 @@
+#include "catch2/catch_all.hpp"
+#include "mock_sink.hpp"
+#include <inputtino/input.hpp>
+#include <string>
+
+using namespace inputtino;
+using namespace inputtino::bench;
+
+/*
+ * Catch2 reports the time of a single call; every benchmark writes a full frame on each call, the number of evdev
+ * events in it is in the name (ex: "3 ev" = REL_X, REL_Y, SYN_REPORT) so events/s = events * 1e9 / mean ns.
+ *
+ * Values are changed on every call: writing the same axis value again is skipped on our side (see AxisShadow) and
+ * would only measure that.
+ */
+
+TEST_CASE("Mouse", "[BENCH]") {
+  auto mouse = std::move(*Mouse::create());
+  int i = 0;
+
+  BENCHMARK("Mouse::move, uinput (3 ev)") {
+    mouse.move(1, (i++ & 1) ? 1 : -1);
+  };
+
+  BENCHMARK("Mouse::move_abs, uinput (3 ev)") {
+    mouse.move_abs(i++ % 1920, 500, 1920, 1080);
+  };
+
+  MockSink sink;
+  auto mock_mouse = std::move(*Mouse::create());
+
+  BENCHMARK("Mouse::move, mock sink (3 ev)") {
+    mock_mouse.move(1, (i++ & 1) ? 1 : -1);
+  };
+
+  BENCHMARK("Mouse::move_abs, mock sink (3 ev)") {
+    mock_mouse.move_abs(i++ % 1920, 500, 1920, 1080);
+  };
+}
+
+TEST_CASE("Keyboard", "[BENCH]") {
+  auto keyboard = std::move(*Keyboard::create());
+
+  BENCHMARK("Keyboard::press + release, uinput (2x 3 ev)") {
+    keyboard.press(0x41);
+    keyboard.release(0x41);
+  };
+
+  MockSink sink;
+  auto mock_keyboard = std::move(*Keyboard::create());
+
+  BENCHMARK("Keyboard::press + release, mock sink (2x 3 ev)") {
+    mock_keyboard.press(0x41);
+    mock_keyboard.release(0x41);
+  };
+
+  BENCHMARK("Keyboard::create, mock sink (cached description)") {
+    return Keyboard::create();
+  };
+}
+
+static void place_fingers(Trackpad &trackpad, int fingers, int i) {
+  for (int finger = 0; finger < fingers; finger++) {
+    trackpad.place_finger(finger, 0.1f * finger + ((i & 1) ? 0.01f : 0.02f), 0.5f, 0.5f, 0);
+  }
+}
+
+static void apply_fingers(Trackpad &trackpad, TouchFrame &frame, int fingers, int i) {
+  frame.clear();
+  for (int finger = 0; finger < fingers; finger++) {
+    frame.place_finger(finger, 0.1f * finger + ((i & 1) ? 0.01f : 0.02f), 0.5f, 0.5f, 0);
+  }
+  trackpad.apply(frame);
+}
+
+TEST_CASE("Trackpad", "[BENCH]") {
+  auto trackpad = std::move(*Trackpad::create());
+  TouchFrame frame;
+  int i = 0;
+
+  for (int fingers = 1; fingers <= 5; fingers++) {
+    auto suffix = std::to_string(fingers) + (fingers == 1 ? " finger" : " fingers");
+    BENCHMARK("Trackpad::place_finger, uinput, " + suffix) {
+      place_fingers(trackpad, fingers, i++);
+    };
+    BENCHMARK("Trackpad::apply(TouchFrame), uinput, " + suffix) {
+      apply_fingers(trackpad, frame, fingers, i++);
+    };
+  }
+
+  MockSink sink;
+  auto mock_trackpad = std::move(*Trackpad::create());
+
+  for (int fingers = 1; fingers <= 5; fingers++) {
+    auto suffix = std::to_string(fingers) + (fingers == 1 ? " finger" : " fingers");
+    BENCHMARK("Trackpad::place_finger, mock sink, " + suffix) {
+      place_fingers(mock_trackpad, fingers, i++);
+    };
+    BENCHMARK("Trackpad::apply(TouchFrame), mock sink, " + suffix) {
+      apply_fingers(mock_trackpad, frame, fingers, i++);
+    };
+  }
+}
+
+TEST_CASE("XboxOneJoypad", "[BENCH]") {
+  auto joypad = std::move(*XboxOneJoypad::create());
+  int i = 0;
+
+  BENCHMARK("XboxOneJoypad::set_pressed_buttons, uinput (3 ev)") {
+    joypad.set_pressed_buttons((i++ & 1) ? Joypad::A : Joypad::B);
+  };
+
+  MockSink sink;
+  auto mock_joypad = std::move(*XboxOneJoypad::create());
+
+  BENCHMARK("XboxOneJoypad::set_pressed_buttons, mock sink (3 ev)") {
+    mock_joypad.set_pressed_buttons((i++ & 1) ? Joypad::A : Joypad::B);
+  };
+}
+
+TEST_CASE("SwitchJoypad", "[BENCH]") {
+  MockSink sink;
+  auto mock_joypad = std::move(*SwitchJoypad::create());
+  int i = 0;
+
+  BENCHMARK("SwitchJoypad::set_pressed_buttons, mock sink (6 ev)") {
+    mock_joypad.set_pressed_buttons((i++ & 1) ? Joypad::A | Joypad::X | Joypad::DPAD_UP | Joypad::MISC_FLAG : Joypad::B);
+  };
+}
+
+TEST_CASE("PS5Joypad", "[BENCH]") {
+  auto joypad = std::move(*PS5Joypad::create());
+  int i = 0;
+
+  BENCHMARK("PS5Joypad::set_stick, uhid (1 report)") {
+    joypad.set_stick(Joypad::LS, (i++ & 1) ? 1000 : -1000, 0);
+  };
+
+  MockSink sink;
+  auto mock_joypad = std::move(*PS5Joypad::create());
+
+  BENCHMARK("PS5Joypad::set_stick, mock sink (1 report)") {
+    mock_joypad.set_stick(Joypad::LS, (i++ & 1) ? 1000 : -1000, 0);
+  };
+
+  BENCHMARK("PS5Joypad::set_pressed_buttons, mock sink (1 report)") {
+    mock_joypad.set_pressed_buttons((i++ & 1) ? Joypad::A | Joypad::DPAD_UP | Joypad::DPAD_LEFT : Joypad::HOME);
+  };
+
+  BENCHMARK("PS5Joypad::set_motion, mock sink (1 report)") {
+    mock_joypad.set_motion(PS5Joypad::GYROSCOPE, (i++ & 1) ? 1.5f : -1.5f, 0.25f, -0.25f);
+  };
+
+  BENCHMARK("PS5Joypad::place_finger, mock sink (1 report)") {
+    mock_joypad.place_finger(0, static_cast<uint16_t>(i++ & 0x3FF), 500);
+  };
+}
@@ -0,0 +1,404 @@
+/**
+ * End to end latency: from the call on a device (ex: Mouse::move()) to the event being readable on its evdev node.
+ *
+ *   inputtino_latency [--devices N] [--rate HZ] [--seconds S] [--only mouse,keyboard,...]
+ *
+ * Creates N devices of each type, calls each of them HZ times per second from a single thread and reads all the
+ * nodes with libevdev from another thread. Every call writes a value that identifies its slot (ex: the stick
+ * position), the reader looks up when that slot was written: it doesn't need the clocks of two processes to match and
+ * a lost event can't skew the following ones.
+ *
+ * Beware: just like the tests, the devices are real, the compositor will see them (the mouse will jiggle).
+ */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <inputtino/input.hpp>
+#include <libevdev/libevdev.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace inputtino;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int MAX_SLOTS = 64;
+
+/**
+ * How to drive one kind of device and how to recognise its events on the node
+ */
+struct Probe {
+  std::string name;
+  /* The node to read is the one that has this event (ex: the PS5 pad also has a touchpad and a motion sensors node) */
+  unsigned int node_type;
+  unsigned int node_code;
+  /* The event that carries the slot, code 0 matches any code of that type */
+  unsigned int type;
+  unsigned int code;
+  int slots;
+  std::function<void(int slot, std::uint64_t seq)> inject;
+  std::function<std::optional<int>(const libevdev *dev, const input_event &ev)> decode;
+  std::function<std::vector<std::string>()> get_nodes;
+  std::shared_ptr<void> device; // keeps the device alive
+};
+
+/* Middle of the range that belongs to `slot`, see decode_abs() */
+float slot_fraction(int slot, int slots) {
+  return (slot + 0.5f) / slots;
+}
+
+short slot_stick(int slot, int slots) {
+  return static_cast<short>(-32768 + std::lround(slot_fraction(slot, slots) * 65535));
+}
+
+std::optional<int> decode_abs(const libevdev *dev, const input_event &ev, int slots) {
+  auto min = libevdev_get_abs_minimum(dev, ev.code);
+  auto max = libevdev_get_abs_maximum(dev, ev.code);
+  auto slot = static_cast<int>((static_cast<std::int64_t>(ev.value) - min) * slots / (max - min + 1));
+  return std::clamp(slot, 0, slots - 1);
+}
+
+template <typename Device> std::shared_ptr<Device> make_device() {
+  auto device = Device::create();
+  if (!device) {
+    std::fprintf(stderr, "Unable to create device: %s\n", device.getErrorMessage().c_str());
+    std::exit(1);
+  }
+  return std::make_shared<Device>(std::move(*device));
+}
+
+template <typename Device>
+Probe abs_probe(std::string name, unsigned int node_type, unsigned int node_code, unsigned int code) {
+  auto device = make_device<Device>();
+  return Probe{.name = std::move(name),
+               .node_type = node_type,
+               .node_code = node_code,
+               .type = EV_ABS,
+               .code = code,
+               .slots = MAX_SLOTS,
+               .inject = {},
+               .decode = [](const libevdev *dev, const input_event &ev) { return decode_abs(dev, ev, MAX_SLOTS); },
+               .get_nodes = [device]() { return device->get_nodes(); },
+               .device = device};
+}
+
+std::optional<Probe> make_probe(const std::string &type) {
+  if (type == "mouse") {
+    auto mouse = make_device<Mouse>();
+    return Probe{.name = type,
+                 .node_type = EV_REL,
+                 .node_code = REL_X,
+                 .type = EV_REL,
+                 .code = REL_X,
+                 .slots = MAX_SLOTS,
+                 .inject = [mouse](int slot, std::uint64_t seq) { mouse->move(((seq & 1) ? -1 : 1) * (slot + 1), 0); },
+                 .decode = [](const libevdev *, const input_event &ev) { return std::abs(ev.value) - 1; },
+                 .get_nodes = [mouse]() { return mouse->get_nodes(); },
+                 .device = mouse};
+  } else if (type == "keyboard") {
+    auto keyboard = make_device<Keyboard>();
+    constexpr short LEFT_SHIFT = 0xA0, RIGHT_SHIFT = 0xA1; // the least disruptive keys for the desktop
+    return Probe{.name = type,
+                 .node_type = EV_KEY,
+                 .node_code = KEY_LEFTSHIFT,
+                 .type = EV_KEY,
+                 .code = 0,
+                 .slots = 2,
+                 .inject =
+                     [keyboard](int slot, std::uint64_t) {
+                       keyboard->press(slot ? RIGHT_SHIFT : LEFT_SHIFT);
+                       keyboard->release(slot ? RIGHT_SHIFT : LEFT_SHIFT);
+                     },
+                 .decode = [](const libevdev *, const input_event &ev) -> std::optional<int> {
+                   if (ev.value != 1) {
+                     return std::nullopt;
+                   }
+                   return ev.code == KEY_RIGHTSHIFT ? 1 : 0;
+                 },
+                 .get_nodes = [keyboard]() { return keyboard->get_nodes(); },
+                 .device = keyboard};
+  } else if (type == "trackpad" || type == "touchscreen") {
+    auto probe = type == "trackpad" ? abs_probe<Trackpad>(type, EV_ABS, ABS_MT_POSITION_X, ABS_MT_POSITION_X)
+                                    : abs_probe<TouchScreen>(type, EV_ABS, ABS_MT_POSITION_X, ABS_MT_POSITION_X);
+    auto device = probe.device;
+    probe.inject = [device, trackpad = type == "trackpad"](int slot, std::uint64_t) {
+      auto x = slot_fraction(slot, MAX_SLOTS);
+      if (trackpad) {
+        std::static_pointer_cast<Trackpad>(device)->place_finger(0, x, 0.5f, 0.5f, 0);
+      } else {
+        std::static_pointer_cast<TouchScreen>(device)->place_finger(0, x, 0.5f, 0.5f, 0);
+      }
+    };
+    return probe;
+  } else if (type == "pentablet") {
+    auto probe = abs_probe<PenTablet>(type, EV_ABS, ABS_X, ABS_X);
+    auto tablet = std::static_pointer_cast<PenTablet>(probe.device);
+    probe.inject = [tablet](int slot, std::uint64_t) {
+      tablet->place_tool(PenTablet::PEN, slot_fraction(slot, MAX_SLOTS), 0.5f, 0.5f, -1, 0, 0);
+    };
+    return probe;
+  } else if (type == "xbox" || type == "switch" || type == "ps5") {
+    Probe probe = type == "xbox"     ? abs_probe<XboxOneJoypad>(type, EV_KEY, BTN_SOUTH, ABS_X)
+                  : type == "switch" ? abs_probe<SwitchJoypad>(type, EV_KEY, BTN_SOUTH, ABS_X)
+                                     : abs_probe<PS5Joypad>(type, EV_KEY, BTN_SOUTH, ABS_X);
+    auto joypad = probe.device;
+    probe.inject = [joypad, type](int slot, std::uint64_t) {
+      auto x = slot_stick(slot, MAX_SLOTS);
+      if (type == "xbox") {
+        std::static_pointer_cast<XboxOneJoypad>(joypad)->set_stick(Joypad::LS, x, 0);
+      } else if (type == "switch") {
+        std::static_pointer_cast<SwitchJoypad>(joypad)->set_stick(Joypad::LS, x, 0);
+      } else {
+        std::static_pointer_cast<PS5Joypad>(joypad)->set_stick(Joypad::LS, x, 0);
+      }
+    };
+    return probe;
+  }
+  return std::nullopt;
+}
+
+struct Instance {
+  Probe probe;
+  libevdev *evdev = nullptr;
+  int fd = -1;
+  std::array<std::atomic<std::int64_t>, MAX_SLOTS> sent_ns = {};
+  std::uint64_t seq = 0;
+};
+
+struct Stats {
+  std::vector<std::int64_t> latencies_ns;
+  std::uint64_t sent = 0;
+  std::uint64_t resyncs = 0;
+};
+
+std::int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/**
+ * The kernel creates the nodes asynchronously for uhid devices and udev might not have set the permissions yet
+ */
+bool open_node(Instance &instance) {
+  auto deadline = Clock::now() + std::chrono::seconds(5);
+  while (Clock::now() < deadline) {
+    for (const auto &node : instance.probe.get_nodes()) {
+      if (node.rfind("/dev/input/event", 0) != 0) {
+        continue;
+      }
+      int fd = open(node.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+      if (fd < 0) {
+        continue;
+      }
+      libevdev *evdev = nullptr;
+      if (libevdev_new_from_fd(fd, &evdev) == 0 &&
+          libevdev_has_event_code(evdev, instance.probe.node_type, instance.probe.node_code)) {
+        instance.fd = fd;
+        instance.evdev = evdev;
+        return true;
+      }
+      if (evdev) {
+        libevdev_free(evdev);
+      }
+      close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return false;
+}
+
+void read_events(Instance &instance, Stats &stats, std::int64_t readable_ns) {
+  input_event ev{};
+  int rc;
+  while ((rc = libevdev_next_event(instance.evdev, LIBEVDEV_READ_FLAG_NORMAL, &ev)) >= 0) {
+    if (rc == LIBEVDEV_READ_STATUS_SYNC) {
+      stats.resyncs++; // the kernel buffer overflowed, drop what's left of it
+      while (libevdev_next_event(instance.evdev, LIBEVDEV_READ_FLAG_SYNC, &ev) == LIBEVDEV_READ_STATUS_SYNC) {
+      }
+      continue;
+    }
+    if (ev.type != instance.probe.type || (instance.probe.code && ev.code != instance.probe.code)) {
+      continue;
+    }
+    if (auto slot = instance.probe.decode(instance.evdev, ev); slot && *slot >= 0 && *slot < instance.probe.slots) {
+      if (auto sent = instance.sent_ns[*slot].exchange(0); sent != 0) {
+        stats.latencies_ns.push_back(readable_ns - sent);
+      }
+    }
+  }
+}
+
+std::int64_t percentile(const std::vector<std::int64_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto idx = static_cast<std::size_t>(std::ceil(p * sorted.size())) - 1;
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void print_stats(const std::string &name, Stats &stats) {
+  auto &lat = stats.latencies_ns;
+  std::sort(lat.begin(), lat.end());
+  double mean = 0, variance = 0;
+  for (auto l : lat) {
+    mean += l;
+  }
+  mean = lat.empty() ? 0 : mean / lat.size();
+  for (auto l : lat) {
+    variance += (l - mean) * (l - mean);
+  }
+  variance = lat.empty() ? 0 : variance / lat.size();
+
+  auto us = [](double ns) { return ns / 1000.0; };
+  std::printf("%-12s %9llu %9llu %6llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+              name.c_str(),
+              static_cast<unsigned long long>(stats.sent),
+              static_cast<unsigned long long>(stats.sent - std::min<std::uint64_t>(lat.size(), stats.sent)),
+              static_cast<unsigned long long>(stats.resyncs),
+              us(percentile(lat, 0.5)),
+              us(percentile(lat, 0.99)),
+              us(percentile(lat, 0.999)),
+              us(lat.empty() ? 0 : lat.back()),
+              us(std::sqrt(variance)));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int devices = 1;
+  int rate_hz = 1000;
+  int seconds = 5;
+  std::vector<std::string> types =
+      {"mouse", "keyboard", "trackpad", "touchscreen", "pentablet", "xbox", "switch", "ps5"};
+
+  for (int i = 1; i < argc; i += 2) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      arg = "--help";
+    }
+    if (arg == "--devices") {
+      devices = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--rate") {
+      rate_hz = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--seconds") {
+      seconds = std::max(1, std::atoi(argv[i + 1]));
+    } else if (arg == "--only") {
+      types.clear();
+      std::string list = argv[i + 1];
+      for (std::size_t start = 0, end; start <= list.size(); start = end + 1) {
+        end = std::min(list.find(',', start), list.size());
+        types.push_back(list.substr(start, end - start));
+      }
+    } else {
+      std::fprintf(stderr,
+                   "Usage: %s [--devices N] [--rate HZ] [--seconds S] [--only mouse,keyboard,trackpad,touchscreen,"
+                   "pentablet,xbox,switch,ps5]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<std::unique_ptr<Instance>> instances;
+  for (const auto &type : types) {
+    for (int i = 0; i < devices; i++) {
+      auto probe = make_probe(type);
+      if (!probe) {
+        std::fprintf(stderr, "Unknown device type: %s\n", type.c_str());
+        return 1;
+      }
+      auto instance = std::make_unique<Instance>();
+      instance->probe = std::move(*probe);
+      if (!open_node(*instance)) {
+        std::fprintf(stderr, "Unable to open the evdev node of %s\n", type.c_str());
+        return 1;
+      }
+      instances.push_back(std::move(instance));
+    }
+  }
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  for (std::size_t i = 0; i < instances.size(); i++) {
+    epoll_event ev{.events = EPOLLIN, .data = {.u64 = i}};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, instances[i]->fd, &ev);
+  }
+
+  std::vector<Stats> stats(instances.size());
+  std::atomic<bool> running = true;
+  std::thread reader([&]() {
+    std::array<epoll_event, 64> events{};
+    while (running.load(std::memory_order_relaxed)) {
+      int n = epoll_wait(epoll_fd, events.data(), events.size(), 100);
+      auto readable_ns = now_ns();
+      for (int i = 0; i < n; i++) {
+        auto idx = events[i].data.u64;
+        read_events(*instances[idx], stats[idx], readable_ns);
+      }
+    }
+  });
+
+  auto period = std::chrono::nanoseconds(1000000000 / rate_hz);
+  auto start = Clock::now();
+  auto end = start + std::chrono::seconds(seconds);
+  for (auto tick = start; tick < end; tick += period) {
+    std::this_thread::sleep_until(tick);
+    for (std::size_t i = 0; i < instances.size(); i++) {
+      auto &instance = *instances[i];
+      auto seq = instance.seq++;
+      auto slot = static_cast<int>(seq % instance.probe.slots);
+      instance.sent_ns[slot].store(now_ns());
+      instance.probe.inject(slot, seq);
+      stats[i].sent++;
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // let the reader catch up
+  running = false;
+  reader.join();
+  close(epoll_fd);
+
+  std::printf("%d device(s) per type, %d Hz each, %.1f calls/s in total\n\n",
+              devices,
+              rate_hz,
+              stats.empty() ? 0 : stats.size() * stats[0].sent / elapsed);
+  std::printf("%-12s %9s %9s %6s %9s %9s %9s %9s %9s\n",
+              "device",
+              "sent",
+              "lost",
+              "resync",
+              "p50 us",
+              "p99 us",
+              "p999 us",
+              "max us",
+              "jitter us");
+  for (const auto &type : types) { // aggregate all the devices of the same type
+    Stats total;
+    for (std::size_t i = 0; i < instances.size(); i++) {
+      if (instances[i]->probe.name == type) {
+        total.sent += stats[i].sent;
+        total.resyncs += stats[i].resyncs;
+        total.latencies_ns.insert(total.latencies_ns.end(),
+                                  stats[i].latencies_ns.begin(),
+                                  stats[i].latencies_ns.end());
+      }
+    }
+    print_stats(type, total);
+  }
+
+  for (auto &instance : instances) {
+    libevdev_free(instance->evdev);
+    close(instance->fd);
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <inputtino/backend.hpp>
+#include <inputtino/mock_backend.hpp>
+#include <memory>
+
+namespace inputtino::bench {
+
+/**
+ * The devices created while this is alive go to an in-memory MockBackend: calls run through exactly the same code
+ * path (serial queue, EventFrame, ...) but the kernel is out of the picture, so what's left is our own overhead.
+ */
+class MockSink {
+public:
+  MockSink() : backend(std::make_shared<MockBackend>()) {
+    set_output_backend(backend);
+  }
+
+  ~MockSink() {
+    set_output_backend(nullptr);
+  }
+
+  MockSink(const MockSink &) = delete;
+  MockSink &operator=(const MockSink &) = delete;
+
+private:
+  std::shared_ptr<MockBackend> backend;
+};
+
+} // namespace inputtino::bench
@@ -0,0 +1,335 @@
+/**
+ * Per device overhead: how many devices a single process can host.
+ *
+ *   inputtino_stress [--max N] [--step N] [--rate HZ] [--seconds S] [--only mouse,keyboard,...] [--mock]
+ *
+ * Ramps up to N devices of each type, --step devices of each type at a time (each create() is timed). After each step
+ * all the devices are driven at HZ calls per second each, from a single thread, for S seconds; then the process is
+ * measured: resident memory, threads, open fds and the CPU used while driving the devices (user + system, the latter
+ * includes the kernel side of our writes to uinput/uhid, not what the readers of the nodes do).
+ * Once the ramp is done all the devices are destroyed (each one is timed) and the process is measured again, whatever
+ * is left over has leaked; except for the shared EventLoop and Scheduler threads (and their fds), which are started
+ * together with the first device and never stopped.
+ *
+ * With --mock the devices go to an in-memory MockBackend: /dev/uinput and /dev/uhid are not needed and only our own
+ * overhead is measured. Without it, the devices are real: the compositor will see them.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <inputtino/input.hpp>
+#include <inputtino/protected_types.hpp>
+#include <malloc.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <uhid/protected_types.hpp>
+#include <vector>
+
+#include "mock_sink.hpp"
+
+using namespace inputtino;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+/**
+ * How to create and drive one kind of device
+ */
+struct Kind {
+  std::string name;
+  /* sizeof() the state struct that each device allocates, see protected_types.hpp */
+  std::size_t state_size;
+  std::function<std::shared_ptr<void>()> create; // nullptr on failure
+  std::function<void(void *device, std::uint64_t seq)> drive;
+  std::vector<std::shared_ptr<void>> devices;
+  std::vector<std::int64_t> create_ns;
+  std::vector<std::int64_t> destroy_ns;
+};
+
+template <typename Device> std::shared_ptr<void> create_device() {
+  auto device = Device::create();
+  if (!device) {
+    std::fprintf(stderr, "Unable to create device: %s\n", device.getErrorMessage().c_str());
+    return nullptr;
+  }
+  return std::make_shared<Device>(std::move(*device));
+}
+
+template <typename Pad> void drive_joypad(void *device, std::uint64_t seq) {
+  static_cast<Pad *>(device)->set_stick(Joypad::LS, static_cast<short>((seq & 1) ? -1000 : 1000), 0);
+}
+
+std::optional<Kind> make_kind(const std::string &type) {
+  if (type == "mouse") {
+    return Kind{.name = type,
+                .state_size = sizeof(MouseState),
+                .create = create_device<Mouse>,
+                .drive = [](void *device, std::uint64_t seq) {
+                  static_cast<Mouse *>(device)->move((seq & 1) ? -1 : 1, 0);
+                }};
+  } else if (type == "keyboard") {
+    return Kind{.name = type,
+                .state_size = sizeof(KeyboardState),
+                .create = create_device<Keyboard>,
+                .drive =
+                    [](void *device, std::uint64_t seq) {
+                      constexpr short LEFT_SHIFT = 0xA0; // the least disruptive key for the desktop
+                      if (seq & 1) {
+                        static_cast<Keyboard *>(device)->release(LEFT_SHIFT);
+                      } else {
+                        static_cast<Keyboard *>(device)->press(LEFT_SHIFT);
+                      }
+                    }};
+  } else if (type == "xbox") {
+    return Kind{.name = type,
+                .state_size = sizeof(XboxOneJoypadState),
+                .create = create_device<XboxOneJoypad>,
+                .drive = drive_joypad<XboxOneJoypad>};
+  } else if (type == "switch") {
+    return Kind{.name = type,
+                .state_size = sizeof(SwitchJoypadState),
+                .create = create_device<SwitchJoypad>,
+                .drive = drive_joypad<SwitchJoypad>};
+  } else if (type == "ps5") {
+    return Kind{.name = type,
+                .state_size = sizeof(PS5JoypadState),
+                .create = create_device<PS5Joypad>,
+                .drive = drive_joypad<PS5Joypad>};
+  }
+  return std::nullopt;
+}
+
+struct ProcessStats {
+  long rss_kb = 0;
+  long threads = 0;
+  long fds = 0;
+};
+
+ProcessStats process_stats() {
+  ProcessStats stats;
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.rfind("VmRSS:", 0) == 0) {
+      stats.rss_kb = std::atol(line.c_str() + 6);
+    } else if (line.rfind("Threads:", 0) == 0) {
+      stats.threads = std::atol(line.c_str() + 8);
+    }
+  }
+  if (auto dir = opendir("/proc/self/fd")) {
+    while (auto entry = readdir(dir)) {
+      if (entry->d_name[0] != '.') {
+        stats.fds++;
+      }
+    }
+    closedir(dir);
+    stats.fds--; // the one of `dir`
+  }
+  return stats;
+}
+
+std::int64_t cpu_us() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  auto us = [](const timeval &tv) { return static_cast<std::int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec; };
+  return us(usage.ru_utime) + us(usage.ru_stime);
+}
+
+std::int64_t elapsed_ns(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+std::int64_t percentile(std::vector<std::int64_t> sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  std::sort(sorted.begin(), sorted.end());
+  auto idx = static_cast<std::size_t>(std::ceil(p * sorted.size())) - 1;
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+double ms(std::int64_t ns) {
+  return ns / 1e6;
+}
+
+/**
+ * Calls every device `rate_hz` times per second for `seconds`, returns how many calls have been made in total
+ */
+std::uint64_t drive(std::vector<Kind> &kinds, int rate_hz, int seconds) {
+  auto period = std::chrono::nanoseconds(1000000000 / rate_hz);
+  auto end = Clock::now() + std::chrono::seconds(seconds);
+  std::uint64_t calls = 0;
+  for (auto tick = Clock::now(); tick < end; tick += period) {
+    std::this_thread::sleep_until(tick);
+    for (auto &kind : kinds) {
+      for (auto &device : kind.devices) {
+        kind.drive(device.get(), calls++);
+      }
+    }
+  }
+  return calls;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int max_devices = 1000;
+  int step = 100;
+  int rate_hz = 60;
+  int seconds = 2;
+  bool mock = false;
+  std::vector<std::string> types = {"mouse", "keyboard", "xbox", "switch", "ps5"};
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--mock") {
+      mock = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      arg = "--help";
+    }
+    if (arg == "--max") {
+      max_devices = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--step") {
+      step = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--rate") {
+      rate_hz = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--seconds") {
+      seconds = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--only") {
+      types.clear();
+      std::string list = argv[++i];
+      for (std::size_t start = 0, end; start <= list.size(); start = end + 1) {
+        end = std::min(list.find(',', start), list.size());
+        types.push_back(list.substr(start, end - start));
+      }
+    } else {
+      std::fprintf(stderr,
+                   "Usage: %s [--max N] [--step N] [--rate HZ] [--seconds S] [--only mouse,keyboard,xbox,switch,ps5] "
+                   "[--mock]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<Kind> kinds;
+  for (const auto &type : types) {
+    auto kind = make_kind(type);
+    if (!kind) {
+      std::fprintf(stderr, "Unknown device type: %s\n", type.c_str());
+      return 1;
+    }
+    kinds.push_back(std::move(*kind));
+  }
+
+  std::optional<bench::MockSink> sink;
+  if (mock) {
+    sink.emplace();
+  }
+
+  auto baseline = process_stats();
+  std::printf("%s devices, up to %d of each type (%zu types), %d Hz each\n\n",
+              mock ? "Mock" : "Real",
+              max_devices,
+              kinds.size(),
+              rate_hz);
+  std::printf("%8s %10s %10s %10s %9s %12s %8s %8s %11s %7s\n",
+              "devices",
+              "create p50",
+              "p99 ms",
+              "max ms",
+              "RSS MB",
+              "KB/device",
+              "threads",
+              "fds",
+              "calls/s",
+              "CPU %");
+
+  for (int count = std::min(step, max_devices); count <= max_devices;) {
+    std::vector<std::int64_t> step_create_ns;
+    for (auto &kind : kinds) {
+      while (kind.devices.size() < static_cast<std::size_t>(count)) {
+        auto start = Clock::now();
+        auto device = kind.create();
+        if (!device) {
+          return 1;
+        }
+        kind.create_ns.push_back(elapsed_ns(start));
+        step_create_ns.push_back(kind.create_ns.back());
+        kind.devices.push_back(std::move(device));
+      }
+    }
+
+    auto cpu_start = cpu_us();
+    auto drive_start = Clock::now();
+    auto calls = drive(kinds, rate_hz, seconds);
+    auto wall_us = elapsed_ns(drive_start) / 1000.0;
+    auto cpu = static_cast<double>(cpu_us() - cpu_start);
+
+    auto stats = process_stats();
+    auto total = count * kinds.size();
+    std::printf("%8zu %10.2f %10.2f %10.2f %9.1f %12.1f %8ld %8ld %11.0f %7.1f\n",
+                total,
+                ms(percentile(step_create_ns, 0.5)),
+                ms(percentile(step_create_ns, 0.99)),
+                ms(percentile(step_create_ns, 1)),
+                stats.rss_kb / 1024.0,
+                static_cast<double>(stats.rss_kb - baseline.rss_kb) / total,
+                stats.threads,
+                stats.fds,
+                calls / (wall_us / 1e6),
+                100.0 * cpu / wall_us);
+
+    if (count == max_devices) {
+      break;
+    }
+    count = std::min(count + step, max_devices);
+  }
+
+  for (auto &kind : kinds) {
+    while (!kind.devices.empty()) {
+      auto start = Clock::now();
+      kind.devices.pop_back();
+      kind.destroy_ns.push_back(elapsed_ns(start));
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // the uhid threads stop asynchronously
+
+  std::printf("\n%-10s %12s %10s %10s %10s %11s %10s %10s\n",
+              "device",
+              "state bytes",
+              "create p50",
+              "p99 ms",
+              "max ms",
+              "destroy p50",
+              "p99 ms",
+              "max ms");
+  for (const auto &kind : kinds) {
+    std::printf("%-10s %12zu %10.2f %10.2f %10.2f %11.2f %10.2f %10.2f\n",
+                kind.name.c_str(),
+                kind.state_size,
+                ms(percentile(kind.create_ns, 0.5)),
+                ms(percentile(kind.create_ns, 0.99)),
+                ms(percentile(kind.create_ns, 1)),
+                ms(percentile(kind.destroy_ns, 0.5)),
+                ms(percentile(kind.destroy_ns, 0.99)),
+                ms(percentile(kind.destroy_ns, 1)));
+  }
+
+  sink.reset(); // the MockBackend keeps track of the devices it has created
+  malloc_trim(0); // otherwise the memory the allocator keeps for later shows up as leaked
+  auto after = process_stats();
+  std::printf("\nAfter destroying everything: RSS %+.1f MB, threads %+ld, fds %+ld (compared to the start)\n",
+              (after.rss_kb - baseline.rss_kb) / 1024.0,
+              after.threads - baseline.threads,
+              after.fds - baseline.fds);
+  return 0;
+}
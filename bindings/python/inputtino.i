@@ -4,9 +4,102 @@
 %{
 #include <inputtino/result.hpp>
 #include <inputtino/input.hpp>
+#include <inputtino/input.h>
+
+/**
+ * Runs `apply` on the buffer of `events` (anything implementing the buffer protocol: bytes, array.array, numpy
+ * arrays, ...) as an array of `Event`, without holding the GIL
+ */
+template <typename Event, typename Fn> static PyObject *py_apply_buffer(PyObject *events, Fn &&apply) {
+  Py_buffer view;
+  if (PyObject_GetBuffer(events, &view, PyBUF_C_CONTIGUOUS) != 0) {
+    return nullptr;
+  }
+  if (view.len % sizeof(Event) != 0) {
+    PyBuffer_Release(&view);
+    PyErr_Format(PyExc_ValueError, "buffer size must be a multiple of %zu bytes", sizeof(Event));
+    return nullptr;
+  }
+  auto data = static_cast<const Event *>(view.buf);
+  auto count = static_cast<size_t>(view.len) / sizeof(Event);
+  Py_BEGIN_ALLOW_THREADS
+  apply(data, count);
+  Py_END_ALLOW_THREADS
+  PyBuffer_Release(&view);
+  Py_RETURN_NONE;
+}
 %}
 
 
 // Parse the original header file
 %include "inputtino/result.hpp"
 %include "inputtino/input.hpp"
+
+/*
+ * Batched calls, they take a C contiguous buffer of packed events (the structs of input.h) and go through the C API
+ * in a single call, without holding the GIL:
+ *  - Mouse.apply_events: InputtinoMouseEvent, numpy.int32 with shape (N, 6):
+ *    [type (MOUSE_MOVE, ...), x, y, screen_width, screen_height, button]
+ *  - Keyboard.apply_events: InputtinoKeyboardEvent, numpy.dtype([('key_code', 'i2'), ('pressed', '?')], align=True)
+ *  - Trackpad/TouchScreen.apply_contacts: InputtinoTouchContact,
+ *    numpy.dtype([('finger_nr', 'i4'), ('released', '?'), ('x', 'f4'), ('y', 'f4'), ('pressure', 'f4'),
+ *                 ('orientation', 'i4')], align=True)
+ *  - *Joypad.apply_states: InputtinoJoypadState, one report for each state,
+ *    numpy.dtype([('buttons', 'i4'), ('left_stick_x', 'i2'), ('left_stick_y', 'i2'), ('right_stick_x', 'i2'),
+ *                 ('right_stick_y', 'i2'), ('left_trigger', 'i2'), ('right_trigger', 'i2')], align=True)
+ */
+
+%constant int MOUSE_MOVE = INPUTTINO_MOUSE_MOVE;
+%constant int MOUSE_MOVE_ABSOLUTE = INPUTTINO_MOUSE_MOVE_ABSOLUTE;
+%constant int MOUSE_PRESS = INPUTTINO_MOUSE_PRESS;
+%constant int MOUSE_RELEASE = INPUTTINO_MOUSE_RELEASE;
+%constant int MOUSE_SCROLL_VERTICAL = INPUTTINO_MOUSE_SCROLL_VERTICAL;
+%constant int MOUSE_SCROLL_HORIZONTAL = INPUTTINO_MOUSE_SCROLL_HORIZONTAL;
+
+%extend inputtino::Mouse {
+  PyObject *apply_events(PyObject *events) {
+    return py_apply_buffer<InputtinoMouseEvent>(events, [$self](const InputtinoMouseEvent *data, size_t count) {
+      inputtino_mouse_apply_events(reinterpret_cast<InputtinoMouse *>($self), data, count);
+    });
+  }
+}
+
+%extend inputtino::Keyboard {
+  PyObject *apply_events(PyObject *events) {
+    return py_apply_buffer<InputtinoKeyboardEvent>(events, [$self](const InputtinoKeyboardEvent *data, size_t count) {
+      inputtino_keyboard_apply_events(reinterpret_cast<InputtinoKeyboard *>($self), data, count);
+    });
+  }
+}
+
+%extend inputtino::Trackpad {
+  PyObject *apply_contacts(PyObject *contacts) {
+    return py_apply_buffer<InputtinoTouchContact>(contacts, [$self](const InputtinoTouchContact *data, size_t count) {
+      inputtino_trackpad_apply_contacts(reinterpret_cast<InputtinoTrackpad *>($self), data, count);
+    });
+  }
+}
+
+%extend inputtino::TouchScreen {
+  PyObject *apply_contacts(PyObject *contacts) {
+    return py_apply_buffer<InputtinoTouchContact>(contacts, [$self](const InputtinoTouchContact *data, size_t count) {
+      inputtino_touchscreen_apply_contacts(reinterpret_cast<InputtinoTouchscreen *>($self), data, count);
+    });
+  }
+}
+
+%define JOYPAD_APPLY_STATES(CLASS, C_TYPE, SET_STATE)
+%extend inputtino::CLASS {
+  PyObject *apply_states(PyObject *states) {
+    return py_apply_buffer<InputtinoJoypadState>(states, [$self](const InputtinoJoypadState *data, size_t count) {
+      for (size_t index = 0; index < count; index++) {
+        SET_STATE(reinterpret_cast<C_TYPE *>($self), &data[index]);
+      }
+    });
+  }
+}
+%enddef
+
+JOYPAD_APPLY_STATES(XboxOneJoypad, InputtinoXOneJoypad, inputtino_joypad_xone_set_state)
+JOYPAD_APPLY_STATES(SwitchJoypad, InputtinoSwitchJoypad, inputtino_joypad_switch_set_state)
+JOYPAD_APPLY_STATES(PS5Joypad, InputtinoPS5Joypad, inputtino_joypad_ps5_set_state)
@@ -4,6 +4,42 @@
 
 include!(concat!(env!("OUT_DIR"), "/bindings.rs"));
 
+/*
+ * Batched calls: a whole slice of events crosses the FFI boundary at once, see the `*_apply_*` functions in input.h
+ */
+
+pub unsafe fn mouse_apply_events(mouse: *mut InputtinoMouse, events: &[InputtinoMouseEvent]) {
+    inputtino_mouse_apply_events(mouse, events.as_ptr(), events.len());
+}
+
+pub unsafe fn keyboard_apply_events(keyboard: *mut InputtinoKeyboard, events: &[InputtinoKeyboardEvent]) {
+    inputtino_keyboard_apply_events(keyboard, events.as_ptr(), events.len());
+}
+
+pub unsafe fn trackpad_apply_contacts(trackpad: *mut InputtinoTrackpad, contacts: &[InputtinoTouchContact]) {
+    inputtino_trackpad_apply_contacts(trackpad, contacts.as_ptr(), contacts.len());
+}
+
+pub unsafe fn touchscreen_apply_contacts(touchscreen: *mut InputtinoTouchscreen, contacts: &[InputtinoTouchContact]) {
+    inputtino_touchscreen_apply_contacts(touchscreen, contacts.as_ptr(), contacts.len());
+}
+
+/// Reads the nodes of a device through one of the `inputtino_*_copy_nodes()` functions, without anything to free
+pub unsafe fn copy_nodes<Device>(
+    device: *mut Device,
+    copy_fn: unsafe extern "C" fn(*mut Device, *mut ::core::ffi::c_char, usize, *mut *const ::core::ffi::c_char, ::core::ffi::c_int) -> ::core::ffi::c_int,
+) -> Vec<String> {
+    let mut buffer = [0 as ::core::ffi::c_char; 512];
+    let mut nodes = [std::ptr::null::<::core::ffi::c_char>(); 8];
+    let count = copy_fn(device, buffer.as_mut_ptr(), buffer.len(), nodes.as_mut_ptr(), nodes.len() as ::core::ffi::c_int);
+    nodes
+        .iter()
+        .take(count.max(0) as usize)
+        .filter(|node| !node.is_null())
+        .map(|node| ::core::ffi::CStr::from_ptr(*node).to_string_lossy().into_owned())
+        .collect()
+}
+
 #[cfg(test)]
 mod tests{
 
@@ -43,6 +79,30 @@ mod tests{
             assert!(CString::from_raw(*nodes.offset(0)).to_str().unwrap().starts_with("/dev/input/event"));
             assert!(CString::from_raw(*nodes.offset(1)).to_str().unwrap().starts_with("/dev/input/event"));
 
+            let copied_nodes = copy_nodes(mouse, inputtino_mouse_copy_nodes);
+            assert!(copied_nodes.len() == 2);
+            assert!(copied_nodes[0].starts_with("/dev/input/event"));
+
+            let events = [
+                InputtinoMouseEvent {
+                    type_: INPUTTINO_MOUSE_EVENT_TYPE::INPUTTINO_MOUSE_MOVE,
+                    x: 10,
+                    y: -10,
+                    screen_width: 0,
+                    screen_height: 0,
+                    button: INPUTTINO_MOUSE_BUTTON::LEFT,
+                },
+                InputtinoMouseEvent {
+                    type_: INPUTTINO_MOUSE_EVENT_TYPE::INPUTTINO_MOUSE_PRESS,
+                    x: 0,
+                    y: 0,
+                    screen_width: 0,
+                    screen_height: 0,
+                    button: INPUTTINO_MOUSE_BUTTON::LEFT,
+                },
+            ];
+            mouse_apply_events(mouse, &events);
+
             inputtino_mouse_destroy(mouse);
         }
     }
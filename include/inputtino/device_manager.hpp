@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <inputtino/input.hpp>
+#include <inputtino/result.hpp>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+namespace inputtino {
+
+/**
+ * Owns the devices of a number of clients (sessions, connections, ...) and hands out handles to them.
+ *
+ * All the devices already share the same EventLoop and Scheduler threads, whichever way they are created; on top of
+ * that the manager:
+ *  - resolves handles in O(1): the low 32 bits are the index of a slot, the high bits are bumped each time the slot
+ *    is reused so that the handle of a removed device is never resolved to a newer one
+ *  - creates and destroys devices in bulk on a few threads: creating or destroying a device blocks in the kernel
+ *    (UI_DEV_CREATE/UI_DEV_DESTROY, UHID_DESTROY) so doing it for all the devices of a client in sequence is slow
+ *  - tears down all the devices of a client at once, see remove_client()
+ */
+class DeviceManager {
+public:
+  using Handle = std::uint64_t;
+  using ClientId = std::string;
+  using AnyDevice = std::variant<std::shared_ptr<Mouse>,
+                                 std::shared_ptr<Keyboard>,
+                                 std::shared_ptr<Trackpad>,
+                                 std::shared_ptr<TouchScreen>,
+                                 std::shared_ptr<PenTablet>,
+                                 std::shared_ptr<XboxOneJoypad>,
+                                 std::shared_ptr<SwitchJoypad>,
+                                 std::shared_ptr<PS5Joypad>>;
+
+  DeviceManager() = default;
+  DeviceManager(const DeviceManager &) = delete;
+  DeviceManager &operator=(const DeviceManager &) = delete;
+
+  /**
+   * Destroys all the remaining devices (in parallel)
+   */
+  ~DeviceManager();
+
+  /**
+   * Creates a device for `client`; `args` are passed to `Device::create()` (none: the default definition)
+   */
+  template <typename Device, typename... Args> Result<Handle> create(const ClientId &client, const Args &...args) {
+    auto device = Device::create(args...);
+    if (!device) {
+      return Error(device.getErrorMessage());
+    }
+    return add(client, AnyDevice{std::make_shared<Device>(std::move(*device))});
+  }
+
+  /**
+   * Creates `count` devices for `client` in parallel, the results are in the same order as the devices are created;
+   * `args` are passed to each `Device::create()`
+   */
+  template <typename Device, typename... Args>
+  std::vector<Result<Handle>> create_many(const ClientId &client, std::size_t count, const Args &...args) {
+    std::vector<std::optional<Result<Handle>>> results(count);
+    parallel_for(count, [&](std::size_t index) { results[index] = create<Device>(client, args...); });
+
+    std::vector<Result<Handle>> handles;
+    handles.reserve(count);
+    for (auto &result : results) {
+      handles.push_back(std::move(*result));
+    }
+    return handles;
+  }
+
+  /**
+   * Registers a device that has been created elsewhere
+   */
+  Result<Handle> add(const ClientId &client, AnyDevice device);
+
+  /**
+   * Returns the device, or nullptr when the handle is unknown (never created, removed) or of a different type
+   */
+  template <typename Device> std::shared_ptr<Device> get(Handle handle) const {
+    auto device = get(handle);
+    if (auto ptr = std::get_if<std::shared_ptr<Device>>(&device)) {
+      return *ptr;
+    }
+    return nullptr;
+  }
+
+  /**
+   * Returns the device as the base class, or nullptr when the handle is unknown
+   */
+  std::shared_ptr<VirtualDevice> get_device(Handle handle) const;
+
+  /**
+   * Returns the device as stored, a variant holding a nullptr (the Mouse alternative) when the handle is unknown
+   */
+  AnyDevice get(Handle handle) const;
+
+  /**
+   * Destroys the device (unless someone else still holds a reference from get()), returns false if the handle was
+   * unknown
+   */
+  bool remove(Handle handle);
+
+  /**
+   * Destroys all the devices of `client` in parallel, returns how many there were; call this on disconnect
+   */
+  std::size_t remove_client(const ClientId &client);
+
+  std::vector<Handle> handles(const ClientId &client) const;
+
+  /**
+   * How many devices are currently managed
+   */
+  std::size_t size() const;
+
+private:
+  /**
+   * Runs `task(0) ... task(count - 1)` spread over up to std::thread::hardware_concurrency() threads
+   */
+  static void parallel_for(std::size_t count, const std::function<void(std::size_t)> &task);
+
+  static void destroy_in_parallel(std::vector<AnyDevice> devices);
+
+  struct Slot {
+    std::uint32_t generation = 0;
+    bool used = false;
+    AnyDevice device;
+    ClientId client;
+  };
+
+  /* Returns the device that was in the slot, must be called with the lock held */
+  AnyDevice release(std::size_t index);
+
+  mutable std::shared_mutex m;
+  std::vector<Slot> slots;
+  std::vector<std::size_t> free_slots;
+  std::unordered_map<ClientId, std::unordered_set<Handle>> clients;
+};
+
+} // namespace inputtino
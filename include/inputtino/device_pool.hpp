@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <inputtino/input.hpp>
+#include <inputtino/result.hpp>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace inputtino {
+
+/**
+ * Creates the device on a separate thread, `Device` is any of the devices in input.hpp (Mouse, Keyboard, PS5Joypad...)
+ *
+ * Example: `auto joypad_future = create_async<XboxOneJoypad>(definition);` then later `joypad_future.get()`
+ */
+template <typename Device> std::future<Result<Device>> create_async(const DeviceDefinition &device) {
+  return std::async(std::launch::async, [device]() { return Device::create(device); });
+}
+
+/**
+ * Same as above, `on_created` will be called (from the creation thread) with the new device or the error
+ */
+template <typename Device, typename Callback> void create_async(const DeviceDefinition &device, Callback on_created) {
+  std::thread([device, on_created = std::move(on_created)]() mutable { on_created(Device::create(device)); }).detach();
+}
+
+/**
+ * Keeps `warm_size` devices of the same type already created (or being created in the background) so that they can
+ * be handed out immediately; each checkout starts the creation of a replacement.
+ *
+ * The kernel doesn't allow renaming uinput/uhid devices once they've been created, so all the devices will use the
+ * `DeviceDefinition` passed to the constructor.
+ */
+template <typename Device> class DevicePool {
+public:
+  DevicePool(const DeviceDefinition &device, std::size_t warm_size) : device(device) {
+    std::lock_guard lock(m);
+    for (std::size_t i = 0; i < warm_size; i++) {
+      warm.push_back(create_async<Device>(device));
+    }
+  }
+
+  DevicePool(const DevicePool &) = delete;
+  DevicePool &operator=(const DevicePool &) = delete;
+
+  /**
+   * Returns a warm device, it'll only block if the oldest device in the pool is still being created.
+   * When the pool is empty (`warm_size == 0`) or the warm device failed to be created, a new device is created
+   * synchronously instead.
+   */
+  Result<Device> checkout() {
+    std::future<Result<Device>> next;
+    {
+      std::lock_guard lock(m);
+      if (!warm.empty()) {
+        next = std::move(warm.front());
+        warm.pop_front();
+        warm.push_back(create_async<Device>(device));
+      }
+    }
+
+    if (next.valid()) {
+      if (auto result = next.get()) {
+        reset(*result);
+        return result;
+      }
+    }
+    return Device::create(device);
+  }
+
+  /**
+   * How many devices are kept in the pool, including the ones still being created
+   */
+  std::size_t size() {
+    std::lock_guard lock(m);
+    return warm.size();
+  }
+
+private:
+  /**
+   * Warm devices have never been used, but a pad that hasn't sent a report yet is reported as "neutral" in
+   * different ways by different drivers; let's make sure applications see it at rest from the start.
+   */
+  static void reset(Device &checked_out) {
+    if constexpr (std::is_base_of_v<Joypad, Device>) {
+      checked_out.set_state({});
+    }
+  }
+
+  DeviceDefinition device;
+
+  std::mutex m;
+  std::deque<std::future<Result<Device>>> warm;
+};
+
+} // namespace inputtino
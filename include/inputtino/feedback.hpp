@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <inputtino/result.hpp>
+#include <memory>
+#include <optional>
+
+namespace inputtino {
+
+/**
+ * Decouples the rumble and LED callbacks of a joypad from whoever consumes them.
+ *
+ * The callbacks run on the thread that serves the device (the shared EventLoop, or the uhid thread of the PS5 pad)
+ * while the kernel waits for the force feedback request to complete: doing network I/O in there stalls the
+ * application that is playing the effect. The callbacks returned by rumble_callback() and led_callback() only store
+ * the new value, without locking or allocating; a consumer thread picks up the latest values with take(), either
+ * polling or waiting on notify_fd().
+ *
+ * Values are latest-value-wins: a consumer that is slower than the updates only ever sees the most recent value.
+ * There should be a single consumer for each mailbox, since take() clears what it returns.
+ *
+ * Example: `joypad.set_on_rumble(mailbox->rumble_callback());`
+ */
+class FeedbackMailbox : public std::enable_shared_from_this<FeedbackMailbox> {
+public:
+  struct Rumble {
+    int low_freq;
+    int high_freq;
+  };
+
+  struct Led {
+    int r;
+    int g;
+    int b;
+  };
+
+  struct Feedback {
+    /* Only set if it has changed since the previous take() */
+    std::optional<Rumble> rumble;
+    std::optional<Led> led;
+
+    explicit operator bool() const {
+      return rumble || led;
+    }
+  };
+
+  static Result<std::shared_ptr<FeedbackMailbox>> create();
+
+  FeedbackMailbox(const FeedbackMailbox &) = delete;
+  FeedbackMailbox &operator=(const FeedbackMailbox &) = delete;
+  ~FeedbackMailbox();
+
+  void post_rumble(int low_freq, int high_freq);
+
+  /* Each channel is in the range 0-255 */
+  void post_led(int r, int g, int b);
+
+  /**
+   * To be passed to set_on_rumble(), they keep the mailbox alive
+   */
+  std::function<void(int low_freq, int high_freq)> rumble_callback();
+  std::function<void(int r, int g, int b)> led_callback();
+
+  /**
+   * Returns what has been posted since the last call, without blocking.
+   * A value that is posted while take() runs might be returned again by the next call.
+   */
+  Feedback take();
+
+  /**
+   * Readable (eventfd) while something has been posted and not taken yet, can be added to an epoll set
+   */
+  int notify_fd() const {
+    return event_fd;
+  }
+
+  /**
+   * Blocks until something has been posted or `timeout` has expired, returns take()
+   */
+  Feedback wait(std::chrono::milliseconds timeout);
+
+private:
+  explicit FeedbackMailbox(int event_fd) : event_fd(event_fd) {}
+
+  enum PENDING : std::uint32_t {
+    RUMBLE = 0x1,
+    LED = 0x2
+  };
+
+  void post(PENDING what);
+
+  int event_fd;
+  std::atomic<std::uint32_t> pending = 0;
+  std::atomic<std::uint64_t> rumble = 0; // low_freq in the high 32 bits, high_freq in the low 32 bits
+  std::atomic<std::uint32_t> led = 0;    // 0x00RRGGBB
+};
+
+} // namespace inputtino
@@ -10,6 +10,7 @@
 #  include <inputtino/export_static.h>
 #endif
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct InputtinoDeviceDefinition {
   const char *name;
@@ -28,6 +29,29 @@ typedef struct InputtinoErrorHandler {
   void *user_data;
 } InputtinoErrorHandler;
 
+/**
+ * See inputtino::DeviceMetrics, all the counters are 0 unless the library has been built with INPUTTINO_METRICS
+ */
+typedef struct InputtinoDeviceMetrics {
+  unsigned long long events_written;
+  unsigned long long syscalls;
+  unsigned long long write_errors;
+  unsigned long long frames_coalesced;
+  unsigned long long frames_dropped;
+  unsigned long long ff_effects_handled;
+  unsigned long long rumble_callbacks;
+  unsigned long long rumble_callback_ns_total;
+  unsigned long long rumble_callback_ns_max;
+} InputtinoDeviceMetrics;
+
+/*
+ * All the inputtino_*_copy_nodes() functions are the same as inputtino_*_get_nodes() without any allocation for the
+ * caller to free: the paths are copied one after the other (each one NUL terminated) into `buffer` and `nodes[i]`
+ * points to the i-th one.
+ * They return how many nodes the device has; the nodes that don't fit (in `max_nodes` or in `buffer_size`) are not
+ * copied and their `nodes[i]` is NULL. Paths are short (ex: /dev/input/event12), 256 bytes are plenty.
+ */
+
 /*
  * MOUSE
  */
@@ -38,6 +62,11 @@ LIBINPUTTINO_EXPORT InputtinoMouse *inputtino_mouse_create(const InputtinoDevice
 
 LIBINPUTTINO_EXPORT char **inputtino_mouse_get_nodes(InputtinoMouse *mouse, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_mouse_copy_nodes(InputtinoMouse *mouse, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_mouse_get_metrics(InputtinoMouse *mouse, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_mouse_move(InputtinoMouse *mouse, int delta_x, int delta_y);
 
 LIBINPUTTINO_EXPORT void inputtino_mouse_move_absolute(InputtinoMouse *mouse, int x, int y, int screen_width, int screen_height);
@@ -58,12 +87,48 @@ LIBINPUTTINO_EXPORT void inputtino_mouse_scroll_vertical(InputtinoMouse *mouse,
 
 LIBINPUTTINO_EXPORT void inputtino_mouse_scroll_horizontal(InputtinoMouse *mouse, int high_res_distance);
 
+enum INPUTTINO_MOUSE_EVENT_TYPE {
+  INPUTTINO_MOUSE_MOVE,              /* x, y: the deltas */
+  INPUTTINO_MOUSE_MOVE_ABSOLUTE,     /* x, y, screen_width, screen_height */
+  INPUTTINO_MOUSE_PRESS,             /* button */
+  INPUTTINO_MOUSE_RELEASE,           /* button */
+  INPUTTINO_MOUSE_SCROLL_VERTICAL,   /* x: the high_res_distance */
+  INPUTTINO_MOUSE_SCROLL_HORIZONTAL, /* x: the high_res_distance */
+};
+
+typedef struct InputtinoMouseEvent {
+  enum INPUTTINO_MOUSE_EVENT_TYPE type;
+  int x;
+  int y;
+  int screen_width;
+  int screen_height;
+  enum INPUTTINO_MOUSE_BUTTON button;
+} InputtinoMouseEvent;
+
+/**
+ * Same as calling the functions above for each one of `events`, in order, with a single call
+ */
+LIBINPUTTINO_EXPORT void inputtino_mouse_apply_events(InputtinoMouse *mouse, const InputtinoMouseEvent *events, size_t count);
+
 LIBINPUTTINO_EXPORT void inputtino_mouse_destroy(InputtinoMouse *mouse);
 
 /*
  * TRACKPAD
  */
 
+/**
+ * A finger update for inputtino_trackpad_apply_contacts() and inputtino_touchscreen_apply_contacts(); when `released`
+ * only `finger_nr` is used
+ */
+typedef struct InputtinoTouchContact {
+  int finger_nr;
+  bool released;
+  float x;
+  float y;
+  float pressure;
+  int orientation;
+} InputtinoTouchContact;
+
 struct InputtinoTrackpad;
 typedef struct InputtinoTrackpad InputtinoTrackpad;
 
@@ -71,6 +136,11 @@ LIBINPUTTINO_EXPORT InputtinoTrackpad *inputtino_trackpad_create(const Inputtino
 
 LIBINPUTTINO_EXPORT char **inputtino_trackpad_get_nodes(InputtinoTrackpad *trackpad, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_trackpad_copy_nodes(InputtinoTrackpad *trackpad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_trackpad_get_metrics(InputtinoTrackpad *trackpad, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_trackpad_place_finger(
     InputtinoTrackpad *trackpad, int finger_nr, float x, float y, float pressure, int orientation);
 
@@ -78,6 +148,12 @@ LIBINPUTTINO_EXPORT void inputtino_trackpad_release_finger(InputtinoTrackpad *tr
 
 LIBINPUTTINO_EXPORT void inputtino_trackpad_set_left_btn(InputtinoTrackpad *trackpad, bool pressed);
 
+/**
+ * Places or releases all the fingers under a single SYN_REPORT (one every 16 contacts), see inputtino::TouchFrame
+ */
+LIBINPUTTINO_EXPORT void
+inputtino_trackpad_apply_contacts(InputtinoTrackpad *trackpad, const InputtinoTouchContact *contacts, size_t count);
+
 LIBINPUTTINO_EXPORT void inputtino_trackpad_destroy(InputtinoTrackpad *trackpad);
 
 /*
@@ -92,11 +168,23 @@ LIBINPUTTINO_EXPORT InputtinoTouchscreen *inputtino_touchscreen_create(const Inp
 
 LIBINPUTTINO_EXPORT char **inputtino_touchscreen_get_nodes(InputtinoTouchscreen *touchscreen, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_touchscreen_copy_nodes(InputtinoTouchscreen *touchscreen, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_touchscreen_get_metrics(InputtinoTouchscreen *touchscreen, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_touchscreen_place_finger(
     InputtinoTouchscreen *touchscreen, int finger_nr, float x, float y, float pressure, int orientation);
 
 LIBINPUTTINO_EXPORT void inputtino_touchscreen_release_finger(InputtinoTouchscreen *touchscreen, int finger_nr);
 
+/**
+ * Same as inputtino_trackpad_apply_contacts()
+ */
+LIBINPUTTINO_EXPORT void inputtino_touchscreen_apply_contacts(InputtinoTouchscreen *touchscreen,
+                                                              const InputtinoTouchContact *contacts,
+                                                              size_t count);
+
 LIBINPUTTINO_EXPORT void inputtino_touchscreen_destroy(InputtinoTouchscreen *touchscreen);
 
 /*
@@ -111,6 +199,11 @@ LIBINPUTTINO_EXPORT InputtinoPenTablet *inputtino_pen_tablet_create(const Inputt
 
 LIBINPUTTINO_EXPORT char **inputtino_pen_tablet_get_nodes(InputtinoPenTablet *pen_tablet, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_pen_tablet_copy_nodes(InputtinoPenTablet *pen_tablet, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_pen_tablet_get_metrics(InputtinoPenTablet *pen_tablet, InputtinoDeviceMetrics *metrics);
+
 enum INPUTTINO_PEN_TOOL_TYPE {
   PEN,
   ERASER,
@@ -152,10 +245,26 @@ LIBINPUTTINO_EXPORT InputtinoKeyboard *inputtino_keyboard_create(const Inputtino
 
 LIBINPUTTINO_EXPORT char **inputtino_keyboard_get_nodes(InputtinoKeyboard *keyboard, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_keyboard_copy_nodes(InputtinoKeyboard *keyboard, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_keyboard_get_metrics(InputtinoKeyboard *keyboard, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_keyboard_press(InputtinoKeyboard *keyboard, short key_code);
 
 LIBINPUTTINO_EXPORT void inputtino_keyboard_release(InputtinoKeyboard *keyboard, short key_code);
 
+typedef struct InputtinoKeyboardEvent {
+  short key_code;
+  bool pressed;
+} InputtinoKeyboardEvent;
+
+/**
+ * Same as calling inputtino_keyboard_press()/inputtino_keyboard_release() for each one of `events`, in order
+ */
+LIBINPUTTINO_EXPORT void
+inputtino_keyboard_apply_events(InputtinoKeyboard *keyboard, const InputtinoKeyboardEvent *events, size_t count);
+
 LIBINPUTTINO_EXPORT void inputtino_keyboard_destroy(InputtinoKeyboard *keyboard);
 
 /*
@@ -198,6 +307,19 @@ enum INPUTTINO_JOYPAD_STICK_POSITION {
 
 typedef void (*InputtinoJoypadRumbleFn)(int low_freq, int high_freq, void *user_data);
 
+/**
+ * The full state of a joypad, see inputtino::GamepadState
+ */
+typedef struct InputtinoJoypadState {
+  int buttons; /* INPUTTINO_JOYPAD_BTN flags */
+  short left_stick_x;
+  short left_stick_y;
+  short right_stick_x;
+  short right_stick_y;
+  short left_trigger;
+  short right_trigger;
+} InputtinoJoypadState;
+
 /*
  * XOne Joypad
  */
@@ -210,8 +332,18 @@ LIBINPUTTINO_EXPORT InputtinoXOneJoypad *inputtino_joypad_xone_create(const Inpu
 
 LIBINPUTTINO_EXPORT char **inputtino_joypad_xone_get_nodes(InputtinoXOneJoypad *joypad, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_joypad_xone_copy_nodes(InputtinoXOneJoypad *joypad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_joypad_xone_get_metrics(InputtinoXOneJoypad *joypad, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_joypad_xone_set_pressed_buttons(InputtinoXOneJoypad *joypad, int newly_pressed);
 
+/**
+ * Buttons, sticks and triggers at once, in a single report
+ */
+LIBINPUTTINO_EXPORT void inputtino_joypad_xone_set_state(InputtinoXOneJoypad *joypad, const InputtinoJoypadState *state);
+
 LIBINPUTTINO_EXPORT void inputtino_joypad_xone_set_triggers(InputtinoXOneJoypad *joypad, short left_trigger, short right_trigger);
 
 LIBINPUTTINO_EXPORT void inputtino_joypad_xone_set_stick(InputtinoXOneJoypad *joypad,
@@ -236,8 +368,18 @@ LIBINPUTTINO_EXPORT InputtinoSwitchJoypad *inputtino_joypad_switch_create(const
 
 LIBINPUTTINO_EXPORT char **inputtino_joypad_switch_get_nodes(InputtinoSwitchJoypad *joypad, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_joypad_switch_copy_nodes(InputtinoSwitchJoypad *joypad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_joypad_switch_get_metrics(InputtinoSwitchJoypad *joypad, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_joypad_switch_set_pressed_buttons(InputtinoSwitchJoypad *joypad, int newly_pressed);
 
+/**
+ * Buttons, sticks and triggers at once, in a single report
+ */
+LIBINPUTTINO_EXPORT void inputtino_joypad_switch_set_state(InputtinoSwitchJoypad *joypad, const InputtinoJoypadState *state);
+
 LIBINPUTTINO_EXPORT void
 inputtino_joypad_switch_set_triggers(InputtinoSwitchJoypad *joypad, short left_trigger, short right_trigger);
 
@@ -264,8 +406,18 @@ LIBINPUTTINO_EXPORT InputtinoPS5Joypad *inputtino_joypad_ps5_create(const Inputt
 
 LIBINPUTTINO_EXPORT char **inputtino_joypad_ps5_get_nodes(InputtinoPS5Joypad *joypad, int *num_nodes);
 
+LIBINPUTTINO_EXPORT int
+inputtino_joypad_ps5_copy_nodes(InputtinoPS5Joypad *joypad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes);
+
+LIBINPUTTINO_EXPORT void inputtino_joypad_ps5_get_metrics(InputtinoPS5Joypad *joypad, InputtinoDeviceMetrics *metrics);
+
 LIBINPUTTINO_EXPORT void inputtino_joypad_ps5_set_pressed_buttons(InputtinoPS5Joypad *joypad, int newly_pressed);
 
+/**
+ * Buttons, sticks and triggers at once, in a single report
+ */
+LIBINPUTTINO_EXPORT void inputtino_joypad_ps5_set_state(InputtinoPS5Joypad *joypad, const InputtinoJoypadState *state);
+
 LIBINPUTTINO_EXPORT void inputtino_joypad_ps5_set_triggers(InputtinoPS5Joypad *joypad, short left_trigger, short right_trigger);
 
 LIBINPUTTINO_EXPORT void inputtino_joypad_ps5_set_stick(InputtinoPS5Joypad *joypad,
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <inputtino/metrics.hpp>
 #include <inputtino/result.hpp>
 #include <map>
 #include <memory>
@@ -14,6 +17,14 @@ namespace inputtino {
 class VirtualDevice {
 public:
   virtual std::vector<std::string> get_nodes() const = 0;
+
+  /**
+   * Lock free snapshot of the counters of this device, all zeroes unless built with INPUTTINO_METRICS
+   */
+  virtual DeviceMetrics get_metrics() const {
+    return {};
+  }
+
   virtual ~VirtualDevice() = default;
 };
 
@@ -25,6 +36,52 @@ struct DeviceDefinition {
 
   std::string device_phys = "";
   std::string device_uniq = "";
+
+  /**
+   * By default axes that didn't change since the last update are not written again (and if nothing changed at all,
+   * nothing is sent to the device); set this in order to always write every axis on every update.
+   */
+  bool force_writes = false;
+};
+
+/**
+ * A pointer acceleration curve for Mouse::set_acceleration(): relative motion is multiplied by `gain(speed)`, where
+ * `speed` is in units per millisecond.
+ * The curve is sampled once into a lookup table so that applying it only costs an index and a multiplication;
+ * speeds above `max_speed` get the gain of `max_speed`, negative or NaN speeds get the gain of 0.
+ */
+class PointerAcceleration {
+public:
+  static constexpr std::size_t TABLE_SIZE = 256;
+  static constexpr double DEFAULT_MAX_SPEED = 8.0;
+
+  /**
+   * A `max_speed` that isn't a positive, finite number is replaced by DEFAULT_MAX_SPEED
+   */
+  explicit PointerAcceleration(const std::function<double(double speed)> &gain,
+                               double max_speed = DEFAULT_MAX_SPEED);
+
+  /**
+   * Plain scaling, the same gain at any speed
+   */
+  static PointerAcceleration flat(double factor);
+
+  /**
+   * gain = factor + acceleration * speed, up to max_gain
+   */
+  static PointerAcceleration linear(double factor, double acceleration, double max_gain);
+
+  double gain(double speed) const {
+    if (!(speed > 0)) { // also NaN, which would make the conversion below undefined
+      return table[0];
+    }
+    auto index = speed * samples_per_unit; // compared as a double: a huge or infinite speed doesn't fit in an index
+    return table[index < TABLE_SIZE - 1 ? static_cast<std::size_t>(index) : TABLE_SIZE - 1];
+  }
+
+private:
+  std::array<float, TABLE_SIZE> table = {};
+  double samples_per_unit;
 };
 
 /**
@@ -41,11 +98,34 @@ public:
   }
   ~Mouse() override;
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   void move(int delta_x, int delta_y);
 
+  /**
+   * Sub-pixel motion: only whole units can be written, the fractions are carried over to the next call so that many
+   * small (or scaled) moves add up to the same distance as a single big one
+   */
+  void move(double delta_x, double delta_y);
+
+  /**
+   * Applies `profile` to all the relative motion from now on, nullopt (default) disables it.
+   * Accelerated motion is fractional, it's carried over the same way as in move(double, double)
+   */
+  void set_acceleration(const std::optional<PointerAcceleration> &profile);
+
   void move_abs(int x, int y, int screen_width, int screen_height);
 
+  /**
+   * Opt-in: instead of writing a new frame on every call to move(), move_abs() and the scroll methods, motion is
+   * coalesced; relative deltas and scroll distances are added up and only the latest absolute position is kept.
+   * Pending motion is written out at most `max_rate_hz` times per second, pressing or releasing a button will write
+   * out any pending motion first so that the order of the events is preserved.
+   *
+   * @param max_rate_hz How many motion frames per second should be written at most, 0 (default) disables coalescing
+   */
+  void set_motion_coalescing(int max_rate_hz);
+
   enum MOUSE_BUTTON {
     LEFT,
     MIDDLE,
@@ -70,6 +150,9 @@ public:
    * Windows Vista Mouse Wheel design document
    * </a>.
    *
+   * The fractions are accumulated across calls: the low resolution wheel moves by one notch each time the total
+   * reaches a multiple of 120, the high resolution one moves by `high_res_distance` right away.
+   *
    * Positive numbers will scroll down, negative numbers will scroll up
    *
    * @param high_res_distance The distance in high resolution
@@ -88,6 +171,9 @@ public:
    * Windows Vista Mouse Wheel design document
    * </a>.
    *
+   * The fractions are accumulated across calls: the low resolution wheel moves by one notch each time the total
+   * reaches a multiple of 120, the high resolution one moves by `high_res_distance` right away.
+   *
    * Positive numbers will scroll right, negative numbers will scroll left
    *
    * @param high_res_distance The distance in high resolution
@@ -102,6 +188,74 @@ private:
   Mouse(); // use Mouse::create() instead
 };
 
+/**
+ * A set of finger updates (place, move or release) that will be sent to a Trackpad or a TouchScreen as a single
+ * frame: all the slots are updated under one SYN_REPORT so readers never see intermediate states
+ * (ex: one finger of a pinch gesture moved and the other not yet).
+ *
+ * Fixed capacity, no allocations; the same frame can be reused after calling clear()
+ */
+class TouchFrame {
+public:
+  static constexpr int MAX_CONTACTS = 16;
+
+  struct Contact {
+    int finger_nr;
+    bool released;
+    float x;
+    float y;
+    float pressure;
+    int orientation;
+  };
+
+  /**
+   * Same parameters as Trackpad::place_finger(); returns false when the frame is full
+   */
+  bool place_finger(int finger_nr, float x, float y, float pressure, int orientation) {
+    return add({.finger_nr = finger_nr,
+                .released = false,
+                .x = x,
+                .y = y,
+                .pressure = pressure,
+                .orientation = orientation});
+  }
+
+  /**
+   * Returns false when the frame is full
+   */
+  bool release_finger(int finger_nr) {
+    return add({.finger_nr = finger_nr, .released = true, .x = 0, .y = 0, .pressure = 0, .orientation = 0});
+  }
+
+  void clear() {
+    count = 0;
+  }
+
+  const Contact *begin() const {
+    return contacts.data();
+  }
+
+  const Contact *end() const {
+    return contacts.data() + count;
+  }
+
+  int size() const {
+    return count;
+  }
+
+private:
+  bool add(const Contact &contact) {
+    if (count == MAX_CONTACTS) {
+      return false;
+    }
+    contacts[count++] = contact;
+    return true;
+  }
+
+  std::array<Contact, MAX_CONTACTS> contacts = {};
+  int count = 0;
+};
+
 /**
  * A virtual trackpad
  *
@@ -118,6 +272,7 @@ public:
   }
   ~Trackpad() override;
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   /**
    * We expect (x,y) to be in the range [0.0, 1.0]; x and y values are normalised device coordinates
@@ -131,6 +286,11 @@ public:
 
   void release_finger(int finger_nr);
 
+  /**
+   * Sends all the finger updates in `frame` at once, BTN_TOOL_* changes are computed once for the whole frame
+   */
+  void apply(const TouchFrame &frame);
+
   void set_left_btn(bool pressed);
 
 protected:
@@ -155,6 +315,7 @@ public:
   }
   ~TouchScreen() override;
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   /**
    * We expect (x,y) to be in the range [0.0, 1.0]; x and y values are normalised device coordinates
@@ -167,6 +328,11 @@ public:
 
   void release_finger(int finger_nr);
 
+  /**
+   * Sends all the finger updates in `frame` at once, under a single SYN_REPORT
+   */
+  void apply(const TouchFrame &frame);
+
 protected:
   typedef struct TouchScreenState TouchScreenState;
   std::shared_ptr<TouchScreenState> _state;
@@ -191,6 +357,7 @@ public:
   }
   ~PenTablet() override;
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   enum TOOL_TYPE {
     PEN,
@@ -249,6 +416,7 @@ public:
   }
   ~Keyboard() override;
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   void press(short key_code);
 
@@ -262,6 +430,19 @@ private:
   Keyboard();
 };
 
+/**
+ * A full snapshot of the common joypad controls, see Joypad::set_state()
+ */
+struct GamepadState {
+  unsigned int buttons = 0; // Joypad::CONTROLLER_BTN flags
+  short left_stick_x = 0;
+  short left_stick_y = 0;
+  short right_stick_x = 0;
+  short right_stick_y = 0;
+  int16_t left_trigger = 0;
+  int16_t right_trigger = 0;
+};
+
 /**
  * Base class for all joypads, they at the very least have to implement buttons and triggers
  */
@@ -315,6 +496,12 @@ public:
   virtual void set_triggers(int16_t left, int16_t right) = 0;
 
   virtual void set_stick(STICK_POSITION stick_type, short x, short y) = 0;
+
+  /**
+   * Applies buttons, sticks and triggers all at once: this is the same as calling the individual setters but it'll
+   * only emit a single report, so applications will never see a half updated controller.
+   */
+  virtual void set_state(const GamepadState &state) = 0;
 };
 
 class XboxOneJoypad : public Joypad {
@@ -332,12 +519,22 @@ public:
   ~XboxOneJoypad() override;
 
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   void set_pressed_buttons(unsigned int newly_pressed) override;
   void set_triggers(int16_t left, int16_t right) override;
   void set_stick(STICK_POSITION stick_type, short x, short y) override;
+
+  void set_state(const GamepadState &state) override;
   void set_on_rumble(const std::function<void(int low_freq, int high_freq)> &callback);
 
+  /**
+   * While a rumble effect is changing over time (attack, fade, ramp or periodic waveform) the on_rumble callback will
+   * be called at most once every `millis` (default: 8ms).
+   * Effects that are constant don't cause any additional update.
+   */
+  void set_rumble_resolution(int millis);
+
 protected:
   typedef struct XboxOneJoypadState XboxOneJoypadState;
   std::shared_ptr<XboxOneJoypadState> _state;
@@ -360,14 +557,24 @@ public:
   ~SwitchJoypad() override;
 
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   void set_pressed_buttons(unsigned int newly_pressed) override;
   void set_triggers(int16_t left, int16_t right) override;
   void set_stick(STICK_POSITION stick_type, short x, short y) override;
+
+  void set_state(const GamepadState &state) override;
   void set_on_rumble(const std::function<void(int low_freq, int high_freq)> &callback);
 
+  /**
+   * While a rumble effect is changing over time (attack, fade, ramp or periodic waveform) the on_rumble callback will
+   * be called at most once every `millis` (default: 8ms).
+   * Effects that are constant don't cause any additional update.
+   */
+  void set_rumble_resolution(int millis);
+
 protected:
-  typedef struct XboxOneJoypadState SwitchJoypadState;
+  typedef struct SwitchJoypadState SwitchJoypadState;
   std::shared_ptr<SwitchJoypadState> _state;
 
 private:
@@ -385,14 +592,21 @@ public:
   ~PS5Joypad() override;
 
   std::vector<std::string> get_nodes() const override;
+  DeviceMetrics get_metrics() const override;
 
   std::string get_mac_address() const;
 
+  /**
+   * The sysfs input devices created by the kernel driver for this joypad (ex: /sys/devices/virtual/misc/uhid/...).
+   * Like get_nodes() the result is cached, sysfs is only scanned again after an input device has been added or removed.
+   */
   std::vector<std::string> get_sys_nodes() const;
 
   void set_pressed_buttons(unsigned int newly_pressed) override;
   void set_triggers(int16_t left, int16_t right) override;
   void set_stick(STICK_POSITION stick_type, short x, short y) override;
+
+  void set_state(const GamepadState &state) override;
   void set_on_rumble(const std::function<void(int low_freq, int high_freq)> &callback);
 
   static constexpr int touchpad_width = 1920;
@@ -414,6 +628,19 @@ public:
    */
   void set_motion(MOTION_TYPE type, float x, float y, float z);
 
+  struct MotionSample {
+    float accel_x, accel_y, accel_z; // m/s^2
+    float gyro_x, gyro_y, gyro_z;    // deg/s
+    /* When the sample was taken, any monotonic reference will do: only the difference between samples matters */
+    std::chrono::microseconds timestamp;
+  };
+
+  /**
+   * Sets both acceleration and gyroscope in a single report, the report will carry the sample `timestamp` so that
+   * the motion data is still correctly timed even if reports are delayed or rate limited.
+   */
+  void set_motion(const MotionSample &sample);
+
   enum BATTERY_STATE : uint8_t {
     BATTERY_DISCHARGING = 0x0,
     BATTERY_CHARGHING = 0x1,
@@ -427,11 +654,33 @@ public:
 
   void set_on_led(const std::function<void(int r, int g, int b)> &callback);
 
+  /**
+   * Opt-in: instead of sending a new report on every call, changes are accumulated into the current report which is
+   * sent at most `max_rate_hz` times per second (a real DualSense over USB sends ~250 reports per second).
+   *
+   * @param max_rate_hz How many reports per second should be sent at most, 0 (default) sends a report on every change
+   */
+  void set_report_rate(int max_rate_hz);
+
+  /**
+   * Opt-in: samples passed to set_motion(const MotionSample &) are queued and sent one per report, evenly spaced at
+   * `rate_hz`, instead of as soon as they arrive; samples that come in bursts (network jitter) end up as steady
+   * reports, each one carrying the timestamp of its sample.
+   * When the client sends faster than `rate_hz` the backlog is drained by merging the two oldest samples into one
+   * and, once the queue is full, by dropping the oldest sample; both are counted in DeviceMetrics::frames_coalesced.
+   *
+   * @param rate_hz How many motion reports per second should be sent, 0 (default) sends each sample right away
+   */
+  void set_motion_rate(int rate_hz);
+
 protected:
   typedef struct PS5JoypadState PS5JoypadState;
   std::shared_ptr<PS5JoypadState> _state;
 
 private:
   PS5Joypad(uint16_t vendor_id);
+
+  std::vector<std::string> scan_sys_nodes() const;
+  std::vector<std::string> scan_nodes() const;
 };
 } // namespace inputtino
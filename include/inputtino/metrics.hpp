@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+namespace inputtino {
+
+/**
+ * A snapshot of the counters of a device, see VirtualDevice::get_metrics().
+ *
+ * The counters are only kept when the library has been built with INPUTTINO_METRICS (see metrics_enabled()),
+ * otherwise they are always 0.
+ */
+struct DeviceMetrics {
+  /* evdev events (for the PS5 pad: HID reports) that have been written to the kernel */
+  std::uint64_t events_written = 0;
+  /* write() calls to /dev/uinput or /dev/uhid */
+  std::uint64_t syscalls = 0;
+  /* write() calls that failed or didn't write everything */
+  std::uint64_t write_errors = 0;
+  /* updates that have been merged into a later frame (mouse motion coalescing, PS5 report rate limiting and
+   * motion samples merged or dropped by PS5Joypad::set_motion_rate()) */
+  std::uint64_t frames_coalesced = 0;
+  /* frames that never made it to the kernel because the write failed */
+  std::uint64_t frames_dropped = 0;
+  /* force feedback requests from the kernel: effect upload, erase, play/stop and gain */
+  std::uint64_t ff_effects_handled = 0;
+  std::uint64_t rumble_callbacks = 0;
+  /* from picking up the kernel request (or the rumble timer) to the rumble callback returning */
+  std::uint64_t rumble_callback_ns_total = 0;
+  std::uint64_t rumble_callback_ns_max = 0;
+};
+
+constexpr bool metrics_enabled() {
+#ifdef INPUTTINO_METRICS
+  return true;
+#else
+  return false;
+#endif
+}
+
+} // namespace inputtino
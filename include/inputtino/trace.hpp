@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <inputtino/input.hpp>
+#include <inputtino/result.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace inputtino {
+
+namespace trace {
+enum class DeviceKind : std::uint8_t {
+  MOUSE = 1,
+  KEYBOARD = 2,
+  XBOX_JOYPAD = 3,
+  SWITCH_JOYPAD = 4,
+  PS5_JOYPAD = 5,
+  TRACKPAD = 6,
+  TOUCH_SCREEN = 7,
+  PEN_TABLET = 8
+};
+} // namespace trace
+
+/**
+ * Records every call made to the devices of this process (Mouse::move(), Keyboard::press(), Joypad::set_stick() ...)
+ * into a compact binary trace that can later be played back with TraceReplayer.
+ *
+ * While recording, calls are timestamped and pushed into a lock free ring buffer, a background thread encodes them
+ * and writes the file; when the ring is full the calls are still executed but they are not recorded, see dropped().
+ * When nothing is being recorded the calls only pay for a relaxed atomic load.
+ */
+class TraceRecorder {
+public:
+  /**
+   * Only one recording can run at a time, the recording stops when the returned recorder is destroyed
+   */
+  static Result<std::shared_ptr<TraceRecorder>> start(const std::string &path);
+
+  TraceRecorder(const TraceRecorder &) = delete;
+  TraceRecorder &operator=(const TraceRecorder &) = delete;
+  ~TraceRecorder();
+
+  /**
+   * Writes out everything that has been recorded so far and closes the file, it's safe to call this multiple times
+   */
+  void stop();
+
+  /**
+   * How many calls couldn't be recorded because the writer thread wasn't keeping up
+   */
+  std::size_t dropped() const;
+
+private:
+  struct Impl;
+  explicit TraceRecorder(std::unique_ptr<Impl> impl);
+  std::unique_ptr<Impl> impl;
+};
+
+/**
+ * Plays back a trace written by TraceRecorder.
+ *
+ * The devices found in the trace have to be bound to real devices first (see devices() and bind()), calls made to
+ * devices that haven't been bound are skipped.
+ */
+class TraceReplayer {
+public:
+  /**
+   * The trace is memory mapped. open() decodes every record once in order to find the devices (see devices()), but only
+   * keeps that list: the calls are decoded again from the mapping by replay()
+   */
+  static Result<TraceReplayer> open(const std::string &path);
+
+  TraceReplayer(TraceReplayer &&other) noexcept;
+  TraceReplayer(const TraceReplayer &) = delete;
+  TraceReplayer &operator=(const TraceReplayer &) = delete;
+  ~TraceReplayer();
+
+  struct Device {
+    std::uint32_t id;
+    trace::DeviceKind kind;
+  };
+
+  /**
+   * All the devices that have been used while recording, in order of first use
+   */
+  const std::vector<Device> &devices() const;
+
+  /**
+   * Returns false when there's no device with the given id in the trace or it's of a different kind.
+   * Any joypad can replay the calls of any other joypad, PS5 specific calls (motion, touchpad, battery) are only
+   * replayed on a PS5Joypad.
+   */
+  bool bind(std::uint32_t id, Mouse &mouse);
+  bool bind(std::uint32_t id, Keyboard &keyboard);
+  bool bind(std::uint32_t id, Joypad &joypad);
+  bool bind(std::uint32_t id, PS5Joypad &joypad);
+  bool bind(std::uint32_t id, Trackpad &trackpad);
+  bool bind(std::uint32_t id, TouchScreen &touch_screen);
+  bool bind(std::uint32_t id, PenTablet &pen_tablet);
+
+  /**
+   * Plays back the whole trace, blocking until it's done
+   *
+   * @param speed 1.0 keeps the original timing, 2.0 plays it twice as fast..., 0 plays it as fast as possible
+   * @return how many calls have been replayed on the bound devices
+   */
+  std::size_t replay(double speed = 1.0);
+
+private:
+  TraceReplayer(const std::uint8_t *data, std::size_t size);
+
+  using Target =
+      std::variant<std::monostate, Mouse *, Keyboard *, Joypad *, PS5Joypad *, Trackpad *, TouchScreen *, PenTablet *>;
+
+  bool bind_target(std::uint32_t id, Target target, bool any_joypad);
+
+  const std::uint8_t *data = nullptr;
+  std::size_t size = 0;
+  std::vector<Device> trace_devices;
+  std::unordered_map<std::uint32_t, Target> targets;
+};
+
+} // namespace inputtino
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstring>
+#include <inputtino/input.h>
 #include <inputtino/input.hpp>
 
 static char **c_get_nodes(void *device, int *num_nodes) {
@@ -17,3 +18,70 @@ static char **c_get_nodes(void *device, int *num_nodes) {
   }
   return nodes;
 }
+
+static int c_copy_nodes(void *device, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  if (!device) {
+    return 0;
+  }
+  auto devices = reinterpret_cast<inputtino::VirtualDevice *>(device)->get_nodes();
+  size_t used = 0;
+  for (int index = 0; index < max_nodes; index++) {
+    nodes[index] = nullptr;
+    if (index < static_cast<int>(devices.size()) && used + devices[index].size() + 1 <= buffer_size) {
+      memcpy(buffer + used, devices[index].c_str(), devices[index].size() + 1);
+      nodes[index] = buffer + used;
+      used += devices[index].size() + 1;
+    }
+  }
+  return static_cast<int>(devices.size());
+}
+
+template <typename Joypad> static void c_set_state(void *joypad, const InputtinoJoypadState *state) {
+  if (joypad && state) {
+    reinterpret_cast<Joypad *>(joypad)->set_state({.buttons = static_cast<unsigned int>(state->buttons),
+                                                   .left_stick_x = state->left_stick_x,
+                                                   .left_stick_y = state->left_stick_y,
+                                                   .right_stick_x = state->right_stick_x,
+                                                   .right_stick_y = state->right_stick_y,
+                                                   .left_trigger = state->left_trigger,
+                                                   .right_trigger = state->right_trigger});
+  }
+}
+
+/**
+ * Splits the contacts in as many TouchFrame as needed, each one is written with a single SYN_REPORT
+ */
+template <typename Device>
+static void c_apply_contacts(void *device, const InputtinoTouchContact *contacts, size_t count) {
+  if (!device || !contacts) {
+    return;
+  }
+  inputtino::TouchFrame frame;
+  for (size_t index = 0; index < count; index++) {
+    const auto &contact = contacts[index];
+    if (contact.released) {
+      frame.release_finger(contact.finger_nr);
+    } else {
+      frame.place_finger(contact.finger_nr, contact.x, contact.y, contact.pressure, contact.orientation);
+    }
+    if (frame.size() == inputtino::TouchFrame::MAX_CONTACTS || index + 1 == count) {
+      reinterpret_cast<Device *>(device)->apply(frame);
+      frame.clear();
+    }
+  }
+}
+
+static void c_get_metrics(void *device, InputtinoDeviceMetrics *metrics) {
+  if (device && metrics) {
+    auto snapshot = reinterpret_cast<inputtino::VirtualDevice *>(device)->get_metrics();
+    *metrics = {.events_written = snapshot.events_written,
+                .syscalls = snapshot.syscalls,
+                .write_errors = snapshot.write_errors,
+                .frames_coalesced = snapshot.frames_coalesced,
+                .frames_dropped = snapshot.frames_dropped,
+                .ff_effects_handled = snapshot.ff_effects_handled,
+                .rumble_callbacks = snapshot.rumble_callbacks,
+                .rumble_callback_ns_total = snapshot.rumble_callback_ns_total,
+                .rumble_callback_ns_max = snapshot.rumble_callback_ns_max};
+  }
+}
@@ -23,12 +23,24 @@ char **inputtino_joypad_ps5_get_nodes(InputtinoPS5Joypad *joypad, int *num_nodes
   return c_get_nodes(joypad, num_nodes);
 }
 
+int inputtino_joypad_ps5_copy_nodes(InputtinoPS5Joypad *joypad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(joypad, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_joypad_ps5_get_metrics(InputtinoPS5Joypad *joypad, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(joypad, metrics);
+}
+
 void inputtino_joypad_ps5_set_pressed_buttons(InputtinoPS5Joypad *joypad, int newly_pressed) {
   if (joypad) {
     reinterpret_cast<inputtino::PS5Joypad *>(joypad)->set_pressed_buttons(newly_pressed);
   }
 }
 
+void inputtino_joypad_ps5_set_state(InputtinoPS5Joypad *joypad, const InputtinoJoypadState *state) {
+  c_set_state<inputtino::PS5Joypad>(joypad, state);
+}
+
 void inputtino_joypad_ps5_set_triggers(InputtinoPS5Joypad *joypad, short left_trigger, short right_trigger) {
   if (joypad) {
     reinterpret_cast<inputtino::PS5Joypad *>(joypad)->set_triggers(left_trigger, right_trigger);
@@ -23,12 +23,24 @@ char **inputtino_joypad_switch_get_nodes(InputtinoSwitchJoypad *joypad, int *num
   return c_get_nodes(joypad, num_nodes);
 }
 
+int inputtino_joypad_switch_copy_nodes(InputtinoSwitchJoypad *joypad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(joypad, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_joypad_switch_get_metrics(InputtinoSwitchJoypad *joypad, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(joypad, metrics);
+}
+
 void inputtino_joypad_switch_set_pressed_buttons(InputtinoSwitchJoypad *joypad, int newly_pressed) {
   if (joypad) {
     reinterpret_cast<inputtino::SwitchJoypad *>(joypad)->set_pressed_buttons(newly_pressed);
   }
 }
 
+void inputtino_joypad_switch_set_state(InputtinoSwitchJoypad *joypad, const InputtinoJoypadState *state) {
+  c_set_state<inputtino::SwitchJoypad>(joypad, state);
+}
+
 void inputtino_joypad_switch_set_triggers(InputtinoSwitchJoypad *joypad, short left_trigger, short right_trigger) {
   if (joypad) {
     reinterpret_cast<inputtino::SwitchJoypad *>(joypad)->set_triggers(left_trigger, right_trigger);
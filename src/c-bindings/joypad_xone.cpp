@@ -22,12 +22,24 @@ char **inputtino_joypad_xone_get_nodes(InputtinoXOneJoypad *joypad, int *num_nod
   return c_get_nodes(joypad, num_nodes);
 }
 
+int inputtino_joypad_xone_copy_nodes(InputtinoXOneJoypad *joypad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(joypad, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_joypad_xone_get_metrics(InputtinoXOneJoypad *joypad, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(joypad, metrics);
+}
+
 void inputtino_joypad_xone_set_pressed_buttons(InputtinoXOneJoypad *joypad, int newly_pressed) {
   if (joypad) {
     reinterpret_cast<inputtino::XboxOneJoypad *>(joypad)->set_pressed_buttons(newly_pressed);
   }
 }
 
+void inputtino_joypad_xone_set_state(InputtinoXOneJoypad *joypad, const InputtinoJoypadState *state) {
+  c_set_state<inputtino::XboxOneJoypad>(joypad, state);
+}
+
 void inputtino_joypad_xone_set_triggers(InputtinoXOneJoypad *joypad, short left_trigger, short right_trigger) {
   if (joypad) {
     reinterpret_cast<inputtino::XboxOneJoypad *>(joypad)->set_triggers(left_trigger, right_trigger);
@@ -22,6 +22,14 @@ char **inputtino_keyboard_get_nodes(InputtinoKeyboard *keyboard, int *num_nodes)
   return c_get_nodes(keyboard, num_nodes);
 }
 
+int inputtino_keyboard_copy_nodes(InputtinoKeyboard *keyboard, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(keyboard, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_keyboard_get_metrics(InputtinoKeyboard *keyboard, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(keyboard, metrics);
+}
+
 void inputtino_keyboard_press(InputtinoKeyboard *keyboard, short key_code) {
   if (keyboard) {
     reinterpret_cast<inputtino::Keyboard *>(keyboard)->press(key_code);
@@ -34,6 +42,20 @@ void inputtino_keyboard_release(InputtinoKeyboard *keyboard, short key_code) {
   }
 }
 
+void inputtino_keyboard_apply_events(InputtinoKeyboard *keyboard, const InputtinoKeyboardEvent *events, size_t count) {
+  if (!keyboard || !events) {
+    return;
+  }
+  auto keyboard_ptr = reinterpret_cast<inputtino::Keyboard *>(keyboard);
+  for (size_t index = 0; index < count; index++) {
+    if (events[index].pressed) {
+      keyboard_ptr->press(events[index].key_code);
+    } else {
+      keyboard_ptr->release(events[index].key_code);
+    }
+  }
+}
+
 void inputtino_keyboard_destroy(InputtinoKeyboard *keyboard) {
   if (keyboard) {
     auto ptr = reinterpret_cast<inputtino::Keyboard *>(keyboard);
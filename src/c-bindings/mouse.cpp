@@ -23,6 +23,14 @@ char **inputtino_mouse_get_nodes(InputtinoMouse *mouse, int *num_nodes) {
   return c_get_nodes(mouse, num_nodes);
 }
 
+int inputtino_mouse_copy_nodes(InputtinoMouse *mouse, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(mouse, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_mouse_get_metrics(InputtinoMouse *mouse, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(mouse, metrics);
+}
+
 void inputtino_mouse_move(InputtinoMouse *mouse, int delta_x, int delta_y) {
   if (mouse) {
     reinterpret_cast<inputtino::Mouse *>(mouse)->move(delta_x, delta_y);
@@ -59,6 +67,36 @@ void inputtino_mouse_scroll_horizontal(InputtinoMouse *mouse, int high_res_dista
   }
 }
 
+void inputtino_mouse_apply_events(InputtinoMouse *mouse, const InputtinoMouseEvent *events, size_t count) {
+  if (!mouse || !events) {
+    return;
+  }
+  auto mouse_ptr = reinterpret_cast<inputtino::Mouse *>(mouse);
+  for (size_t index = 0; index < count; index++) {
+    const auto &event = events[index];
+    switch (event.type) {
+    case INPUTTINO_MOUSE_MOVE:
+      mouse_ptr->move(event.x, event.y);
+      break;
+    case INPUTTINO_MOUSE_MOVE_ABSOLUTE:
+      mouse_ptr->move_abs(event.x, event.y, event.screen_width, event.screen_height);
+      break;
+    case INPUTTINO_MOUSE_PRESS:
+      mouse_ptr->press(inputtino::Mouse::MOUSE_BUTTON(event.button));
+      break;
+    case INPUTTINO_MOUSE_RELEASE:
+      mouse_ptr->release(inputtino::Mouse::MOUSE_BUTTON(event.button));
+      break;
+    case INPUTTINO_MOUSE_SCROLL_VERTICAL:
+      mouse_ptr->vertical_scroll(event.x);
+      break;
+    case INPUTTINO_MOUSE_SCROLL_HORIZONTAL:
+      mouse_ptr->horizontal_scroll(event.x);
+      break;
+    }
+  }
+}
+
 void inputtino_mouse_destroy(InputtinoMouse *mouse) {
   if (mouse) {
     inputtino::Mouse *mouse_ptr = reinterpret_cast<inputtino::Mouse *>(mouse);
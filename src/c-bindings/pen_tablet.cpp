@@ -22,6 +22,14 @@ char **inputtino_pen_tablet_get_nodes(InputtinoPenTablet *pen_tablet, int *num_n
   return c_get_nodes(pen_tablet, num_nodes);
 }
 
+int inputtino_pen_tablet_copy_nodes(InputtinoPenTablet *pen_tablet, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(pen_tablet, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_pen_tablet_get_metrics(InputtinoPenTablet *pen_tablet, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(pen_tablet, metrics);
+}
+
 void inputtino_pen_tablet_place_tool(InputtinoPenTablet *pen_tablet,
                                      enum INPUTTINO_PEN_TOOL_TYPE tool_type,
                                      float x,
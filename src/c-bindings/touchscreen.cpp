@@ -22,6 +22,14 @@ char **inputtino_touchscreen_get_nodes(InputtinoTouchscreen *touchscreen, int *n
   return c_get_nodes(touchscreen, num_nodes);
 }
 
+int inputtino_touchscreen_copy_nodes(InputtinoTouchscreen *touchscreen, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(touchscreen, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_touchscreen_get_metrics(InputtinoTouchscreen *touchscreen, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(touchscreen, metrics);
+}
+
 void inputtino_touchscreen_place_finger(
     InputtinoTouchscreen *touchscreen, int finger_nr, float x, float y, float pressure, int orientation) {
   if (touchscreen) {
@@ -35,6 +43,12 @@ void inputtino_touchscreen_release_finger(InputtinoTouchscreen *touchscreen, int
   }
 }
 
+void inputtino_touchscreen_apply_contacts(InputtinoTouchscreen *touchscreen,
+                                          const InputtinoTouchContact *contacts,
+                                          size_t count) {
+  c_apply_contacts<inputtino::TouchScreen>(touchscreen, contacts, count);
+}
+
 void inputtino_touchscreen_destroy(InputtinoTouchscreen *touchscreen) {
   if (touchscreen) {
     inputtino::TouchScreen *touch_ptr = reinterpret_cast<inputtino::TouchScreen *>(touchscreen);
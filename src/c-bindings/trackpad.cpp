@@ -22,6 +22,14 @@ char **inputtino_trackpad_get_nodes(InputtinoTrackpad *trackpad, int *num_nodes)
   return c_get_nodes(trackpad, num_nodes);
 }
 
+int inputtino_trackpad_copy_nodes(InputtinoTrackpad *trackpad, char *buffer, size_t buffer_size, const char **nodes, int max_nodes) {
+  return c_copy_nodes(trackpad, buffer, buffer_size, nodes, max_nodes);
+}
+
+void inputtino_trackpad_get_metrics(InputtinoTrackpad *trackpad, InputtinoDeviceMetrics *metrics) {
+  c_get_metrics(trackpad, metrics);
+}
+
 void inputtino_trackpad_place_finger(
     InputtinoTrackpad *trackpad, int finger_nr, float x, float y, float pressure, int orientation) {
   if (trackpad) {
@@ -41,6 +49,12 @@ void inputtino_trackpad_set_left_btn(InputtinoTrackpad *trackpad, bool pressed)
   }
 }
 
+void inputtino_trackpad_apply_contacts(InputtinoTrackpad *trackpad,
+                                       const InputtinoTouchContact *contacts,
+                                       size_t count) {
+  c_apply_contacts<inputtino::Trackpad>(trackpad, contacts, count);
+}
+
 void inputtino_trackpad_destroy(InputtinoTrackpad *trackpad) {
   if (trackpad) {
     inputtino::Trackpad *trackpad_ptr = reinterpret_cast<inputtino::Trackpad *>(trackpad);
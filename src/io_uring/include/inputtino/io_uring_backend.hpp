@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <inputtino/backend.hpp>
+#include <memory>
+
+namespace inputtino {
+
+struct IoUringOptions {
+  /* How long frames wait before being submitted; all the frames of a tick go out with a single io_uring_enter() */
+  std::chrono::microseconds tick = std::chrono::microseconds(1000);
+  /* Devices that can be registered with the ring, the ones created after that use plain writes */
+  std::size_t max_devices = 256;
+  /* Events that each device can queue in a tick, when full, the batch is submitted early */
+  std::size_t events_per_tick = 128;
+};
+
+/**
+ * An OutputBackend for processes that drive a lot of devices: instead of one write() for each frame, the frames of
+ * each device are collected for a `tick` and all the devices are written with a single io_uring_enter() call.
+ *
+ * The uinput fds are registered with the ring and the frames are kept in a registered buffer (double buffered, so
+ * that new frames can be queued while the previous batch is in flight); there's one write per device per tick, which
+ * keeps the frames of a device in order.
+ *
+ * Only the uinput writes go through the ring: FF requests are still read by the EventLoop and uhid devices (rate
+ * limited already, and one write() per uhid event) are the same as the system_output_backend().
+ *
+ * Falls back to system_output_backend() (plain writes) when io_uring is not available (old kernels, seccomp).
+ */
+std::shared_ptr<OutputBackend> io_uring_output_backend(const IoUringOptions &options = {});
+
+} // namespace inputtino
@@ -0,0 +1,320 @@
+#include <cerrno>
+#include <cstring>
+#include <inputtino/io_uring_backend.hpp>
+#include <inputtino/scheduler.hpp>
+#include <iostream>
+#include <liburing.h>
+#include <mutex>
+#include <optional>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace inputtino {
+
+/**
+ * The ring shared by all the devices of an io_uring_output_backend().
+ *
+ * Frames are appended to the slot of their device in the active half of `arena`; on each tick the halves are swapped
+ * and the other one gets submitted, one write for each device that has something queued.
+ * Before swapping again, the completions of the previous batch are reaped so that the half is free to be reused.
+ */
+class IoUringRing : public std::enable_shared_from_this<IoUringRing> {
+public:
+  static std::shared_ptr<IoUringRing> create(const IoUringOptions &options) {
+    auto ring = std::shared_ptr<IoUringRing>(new IoUringRing(options));
+    auto ret = io_uring_queue_init(static_cast<unsigned>(options.max_devices), &ring->ring, 0);
+    if (ret < 0) {
+      std::cerr << "Unable to create io_uring, falling back to plain writes; " << strerror(-ret) << std::endl;
+      return nullptr;
+    }
+    ring->initialized = true;
+
+    std::vector<int> no_files(options.max_devices, -1);
+    ring->fixed_files = io_uring_register_files(&ring->ring, no_files.data(), no_files.size()) == 0;
+    iovec arena = {.iov_base = ring->arena.data(), .iov_len = ring->arena.size() * sizeof(input_event)};
+    ring->fixed_buffers = io_uring_register_buffers(&ring->ring, &arena, 1) == 0;
+    return ring;
+  }
+
+  ~IoUringRing() {
+    if (initialized) {
+      std::lock_guard submitting(submit_mutex);
+      reap();
+      io_uring_queue_exit(&ring);
+    }
+  }
+
+  /**
+   * Returns the slot for `fd`, or an empty optional if the ring is full
+   */
+  std::optional<std::size_t> add_device(int fd) {
+    std::lock_guard lock(mutex);
+    for (std::size_t index = 0; index < slots.size(); index++) {
+      if (slots[index].fd < 0) {
+        if (fixed_files && io_uring_register_files_update(&ring, static_cast<unsigned>(index), &fd, 1) != 1) {
+          return {};
+        }
+        slots[index] = {.fd = fd};
+        return index;
+      }
+    }
+    return {};
+  }
+
+  /**
+   * Writes what's still queued for the device, once this returns the fd isn't used by the ring anymore
+   */
+  void remove_device(std::size_t slot) {
+    std::lock_guard submitting(submit_mutex);
+    submit_batch();
+    reap();
+    std::lock_guard lock(mutex);
+    if (fixed_files) {
+      int no_file = -1;
+      io_uring_register_files_update(&ring, static_cast<unsigned>(slot), &no_file, 1);
+    }
+    slots[slot] = {};
+  }
+
+  Result<bool> queue(std::size_t slot, const input_event *events, std::size_t count) {
+    if (count > options.events_per_tick) { // Doesn't fit in a slot: flush what we have and write it directly
+      submit();
+      std::lock_guard submitting(submit_mutex);
+      reap();
+      return plain_write(slots[slot].fd, events, count);
+    }
+
+    std::unique_lock lock(mutex);
+    if (slots[slot].count[active] + count > options.events_per_tick) {
+      lock.unlock();
+      submit();
+      lock.lock();
+    }
+
+    auto &state = slots[slot];
+    std::copy(events, events + count, buffer(active, slot) + state.count[active]);
+    state.count[active] += count;
+    if (!state.dirty) {
+      state.dirty = true;
+      dirty.push_back(slot);
+    }
+    if (!tick_task) {
+      tick_task = Scheduler::get().schedule(options.tick, [weak_ring = weak_from_this()]() {
+        if (auto ring = weak_ring.lock()) {
+          ring->submit();
+        }
+        return std::optional<std::chrono::microseconds>{};
+      });
+    }
+    return true; // Errors are only known once the batch completes, see reap()
+  }
+
+  /**
+   * Sends everything that has been queued so far with a single io_uring_enter()
+   */
+  void submit() {
+    std::lock_guard submitting(submit_mutex);
+    submit_batch();
+  }
+
+private:
+  explicit IoUringRing(const IoUringOptions &options)
+      : options(options), arena(2 * options.max_devices * options.events_per_tick), slots(options.max_devices) {}
+
+  struct Slot {
+    int fd = -1;
+    bool dirty = false;
+    std::size_t count[2] = {0, 0};
+    bool reported_error = false;
+  };
+
+  input_event *buffer(std::size_t half, std::size_t slot) {
+    return arena.data() + (half * options.max_devices + slot) * options.events_per_tick;
+  }
+
+  static Result<bool> plain_write(int fd, const input_event *events, std::size_t count) {
+    auto bytes = count * sizeof(input_event);
+    ssize_t ret = write(fd, events, bytes);
+    if (ret < 0) {
+      return Error(strerror(errno));
+    } else if (static_cast<std::size_t>(ret) != bytes) {
+      return Error(strerror(EFAULT));
+    }
+    return true;
+  }
+
+  /**
+   * Must be called with `submit_mutex` held
+   */
+  void submit_batch() {
+    reap(); // The half that is about to become active might still be in flight
+
+    std::size_t half;
+    {
+      std::lock_guard lock(mutex);
+      tick_task = 0;
+      if (dirty.empty()) {
+        return;
+      }
+      half = active;
+      active = 1 - active;
+      batch.clear();
+      for (auto slot : dirty) {
+        batch.emplace_back(slot, slots[slot].count[half]);
+        slots[slot].count[half] = 0;
+        slots[slot].dirty = false;
+      }
+      dirty.clear();
+    }
+
+    for (const auto &[slot, count] : batch) {
+      auto sqe = io_uring_get_sqe(&ring); // never null: there's at most one write for each slot
+      auto data = buffer(half, slot);
+      auto bytes = static_cast<unsigned>(count * sizeof(input_event));
+      int fd = fixed_files ? static_cast<int>(slot) : slots[slot].fd;
+      if (fixed_buffers) {
+        io_uring_prep_write_fixed(sqe, fd, data, bytes, -1, 0);
+      } else {
+        io_uring_prep_write(sqe, fd, data, bytes, -1);
+      }
+      if (fixed_files) {
+        sqe->flags |= IOSQE_FIXED_FILE;
+      }
+      io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(slot));
+    }
+    auto ret = io_uring_submit(&ring);
+    if (ret < 0) {
+      std::cerr << "io_uring_submit failed; " << strerror(-ret) << std::endl;
+    } else {
+      in_flight += static_cast<std::size_t>(ret);
+    }
+  }
+
+  /**
+   * Waits for the completions of the last batch; must be called with `submit_mutex` held
+   */
+  void reap() {
+    while (in_flight > 0) {
+      io_uring_cqe *cqe = nullptr;
+      if (io_uring_wait_cqe(&ring, &cqe) < 0 || !cqe) {
+        break;
+      }
+      auto slot = reinterpret_cast<std::size_t>(io_uring_cqe_get_data(cqe));
+      if (cqe->res < 0) {
+        std::lock_guard lock(mutex);
+        if (slot < slots.size() && !slots[slot].reported_error) {
+          slots[slot].reported_error = true;
+          std::cerr << "io_uring write to uinput failed; " << strerror(-cqe->res) << std::endl;
+        }
+      }
+      io_uring_cqe_seen(&ring, cqe);
+      in_flight--;
+    }
+  }
+
+  IoUringOptions options;
+  io_uring ring{};
+  bool initialized = false;
+  bool fixed_files = false;
+  bool fixed_buffers = false;
+  std::vector<input_event> arena;
+
+  /* Held while a batch is being prepared or reaped, always taken before `mutex` */
+  std::mutex submit_mutex;
+  std::size_t in_flight = 0;
+  std::vector<std::pair<std::size_t, std::size_t>> batch; // slot, count; reused between ticks
+
+  std::mutex mutex;
+  std::vector<Slot> slots;
+  std::vector<std::size_t> dirty;
+  std::size_t active = 0;
+  Scheduler::TaskId tick_task = 0;
+};
+
+/**
+ * A uinput device from the system backend whose frames go through the ring
+ */
+class IoUringOutput : public EvdevOutput {
+public:
+  IoUringOutput(evdev_output_ptr device, std::shared_ptr<IoUringRing> ring, std::size_t slot)
+      : device(std::move(device)), ring(std::move(ring)), slot(slot) {}
+
+  ~IoUringOutput() override {
+    ring->remove_device(slot);
+  }
+
+  Result<bool> write_frame(const input_event *events, std::size_t count) override {
+    return ring->queue(slot, events, count);
+  }
+
+  std::size_t read_events(input_event *buffer, std::size_t max) override {
+    return device->read_events(buffer, max);
+  }
+
+  int poll_fd() const override {
+    return device->poll_fd();
+  }
+
+  void begin_ff_upload(uinput_ff_upload &upload) override {
+    device->begin_ff_upload(upload);
+  }
+
+  void end_ff_upload(const uinput_ff_upload &upload) override {
+    device->end_ff_upload(upload);
+  }
+
+  void begin_ff_erase(uinput_ff_erase &erase) override {
+    device->begin_ff_erase(erase);
+  }
+
+  void end_ff_erase(const uinput_ff_erase &erase) override {
+    device->end_ff_erase(erase);
+  }
+
+  std::string devnode() const override {
+    return device->devnode();
+  }
+
+  std::string syspath() const override {
+    return device->syspath();
+  }
+
+private:
+  evdev_output_ptr device;
+  std::shared_ptr<IoUringRing> ring;
+  std::size_t slot;
+};
+
+class IoUringBackend : public OutputBackend {
+public:
+  explicit IoUringBackend(std::shared_ptr<IoUringRing> ring) : ring(std::move(ring)) {}
+
+  Result<evdev_output_ptr> create_evdev(const libevdev *dev) override {
+    auto device = system_output_backend()->create_evdev(dev);
+    if (!device) {
+      return device;
+    }
+    auto slot = ring->add_device((*device)->poll_fd());
+    if (!slot) { // The ring is full, this one will use plain writes
+      return device;
+    }
+    return evdev_output_ptr{std::make_shared<IoUringOutput>(*device, ring, *slot)};
+  }
+
+  Result<hid_output_ptr> create_hid(const uhid_create2_req &definition) override {
+    return system_output_backend()->create_hid(definition);
+  }
+
+private:
+  std::shared_ptr<IoUringRing> ring;
+};
+
+std::shared_ptr<OutputBackend> io_uring_output_backend(const IoUringOptions &options) {
+  if (auto ring = IoUringRing::create(options)) {
+    return std::make_shared<IoUringBackend>(std::move(ring));
+  }
+  return system_output_backend();
+}
+
+} // namespace inputtino
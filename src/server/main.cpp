@@ -1,4 +1,6 @@
 #include <server/rest.hpp>
+#include <server/shm.hpp>
+#include <server/stream.hpp>
 #include <thread>
 
 
@@ -8,7 +10,16 @@ int main() {
 
     auto rest_ip = get_env("INPUTTINO_REST_IP", "0.0.0.0");
     auto rest_port = std::stoi(get_env("INPUTTINO_REST_PORT", "8080"));
-    auto svr = setup_rest_server(state);
+
+    // Device events are applied by the workers, each client is always served by the same one
+    auto default_workers = std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+    auto workers_count = std::stoul(get_env("INPUTTINO_WORKERS", default_workers.c_str()));
+    auto workers_cpus = WorkerPool::parse_cpus(get_env("INPUTTINO_WORKERS_CPUS", "")); // ex: "0,2,4-7"
+    auto workers = std::make_shared<WorkerPool>(workers_count, workers_cpus);
+    auto svr = setup_rest_server(state, workers);
+    // Each keep-alive connection holds an HTTP thread, the default pool would only serve a handful of clients
+    auto http_threads = std::stoul(get_env("INPUTTINO_HTTP_THREADS", "64"));
+    svr->new_task_queue = [http_threads] { return new httplib::ThreadPool(http_threads); };
     auto file_path = get_env("INPUTTINO_CLIENT_PATH", "./src/server/client/dist");
     if (!svr->set_mount_point("/", file_path)) {
         std::cerr << "Failed to set mount point: " << file_path << std::endl;
@@ -25,6 +36,19 @@ int main() {
 
     std::cout << "Server listening on http://" << rest_ip << ":" << rest_port << "" << std::endl;
 
+    auto stream_port = std::stoi(get_env("INPUTTINO_STREAM_PORT", "8081"));
+    StreamServer stream_svr(state);
+    if (stream_svr.listen(rest_ip, stream_port)) {
+        std::cout << "Stream listening on " << rest_ip << ":" << stream_port << "" << std::endl;
+    }
+
+    // Opt-in, for producers running on the same host
+    std::string shm_socket = get_env("INPUTTINO_SHM_SOCKET", "");
+    ShmServer shm_svr(state, workers);
+    if (!shm_socket.empty() && shm_svr.listen(shm_socket)) {
+        std::cout << "Shared memory rings available on " << shm_socket << std::endl;
+    }
+
     svr_thread.join();
     return 0;
 }
\ No newline at end of file
@@ -3,7 +3,10 @@
 #include <immer/map.hpp>
 #include <immer/vector.hpp>
 #include <immer/box.hpp>
+#include <atomic>
+#include <inputtino/feedback.hpp>
 #include <inputtino/input.hpp>
+#include <server/handles.hpp>
 
 enum DeviceType {
     KEYBOARD,
@@ -14,6 +17,15 @@ enum DeviceType {
     TOUCH_SCREEN
 };
 
+/**
+ * Rumble and LED updates of a joypad, streamed by GET /api/v1.0/devices/joypad/:id/feedback
+ */
+struct JoypadFeedback {
+    std::shared_ptr<inputtino::FeedbackMailbox> mailbox;
+    /* A mailbox only has one consumer, so there can only be one stream at a time */
+    std::atomic<bool> streaming = false;
+};
+
 struct LocalDevice {
     DeviceType type;
     std::size_t device_id;
@@ -26,10 +38,18 @@ struct LocalDevice {
             std::shared_ptr<inputtino::Trackpad>,
             std::shared_ptr<inputtino::TouchScreen>>
             device;
+    std::shared_ptr<JoypadFeedback> feedback = nullptr; // only for joypads
 };
 
 using devices_map = immer::map<std::size_t, immer::box<LocalDevice>>;
 
+/**
+ * Used by the handlers in order to get to the devices without loading the whole state, see HandleTable
+ */
+using DeviceHandles = HandleTable<decltype(LocalDevice::device)>;
+
 struct ServerState {
     devices_map devices;
+    /* Shared by all the copies of the state, devices have to be registered here as well as in `devices` */
+    std::shared_ptr<DeviceHandles> handles = std::make_shared<DeviceHandles>();
 };
\ No newline at end of file
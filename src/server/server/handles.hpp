@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <variant>
+
+/**
+ * Resolves the device ids handed out to clients straight to the devices, without going through the immer state.
+ *
+ * Ids are small integers: the low bits are the index of the slot, the high bits are bumped every time the slot is
+ * reused so that a stale id (of a device that has been removed) is never resolved to a newer device.
+ *
+ * Lookups don't take locks nor touch any refcount, the devices are kept alive by ServerState; in order to be able to
+ * release a device safely, lookups are done while holding a ReadGuard and remove() waits until all the guards that
+ * might have seen the device have been released (two epochs, like a minimal RCU).
+ */
+template <typename Variant, std::size_t Capacity = 1024> class HandleTable {
+  static_assert(Capacity > 0 && Capacity <= 0xFFFF, "The slot index is stored in the low 16 bits of the id");
+
+public:
+  using Id = std::size_t;
+
+  enum class Error {
+    NOT_FOUND,  // never existed, or it has been removed
+    WRONG_TYPE, // ex: a keyboard id passed to a mouse endpoint
+  };
+
+  template <typename T> struct Handle {
+    T *device = nullptr;
+    Error error = Error::NOT_FOUND;
+
+    explicit operator bool() const {
+      return device != nullptr;
+    }
+  };
+
+  /**
+   * Held while using the pointers returned by get(), should be short lived (ex: one request, one batch of events)
+   */
+  class ReadGuard {
+  public:
+    explicit ReadGuard(HandleTable &table) : table(table) {
+      while (true) {
+        epoch = table.epoch.load(std::memory_order_seq_cst);
+        table.readers[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
+        if (table.epoch.load(std::memory_order_seq_cst) == epoch) {
+          break;
+        }
+        table.readers[epoch & 1].fetch_sub(1, std::memory_order_seq_cst); // remove() is flipping the epoch, retry
+      }
+    }
+
+    ~ReadGuard() {
+      table.readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+
+  private:
+    HandleTable &table;
+    std::uint64_t epoch;
+  };
+
+  ReadGuard read() {
+    return ReadGuard(*this);
+  }
+
+  /**
+   * Registers the device, returns the new id or an empty optional when all the slots are in use
+   */
+  std::optional<Id> add(const Variant &device) {
+    std::lock_guard lock(writer_m);
+    for (std::size_t index = 0; index < Capacity; index++) {
+      auto &slot = slots[index];
+      if (slot.id.load(std::memory_order_relaxed) == 0) {
+        slot.generation++;
+        slot.type.store(device.index(), std::memory_order_relaxed);
+        slot.device.store(std::visit([](const auto &ptr) -> void * { return ptr.get(); }, device),
+                          std::memory_order_relaxed);
+        auto id = (slot.generation << 16) | index;
+        slot.id.store(id, std::memory_order_seq_cst);
+        return id;
+      }
+    }
+    return {};
+  }
+
+  /**
+   * After this returns there are no more readers using the device, it's safe to release it
+   */
+  void remove(Id id) {
+    std::lock_guard lock(writer_m);
+    auto index = id & 0xFFFF;
+    if (index >= Capacity || slots[index].id.load(std::memory_order_relaxed) != id) {
+      return;
+    }
+    slots[index].id.store(0, std::memory_order_seq_cst);
+
+    // Readers that start from now on will not find the device, wait for the ones that might still be using it
+    auto old_epoch = epoch.load(std::memory_order_relaxed);
+    epoch.store(old_epoch + 1, std::memory_order_seq_cst);
+    while (readers[old_epoch & 1].load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  template <typename T> Handle<T> get(const ReadGuard &, Id id) const {
+    auto index = id & 0xFFFF;
+    if (id == 0 || index >= Capacity) {
+      return {};
+    }
+    auto &slot = slots[index];
+    if (slot.id.load(std::memory_order_seq_cst) != id) {
+      return {};
+    }
+    if (slot.type.load(std::memory_order_relaxed) != index_of<std::shared_ptr<T>>()) {
+      return {.error = Error::WRONG_TYPE};
+    }
+    return {.device = static_cast<T *>(slot.device.load(std::memory_order_relaxed))};
+  }
+
+  /**
+   * Parses an id as sent by the clients (ex: a REST path parameter)
+   */
+  static std::optional<Id> parse_id(std::string_view str) {
+    Id id = 0;
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), id);
+    if (ec != std::errc() || end != str.data() + str.size()) {
+      return {};
+    }
+    return id;
+  }
+
+private:
+  template <typename T, std::size_t I = 0> static constexpr std::size_t index_of() {
+    static_assert(I < std::variant_size_v<Variant>, "Type is not one of the devices");
+    if constexpr (std::is_same_v<std::variant_alternative_t<I, Variant>, T>) {
+      return I;
+    } else {
+      return index_of<T, I + 1>();
+    }
+  }
+
+  struct Slot {
+    std::atomic<Id> id{0}; // 0 when the slot is free
+    std::atomic<std::size_t> type{0};
+    std::atomic<void *> device{nullptr};
+    Id generation = 0; // only accessed by the writer
+  };
+
+  std::array<Slot, Capacity> slots{};
+
+  std::mutex writer_m;
+  std::atomic<std::uint64_t> epoch{0};
+  std::array<std::atomic<std::uint32_t>, 2> readers{};
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <inputtino/metrics.hpp>
+#include <server/data_model.hpp>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * The DeviceMetrics of all the devices in the Prometheus text exposition format, one sample per device and counter
+ */
+static std::string to_prometheus(const ServerState &state) {
+  struct Counter {
+    const char *name;
+    const char *help;
+    std::uint64_t inputtino::DeviceMetrics::*field;
+  };
+  static constexpr Counter counters[] = {
+      {"inputtino_events_written_total", "Events written to the kernel", &inputtino::DeviceMetrics::events_written},
+      {"inputtino_syscalls_total", "write() calls to uinput/uhid", &inputtino::DeviceMetrics::syscalls},
+      {"inputtino_write_errors_total", "Failed write() calls", &inputtino::DeviceMetrics::write_errors},
+      {"inputtino_frames_coalesced_total",
+       "Updates merged into a later frame",
+       &inputtino::DeviceMetrics::frames_coalesced},
+      {"inputtino_frames_dropped_total", "Frames lost to a failed write", &inputtino::DeviceMetrics::frames_dropped},
+      {"inputtino_ff_effects_handled_total",
+       "Force feedback requests from the kernel",
+       &inputtino::DeviceMetrics::ff_effects_handled},
+      {"inputtino_rumble_callbacks_total", "Rumble callbacks called", &inputtino::DeviceMetrics::rumble_callbacks},
+      {"inputtino_rumble_callback_seconds_total",
+       "Time from the rumble request to the callback returning",
+       &inputtino::DeviceMetrics::rumble_callback_ns_total},
+  };
+  static constexpr const char *type_names[] = {"keyboard", "mouse", "joypad", "pen_tablet", "trackpad", "touchscreen"};
+
+  std::vector<std::pair<const LocalDevice *, inputtino::DeviceMetrics>> snapshots;
+  for (const auto &[id, device] : state.devices) {
+    auto metrics = std::visit([](const auto &ptr) { return ptr->get_metrics(); }, device->device);
+    snapshots.emplace_back(&device.get(), metrics);
+  }
+
+  std::ostringstream out;
+  out.precision(9);
+  for (const auto &counter : counters) {
+    bool seconds = counter.field == &inputtino::DeviceMetrics::rumble_callback_ns_total;
+    out << "# HELP " << counter.name << " " << counter.help << "\n";
+    out << "# TYPE " << counter.name << " counter\n";
+    for (const auto &[device, metrics] : snapshots) {
+      out << counter.name << "{device_id=\"" << device->device_id << "\",type=\"" << type_names[device->type] << "\"} ";
+      if (seconds) {
+        out << std::fixed << static_cast<double>(metrics.*counter.field) / 1e9 << std::defaultfloat;
+      } else {
+        out << metrics.*counter.field;
+      }
+      out << "\n";
+    }
+  }
+  out << "# HELP inputtino_rumble_callback_max_seconds Slowest rumble callback so far\n";
+  out << "# TYPE inputtino_rumble_callback_max_seconds gauge\n";
+  for (const auto &[device, metrics] : snapshots) {
+    out << "inputtino_rumble_callback_max_seconds{device_id=\"" << device->device_id << "\",type=\""
+        << type_names[device->type] << "\"} " << std::fixed << static_cast<double>(metrics.rumble_callback_ns_max) / 1e9
+        << std::defaultfloat << "\n";
+  }
+  return out.str();
+}
@@ -1,28 +1,283 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <httplib.h>
 #include <immer/atom.hpp>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <server/json_serialization.hpp>
+#include <server/prometheus.hpp>
+#include <server/workers.hpp>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
-static void handle_error(httplib::Response &res, const std::string &message) {
+static void handle_error(httplib::Response &res,
+                         const std::string &message,
+                         int status = httplib::StatusCode::InternalServerError_500) {
   res.set_content(json{{"error", message}}.dump(), "application/json");
-  res.status = httplib::StatusCode::InternalServerError_500;
+  res.status = status;
 }
 
 template <typename T>
-static bool handle_device(inputtino::Result<T> &result, httplib::Response &response, LocalDevice &device) {
+static bool handle_device(inputtino::Result<T> &result,
+                          httplib::Response &response,
+                          LocalDevice &device,
+                          DeviceHandles &handles) {
   if (!result) {
     handle_error(response, result.getErrorMessage());
     return false;
-  } else {
-    device.device_id = std::hash<std::string>{}((*result).get_nodes()[0]);
-    device.device = std::make_shared<T>(std::move(*result));
+  }
+
+  device.device = std::make_shared<T>(std::move(*result));
+  if (auto id = handles.add(device.device)) {
+    device.device_id = *id;
     return true;
   }
+  handle_error(response, "Too many devices");
+  return false;
+}
+
+/**
+ * Same as handle_device(), the rumble (and LED) callbacks of the joypad go to a FeedbackMailbox so that they never
+ * wait for the clients that are streaming them
+ */
+template <typename T>
+static bool handle_joypad(inputtino::Result<T> &result,
+                          httplib::Response &response,
+                          LocalDevice &device,
+                          DeviceHandles &handles) {
+  if (!result) {
+    handle_error(response, result.getErrorMessage());
+    return false;
+  }
+
+  auto mailbox = inputtino::FeedbackMailbox::create();
+  if (!mailbox) {
+    handle_error(response, mailbox.getErrorMessage());
+    return false;
+  }
+  (*result).set_on_rumble((*mailbox)->rumble_callback());
+  if constexpr (std::is_same_v<T, inputtino::PS5Joypad>) {
+    (*result).set_on_led((*mailbox)->led_callback());
+  }
+  device.feedback = std::make_shared<JoypadFeedback>();
+  device.feedback->mailbox = *mailbox;
+  return handle_device(result, response, device, handles);
+}
+
+/**
+ * Resolves the `:id` path parameter to the device, on failure the error response is set and nullptr is returned.
+ * The pointer is only valid while `guard` is held.
+ */
+template <typename T>
+static T *resolve_device(const DeviceHandles &handles,
+                         const DeviceHandles::ReadGuard &guard,
+                         const httplib::Request &req,
+                         httplib::Response &res) {
+  auto id = DeviceHandles::parse_id(req.path_params.at("id"));
+  if (!id) {
+    handle_error(res, "Invalid device id: " + req.path_params.at("id"), httplib::StatusCode::BadRequest_400);
+    return nullptr;
+  }
+
+  auto handle = handles.get<T>(guard, *id);
+  if (!handle) {
+    if (handle.error == DeviceHandles::Error::WRONG_TYPE) {
+      handle_error(res, "Wrong device type for id: " + std::to_string(*id), httplib::StatusCode::BadRequest_400);
+    } else {
+      handle_error(res, "Device not found: " + std::to_string(*id), httplib::StatusCode::NotFound_404);
+    }
+    return nullptr;
+  }
+  return handle.device;
+}
+
+/**
+ * What a coalesced event updates, together with the device id it makes up the WorkerPool coalesce key
+ */
+enum MotionKind : std::uint8_t {
+  MOVE_REL = 1,
+  MOVE_ABS,
+  SCROLL_VERTICAL,
+  SCROLL_HORIZONTAL
+};
+
+static std::uint64_t coalesce_key(DeviceHandles::Id id, MotionKind kind) {
+  return (static_cast<std::uint64_t>(id) << 8) | kind;
+}
+
+/**
+ * Wraps `apply(device)` into a WorkerPool task, the device is resolved again when the task runs
+ */
+template <typename T, typename Apply>
+static WorkerPool::Task device_task(std::shared_ptr<DeviceHandles> handles, DeviceHandles::Id id, Apply apply) {
+  return [handles = std::move(handles), id, apply = std::move(apply)]() {
+    auto guard = handles->read();
+    if (auto device = handles->get<T>(guard, id).device) { // might have been removed in the meantime
+      apply(*device);
+    }
+  };
+}
+
+/**
+ * The id is resolved right away (so that errors can be reported) but the event itself is applied on the worker of the
+ * client, the response doesn't wait for it. `submit(id)` queues the task, it's only called once the device is found.
+ */
+template <typename T, typename Submit>
+static void queue_event(const std::shared_ptr<DeviceHandles> &handles,
+                        const httplib::Request &req,
+                        httplib::Response &res,
+                        const Submit &submit) {
+  {
+    auto guard = handles->read();
+    if (!resolve_device<T>(*handles, guard, req, res)) {
+      return;
+    }
+  }
+
+  if (!submit(*DeviceHandles::parse_id(req.path_params.at("id")))) {
+    handle_error(res, "Too many pending events", httplib::StatusCode::ServiceUnavailable_503);
+    return;
+  }
+  res.set_content(json{{"success", true}}.dump(), "application/json");
+}
+
+/**
+ * Runs `read(payload)` on the HTTP thread: a malformed request is answered with a 400, instead of failing later on
+ * the worker once the client has already been told that the event has been queued.
+ * The tasks only capture what `read` returns, never the json.
+ */
+template <typename Read>
+static auto read_payload(const httplib::Request &req, httplib::Response &res, const Read &read)
+    -> std::optional<decltype(read(json::parse(req.body)))> {
+  try {
+    return read(json::parse(req.body));
+  } catch (const json::exception &e) {
+    handle_error(res, std::string("Invalid payload: ") + e.what(), httplib::StatusCode::BadRequest_400);
+    return std::nullopt;
+  }
+}
+
+/**
+ * Handler for device events: `read(payload)` extracts the arguments, then `apply(device, args)` runs on the worker,
+ * see queue_event()
+ */
+template <typename T, typename Read, typename Apply>
+static httplib::Server::Handler device_event(std::shared_ptr<DeviceHandles> handles,
+                                             std::shared_ptr<WorkerPool> workers,
+                                             Read read,
+                                             Apply apply,
+                                             WorkerPool::Priority priority = WorkerPool::Priority::NORMAL) {
+  return [handles, workers, read, apply, priority](const httplib::Request &req, httplib::Response &res) {
+    auto args = read_payload(req, res, read);
+    if (!args) {
+      return;
+    }
+    queue_event<T>(handles, req, res, [&](DeviceHandles::Id id) {
+      auto task = device_task<T>(handles, id, [apply, args = std::move(*args)](T &device) { apply(device, args); });
+      return workers->submit(req.remote_addr, std::move(task), priority);
+    });
+  };
+}
+
+/**
+ * Handler for absolute values (positions...): an update that is still queued is replaced by the new one
+ */
+template <typename T, typename Read, typename Apply>
+static httplib::Server::Handler latest_event(std::shared_ptr<DeviceHandles> handles,
+                                             std::shared_ptr<WorkerPool> workers,
+                                             MotionKind kind,
+                                             Read read,
+                                             Apply apply) {
+  return [handles, workers, kind, read, apply](const httplib::Request &req, httplib::Response &res) {
+    auto args = read_payload(req, res, read);
+    if (!args) {
+      return;
+    }
+    queue_event<T>(handles, req, res, [&](DeviceHandles::Id id) {
+      auto task = device_task<T>(handles, id, [apply, args = std::move(*args)](T &device) { apply(device, args); });
+      return workers->submit(req.remote_addr, std::move(task), WorkerPool::Priority::MOTION, coalesce_key(id, kind));
+    });
+  };
+}
+
+/**
+ * Relative motion (or scroll) that is waiting to be applied, each task applies its own Delta. When a task is
+ * coalesced, the Delta of the task it replaces is added to its own so that no motion is lost.
+ */
+class PendingDeltas {
+public:
+  struct Delta {
+    double x = 0;
+    double y = 0;
+  };
+
+  /**
+   * Queues the task returned by `make_task(delta)`, which must only read `delta` through take()
+   */
+  template <typename MakeTask>
+  bool submit(WorkerPool &workers, std::string_view client_id, std::uint64_t key, Delta delta, MakeTask make_task) {
+    auto pending = std::make_shared<Delta>(delta);
+    std::lock_guard lock(m); // until `pending` is complete, its task might already be running
+    bool coalesced = false;
+    if (!workers.submit(client_id, make_task(pending), WorkerPool::Priority::MOTION, key, &coalesced)) {
+      return false;
+    }
+    auto &queued = waiting[key];
+    if (coalesced && queued) { // the previous task won't run, we have to apply its delta
+      pending->x += queued->x;
+      pending->y += queued->y;
+    }
+    queued = pending;
+    return true;
+  }
+
+  Delta take(std::uint64_t key, const std::shared_ptr<Delta> &delta) {
+    std::lock_guard lock(m);
+    if (auto queued = waiting.find(key); queued != waiting.end() && queued->second == delta) {
+      waiting.erase(queued);
+    }
+    return *delta;
+  }
+
+private:
+  std::mutex m;
+  std::unordered_map<std::uint64_t, std::shared_ptr<Delta>> waiting; // by coalesce key, the latest task queued
+};
+
+/**
+ * Handler for relative values (motion, scroll): `read(payload)` returns the kind and the delta, and once the task
+ * runs `apply(device, kind, x, y)` is called with the sum of the deltas that have been coalesced into it
+ */
+template <typename T, typename Read, typename Apply>
+static httplib::Server::Handler
+relative_event(std::shared_ptr<DeviceHandles> handles, std::shared_ptr<WorkerPool> workers, Read read, Apply apply) {
+  auto pending = std::make_shared<PendingDeltas>();
+  return [handles, workers, pending, read, apply](const httplib::Request &req, httplib::Response &res) {
+    auto delta = read_payload(req, res, read);
+    if (!delta) {
+      return;
+    }
+    auto [kind, x, y] = *delta;
+    queue_event<T>(handles, req, res, [&, kind = kind, x = x, y = y](DeviceHandles::Id id) {
+      auto key = coalesce_key(id, kind);
+      return pending->submit(*workers, req.remote_addr, key, {x, y}, [&](std::shared_ptr<PendingDeltas::Delta> delta) {
+        return device_task<T>(handles, id, [pending, key, kind, delta, apply](T &device) {
+          auto total = pending->take(key, delta);
+          if (total.x != 0 || total.y != 0) {
+            apply(device, kind, total.x, total.y);
+          }
+        });
+      });
+    });
+  };
 }
 
 /**
@@ -43,170 +298,270 @@ static inputtino::Mouse::MOUSE_BUTTON to_mouse_button(const std::string &button)
   }
 }
 
-std::unique_ptr<httplib::Server> setup_rest_server(std::shared_ptr<immer::atom<ServerState>> state) {
+/**
+ * @param workers where the device events are applied, see WorkerPool
+ */
+std::unique_ptr<httplib::Server>
+setup_rest_server(std::shared_ptr<immer::atom<ServerState>> state,
+                  std::shared_ptr<WorkerPool> workers = std::make_shared<WorkerPool>(1)) {
   auto svr = std::make_unique<httplib::Server>();
+  auto handles = state->load()->handles; // shared by all the versions of the state
 
   svr->Get("/api/v1.0/devices", [state](const httplib::Request &, httplib::Response &res) {
     res.set_content(json(state->load()).dump(), "application/json");
   });
 
-  svr->Post("/api/v1.0/devices/add", [state](const httplib::Request &req, httplib::Response &res) {
+  if constexpr (inputtino::metrics_enabled()) {
+    svr->Get("/metrics", [state](const httplib::Request &, httplib::Response &res) {
+      res.set_content(to_prometheus(*state->load()), "text/plain; version=0.0.4");
+    });
+  }
+
+  svr->Post("/api/v1.0/devices/add", [state, handles](const httplib::Request &req, httplib::Response &res) {
     auto payload = json::parse(req.body);
+    auto device_type = to_lower((std::string)payload.at("type"));
 
-    state->update([&](const ServerState &state) {
-      auto device_type = to_lower((std::string)payload.at("type"));
-      ServerState new_state = state;
-      LocalDevice new_device = {.client_id = req.remote_addr};
-      bool success = false;
-      switch (hash(device_type)) {
-      case hash("keyboard"): {
-        auto keyboard = inputtino::Keyboard::create();
-        success = handle_device(keyboard, res, new_device);
-        new_device.type = DeviceType::KEYBOARD;
-        break;
-      }
-      case hash("joypad"): {
-        //                    auto joypad_type = to_lower((std::string) payload.value("joypad_type", "xbox"));
-        //                    inputtino::Joypad::CONTROLLER_TYPE type;
-        //                    switch (hash(joypad_type)) {
-        //                        case hash("xbox"):
-        //                            type = inputtino::Joypad::CONTROLLER_TYPE::XBOX;
-        //                            break;
-        //                        case hash("ps"):
-        //                            type = inputtino::Joypad::CONTROLLER_TYPE::PS;
-        //                            break;
-        //                        case hash("nintendo"):
-        //                            type = inputtino::Joypad::CONTROLLER_TYPE::NINTENDO;
-        //                            break;
-        //                        default:
-        //                            handle_error(res, "Unknown joypad type: " + joypad_type);
-        //                    }
-        //
-        //                    // TODO: ["ANALOG_TRIGGERS, "RUMBLE"] --> uint8_t
-        //                    uint8_t capabilities = payload.value("capabilities", 0);
-        //
-        //                    auto joypad = inputtino::Joypad::create(type, capabilities);
-        //                    success = handle_device(joypad, res, new_device);
-        //                    new_device.type = DeviceType::JOYPAD;
-        break;
-      }
-      case hash("mouse"): {
-        auto mouse = inputtino::Mouse::create();
-        success = handle_device(mouse, res, new_device);
-        new_device.type = DeviceType::MOUSE;
-        break;
-      }
-      case hash("touchscreen"): {
-        auto touch = inputtino::TouchScreen::create();
-        success = handle_device(touch, res, new_device);
-        new_device.type = DeviceType::TOUCH_SCREEN;
+    // Creating the device can take a while, only the insertion in the state is done in update()
+    LocalDevice new_device = {.client_id = req.remote_addr};
+    bool success = false;
+    switch (hash(device_type)) {
+    case hash("keyboard"): {
+      auto keyboard = inputtino::Keyboard::create();
+      success = handle_device(keyboard, res, new_device, *handles);
+      new_device.type = DeviceType::KEYBOARD;
+      break;
+    }
+    case hash("joypad"): {
+      auto joypad_type = to_lower(payload.value("joypad_type", "xbox"));
+      switch (hash(joypad_type)) {
+      case hash("xbox"): {
+        auto joypad = inputtino::XboxOneJoypad::create();
+        success = handle_joypad(joypad, res, new_device, *handles);
         break;
       }
-      case hash("pen_tablet"): {
-        auto pen = inputtino::PenTablet::create();
-        success = handle_device(pen, res, new_device);
-        new_device.type = DeviceType::PEN_TABLET;
+      case hash("ps"):
+      case hash("ps5"): {
+        auto joypad = inputtino::PS5Joypad::create();
+        success = handle_joypad(joypad, res, new_device, *handles);
         break;
       }
-      case hash("trackpad"): {
-        auto trackpad = inputtino::Trackpad::create();
-        success = handle_device(trackpad, res, new_device);
-        new_device.type = DeviceType::TRACKPAD;
+      case hash("nintendo"):
+      case hash("switch"): {
+        auto joypad = inputtino::SwitchJoypad::create();
+        success = handle_joypad(joypad, res, new_device, *handles);
         break;
       }
       default:
-        handle_error(res, "Unknown device type: " + device_type);
+        handle_error(res, "Unknown joypad type: " + joypad_type, httplib::StatusCode::BadRequest_400);
         break;
       }
+      new_device.type = DeviceType::JOYPAD;
+      break;
+    }
+    case hash("mouse"): {
+      auto mouse = inputtino::Mouse::create();
+      success = handle_device(mouse, res, new_device, *handles);
+      new_device.type = DeviceType::MOUSE;
+      break;
+    }
+    case hash("touchscreen"): {
+      auto touch = inputtino::TouchScreen::create();
+      success = handle_device(touch, res, new_device, *handles);
+      new_device.type = DeviceType::TOUCH_SCREEN;
+      break;
+    }
+    case hash("pen_tablet"): {
+      auto pen = inputtino::PenTablet::create();
+      success = handle_device(pen, res, new_device, *handles);
+      new_device.type = DeviceType::PEN_TABLET;
+      break;
+    }
+    case hash("trackpad"): {
+      auto trackpad = inputtino::Trackpad::create();
+      success = handle_device(trackpad, res, new_device, *handles);
+      new_device.type = DeviceType::TRACKPAD;
+      break;
+    }
+    default:
+      handle_error(res, "Unknown device type: " + device_type);
+      break;
+    }
 
-      if (success) {
-        res.set_content(json(new_device).dump(), "application/json");
-        new_state.devices = state.devices.set(new_device.device_id, std::move(new_device));
-      }
+    if (success) {
+      res.set_content(json(new_device).dump(), "application/json");
+      state->update([&new_device](const ServerState &state) {
+        ServerState new_state = state;
+        new_state.devices = state.devices.set(new_device.device_id, new_device);
+        return new_state;
+      });
+    }
+  });
 
+  svr->Delete("/api/v1.0/devices/:id", [state, handles](const httplib::Request &req, httplib::Response &res) {
+    auto id = DeviceHandles::parse_id(req.path_params.at("id"));
+    if (!id) {
+      handle_error(res, "Invalid device id: " + req.path_params.at("id"), httplib::StatusCode::BadRequest_400);
+      return;
+    }
+    handles->remove(*id); // Wait for in flight events before the device is released below
+    state->update([id = *id](const ServerState &state) {
+      ServerState new_state = state;
+      new_state.devices = state.devices.erase(id);
       return new_state;
     });
-  });
-
-  svr->Delete("/api/v1.0/devices/:id", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    state->update([id](const ServerState &state) { return ServerState{.devices = state.devices.erase(id)}; });
     res.set_content(json{{"success", true}}.dump(), "application/json");
   });
 
   /* Mouse handlers */
-  svr->Post("/api/v1.0/devices/mouse/:id/move_rel", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto mouse = std::get<std::shared_ptr<inputtino::Mouse>>(device->device);
-    mouse->move(payload.value("delta_x", 0.0), payload.value("delta_y", 0.0));
-    res.set_content(json{{"success", true}}.dump(), "application/json");
-  });
+  /*
+   * Button and key transitions are CRITICAL, motion is coalesced while it's waiting to be applied: a client that floods
+   * the server with motion doesn't delay its own (or other clients') key releases, see WorkerPool
+   */
+  svr->Post("/api/v1.0/devices/mouse/:id/move_rel",
+            relative_event<inputtino::Mouse>(
+                handles,
+                workers,
+                [](const json &payload) {
+                  return std::tuple{MOVE_REL, payload.value("delta_x", 0.0), payload.value("delta_y", 0.0)};
+                },
+                [](inputtino::Mouse &mouse, MotionKind, double x, double y) { mouse.move(x, y); }));
 
-  svr->Post("/api/v1.0/devices/mouse/:id/move_abs", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto mouse = std::get<std::shared_ptr<inputtino::Mouse>>(device->device);
-    mouse->move_abs(payload.value("abs_x", 0.0),
-                    payload.value("abs_y", 0.0),
-                    payload.value("screen_width", 0.0),
-                    payload.value("screen_height", 0.0));
-    res.set_content(json{{"success", true}}.dump(), "application/json");
-  });
+  /* Linear acceleration: gain = factor + acceleration * speed (units/ms), up to max_gain; an empty payload disables it */
+  svr->Post("/api/v1.0/devices/mouse/:id/acceleration",
+            device_event<inputtino::Mouse>(
+                handles,
+                workers,
+                [](const json &payload) -> std::optional<inputtino::PointerAcceleration> {
+                  if (!payload.contains("factor")) {
+                    return std::nullopt;
+                  }
+                  auto factor = payload.value("factor", 1.0);
+                  return inputtino::PointerAcceleration::linear(factor,
+                                                                payload.value("acceleration", 0.0),
+                                                                payload.value("max_gain", factor));
+                },
+                [](inputtino::Mouse &mouse, const std::optional<inputtino::PointerAcceleration> &acceleration) {
+                  mouse.set_acceleration(acceleration);
+                }));
 
-  svr->Post("/api/v1.0/devices/mouse/:id/press", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto mouse = std::get<std::shared_ptr<inputtino::Mouse>>(device->device);
-    mouse->press(to_mouse_button(payload.value("button", "LEFT")));
-    res.set_content(json{{"success", true}}.dump(), "application/json");
-  });
+  svr->Post("/api/v1.0/devices/mouse/:id/move_abs",
+            latest_event<inputtino::Mouse>(
+                handles,
+                workers,
+                MOVE_ABS,
+                [](const json &payload) {
+                  return std::array{payload.value("abs_x", 0.0),
+                                    payload.value("abs_y", 0.0),
+                                    payload.value("screen_width", 0.0),
+                                    payload.value("screen_height", 0.0)};
+                },
+                [](inputtino::Mouse &mouse, const std::array<double, 4> &position) {
+                  mouse.move_abs(position[0], position[1], position[2], position[3]);
+                }));
 
-  svr->Post("/api/v1.0/devices/mouse/:id/release", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto mouse = std::get<std::shared_ptr<inputtino::Mouse>>(device->device);
-    mouse->release(to_mouse_button(payload.value("button", "LEFT")));
-    res.set_content(json{{"success", true}}.dump(), "application/json");
-  });
+  svr->Post("/api/v1.0/devices/mouse/:id/press",
+            device_event<inputtino::Mouse>(
+                handles,
+                workers,
+                [](const json &payload) { return to_mouse_button(payload.value("button", "LEFT")); },
+                [](inputtino::Mouse &mouse, inputtino::Mouse::MOUSE_BUTTON button) { mouse.press(button); },
+                WorkerPool::Priority::CRITICAL));
 
-  svr->Post("/api/v1.0/devices/mouse/:id/scroll", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto mouse = std::get<std::shared_ptr<inputtino::Mouse>>(device->device);
-    switch (hash(to_lower(payload.value("direction", "vertical")))) {
-    case hash("vertical"):
-      mouse->vertical_scroll(payload.value("distance", 0.0));
-      break;
-    case hash("horizontal"):
-      mouse->horizontal_scroll(payload.value("distance", 0.0));
-      break;
-    }
-    res.set_content(json{{"success", true}}.dump(), "application/json");
-  });
+  svr->Post("/api/v1.0/devices/mouse/:id/release",
+            device_event<inputtino::Mouse>(
+                handles,
+                workers,
+                [](const json &payload) { return to_mouse_button(payload.value("button", "LEFT")); },
+                [](inputtino::Mouse &mouse, inputtino::Mouse::MOUSE_BUTTON button) { mouse.release(button); },
+                WorkerPool::Priority::CRITICAL));
+
+  svr->Post("/api/v1.0/devices/mouse/:id/scroll",
+            relative_event<inputtino::Mouse>(
+                handles,
+                workers,
+                [](const json &payload) {
+                  switch (hash(to_lower(payload.value("direction", "vertical")))) {
+                  case hash("vertical"):
+                    return std::tuple{SCROLL_VERTICAL, payload.value("distance", 0.0), 0.0};
+                  case hash("horizontal"):
+                    return std::tuple{SCROLL_HORIZONTAL, payload.value("distance", 0.0), 0.0};
+                  default:
+                    return std::tuple{SCROLL_VERTICAL, 0.0, 0.0}; // nothing to apply
+                  }
+                },
+                [](inputtino::Mouse &mouse, MotionKind kind, double distance, double) {
+                  if (kind == SCROLL_HORIZONTAL) {
+                    mouse.horizontal_scroll(static_cast<int>(distance));
+                  } else {
+                    mouse.vertical_scroll(static_cast<int>(distance));
+                  }
+                }));
 
   /* Keyboard handlers */
-  svr->Post("/api/v1.0/devices/keyboard/:id/press", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto keyboard = std::get<std::shared_ptr<inputtino::Keyboard>>(device->device);
-    keyboard->press(payload.at("key"));
-    res.set_content(json{{"success", true}}.dump(), "application/json");
-  });
+  svr->Post("/api/v1.0/devices/keyboard/:id/press",
+            device_event<inputtino::Keyboard>(
+                handles,
+                workers,
+                [](const json &payload) { return payload.at("key").get<short>(); },
+                [](inputtino::Keyboard &keyboard, short key) { keyboard.press(key); },
+                WorkerPool::Priority::CRITICAL));
 
-  svr->Post("/api/v1.0/devices/keyboard/:id/release", [state](const httplib::Request &req, httplib::Response &res) {
-    std::size_t id = std::stoul(req.path_params.at("id"));
-    auto payload = json::parse(req.body);
-    auto device = state->load()->devices.at(id);
-    auto keyboard = std::get<std::shared_ptr<inputtino::Keyboard>>(device->device);
-    keyboard->release(payload.at("key"));
-    res.set_content(json{{"success", true}}.dump(), "application/json");
+  svr->Post("/api/v1.0/devices/keyboard/:id/release",
+            device_event<inputtino::Keyboard>(
+                handles,
+                workers,
+                [](const json &payload) { return payload.at("key").get<short>(); },
+                [](inputtino::Keyboard &keyboard, short key) { keyboard.release(key); },
+                WorkerPool::Priority::CRITICAL));
+
+  /* Joypad handlers */
+  /*
+   * Server-Sent Events: `rumble` ({"low_freq", "high_freq"}) and `led` ({"r", "g", "b"}, PS5 only) are sent as soon
+   * as they change, updates that come in faster than they can be sent are coalesced (latest value wins).
+   * Each stream keeps one of the HTTP threads busy until the client disconnects or the joypad is removed.
+   */
+  svr->Get("/api/v1.0/devices/joypad/:id/feedback", [state](const httplib::Request &req, httplib::Response &res) {
+    auto id = DeviceHandles::parse_id(req.path_params.at("id"));
+    if (!id) {
+      handle_error(res, "Invalid device id: " + req.path_params.at("id"), httplib::StatusCode::BadRequest_400);
+      return;
+    }
+    auto device = state->load()->devices.find(*id);
+    if (!device || !device->get().feedback) {
+      handle_error(res, "Joypad not found: " + std::to_string(*id), httplib::StatusCode::NotFound_404);
+      return;
+    }
+    auto feedback = device->get().feedback;
+    if (feedback->streaming.exchange(true)) {
+      handle_error(res, "Feedback is already being streamed", httplib::StatusCode::Conflict_409);
+      return;
+    }
+
+    res.set_header("Cache-Control", "no-cache");
+    res.set_chunked_content_provider(
+        "text/event-stream",
+        [state, id = *id, feedback](std::size_t, httplib::DataSink &sink) {
+          auto update = feedback->mailbox->wait(std::chrono::seconds(1));
+          std::string events;
+          if (update.rumble) {
+            events += "event: rumble\ndata: " +
+                      json{{"low_freq", update.rumble->low_freq}, {"high_freq", update.rumble->high_freq}}.dump() +
+                      "\n\n";
+          }
+          if (update.led) {
+            events += "event: led\ndata: " +
+                      json{{"r", update.led->r}, {"g", update.led->g}, {"b", update.led->b}}.dump() + "\n\n";
+          }
+          if (events.empty()) {
+            if (!state->load()->devices.find(id)) { // the joypad has been removed
+              sink.done();
+              return true;
+            }
+            events = ": keep-alive\n\n"; // also lets us notice clients that are gone
+          }
+          return sink.write(events.data(), events.size());
+        },
+        [feedback](bool) { feedback->streaming = false; });
   });
 
   /* Default error handling */
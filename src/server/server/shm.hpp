@@ -0,0 +1,505 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <immer/atom.hpp>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <server/data_model.hpp>
+#include <server/stream.hpp>
+#include <server/workers.hpp>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A shared memory alternative to the stream server, for producers running on the same host as the server.
+ *
+ * Producers connect to a unix socket (SOCK_SEQPACKET) and get back a single message carrying two file descriptors
+ * (SCM_RIGHTS): a memfd holding the ring and an eventfd, the doorbell. The connection is kept open for the whole
+ * session, closing it releases the ring; the replies to SYNC messages are sent on it (same format as the stream
+ * server).
+ *
+ * The memfd is a RingHeader followed by `capacity` bytes (a power of two). The ring carries messages in the same format
+ * as the stream protocol, see stream.hpp; `head` and `tail` only grow, the byte at position `p` is stored at
+ * `p % capacity`, so messages can wrap around the end. There's a single producer for each ring:
+ *   1. wait until `capacity - (tail - head)` is enough for the messages
+ *   2. copy the messages in, then store the new `tail`
+ *   3. if `consumer_waiting` is set, clear it and write 1 to the doorbell
+ * As long as the server keeps up, `consumer_waiting` stays clear and writing events doesn't take any syscall.
+ * The server drains the rings on the WorkerPool, with the same per client ordering as the REST events.
+ */
+namespace shm {
+
+constexpr std::uint32_t MAGIC = 0x52535449; // "ITSR"
+constexpr std::uint32_t VERSION = 1;
+constexpr std::size_t DEFAULT_CAPACITY = 256 * 1024;
+
+struct RingHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t capacity;
+  /* Each one on its own cache line: the producer only writes `tail`, the server only writes `head` */
+  alignas(64) std::atomic<std::uint64_t> head;
+  alignas(64) std::atomic<std::uint64_t> tail;
+  alignas(64) std::atomic<std::uint32_t> consumer_waiting;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "The ring is shared between processes, the atomics can't be implemented with a lock");
+
+/**
+ * One side (producer or server) of a ring mapped in memory
+ */
+class Ring {
+public:
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  ~Ring() {
+    munmap(mapping, mapping_size);
+    close(memfd);
+  }
+
+  /**
+   * Server side: creates the memfd, `capacity` is rounded up to a power of two
+   */
+  static std::unique_ptr<Ring> create(std::size_t capacity = DEFAULT_CAPACITY) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+
+    int fd = memfd_create("inputtino-ring", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(sizeof(RingHeader) + size)) < 0) {
+      std::cerr << "[SHM] Unable to create ring: " << strerror(errno) << std::endl;
+      if (fd >= 0) {
+        close(fd);
+      }
+      return nullptr;
+    }
+    auto ring = map(fd, sizeof(RingHeader) + size);
+    if (ring) {
+      auto header = ring->header();
+      header->magic = MAGIC;
+      header->version = VERSION;
+      header->capacity = size;
+      header->head = 0;
+      header->tail = 0;
+      header->consumer_waiting = 1; // nothing is being drained yet
+    }
+    return ring;
+  }
+
+  /**
+   * Producer side: maps the memfd received from the server, takes ownership of `fd`
+   */
+  static std::unique_ptr<Ring> open(int fd) {
+    struct stat info {};
+    if (fstat(fd, &info) < 0 || static_cast<std::size_t>(info.st_size) <= sizeof(RingHeader)) {
+      close(fd);
+      return nullptr;
+    }
+    auto ring = map(fd, static_cast<std::size_t>(info.st_size));
+    if (ring && (ring->header()->magic != MAGIC || ring->header()->version != VERSION ||
+                 ring->header()->capacity != ring->capacity() || (ring->capacity() & (ring->capacity() - 1)) != 0)) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  RingHeader *header() const {
+    return static_cast<RingHeader *>(mapping);
+  }
+
+  /**
+   * Computed from the size of the mapping, never read back from the header: the other side can write anything in there
+   */
+  std::size_t capacity() const {
+    return ring_capacity;
+  }
+
+  int fd() const {
+    return memfd;
+  }
+
+  /**
+   * Producer side: appends `size` bytes, returns false (and writes nothing) if there isn't enough room for all of them
+   */
+  bool write(const std::uint8_t *bytes, std::size_t size) {
+    auto tail = header()->tail.load(std::memory_order_relaxed);
+    auto head = header()->head.load(std::memory_order_acquire);
+    if (capacity() - (tail - head) < size) {
+      return false;
+    }
+    copy_in(tail, bytes, size);
+    header()->tail.store(tail + size, std::memory_order_seq_cst); // ordered with the consumer_waiting check after it
+    return true;
+  }
+
+  /**
+   * Copies `size` bytes starting at position `from` out of the ring
+   */
+  void copy_out(std::uint64_t from, std::uint8_t *bytes, std::size_t size) const {
+    auto pos = static_cast<std::size_t>(from & (capacity() - 1));
+    auto first = std::min(size, capacity() - pos);
+    std::memcpy(bytes, data() + pos, first);
+    std::memcpy(bytes + first, data(), size - first);
+  }
+
+private:
+  Ring(int memfd, void *mapping, std::size_t mapping_size)
+      : memfd(memfd), mapping(mapping), mapping_size(mapping_size), ring_capacity(mapping_size - sizeof(RingHeader)) {}
+
+  static std::unique_ptr<Ring> map(int fd, std::size_t size) {
+    auto mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+      std::cerr << "[SHM] Unable to map ring: " << strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<Ring>(new Ring(fd, mapping, size));
+  }
+
+  std::uint8_t *data() const {
+    return static_cast<std::uint8_t *>(mapping) + sizeof(RingHeader);
+  }
+
+  void copy_in(std::uint64_t to, const std::uint8_t *bytes, std::size_t size) {
+    auto pos = static_cast<std::size_t>(to & (capacity() - 1));
+    auto first = std::min(size, capacity() - pos);
+    std::memcpy(data() + pos, bytes, first);
+    std::memcpy(data(), bytes + first, size - first);
+  }
+
+  int memfd;
+  void *mapping;
+  std::size_t mapping_size;
+  std::size_t ring_capacity;
+};
+
+/**
+ * The producer side of a connection to a ShmServer, see the protocol description above.
+ * A single thread should write to it at a time.
+ */
+class Producer {
+public:
+  Producer(const Producer &) = delete;
+  Producer &operator=(const Producer &) = delete;
+
+  ~Producer() {
+    close(doorbell);
+    close(socket_fd);
+  }
+
+  static std::unique_ptr<Producer> connect(const std::string &path) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{.sun_family = AF_UNIX};
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+      std::cerr << "[SHM] Unable to connect to " << path << ": " << strerror(errno) << std::endl;
+      if (fd >= 0) {
+        close(fd);
+      }
+      return nullptr;
+    }
+
+    std::uint32_t version = 0;
+    iovec iov{.iov_base = &version, .iov_len = sizeof(version)};
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(int))> control{};
+    msghdr msg{.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.data(), .msg_controllen = control.size()};
+    auto received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    auto cmsg = received == sizeof(version) ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (!cmsg || version != VERSION || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+      std::cerr << "[SHM] Unexpected handshake from " << path << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    int fds[2];
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    auto ring = Ring::open(fds[0]);
+    if (!ring) {
+      close(fds[1]);
+      close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<Producer>(new Producer(fd, std::move(ring), fds[1]));
+  }
+
+  /**
+   * Appends complete messages to the ring, returns false (and writes nothing) when the ring is full
+   */
+  bool write(const std::uint8_t *messages, std::size_t size) {
+    if (!ring->write(messages, size)) {
+      return false;
+    }
+    if (ring->header()->consumer_waiting.exchange(0, std::memory_order_seq_cst) != 0) {
+      std::uint64_t ring_it = 1;
+      ::write(doorbell, &ring_it, sizeof(ring_it));
+    }
+    return true;
+  }
+
+  /**
+   * Where the replies to SYNC messages can be read from
+   */
+  int sync_fd() const {
+    return socket_fd;
+  }
+
+private:
+  Producer(int socket_fd, std::unique_ptr<Ring> ring, int doorbell)
+      : socket_fd(socket_fd), ring(std::move(ring)), doorbell(doorbell) {}
+
+  int socket_fd;
+  std::unique_ptr<Ring> ring;
+  int doorbell;
+};
+
+} // namespace shm
+
+/**
+ * Accepts shared memory producers on a unix socket and drains their rings on the WorkerPool, see the protocol
+ * description above
+ */
+class ShmServer {
+public:
+  ShmServer(std::shared_ptr<immer::atom<ServerState>> state,
+            std::shared_ptr<WorkerPool> workers,
+            std::size_t ring_capacity = shm::DEFAULT_CAPACITY)
+      : handles(state->load()->handles), workers(std::move(workers)), ring_capacity(ring_capacity) {}
+
+  ShmServer(const ShmServer &) = delete;
+  ShmServer &operator=(const ShmServer &) = delete;
+
+  ~ShmServer() {
+    stop();
+  }
+
+  /**
+   * Creates the socket at `path` (replacing any stale one) and starts serving producers on a background thread;
+   * access to the socket is controlled by the file permissions (umask)
+   */
+  bool listen(const std::string &path) {
+    sockaddr_un addr{.sun_family = AF_UNIX};
+    if (path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "[SHM] Socket path too long: " << path << std::endl;
+      return false;
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd, 16) < 0) {
+      std::cerr << "[SHM] Unable to listen on " << path << " " << strerror(errno) << std::endl;
+      close_fd(listen_fd);
+      return false;
+    }
+    socket_path = path;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    watch(listen_fd, EPOLLIN);
+    watch(wake_fd, EPOLLIN);
+
+    running = true;
+    poll_thread = std::thread([this]() { poll_loop(); });
+    return true;
+  }
+
+  void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    std::uint64_t wake = 1;
+    write(wake_fd, &wake, sizeof(wake));
+    poll_thread.join();
+
+    clients.clear(); // pending drains keep their client alive until they are done
+    close_fd(listen_fd);
+    close_fd(wake_fd);
+    close_fd(epoll_fd);
+    unlink(socket_path.c_str());
+  }
+
+private:
+  static void close_fd(int &fd) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  struct Client {
+    std::string id; // for the WorkerPool
+    int socket_fd = -1;
+    int doorbell = -1;
+    std::unique_ptr<shm::Ring> ring;
+    std::uint64_t head = 0; // our own copy, the one in shared memory is only written to
+    std::atomic<bool> drain_scheduled = false;
+    std::vector<std::uint8_t> buffer = std::vector<std::uint8_t>(64 * 1024);
+
+    ~Client() {
+      close_fd(doorbell);
+      close_fd(socket_fd);
+    }
+  };
+
+  void watch(int fd, std::uint32_t events) {
+    epoll_event ev{.events = events, .data = {.fd = fd}};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  void poll_loop() {
+    std::array<epoll_event, 64> events{};
+    while (running) {
+      auto ready = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+      for (int i = 0; i < ready; i++) {
+        auto fd = events[i].data.fd;
+        if (fd == wake_fd) {
+          continue;
+        } else if (fd == listen_fd) {
+          accept_client();
+        } else if (auto client = clients.find(fd); client != clients.end()) {
+          if (fd == client->second->doorbell) {
+            std::uint64_t count;
+            read(fd, &count, sizeof(count));
+            schedule_drain(client->second);
+          } else {
+            std::uint8_t ignored;
+            if (recv(fd, &ignored, sizeof(ignored), MSG_DONTWAIT) == 0 || (events[i].events & (EPOLLHUP | EPOLLERR))) {
+              remove_client(client->second);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void accept_client() {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+      return;
+    }
+    auto client = std::make_shared<Client>();
+    client->id = "shm-" + std::to_string(next_client++);
+    client->socket_fd = fd;
+    client->doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    client->ring = shm::Ring::create(ring_capacity);
+    if (client->doorbell < 0 || !client->ring) {
+      return; // closes the socket, the producer will see the connection drop
+    }
+
+    std::uint32_t version = shm::VERSION;
+    iovec iov{.iov_base = &version, .iov_len = sizeof(version)};
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(int))> control{};
+    msghdr msg{.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.data(), .msg_controllen = control.size()};
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int fds[2] = {client->ring->fd(), client->doorbell};
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(version)) {
+      std::cerr << "[SHM] Unable to send the ring to " << client->id << ": " << strerror(errno) << std::endl;
+      return;
+    }
+
+    clients[client->socket_fd] = client;
+    clients[client->doorbell] = client;
+    watch(client->socket_fd, EPOLLIN | EPOLLRDHUP);
+    watch(client->doorbell, EPOLLIN);
+  }
+
+  void remove_client(const std::shared_ptr<Client> &client) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->socket_fd, nullptr);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->doorbell, nullptr);
+    auto keep_alive = client; // the erase below would otherwise destroy the client we're working on
+    clients.erase(keep_alive->socket_fd);
+    clients.erase(keep_alive->doorbell);
+  }
+
+  void schedule_drain(const std::shared_ptr<Client> &client) {
+    if (client->drain_scheduled.exchange(true)) {
+      return; // the drain that is already queued will pick up the new messages
+    }
+    if (!workers->submit(client->id, [client, handles = handles]() { drain(*client, *handles); })) {
+      client->drain_scheduled = false;
+      client->ring->header()->consumer_waiting = 1; // let the next write ring the doorbell again
+    }
+  }
+
+  /**
+   * Applies all the complete messages in the ring, then goes back to waiting for the doorbell
+   */
+  static void drain(Client &client, DeviceHandles &handles) {
+    client.drain_scheduled = false; // a doorbell that comes while draining schedules another run
+    auto header = client.ring->header();
+    auto send_sync = [&client](std::uint32_t sequence) {
+      std::array<std::uint8_t, stream::HEADER_SIZE + 4> reply{stream::SYNC, 4};
+      for (int i = 0; i < 4; i++) {
+        reply[stream::HEADER_SIZE + i] = static_cast<std::uint8_t>(sequence >> (8 * i));
+      }
+      send(client.socket_fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+    };
+
+    while (true) {
+      auto tail = header->tail.load(std::memory_order_acquire);
+      auto available = tail - client.head;
+      if (available > client.ring->capacity()) {
+        std::cerr << "[SHM] Invalid tail from " << client.id << ", dropping its messages" << std::endl;
+        client.head = tail;
+        header->head.store(client.head, std::memory_order_release);
+        available = 0;
+      }
+
+      if (available > 0) {
+        auto size = std::min<std::size_t>(available, client.buffer.size());
+        client.ring->copy_out(client.head, client.buffer.data(), size);
+        auto consumed = stream::process_batch(handles, client.buffer.data(), size, send_sync);
+        client.head += consumed;
+        header->head.store(client.head, std::memory_order_release);
+        if (consumed > 0) {
+          continue;
+        }
+      }
+
+      // Nothing left but (maybe) a partial message: ask for the doorbell, unless more has been written meanwhile
+      header->consumer_waiting.store(1, std::memory_order_seq_cst);
+      if (header->tail.load(std::memory_order_seq_cst) == tail) {
+        return;
+      }
+      header->consumer_waiting.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::shared_ptr<DeviceHandles> handles;
+  std::shared_ptr<WorkerPool> workers;
+  std::size_t ring_capacity;
+
+  std::string socket_path;
+  int listen_fd = -1;
+  int epoll_fd = -1;
+  int wake_fd = -1;
+  std::atomic<bool> running = false;
+  std::thread poll_thread;
+
+  /* Only used by the poll thread (and stop(), once it's gone); both fds of a client point to it */
+  std::unordered_map<int, std::shared_ptr<Client>> clients;
+  std::size_t next_client = 0;
+};
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <immer/atom.hpp>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <server/data_model.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * A persistent, binary, alternative to the REST endpoints for continuous input (mouse motion, joypad sticks...).
+ *
+ * Clients open a TCP connection and write a stream of messages, any number of messages can be batched in a
+ * single write. Devices are still created and removed through the REST API, the `device_id` is the same.
+ * Devices are resolved through the DeviceHandles table, the server state is never loaded on this path.
+ *
+ * Every message (all values are little endian):
+ *   | opcode: u8 | payload_size: u8 | device_id: u64 | payload: payload_size bytes |
+ *
+ * Nothing is sent back, except for SYNC: the server answers with the same message once all the messages that came
+ * before it have been applied, clients can use it as an optional sequence number (ex: to measure latency).
+ * Messages with an unknown opcode are skipped, so that new opcodes can be added without breaking old servers.
+ */
+namespace stream {
+
+enum OPCODE : std::uint8_t {
+  MOUSE_MOVE_REL = 0x01,    // delta_x: i16, delta_y: i16
+  MOUSE_MOVE_ABS = 0x02,    // x: u16, y: u16, screen_width: u16, screen_height: u16
+  MOUSE_PRESS = 0x03,       // button: u8 (inputtino::Mouse::MOUSE_BUTTON)
+  MOUSE_RELEASE = 0x04,     // button: u8 (inputtino::Mouse::MOUSE_BUTTON)
+  MOUSE_SCROLL_V = 0x05,    // high_res_distance: i16
+  MOUSE_SCROLL_H = 0x06,    // high_res_distance: i16
+  KEYBOARD_PRESS = 0x10,    // key_code: i16
+  KEYBOARD_RELEASE = 0x11,  // key_code: i16
+  JOYPAD_BUTTONS = 0x20,    // pressed: u32 (inputtino::Joypad::CONTROLLER_BTN)
+  JOYPAD_STICK = 0x21,      // stick: u8 (inputtino::Joypad::STICK_POSITION), x: i16, y: i16
+  JOYPAD_TRIGGERS = 0x22,   // left: i16, right: i16
+  SYNC = 0xF0               // sequence: u32, device_id is ignored
+};
+
+constexpr std::size_t HEADER_SIZE = 1 + 1 + 8;
+
+static std::uint16_t read_u16(const std::uint8_t *data) {
+  return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+}
+
+static std::int16_t read_i16(const std::uint8_t *data) {
+  return static_cast<std::int16_t>(read_u16(data));
+}
+
+static std::uint32_t read_u32(const std::uint8_t *data) {
+  return static_cast<std::uint32_t>(read_u16(data)) | (static_cast<std::uint32_t>(read_u16(data + 2)) << 16);
+}
+
+static std::uint64_t read_u64(const std::uint8_t *data) {
+  return static_cast<std::uint64_t>(read_u32(data)) | (static_cast<std::uint64_t>(read_u32(data + 4)) << 32);
+}
+
+/**
+ * Expected payload size for each opcode, -1 for unknown opcodes
+ */
+constexpr int payload_size(std::uint8_t opcode) {
+  switch (opcode) {
+  case MOUSE_MOVE_REL:
+    return 4;
+  case MOUSE_MOVE_ABS:
+    return 8;
+  case MOUSE_PRESS:
+  case MOUSE_RELEASE:
+    return 1;
+  case MOUSE_SCROLL_V:
+  case MOUSE_SCROLL_H:
+  case KEYBOARD_PRESS:
+  case KEYBOARD_RELEASE:
+    return 2;
+  case JOYPAD_BUTTONS:
+    return 4;
+  case JOYPAD_STICK:
+    return 5;
+  case JOYPAD_TRIGGERS:
+    return 4;
+  case SYNC:
+    return 4;
+  default:
+    return -1;
+  }
+}
+
+/**
+ * Applies a single message to the device, returns false if there's no device with the given id for this opcode
+ */
+static bool apply_message(const DeviceHandles &handles,
+                          const DeviceHandles::ReadGuard &guard,
+                          DeviceHandles::Id device_id,
+                          std::uint8_t opcode,
+                          const std::uint8_t *payload) {
+  switch (opcode) {
+  case MOUSE_MOVE_REL:
+  case MOUSE_MOVE_ABS:
+  case MOUSE_PRESS:
+  case MOUSE_RELEASE:
+  case MOUSE_SCROLL_V:
+  case MOUSE_SCROLL_H: {
+    auto mouse = handles.get<inputtino::Mouse>(guard, device_id).device;
+    if (!mouse) {
+      return false;
+    }
+    if (opcode == MOUSE_MOVE_REL) {
+      mouse->move(read_i16(payload), read_i16(payload + 2));
+    } else if (opcode == MOUSE_MOVE_ABS) {
+      mouse->move_abs(read_u16(payload), read_u16(payload + 2), read_u16(payload + 4), read_u16(payload + 6));
+    } else if (opcode == MOUSE_PRESS) {
+      mouse->press(static_cast<inputtino::Mouse::MOUSE_BUTTON>(payload[0]));
+    } else if (opcode == MOUSE_RELEASE) {
+      mouse->release(static_cast<inputtino::Mouse::MOUSE_BUTTON>(payload[0]));
+    } else if (opcode == MOUSE_SCROLL_V) {
+      mouse->vertical_scroll(read_i16(payload));
+    } else {
+      mouse->horizontal_scroll(read_i16(payload));
+    }
+    return true;
+  }
+  case KEYBOARD_PRESS:
+  case KEYBOARD_RELEASE: {
+    auto keyboard = handles.get<inputtino::Keyboard>(guard, device_id).device;
+    if (!keyboard) {
+      return false;
+    }
+    if (opcode == KEYBOARD_PRESS) {
+      keyboard->press(read_i16(payload));
+    } else {
+      keyboard->release(read_i16(payload));
+    }
+    return true;
+  }
+  case JOYPAD_BUTTONS:
+  case JOYPAD_STICK:
+  case JOYPAD_TRIGGERS: {
+    auto joypad = handles.get<inputtino::Joypad>(guard, device_id).device;
+    if (!joypad) {
+      return false;
+    }
+    if (opcode == JOYPAD_BUTTONS) {
+      joypad->set_pressed_buttons(read_u32(payload));
+    } else if (opcode == JOYPAD_STICK) {
+      joypad->set_stick(static_cast<inputtino::Joypad::STICK_POSITION>(payload[0]),
+                        read_i16(payload + 1),
+                        read_i16(payload + 3));
+    } else {
+      joypad->set_triggers(read_i16(payload), read_i16(payload + 2));
+    }
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/**
+ * Parses and applies all the complete messages in `data`, returns how many bytes have been consumed; any partial
+ * message at the end is left for the next read.
+ */
+template <typename OnSync>
+static std::size_t
+process_batch(DeviceHandles &handles, const std::uint8_t *data, std::size_t size, const OnSync &on_sync) {
+  auto guard = handles.read(); // a single guard for the whole batch
+  std::size_t pos = 0;
+  while (size - pos >= HEADER_SIZE) {
+    auto opcode = data[pos];
+    std::size_t msg_payload_size = data[pos + 1];
+    if (size - pos < HEADER_SIZE + msg_payload_size) {
+      break; // wait for the rest of the message
+    }
+
+    auto device_id = read_u64(data + pos + 2);
+    auto payload = data + pos + HEADER_SIZE;
+    if (payload_size(opcode) == static_cast<int>(msg_payload_size)) {
+      if (opcode == SYNC) {
+        on_sync(read_u32(payload));
+      } else if (!apply_message(handles, guard, device_id, opcode, payload)) {
+        std::cerr << "[STREAM] No device " << device_id << " for opcode " << (int)opcode << std::endl;
+      }
+    } // else: unknown opcode or unexpected payload, skip it
+
+    pos += HEADER_SIZE + msg_payload_size;
+  }
+  return pos;
+}
+
+} // namespace stream
+
+/**
+ * Accepts stream connections and serves each one on its own thread, see the protocol description above
+ */
+class StreamServer {
+public:
+  explicit StreamServer(std::shared_ptr<immer::atom<ServerState>> state) : handles(state->load()->handles) {}
+
+  StreamServer(const StreamServer &) = delete;
+  StreamServer &operator=(const StreamServer &) = delete;
+
+  ~StreamServer() {
+    stop();
+  }
+
+  /**
+   * Binds to the given address and starts accepting clients on a background thread
+   */
+  bool listen(const std::string &ip, int port) {
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+      std::cerr << "[STREAM] Unable to create socket: " << strerror(errno) << std::endl;
+      return false;
+    }
+    int enable = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1 ||
+        bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd, 16) < 0) {
+      std::cerr << "[STREAM] Unable to listen on " << ip << ":" << port << " " << strerror(errno) << std::endl;
+      close(listen_fd);
+      listen_fd = -1;
+      return false;
+    }
+
+    running = true;
+    accept_thread = std::thread([this]() { accept_loop(); });
+    return true;
+  }
+
+  void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    shutdown(listen_fd, SHUT_RDWR);
+    if (accept_thread.joinable()) {
+      accept_thread.join();
+    }
+    close(listen_fd);
+    listen_fd = -1;
+
+    {
+      std::lock_guard lock(clients_m);
+      for (auto fd : client_fds) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+    for (auto &[id, thread] : client_threads) { // the accept thread is gone, nobody else touches the map
+      thread.join();
+    }
+    client_threads.clear();
+    finished_clients.clear();
+  }
+
+private:
+  void accept_loop() {
+    while (running) {
+      int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client_fd < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break; // stop() has shut the socket down
+      }
+      int enable = 1;
+      setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)); // SYNC replies are tiny
+
+      reap_clients();
+      std::lock_guard lock(clients_m);
+      client_fds.insert(client_fd);
+      auto id = next_client_id++;
+      client_threads.emplace(id, std::thread([this, id, client_fd]() { serve_client(id, client_fd); }));
+    }
+  }
+
+  /**
+   * Joins the threads of the clients that have disconnected, so that a long running server with clients coming and
+   * going doesn't pile them up until stop()
+   */
+  void reap_clients() {
+    std::vector<std::thread> finished;
+    {
+      std::lock_guard lock(clients_m);
+      for (auto id : finished_clients) {
+        if (auto client = client_threads.find(id); client != client_threads.end()) {
+          finished.push_back(std::move(client->second));
+          client_threads.erase(client);
+        }
+      }
+      finished_clients.clear();
+    }
+    for (auto &thread : finished) {
+      thread.join(); // they are only returning from serve_client()
+    }
+  }
+
+  void serve_client(std::uint64_t id, int client_fd) {
+    std::vector<std::uint8_t> buffer(64 * 1024);
+    std::size_t buffered = 0;
+    auto send_sync = [client_fd](std::uint32_t sequence) {
+      std::array<std::uint8_t, stream::HEADER_SIZE + 4> reply{stream::SYNC, 4};
+      for (int i = 0; i < 4; i++) {
+        reply[stream::HEADER_SIZE + i] = static_cast<std::uint8_t>(sequence >> (8 * i));
+      }
+      send(client_fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+    };
+
+    while (true) {
+      auto received = recv(client_fd, buffer.data() + buffered, buffer.size() - buffered, 0);
+      if (received <= 0) {
+        if (received < 0 && errno == EINTR) {
+          continue;
+        }
+        break; // disconnected (or stop() has been called)
+      }
+      buffered += received;
+
+      auto consumed = stream::process_batch(*handles, buffer.data(), buffered, send_sync);
+      std::memmove(buffer.data(), buffer.data() + consumed, buffered - consumed);
+      buffered -= consumed;
+    }
+
+    std::lock_guard lock(clients_m);
+    client_fds.erase(client_fd);
+    close(client_fd);
+    finished_clients.push_back(id);
+  }
+
+  std::shared_ptr<DeviceHandles> handles;
+
+  int listen_fd = -1;
+  std::atomic<bool> running = false;
+  std::thread accept_thread;
+
+  std::mutex clients_m;
+  std::unordered_set<int> client_fds;
+  std::unordered_map<std::uint64_t, std::thread> client_threads;
+  std::vector<std::uint64_t> finished_clients; // see reap_clients()
+  std::uint64_t next_client_id = 0;
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Runs the device updates off the HTTP threads.
+ *
+ * Each client is pinned to one worker (by hashing its id), so all the events of a client are applied in order.
+ * A worker can serve many clients: it takes one task per client in turn, so a client flooding the server doesn't
+ * stall the other clients on the same worker, and each client can only have `max_pending` tasks queued.
+ *
+ * On top of that, each task has a Priority: among the clients that are waiting, the ones whose next task is CRITICAL
+ * (button and key transitions) are served first, then NORMAL, then MOTION. Motion can also be coalesced, see
+ * submit(): a client streaming motion faster than it can be applied only ever has one pending task for each key, so
+ * a key release that comes after it is not stuck behind the whole backlog.
+ */
+class WorkerPool {
+public:
+  using Task = std::function<void()>;
+
+  enum class Priority : std::uint8_t {
+    CRITICAL, // state transitions that must never wait: button and key presses/releases
+    NORMAL,
+    MOTION, // continuous updates (mouse motion, sticks...), usually coalesced
+  };
+
+  /* After this many tasks of a higher class in a row, one of a lower class is served, so that nothing starves */
+  static constexpr std::size_t MAX_BURST = 8;
+
+  /**
+   * @param count how many threads, at least one is always started
+   * @param cpus optional CPU affinity, worker `i` is pinned to `cpus[i % cpus.size()]`
+   * @param max_pending how many tasks a single client can have queued before submit() starts refusing them
+   */
+  explicit WorkerPool(std::size_t count, const std::vector<int> &cpus = {}, std::size_t max_pending = 1024)
+      : max_pending(max_pending) {
+    count = std::max<std::size_t>(count, 1);
+    for (std::size_t i = 0; i < count; i++) {
+      auto worker = std::make_unique<Worker>();
+      worker->thread = std::thread([w = worker.get()]() { run(*w); });
+      if (!cpus.empty()) {
+        set_affinity(worker->thread, cpus[i % cpus.size()]);
+      }
+      workers.push_back(std::move(worker));
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  ~WorkerPool() {
+    for (auto &worker : workers) {
+      {
+        std::lock_guard lock(worker->m);
+        worker->stop = true;
+      }
+      worker->cv.notify_one();
+    }
+    for (auto &worker : workers) {
+      worker->thread.join();
+    }
+  }
+
+  /**
+   * Queues the task on the worker of `client_id`, returns false (and drops the task) when the client already has
+   * `max_pending` tasks queued.
+   *
+   * When `coalesce_key` is not 0 and the client still has a pending task with the same key, that task is replaced
+   * instead (latest value wins) and `coalesced` (optional) is set. This is only done when nothing but other coalesced
+   * tasks are queued after it, so the order with the other events of the client is preserved.
+   */
+  bool submit(std::string_view client_id,
+              Task task,
+              Priority priority = Priority::NORMAL,
+              std::uint64_t coalesce_key = 0,
+              bool *coalesced = nullptr) {
+    auto &worker = *workers[std::hash<std::string_view>{}(client_id) % workers.size()];
+    {
+      std::lock_guard lock(worker.m);
+      auto &queue = worker.queues[std::string(client_id)];
+      if (coalesce_key != 0) {
+        for (auto pending = queue.rbegin(); pending != queue.rend() && pending->coalesce_key != 0; pending++) {
+          if (pending->coalesce_key == coalesce_key) {
+            pending->task = std::move(task);
+            if (coalesced) {
+              *coalesced = true;
+            }
+            return true; // still queued, no need to wake the worker up
+          }
+        }
+      }
+      if (queue.size() >= max_pending) {
+        return false;
+      }
+      if (queue.empty()) {
+        worker.ready[static_cast<std::size_t>(priority)].emplace_back(client_id);
+      }
+      queue.push_back({std::move(task), priority, coalesce_key});
+    }
+    worker.cv.notify_one();
+    return true;
+  }
+
+  std::size_t size() const {
+    return workers.size();
+  }
+
+  /**
+   * Parses a list of CPUs like "0,2,4-7"
+   */
+  static std::vector<int> parse_cpus(std::string_view list) {
+    std::vector<int> cpus;
+    while (!list.empty()) {
+      auto comma = list.find(',');
+      auto item = list.substr(0, comma);
+      list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+      if (item.empty()) {
+        continue;
+      }
+      auto dash = item.find('-');
+      try {
+        auto first = std::stoi(std::string(item.substr(0, dash)));
+        auto last = dash == std::string_view::npos ? first : std::stoi(std::string(item.substr(dash + 1)));
+        for (int cpu = first; cpu <= last; cpu++) {
+          cpus.push_back(cpu);
+        }
+      } catch (const std::exception &) {
+        std::cerr << "[WORKERS] Ignoring invalid CPU: " << item << std::endl;
+      }
+    }
+    return cpus;
+  }
+
+private:
+  static constexpr std::size_t PRIORITIES = 3;
+
+  struct PendingTask {
+    Task task;
+    Priority priority;
+    std::uint64_t coalesce_key;
+  };
+
+  struct Worker {
+    std::mutex m;
+    std::condition_variable cv;
+    std::unordered_map<std::string, std::deque<PendingTask>> queues;
+    /* Clients with queued tasks, by the Priority of their next task, each one in round robin order */
+    std::array<std::deque<std::string>, PRIORITIES> ready;
+    /* How many tasks in a row have been taken from each class while a lower one was waiting */
+    std::array<std::size_t, PRIORITIES> burst = {};
+    bool stop = false;
+    std::thread thread;
+
+    bool has_ready() const {
+      return std::any_of(ready.begin(), ready.end(), [](const auto &clients) { return !clients.empty(); });
+    }
+
+    /**
+     * The class to serve next: the highest one that is waiting, unless it has used up its MAX_BURST
+     */
+    std::size_t next_class() {
+      std::size_t selected = PRIORITIES;
+      for (std::size_t priority = 0; priority < PRIORITIES; priority++) {
+        if (ready[priority].empty()) {
+          continue;
+        }
+        if (selected == PRIORITIES) {
+          selected = priority;
+        } else { // a lower class is waiting
+          if (burst[selected] < MAX_BURST) {
+            burst[selected]++;
+            return selected;
+          }
+          burst[selected] = 0;
+          return priority;
+        }
+      }
+      burst[selected] = 0;
+      return selected;
+    }
+  };
+
+  static void run(Worker &worker) {
+    while (true) {
+      Task task;
+      {
+        std::unique_lock lock(worker.m);
+        worker.cv.wait(lock, [&worker]() { return worker.stop || worker.has_ready(); });
+        if (worker.stop) {
+          return;
+        }
+
+        auto &ready = worker.ready[worker.next_class()];
+        auto client = std::move(ready.front());
+        ready.pop_front();
+        auto queue = worker.queues.find(client);
+        task = std::move(queue->second.front().task);
+        queue->second.pop_front();
+        if (queue->second.empty()) {
+          worker.queues.erase(queue);
+        } else {
+          auto next = static_cast<std::size_t>(queue->second.front().priority);
+          worker.ready[next].push_back(std::move(client));
+        }
+      }
+
+      try {
+        task();
+      } catch (const std::exception &e) {
+        std::cerr << "[WORKERS] Exception: " << e.what() << std::endl;
+      } catch (...) {
+      }
+    }
+  }
+
+  static void set_affinity(std::thread &thread, int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (auto err = pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset); err != 0) {
+      std::cerr << "[WORKERS] Unable to pin worker to CPU " << cpu << std::endl;
+    }
+  }
+
+  std::size_t max_pending;
+  std::vector<std::unique_ptr<Worker>> workers;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <inputtino/trace.hpp>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Called by the devices on every public call, see TraceRecorder
+ */
+namespace inputtino::trace {
+
+enum class Op : std::uint8_t {
+  DEVICE_ADDED = 0x00, // written by the recorder the first time a device is seen
+  DEVICE_REMOVED = 0x01,
+
+  MOUSE_MOVE = 0x10,
+  MOUSE_MOVE_ABS = 0x11,
+  MOUSE_PRESS = 0x12,
+  MOUSE_RELEASE = 0x13,
+  MOUSE_SCROLL_V = 0x14,
+  MOUSE_SCROLL_H = 0x15,
+  MOUSE_MOVE_FRACTIONAL = 0x16,
+
+  KEYBOARD_PRESS = 0x20,
+  KEYBOARD_RELEASE = 0x21,
+
+  JOYPAD_BUTTONS = 0x30,
+  JOYPAD_STICK = 0x31,
+  JOYPAD_TRIGGERS = 0x32,
+  JOYPAD_STATE = 0x33,
+
+  PS5_MOTION = 0x40,
+  PS5_MOTION_SAMPLE = 0x41,
+  PS5_BATTERY = 0x42,
+  PS5_PLACE_FINGER = 0x43,
+  PS5_RELEASE_FINGER = 0x44,
+
+  TOUCH_PLACE = 0x50, // One per contact in the TouchFrame, the frame is applied on TOUCH_APPLY
+  TOUCH_RELEASE = 0x51,
+  TOUCH_APPLY = 0x52,
+  TRACKPAD_LEFT_BTN = 0x53,
+
+  PEN_PLACE_TOOL = 0x60,
+  PEN_BTN = 0x61,
+};
+
+/**
+ * The arguments of each op: 'i' is an integer (zigzag varint in the trace), 'f' is a float (4 bytes).
+ * nullopt for unknown ops.
+ */
+constexpr std::optional<std::string_view> signature(Op op) {
+  switch (op) {
+  case Op::DEVICE_ADDED:
+    return "i"; // DeviceKind
+  case Op::DEVICE_REMOVED:
+  case Op::TOUCH_APPLY:
+    return "";
+  case Op::MOUSE_MOVE:
+  case Op::JOYPAD_TRIGGERS:
+  case Op::PS5_BATTERY:
+  case Op::PEN_BTN:
+    return "ii";
+  case Op::MOUSE_MOVE_FRACTIONAL:
+    return "ff";
+  case Op::MOUSE_MOVE_ABS:
+    return "iiii";
+  case Op::MOUSE_PRESS:
+  case Op::MOUSE_RELEASE:
+  case Op::MOUSE_SCROLL_V:
+  case Op::MOUSE_SCROLL_H:
+  case Op::KEYBOARD_PRESS:
+  case Op::KEYBOARD_RELEASE:
+  case Op::JOYPAD_BUTTONS:
+  case Op::PS5_RELEASE_FINGER:
+  case Op::TOUCH_RELEASE:
+  case Op::TRACKPAD_LEFT_BTN:
+    return "i";
+  case Op::JOYPAD_STICK:
+  case Op::PS5_PLACE_FINGER:
+    return "iii";
+  case Op::JOYPAD_STATE:
+    return "iiiiiii"; // buttons, left stick x/y, right stick x/y, left/right trigger
+  case Op::PS5_MOTION:
+    return "ifff";
+  case Op::PS5_MOTION_SAMPLE:
+    return "ffffffi"; // accel x/y/z, gyro x/y/z, timestamp in us
+  case Op::TOUCH_PLACE:
+    return "ifffi";
+  case Op::PEN_PLACE_TOOL:
+    return "iffffff";
+  }
+  return std::nullopt;
+}
+
+constexpr std::size_t MAX_ARGS = 7;
+
+struct Event {
+  std::int64_t timestamp_us;
+  const void *device;
+  DeviceKind kind;
+  Op op;
+  std::int64_t args[MAX_ARGS];
+};
+
+/* 1 while a TraceRecorder is running, this is the only thing the hooks look at when nothing is being recorded */
+extern std::atomic<int> recording;
+
+/**
+ * Pushes the event into the recorder ring buffer, never blocks
+ */
+void push(const Event &event);
+
+template <typename T> inline std::int64_t to_arg(T value) {
+  if constexpr (std::is_floating_point_v<T>) {
+    auto f = static_cast<float>(value);
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+  } else {
+    return static_cast<std::int64_t>(value);
+  }
+}
+
+inline float to_float(std::int64_t arg) {
+  auto bits = static_cast<std::uint32_t>(arg);
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/**
+ * `device` identifies the device in the trace, devices use the address of their state (it doesn't change when the
+ * device is moved)
+ */
+template <typename... Args> inline void record(const void *device, DeviceKind kind, Op op, Args... args) {
+  static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments");
+  if (recording.load(std::memory_order_relaxed) != 1) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  push(Event{.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(now).count(),
+             .device = device,
+             .kind = kind,
+             .op = op,
+             .args = {to_arg(args)...}});
+}
+
+/**
+ * One TOUCH_PLACE/TOUCH_RELEASE per contact followed by TOUCH_APPLY, shared by Trackpad and TouchScreen
+ */
+inline void record(const void *device, DeviceKind kind, const TouchFrame &frame) {
+  if (recording.load(std::memory_order_relaxed) != 1) {
+    return;
+  }
+  for (const auto &contact : frame) {
+    if (contact.released) {
+      record(device, kind, Op::TOUCH_RELEASE, contact.finger_nr);
+    } else {
+      record(device,
+             kind,
+             Op::TOUCH_PLACE,
+             contact.finger_nr,
+             contact.x,
+             contact.y,
+             contact.pressure,
+             contact.orientation);
+    }
+  }
+  record(device, kind, Op::TOUCH_APPLY);
+}
+
+} // namespace inputtino::trace
@@ -0,0 +1,221 @@
+#include "trace_format.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <inputtino/trace.hpp>
+#include <inputtino/trace_hooks.hpp>
+#include <thread>
+#include <unordered_map>
+
+namespace inputtino {
+
+namespace trace {
+
+std::atomic<int> recording{0};
+
+/**
+ * Bounded MPSC ring (Vyukov), producers never block: when it's full the event is dropped
+ */
+class EventRing {
+public:
+  static constexpr std::size_t CAPACITY = 8192;
+
+  EventRing() {
+    for (std::size_t i = 0; i < CAPACITY; i++) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool try_push(const Event &event) {
+    auto pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      auto &slot = slots[pos & (CAPACITY - 1)];
+      auto diff = static_cast<std::intptr_t>(slot.seq.load(std::memory_order_acquire)) -
+                  static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.event = event;
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Single consumer: only called by the writer thread
+   */
+  bool try_pop(Event &event) {
+    auto &slot = slots[dequeue_pos & (CAPACITY - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != dequeue_pos + 1) {
+      return false;
+    }
+    event = slot.event;
+    slot.seq.store(dequeue_pos + CAPACITY, std::memory_order_release);
+    dequeue_pos++;
+    return true;
+  }
+
+  std::atomic<std::size_t> dropped{0};
+
+private:
+  struct Slot {
+    std::atomic<std::size_t> seq;
+    Event event;
+  };
+
+  alignas(64) std::atomic<std::size_t> enqueue_pos{0};
+  alignas(64) std::size_t dequeue_pos = 0;
+  std::array<Slot, CAPACITY> slots;
+};
+
+/* Allocated by the first recording and never released, so that a late push() can't end up in a freed ring */
+static std::atomic<EventRing *> ring{nullptr};
+
+void push(const Event &event) {
+  if (auto r = ring.load(std::memory_order_acquire)) {
+    r->try_push(event);
+  }
+}
+
+} // namespace trace
+
+struct TraceRecorder::Impl {
+  std::FILE *file = nullptr;
+  trace::EventRing *ring = nullptr;
+  std::size_t dropped_at_start = 0;
+  std::atomic<bool> running{true};
+  std::thread writer;
+
+  std::vector<std::uint8_t> buffer;
+  std::unordered_map<const void *, std::uint32_t> device_ids;
+  std::uint32_t next_device_id = 1;
+  std::int64_t last_timestamp_us = 0;
+
+  void write_record(std::int64_t timestamp_us, trace::Op op, std::uint32_t device_id, const std::int64_t *args) {
+    trace::write_varint(buffer, last_timestamp_us ? std::max<std::int64_t>(timestamp_us - last_timestamp_us, 0) : 0);
+    last_timestamp_us = timestamp_us;
+    buffer.push_back(static_cast<std::uint8_t>(op));
+    trace::write_varint(buffer, device_id);
+    auto arg_types = *trace::signature(op);
+    for (std::size_t i = 0; i < arg_types.size(); i++) {
+      if (arg_types[i] == 'f') {
+        trace::write_fixed32(buffer, static_cast<std::uint32_t>(args[i]));
+      } else {
+        trace::write_signed(buffer, args[i]);
+      }
+    }
+  }
+
+  void encode(const trace::Event &event) {
+    auto device = device_ids.find(event.device);
+    if (device == device_ids.end()) {
+      if (event.op == trace::Op::DEVICE_REMOVED) {
+        return; // never used while recording
+      }
+      device = device_ids.emplace(event.device, next_device_id++).first;
+      std::int64_t kind = static_cast<std::int64_t>(event.kind);
+      write_record(event.timestamp_us, trace::Op::DEVICE_ADDED, device->second, &kind);
+    }
+
+    write_record(event.timestamp_us, event.op, device->second, event.args);
+    if (event.op == trace::Op::DEVICE_REMOVED) {
+      device_ids.erase(device); // the address might be reused by a new device
+    }
+  }
+
+  void flush() {
+    if (!buffer.empty()) {
+      std::fwrite(buffer.data(), 1, buffer.size(), file);
+      buffer.clear();
+    }
+  }
+
+  void run() {
+    trace::Event event{};
+    while (true) {
+      bool stopping = !running.load(std::memory_order_acquire);
+      std::size_t popped = 0;
+      while (ring->try_pop(event)) {
+        encode(event);
+        popped++;
+        if (buffer.size() >= 64 * 1024) {
+          flush();
+        }
+      }
+      if (stopping) {
+        break;
+      }
+      if (popped == 0) {
+        flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    flush();
+  }
+};
+
+Result<std::shared_ptr<TraceRecorder>> TraceRecorder::start(const std::string &path) {
+  int expected = 0;
+  if (!trace::recording.compare_exchange_strong(expected, -1)) { // -1: starting or stopping, nothing is recorded
+    return Error("Another trace is already being recorded");
+  }
+
+  auto file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    trace::recording.store(0);
+    return Error("Unable to open " + path + ": " + strerror(errno));
+  }
+
+  auto ring = trace::ring.load(std::memory_order_acquire);
+  if (!ring) {
+    ring = new trace::EventRing();
+    trace::ring.store(ring, std::memory_order_release);
+  }
+  trace::Event leftover{};
+  while (ring->try_pop(leftover)) {
+    // Calls that were already past the check in record() when the previous recording stopped
+  }
+
+  std::fwrite(trace::MAGIC, 1, sizeof(trace::MAGIC), file);
+  std::fputc(trace::VERSION, file);
+
+  auto impl = std::make_unique<Impl>();
+  impl->file = file;
+  impl->ring = ring;
+  impl->dropped_at_start = ring->dropped.load();
+  impl->writer = std::thread([impl = impl.get()]() { impl->run(); });
+
+  trace::recording.store(1, std::memory_order_release);
+  return std::shared_ptr<TraceRecorder>(new TraceRecorder(std::move(impl)));
+}
+
+TraceRecorder::TraceRecorder(std::unique_ptr<Impl> impl) : impl(std::move(impl)) {}
+
+TraceRecorder::~TraceRecorder() {
+  stop();
+}
+
+void TraceRecorder::stop() {
+  if (!impl->running.exchange(false)) {
+    return;
+  }
+  trace::recording.store(-1, std::memory_order_release); // stop recording, but don't allow a new start() just yet
+  impl->writer.join();
+  std::fclose(impl->file);
+  impl->file = nullptr;
+  trace::recording.store(0, std::memory_order_release);
+}
+
+std::size_t TraceRecorder::dropped() const {
+  return impl->ring->dropped.load() - impl->dropped_at_start;
+}
+
+} // namespace inputtino
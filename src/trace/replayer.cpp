@@ -0,0 +1,371 @@
+#include "trace_format.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <inputtino/trace.hpp>
+#include <inputtino/trace_hooks.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace inputtino {
+
+namespace {
+
+struct Record {
+  std::uint64_t delta_us;
+  trace::Op op;
+  std::uint32_t device_id;
+  std::int64_t args[trace::MAX_ARGS];
+};
+
+/**
+ * Returns nullopt at the end of the trace; a truncated record (ex: the recording process crashed) ends the trace
+ */
+std::optional<Record> next_record(trace::TraceReader &reader) {
+  auto delta = reader.varint();
+  auto op = reader.byte();
+  auto device_id = reader.varint();
+  if (!delta || !op || !device_id) {
+    return std::nullopt;
+  }
+
+  auto arg_types = trace::signature(static_cast<trace::Op>(*op));
+  if (!arg_types) {
+    return std::nullopt; // We can't know how long the record is, nothing after it can be decoded
+  }
+
+  Record record{.delta_us = *delta,
+                .op = static_cast<trace::Op>(*op),
+                .device_id = static_cast<std::uint32_t>(*device_id),
+                .args = {}};
+  for (std::size_t i = 0; i < arg_types->size(); i++) {
+    if ((*arg_types)[i] == 'f') {
+      auto arg = reader.fixed32();
+      if (!arg) {
+        return std::nullopt;
+      }
+      record.args[i] = *arg;
+    } else {
+      auto arg = reader.signed_varint();
+      if (!arg) {
+        return std::nullopt;
+      }
+      record.args[i] = *arg;
+    }
+  }
+  return record;
+}
+
+bool is_joypad(trace::DeviceKind kind) {
+  return kind == trace::DeviceKind::XBOX_JOYPAD || kind == trace::DeviceKind::SWITCH_JOYPAD ||
+         kind == trace::DeviceKind::PS5_JOYPAD;
+}
+
+} // namespace
+
+Result<TraceReplayer> TraceReplayer::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Error("Unable to open " + path + ": " + strerror(errno));
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < trace::HEADER_SIZE) {
+    close(fd);
+    return Error("Not a valid trace: " + path);
+  }
+
+  auto size = static_cast<std::size_t>(st.st_size);
+  auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return Error("Unable to map " + path + ": " + strerror(errno));
+  }
+
+  auto replayer = TraceReplayer(static_cast<const std::uint8_t *>(data), size);
+  if (std::memcmp(data, trace::MAGIC, sizeof(trace::MAGIC)) != 0 ||
+      replayer.data[sizeof(trace::MAGIC)] != trace::VERSION) {
+    return Error("Not a valid trace (or unsupported version): " + path);
+  }
+  return replayer;
+}
+
+TraceReplayer::TraceReplayer(const std::uint8_t *data, std::size_t size) : data(data), size(size) {
+  if (size < trace::HEADER_SIZE) {
+    return;
+  }
+  trace::TraceReader reader(data + trace::HEADER_SIZE, size - trace::HEADER_SIZE);
+  while (auto record = next_record(reader)) {
+    if (record->op == trace::Op::DEVICE_ADDED) {
+      trace_devices.push_back({record->device_id, static_cast<trace::DeviceKind>(record->args[0])});
+    }
+  }
+}
+
+TraceReplayer::TraceReplayer(TraceReplayer &&other) noexcept
+    : data(other.data), size(other.size), trace_devices(std::move(other.trace_devices)),
+      targets(std::move(other.targets)) {
+  other.data = nullptr;
+  other.size = 0;
+}
+
+TraceReplayer::~TraceReplayer() {
+  if (data) {
+    munmap(const_cast<std::uint8_t *>(data), size);
+  }
+}
+
+const std::vector<TraceReplayer::Device> &TraceReplayer::devices() const {
+  return trace_devices;
+}
+
+bool TraceReplayer::bind_target(std::uint32_t id, Target target, bool any_joypad) {
+  for (const auto &device : trace_devices) {
+    if (device.id == id) {
+      auto expected = std::visit(
+          [](auto ptr) -> std::optional<trace::DeviceKind> {
+            using T = std::remove_pointer_t<decltype(ptr)>;
+            if constexpr (std::is_same_v<T, Mouse>) {
+              return trace::DeviceKind::MOUSE;
+            } else if constexpr (std::is_same_v<T, Keyboard>) {
+              return trace::DeviceKind::KEYBOARD;
+            } else if constexpr (std::is_same_v<T, PS5Joypad>) {
+              return trace::DeviceKind::PS5_JOYPAD;
+            } else if constexpr (std::is_same_v<T, Trackpad>) {
+              return trace::DeviceKind::TRACKPAD;
+            } else if constexpr (std::is_same_v<T, TouchScreen>) {
+              return trace::DeviceKind::TOUCH_SCREEN;
+            } else if constexpr (std::is_same_v<T, PenTablet>) {
+              return trace::DeviceKind::PEN_TABLET;
+            } else {
+              return std::nullopt;
+            }
+          },
+          target);
+      if ((any_joypad && is_joypad(device.kind)) || expected == device.kind) {
+        targets[id] = target;
+        return true;
+      }
+      return false;
+    }
+  }
+  return false;
+}
+
+bool TraceReplayer::bind(std::uint32_t id, Mouse &mouse) {
+  return bind_target(id, &mouse, false);
+}
+
+bool TraceReplayer::bind(std::uint32_t id, Keyboard &keyboard) {
+  return bind_target(id, &keyboard, false);
+}
+
+bool TraceReplayer::bind(std::uint32_t id, Joypad &joypad) {
+  return bind_target(id, &joypad, true);
+}
+
+bool TraceReplayer::bind(std::uint32_t id, PS5Joypad &joypad) {
+  return bind_target(id, &joypad, true);
+}
+
+bool TraceReplayer::bind(std::uint32_t id, Trackpad &trackpad) {
+  return bind_target(id, &trackpad, false);
+}
+
+bool TraceReplayer::bind(std::uint32_t id, TouchScreen &touch_screen) {
+  return bind_target(id, &touch_screen, false);
+}
+
+bool TraceReplayer::bind(std::uint32_t id, PenTablet &pen_tablet) {
+  return bind_target(id, &pen_tablet, false);
+}
+
+namespace {
+
+/**
+ * Returns false if the target doesn't support the op (or nothing is bound)
+ */
+template <typename Target> bool apply(const Target &target, const Record &r, TouchFrame &touch_frame) {
+  using trace::Op;
+  using trace::to_float;
+  auto args = r.args;
+
+  if (auto mouse = std::get_if<Mouse *>(&target)) {
+    switch (r.op) {
+    case Op::MOUSE_MOVE:
+      (*mouse)->move(static_cast<int>(args[0]), static_cast<int>(args[1]));
+      return true;
+    case Op::MOUSE_MOVE_FRACTIONAL:
+      (*mouse)->move(static_cast<double>(to_float(args[0])), static_cast<double>(to_float(args[1])));
+      return true;
+    case Op::MOUSE_MOVE_ABS:
+      (*mouse)->move_abs(args[0], args[1], args[2], args[3]);
+      return true;
+    case Op::MOUSE_PRESS:
+      (*mouse)->press(static_cast<Mouse::MOUSE_BUTTON>(args[0]));
+      return true;
+    case Op::MOUSE_RELEASE:
+      (*mouse)->release(static_cast<Mouse::MOUSE_BUTTON>(args[0]));
+      return true;
+    case Op::MOUSE_SCROLL_V:
+      (*mouse)->vertical_scroll(args[0]);
+      return true;
+    case Op::MOUSE_SCROLL_H:
+      (*mouse)->horizontal_scroll(args[0]);
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  if (auto keyboard = std::get_if<Keyboard *>(&target)) {
+    if (r.op == Op::KEYBOARD_PRESS || r.op == Op::KEYBOARD_RELEASE) {
+      r.op == Op::KEYBOARD_PRESS ? (*keyboard)->press(args[0]) : (*keyboard)->release(args[0]);
+      return true;
+    }
+    return false;
+  }
+
+  Joypad *joypad = nullptr;
+  if (auto ps5 = std::get_if<PS5Joypad *>(&target)) {
+    joypad = *ps5;
+    switch (r.op) {
+    case Op::PS5_MOTION:
+      (*ps5)->set_motion(static_cast<PS5Joypad::MOTION_TYPE>(args[0]),
+                         to_float(args[1]),
+                         to_float(args[2]),
+                         to_float(args[3]));
+      return true;
+    case Op::PS5_MOTION_SAMPLE:
+      (*ps5)->set_motion(PS5Joypad::MotionSample{.accel_x = to_float(args[0]),
+                                                 .accel_y = to_float(args[1]),
+                                                 .accel_z = to_float(args[2]),
+                                                 .gyro_x = to_float(args[3]),
+                                                 .gyro_y = to_float(args[4]),
+                                                 .gyro_z = to_float(args[5]),
+                                                 .timestamp = std::chrono::microseconds(args[6])});
+      return true;
+    case Op::PS5_BATTERY:
+      (*ps5)->set_battery(static_cast<PS5Joypad::BATTERY_STATE>(args[0]), args[1]);
+      return true;
+    case Op::PS5_PLACE_FINGER:
+      (*ps5)->place_finger(args[0], args[1], args[2]);
+      return true;
+    case Op::PS5_RELEASE_FINGER:
+      (*ps5)->release_finger(args[0]);
+      return true;
+    default:
+      break;
+    }
+  } else if (auto generic = std::get_if<Joypad *>(&target)) {
+    joypad = *generic;
+  }
+  if (joypad) {
+    switch (r.op) {
+    case Op::JOYPAD_BUTTONS:
+      joypad->set_pressed_buttons(static_cast<unsigned int>(args[0]));
+      return true;
+    case Op::JOYPAD_STICK:
+      joypad->set_stick(static_cast<Joypad::STICK_POSITION>(args[0]), args[1], args[2]);
+      return true;
+    case Op::JOYPAD_TRIGGERS:
+      joypad->set_triggers(args[0], args[1]);
+      return true;
+    case Op::JOYPAD_STATE:
+      joypad->set_state({.buttons = static_cast<unsigned int>(args[0]),
+                         .left_stick_x = static_cast<short>(args[1]),
+                         .left_stick_y = static_cast<short>(args[2]),
+                         .right_stick_x = static_cast<short>(args[3]),
+                         .right_stick_y = static_cast<short>(args[4]),
+                         .left_trigger = static_cast<std::int16_t>(args[5]),
+                         .right_trigger = static_cast<std::int16_t>(args[6])});
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  if (r.op == Op::TOUCH_PLACE) {
+    touch_frame.place_finger(args[0], to_float(args[1]), to_float(args[2]), to_float(args[3]), args[4]);
+    return true;
+  } else if (r.op == Op::TOUCH_RELEASE) {
+    touch_frame.release_finger(args[0]);
+    return true;
+  }
+
+  if (auto trackpad = std::get_if<Trackpad *>(&target)) {
+    if (r.op == Op::TOUCH_APPLY) {
+      (*trackpad)->apply(touch_frame);
+      touch_frame.clear();
+      return true;
+    } else if (r.op == Op::TRACKPAD_LEFT_BTN) {
+      (*trackpad)->set_left_btn(args[0]);
+      return true;
+    }
+    return false;
+  }
+
+  if (auto touch_screen = std::get_if<TouchScreen *>(&target)) {
+    if (r.op == Op::TOUCH_APPLY) {
+      (*touch_screen)->apply(touch_frame);
+      touch_frame.clear();
+      return true;
+    }
+    return false;
+  }
+
+  if (auto pen = std::get_if<PenTablet *>(&target)) {
+    if (r.op == Op::PEN_PLACE_TOOL) {
+      (*pen)->place_tool(static_cast<PenTablet::TOOL_TYPE>(args[0]),
+                         to_float(args[1]),
+                         to_float(args[2]),
+                         to_float(args[3]),
+                         to_float(args[4]),
+                         to_float(args[5]),
+                         to_float(args[6]));
+      return true;
+    } else if (r.op == Op::PEN_BTN) {
+      (*pen)->set_btn(static_cast<PenTablet::BTN_TYPE>(args[0]), args[1]);
+      return true;
+    }
+    return false;
+  }
+
+  return false;
+}
+
+} // namespace
+
+std::size_t TraceReplayer::replay(double speed) {
+  if (!data) {
+    return 0;
+  }
+
+  std::size_t replayed = 0;
+  std::unordered_map<std::uint32_t, TouchFrame> touch_frames;
+  auto start = std::chrono::steady_clock::now();
+  std::uint64_t trace_time_us = 0;
+
+  trace::TraceReader reader(data + trace::HEADER_SIZE, size - trace::HEADER_SIZE);
+  while (auto record = next_record(reader)) {
+    trace_time_us += record->delta_us;
+    auto target = targets.find(record->device_id);
+    if (target == targets.end() || record->op == trace::Op::DEVICE_ADDED ||
+        record->op == trace::Op::DEVICE_REMOVED) {
+      continue;
+    }
+
+    if (speed > 0) {
+      auto at = std::chrono::microseconds(static_cast<std::int64_t>(trace_time_us / speed));
+      std::this_thread::sleep_until(start + at);
+    }
+    if (apply(target->second, *record, touch_frames[record->device_id])) {
+      replayed++;
+    }
+  }
+  return replayed;
+}
+
+} // namespace inputtino
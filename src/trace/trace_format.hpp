@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+/**
+ * Trace file layout:
+ *
+ *   | magic: "INPTRACE" | version: u8 | records... |
+ *
+ * Every record:
+ *
+ *   | time since the previous record in us: varint | op: u8 | device id: varint | args (see trace::signature()) |
+ *
+ * Integers are zigzag varints, floats are 4 bytes little endian; device ids are assigned by the recorder in order
+ * of first use and are introduced by a DEVICE_ADDED record.
+ */
+namespace inputtino::trace {
+
+constexpr char MAGIC[8] = {'I', 'N', 'P', 'T', 'R', 'A', 'C', 'E'};
+constexpr std::uint8_t VERSION = 1;
+constexpr std::size_t HEADER_SIZE = sizeof(MAGIC) + 1;
+
+inline void write_varint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+
+inline void write_signed(std::vector<std::uint8_t> &out, std::int64_t value) {
+  write_varint(out, (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+}
+
+inline void write_fixed32(std::vector<std::uint8_t> &out, std::uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+  }
+}
+
+/**
+ * Reads from a memory mapped trace, every read returns nullopt once the data is over (ex: a truncated trace)
+ */
+class TraceReader {
+public:
+  TraceReader(const std::uint8_t *data, std::size_t size) : data(data), size(size) {}
+
+  std::optional<std::uint64_t> varint() {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64 && pos < size; shift += 7) {
+      auto byte = data[pos++];
+      value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::optional<std::int64_t> signed_varint() {
+    auto value = varint();
+    if (!value) {
+      return std::nullopt;
+    }
+    return static_cast<std::int64_t>((*value >> 1) ^ (~(*value & 1) + 1));
+  }
+
+  std::optional<std::uint32_t> fixed32() {
+    if (size - pos < 4) {
+      return std::nullopt;
+    }
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+      value |= static_cast<std::uint32_t>(data[pos++]) << (8 * i);
+    }
+    return value;
+  }
+
+  std::optional<std::uint8_t> byte() {
+    if (pos >= size) {
+      return std::nullopt;
+    }
+    return data[pos++];
+  }
+
+  bool done() const {
+    return pos >= size;
+  }
+
+private:
+  const std::uint8_t *data;
+  std::size_t size;
+  std::size_t pos = 0;
+};
+
+} // namespace inputtino::trace
@@ -1,12 +1,23 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <inputtino/callback_slot.hpp>
+#include <inputtino/metrics_counters.hpp>
+#include <inputtino/scheduler.hpp>
+#include <inputtino/serial_queue.hpp>
+#include <inputtino/uevent_monitor.hpp>
+#include <memory>
 #include <optional>
+#include <string>
 #include <uhid/ps5.hpp>
 #include <uhid/uhid.hpp>
 
 namespace inputtino {
-struct PS5JoypadState {
+struct PS5JoypadState : std::enable_shared_from_this<PS5JoypadState> {
   std::shared_ptr<uhid::Device> dev;
+  MetricsCounters metrics; // see get_metrics()
   /**
    * This will be the MAC address of the device
    *
@@ -21,11 +32,61 @@ struct PS5JoypadState {
       0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF
   };
   uint16_t vendor_id;
+  /* Formatted once, they are compared against every sysfs entry in get_sys_nodes() */
+  std::string mac_string;
+  std::string vendor_hex;
 
+  /**
+   * Runs all the methods that change the report (and the rate limited sends from the Scheduler thread);
+   * the fields below are only modified by the operations
+   */
+  SerialQueue<> serial;
   uhid::dualsense_input_report_usb current_state;
+  /**
+   * Pre-initialised UHID_INPUT2 event: each report only copies `current_state` in and writes out the header plus the
+   * report, instead of clearing and writing a full (~4KB) uhid_event every time.
+   */
+  uhid_event report_event{};
   uint8_t last_touch_id = 0;
 
-  std::optional<std::function<void(int, int)>> on_rumble = std::nullopt;
-  std::optional<std::function<void(int, int, int)>> on_led = std::nullopt;
+  /**
+   * Report rate limiting, see PS5Joypad::set_report_rate()
+   * When enabled, changes only mark the report as dirty; it's sent either by the next change that comes after
+   * `report_interval` has passed or by a task on the shared Scheduler, which is only registered when dirty.
+   */
+  std::chrono::microseconds report_interval{0};
+  std::chrono::steady_clock::time_point last_report = {};
+  bool report_dirty = false;
+  std::atomic<Scheduler::TaskId> report_task = 0;
+
+  /**
+   * Time of the sample passed to PS5Joypad::set_motion(const MotionSample &) that hasn't been sent yet, it's used as
+   * the sensor_timestamp of the report that carries it.
+   * From then on the other reports (buttons, sticks...) follow the same time base: `motion_clock_offset` is the
+   * difference between the sample time and the steady_clock when it was sent.
+   */
+  std::optional<std::chrono::microseconds> motion_timestamp = std::nullopt;
+  std::optional<std::chrono::nanoseconds> motion_clock_offset = std::nullopt;
+
+  /**
+   * Motion pacing, see PS5Joypad::set_motion_rate()
+   * When enabled, samples are queued here and sent one every `motion_interval` by a task on the shared Scheduler,
+   * which is only registered while the queue isn't empty.
+   */
+  static constexpr std::size_t MOTION_QUEUE_SIZE = 32;
+  std::array<PS5Joypad::MotionSample, MOTION_QUEUE_SIZE> motion_queue = {};
+  std::size_t motion_queue_head = 0;
+  std::size_t motion_queue_count = 0;
+  std::chrono::microseconds motion_interval{0};
+  std::chrono::steady_clock::time_point next_motion_report = {};
+  std::atomic<Scheduler::TaskId> motion_task = 0;
+
+  /* Set by set_on_rumble() and set_on_led() on any thread, invoked on the EventLoop */
+  CallbackSlot<void(int, int)> on_rumble;
+  CallbackSlot<void(int, int, int)> on_led;
+
+  /* Walking /sys/devices/virtual/misc/uhid/ is slow, see get_sys_nodes() and get_nodes() */
+  NodesCache sys_nodes;
+  NodesCache nodes;
 };
 } // namespace inputtino
@@ -1,10 +1,13 @@
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <endian.h>
 #include <filesystem>
 #include <fstream>
 #include <inputtino/input.hpp>
-#include <iomanip>
+#include <inputtino/trace_hooks.hpp>
 #include <random>
 #include <uhid/protected_types.hpp>
 #include <uhid/ps5.hpp>
@@ -12,7 +15,13 @@
 
 namespace inputtino {
 
+/**
+ * Sends out the current report right away, must be called from an operation on `serial`
+ */
 static void send_report(PS5JoypadState &state) {
+  if (!state.dev) { // not created yet, or already destroyed
+    return;
+  }
   { // setup timestamp and increase seq_number
     state.current_state.seq_number++;
     if (state.current_state.seq_number >= 255) {
@@ -22,22 +31,68 @@ static void send_report(PS5JoypadState &state) {
     // Seems that the timestamp is little endian and 0.33us units
     // see:
     // https://github.com/torvalds/linux/blob/305230142ae0637213bf6e04f6d9f10bbcb74af8/drivers/hid/hid-playstation.c#L1409-L1410
-    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
-                   .count();
-    state.current_state.sensor_timestamp = htole32(now / 333);
+    auto steady_now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch());
+    std::chrono::nanoseconds now;
+    if (state.motion_timestamp) { // this report carries a motion sample
+      now = std::chrono::duration_cast<std::chrono::nanoseconds>(*state.motion_timestamp);
+      state.motion_clock_offset = now - steady_now;
+      state.motion_timestamp.reset();
+    } else if (state.motion_clock_offset) { // keep going from the time of the last sample
+      now = steady_now + *state.motion_clock_offset;
+    } else {
+      now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+    }
+    state.current_state.sensor_timestamp = htole32(now.count() / 333);
   }
 
-  struct uhid_event ev {};
-  {
-    ev.type = UHID_INPUT2;
-    unsigned char *data = (unsigned char *)&state.current_state;
-    std::copy(data, data + sizeof(state.current_state), &ev.u.input2.data[0]);
-    ev.u.input2.size = sizeof(state.current_state);
+  std::memcpy(state.report_event.u.input2.data, &state.current_state, sizeof(state.current_state));
+  auto res = state.dev->send(state.report_event, uhid::input2_event_size(sizeof(state.current_state)));
+  state.metrics.add_write(1, static_cast<bool>(res));
+
+  state.report_dirty = false;
+  state.last_report = std::chrono::steady_clock::now();
+}
+
+/**
+ * To be called after changing `current_state`, must be called from an operation on `serial`.
+ * When rate limiting is off this will send the report right away; otherwise, it'll be sent now only if enough time
+ * has passed since the last report, if not we'll register a task on the shared Scheduler that will send it once
+ * `report_interval` has passed.
+ */
+static void report_changed(PS5JoypadState &state) {
+  if (state.report_interval.count() <= 0) {
+    send_report(state);
+    return;
+  }
+
+  if (state.report_dirty) {
+    state.metrics.add_coalesced();
+  }
+  state.report_dirty = true;
+  auto now = std::chrono::steady_clock::now();
+  auto send_at = state.last_report + state.report_interval;
+  if (now >= send_at) {
+    send_report(state);
+  } else if (!state.report_task) {
+    auto delay = std::chrono::duration_cast<std::chrono::microseconds>(send_at - now);
+    auto report_task = [weak_state = state.weak_from_this()]() -> std::optional<std::chrono::microseconds> {
+      if (auto state = weak_state.lock()) {
+        state->serial.run([state = state.get()] {
+          state->report_task = 0;
+          if (state->report_dirty && state->dev) {
+            send_report(*state);
+          }
+        });
+      }
+      return {};
+    };
+    state.report_task = Scheduler::get().schedule(delay, report_task);
   }
-  state.dev->send(ev);
 }
 
-static void on_uhid_event(std::shared_ptr<PS5JoypadState> state, uhid_event ev, int fd) {
+static void on_uhid_event(std::shared_ptr<PS5JoypadState> state, const uhid_event &ev, HidOutput &output) {
+  auto received_at = MetricsCounters::now();
   switch (ev.type) {
   case UHID_GET_REPORT: {
     uhid_event answer{};
@@ -76,13 +131,13 @@ static void on_uhid_event(std::shared_ptr<PS5JoypadState> state, uhid_event ev,
       answer.u.get_report_reply.err = -EINVAL;
       break;
     }
-    auto res = uhid::uhid_write(fd, &answer);
-    // TODO: signal error somehow
+    auto res = output.write(answer);
+    state->metrics.add_write(0, static_cast<bool>(res), false);
     break;
   }
   case UHID_OUTPUT: { // This is sent if the HID device driver wants to send raw data to the device
     // Here is where we'll get Rumble and LED events
-    uhid::dualsense_output_report_usb *report = (uhid::dualsense_output_report_usb *)ev.u.output.data;
+    auto report = (const uhid::dualsense_output_report_usb *)ev.u.output.data;
     /*
      * RUMBLE
      * The PS5 joypad seems to report values in the range 0-255,
@@ -91,13 +146,17 @@ static void on_uhid_event(std::shared_ptr<PS5JoypadState> state, uhid_event ev,
     if (report->valid_flag0 & uhid::MOTOR_OR_COMPATIBLE_VIBRATION || report->valid_flag2 & uhid::COMPATIBLE_VIBRATION) {
       auto left = (report->motor_left / 255.0f) * 0xFFFF;
       auto right = (report->motor_right / 255.0f) * 0xFFFF;
-      if (state->on_rumble) {
-        (*state->on_rumble)(left, right);
+      state->metrics.add_ff_effect();
+      if (auto callback = state->on_rumble.get()) {
+        (*callback)(left, right);
+        state->metrics.add_rumble_callback(received_at);
       }
     } else if (report->valid_flag0 == 0 && report->valid_flag1 == 0 && report->valid_flag2 == 0) {
       // Seems to be a special stop rumble event, let's propagate it
-      if (state->on_rumble) {
-        (*state->on_rumble)(0, 0);
+      state->metrics.add_ff_effect();
+      if (auto callback = state->on_rumble.get()) {
+        (*callback)(0, 0);
+        state->metrics.add_rumble_callback(received_at);
       }
     }
 
@@ -105,9 +164,9 @@ static void on_uhid_event(std::shared_ptr<PS5JoypadState> state, uhid_event ev,
      * LED
      */
     if (report->valid_flag1 & uhid::LIGHTBAR_ENABLE) {
-      if (state->on_led) {
+      if (auto callback = state->on_led.get()) {
         // TODO: should we blend brightness?
-        (*state->on_led)(report->lightbar_red, report->lightbar_green, report->lightbar_blue);
+        (*callback)(report->lightbar_red, report->lightbar_green, report->lightbar_blue);
       }
     }
   }
@@ -117,16 +176,34 @@ static void on_uhid_event(std::shared_ptr<PS5JoypadState> state, uhid_event ev,
 }
 
 void generate_mac_address(PS5JoypadState *state) {
-  auto rand = std::bind(std::uniform_int_distribution<unsigned char>{0, 0xFF},
+  auto rand = std::bind(std::uniform_int_distribution<unsigned int>{0, 0xFF},
                         std::default_random_engine{std::random_device()()});
   for (int i = 0; i < 6; i++) {
-    state->mac_address[i] = rand();
+    state->mac_address[i] = static_cast<unsigned char>(rand());
   }
+
+  // Same format as the kernel (%pMR, ex: the power supply name), see get_sys_nodes() and get_mac_address()
+  char mac[18];
+  std::snprintf(mac,
+                sizeof(mac),
+                "%02x:%02x:%02x:%02x:%02x:%02x",
+                state->mac_address[0],
+                state->mac_address[1],
+                state->mac_address[2],
+                state->mac_address[3],
+                state->mac_address[4],
+                state->mac_address[5]);
+  state->mac_string = mac;
 }
 
 PS5Joypad::PS5Joypad(uint16_t vendor_id) : _state(std::make_shared<PS5JoypadState>()) {
   generate_mac_address(this->_state.get());
   this->_state->vendor_id = vendor_id;
+  char vendor_hex[5];
+  std::snprintf(vendor_hex, sizeof(vendor_hex), "%04X", vendor_id); // as in the uhid device name, ex: 0003:054C:0CE6.000D
+  this->_state->vendor_hex = vendor_hex;
+  this->_state->report_event.type = UHID_INPUT2;
+  this->_state->report_event.u.input2.size = sizeof(this->_state->current_state);
   // Set touchpad as not pressed
   this->_state->current_state.points[0].contact = 1;
   this->_state->current_state.points[1].contact = 1;
@@ -136,6 +213,17 @@ PS5Joypad::PS5Joypad(uint16_t vendor_id) : _state(std::make_shared<PS5JoypadStat
 }
 
 PS5Joypad::~PS5Joypad() {
+  if (this->_state) {
+    trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::DEVICE_REMOVED);
+  }
+  if (this->_state && this->_state->report_task) {
+    Scheduler::get().cancel_and_wait(this->_state->report_task);
+  }
+  if (this->_state && this->_state->motion_task) {
+    Scheduler::get().cancel_and_wait(this->_state->motion_task);
+  }
+  // The tasks have been cancelled and have returned, the uhid thread is stopped below: once that is done nothing else
+  // runs operations on `serial` and `dev` can go
   if (this->_state && this->_state->dev) {
     this->_state->dev->stop_thread();
     this->_state->dev.reset(); // Will trigger ~Device and ultimately destroy the device
@@ -154,6 +242,7 @@ Result<PS5Joypad> PS5Joypad::create(const DeviceDefinition &device) {
       .country = 0,
       .report_description = {&uhid::ps5_rdesc[0], &uhid::ps5_rdesc[0] + sizeof(uhid::ps5_rdesc)}};
 
+  UeventMonitor::get(); // start listening before the kernel driver creates the input devices, see get_nodes()
   auto joypad = PS5Joypad(device.vendor_id);
 
   if (def.phys.empty()) {
@@ -163,8 +252,9 @@ Result<PS5Joypad> PS5Joypad::create(const DeviceDefinition &device) {
     def.uniq = joypad.get_mac_address();
   }
 
-  auto dev =
-      uhid::Device::create(def, [state = joypad._state](uhid_event ev, int fd) { on_uhid_event(state, ev, fd); });
+  auto dev = uhid::Device::create(def, [state = joypad._state](const uhid_event &ev, HidOutput &output) {
+    on_uhid_event(state, ev, output);
+  });
   if (dev) {
     joypad._state->dev = std::make_shared<uhid::Device>(std::move(*dev));
     return joypad;
@@ -172,24 +262,18 @@ Result<PS5Joypad> PS5Joypad::create(const DeviceDefinition &device) {
   return Error(dev.getErrorMessage());
 }
 
-static int scale_value(int input, int input_start, int input_end, int output_start, int output_end) {
-  auto slope = 1.0 * (output_end - output_start) / (input_end - input_start);
-  return output_start + std::round(slope * (input - input_start));
-}
-
-template <typename T> std::string to_hex(T i) {
-  std::stringstream stream;
-  stream << std::hex << std::uppercase << i;
-  return stream.str();
+/**
+ * Linear mapping with rounding (half away from zero), in integers only
+ */
+static constexpr int scale_value(int input, int input_start, int input_end, int output_start, int output_end) {
+  auto numerator = static_cast<long long>(input - input_start) * (output_end - output_start) * 2;
+  auto denominator = static_cast<long long>(input_end - input_start) * 2;
+  auto half = denominator / 2;
+  return output_start + static_cast<int>((numerator >= 0 ? numerator + half : numerator - half) / denominator);
 }
 
 std::string PS5Joypad::get_mac_address() const {
-  std::stringstream stream;
-  stream << std::hex << std::setfill('0') << std::setw(2) //
-         << (unsigned int)_state->mac_address[0] << ":" << (unsigned int)_state->mac_address[1] << ":"
-         << (unsigned int)_state->mac_address[2] << ":" << (unsigned int)_state->mac_address[3] << ":"
-         << (unsigned int)_state->mac_address[4] << ":" << (unsigned int)_state->mac_address[5];
-  return stream.str();
+  return _state->mac_string;
 }
 
 /**
@@ -200,16 +284,20 @@ std::string PS5Joypad::get_mac_address() const {
  * /sys/devices/virtual/misc/uhid/0003:054C:0CE6.000D/input/input58/
  */
 std::vector<std::string> PS5Joypad::get_sys_nodes() const {
+  return _state->sys_nodes.get([this]() { return scan_sys_nodes(); });
+}
+
+std::vector<std::string> PS5Joypad::scan_sys_nodes() const {
   std::vector<std::string> nodes;
   auto base_path = "/sys/devices/virtual/misc/uhid/";
-  auto target_mac = get_mac_address();
+  const auto &target_mac = _state->mac_string;
   if (std::filesystem::exists(base_path)) {
     auto uhid_entries = std::filesystem::directory_iterator{base_path};
     for (auto uhid_entry : uhid_entries) {
       // Here we are looking for a directory that has a name like {BUS_ID}:{VENDOR_ID}:{PRODUCT_ID}.xxxx
       // (ex: 0003:054C:0CE6.000D)
       auto uhid_candidate_path = uhid_entry.path().filename().string();
-      auto target_id = to_hex(this->_state->vendor_id);
+      const auto &target_id = this->_state->vendor_hex;
       if (uhid_entry.is_directory() && uhid_candidate_path.find(target_id) != std::string::npos) {
         // Found a match! Let's scan the input devices in that directory
         if (std::filesystem::exists(uhid_entry.path() / "input")) {
@@ -243,7 +331,15 @@ std::vector<std::string> PS5Joypad::get_sys_nodes() const {
   return nodes;
 }
 
+DeviceMetrics PS5Joypad::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> PS5Joypad::get_nodes() const {
+  return _state->nodes.get([this]() { return scan_nodes(); });
+}
+
+std::vector<std::string> PS5Joypad::scan_nodes() const {
   std::vector<std::string> nodes;
 
   auto sys_nodes = get_sys_nodes();
@@ -260,176 +356,386 @@ std::vector<std::string> PS5Joypad::get_nodes() const {
   return nodes;
 }
 
-void PS5Joypad::set_pressed_buttons(unsigned int pressed) {
-  { // First reset everything to non-pressed
-    this->_state->current_state.buttons[0] = 0;
-    this->_state->current_state.buttons[1] = 0;
-    this->_state->current_state.buttons[2] = 0;
-    this->_state->current_state.buttons[3] = 0;
-  }
-  {
-    if (DPAD_UP & pressed) {     // Pressed UP
-      if (DPAD_LEFT & pressed) { // NW
-        this->_state->current_state.buttons[0] |= uhid::HAT_NW;
-      } else if (DPAD_RIGHT & pressed) { // NE
-        this->_state->current_state.buttons[0] |= uhid::HAT_NE;
-      } else { // N
-        this->_state->current_state.buttons[0] |= uhid::HAT_N;
-      }
+/**
+ * DPAD_UP, DPAD_DOWN, DPAD_LEFT, DPAD_RIGHT (the lowest 4 bits of the flags) to the value of the HAT switch;
+ * opposite directions pressed together resolve the same way as a real pad would report them.
+ */
+static constexpr std::array<uint8_t, 16> make_hat_table() {
+  std::array<uint8_t, 16> table = {};
+  for (unsigned int pressed = 0; pressed < table.size(); pressed++) {
+    uint8_t hat = 0;
+    bool up = pressed & Joypad::DPAD_UP, down = pressed & Joypad::DPAD_DOWN;
+    bool left = pressed & Joypad::DPAD_LEFT, right = pressed & Joypad::DPAD_RIGHT;
+    if (up) {
+      hat |= left ? uhid::HAT_NW : right ? uhid::HAT_NE : uhid::HAT_N;
     }
-
-    if (DPAD_DOWN & pressed) {   // Pressed DOWN
-      if (DPAD_LEFT & pressed) { // SW
-        this->_state->current_state.buttons[0] |= uhid::HAT_SW;
-      } else if (DPAD_RIGHT & pressed) { // SE
-        this->_state->current_state.buttons[0] |= uhid::HAT_SE;
-      } else { // S
-        this->_state->current_state.buttons[0] |= uhid::HAT_S;
-      }
+    if (down) {
+      hat |= left ? uhid::HAT_SW : right ? uhid::HAT_SE : uhid::HAT_S;
     }
-
-    if (DPAD_LEFT & pressed) {                              // Pressed LEFT
-      if (!(DPAD_UP & pressed) && !(DPAD_DOWN & pressed)) { // Pressed only LEFT
-        this->_state->current_state.buttons[0] |= uhid::HAT_W;
-      }
+    if (!up && !down) {
+      hat |= (left ? uhid::HAT_W : 0) | (right ? uhid::HAT_E : 0) | (!left && !right ? uhid::HAT_NEUTRAL : 0);
     }
+    table[pressed] = hat;
+  }
+  return table;
+}
 
-    if (DPAD_RIGHT & pressed) {                             // Pressed RIGHT
-      if (!(DPAD_UP & pressed) && !(DPAD_DOWN & pressed)) { // Pressed only RIGHT
-        this->_state->current_state.buttons[0] |= uhid::HAT_E;
+static constexpr auto hat_table = make_hat_table();
+
+/**
+ * Joypad::CONTROLLER_BTN flag -> (DualSense buttons byte, mask); the DPAD is in hat_table
+ */
+struct ButtonMapping {
+  unsigned int flag;
+  int byte;
+  uint8_t mask;
+};
+
+static constexpr ButtonMapping button_mappings[] = {
+    {Joypad::X, 0, uhid::SQUARE},
+    {Joypad::Y, 0, uhid::TRIANGLE},
+    {Joypad::A, 0, uhid::CROSS},
+    {Joypad::B, 0, uhid::CIRCLE},
+    {Joypad::LEFT_BUTTON, 1, uhid::L1},
+    {Joypad::RIGHT_BUTTON, 1, uhid::R1},
+    {Joypad::LEFT_STICK, 1, uhid::L3},
+    {Joypad::RIGHT_STICK, 1, uhid::R3},
+    {Joypad::START, 1, uhid::OPTIONS},
+    {Joypad::BACK, 1, uhid::CREATE},
+    {Joypad::TOUCHPAD_FLAG, 2, uhid::TOUCHPAD},
+    {Joypad::HOME, 2, uhid::PS_HOME},
+    {Joypad::MISC_FLAG, 2, uhid::MIC_MUTE},
+};
+
+/**
+ * One table for each byte of the flags: the value is the 4 DualSense button bytes (little endian) for the bits of
+ * that byte, so that encoding the buttons is 3 lookups and 2 ORs
+ */
+using ButtonTable = std::array<std::array<uint32_t, 256>, 3>;
+
+static constexpr ButtonTable make_button_tables() {
+  ButtonTable tables = {};
+  for (int flags_byte = 0; flags_byte < 3; flags_byte++) {
+    for (unsigned int value = 0; value < 256; value++) {
+      auto pressed = value << (8 * flags_byte);
+      uint32_t buttons = 0;
+      for (const auto &mapping : button_mappings) {
+        if (pressed & mapping.flag) {
+          buttons |= static_cast<uint32_t>(mapping.mask) << (8 * mapping.byte);
+        }
       }
+      tables[flags_byte][value] = buttons;
     }
+  }
+  return tables;
+}
 
-    if (!(DPAD_UP & pressed) && !(DPAD_DOWN & pressed) && !(DPAD_LEFT & pressed) && !(DPAD_RIGHT & pressed)) {
-      this->_state->current_state.buttons[0] |= uhid::HAT_NEUTRAL;
-    }
+static constexpr auto button_tables = make_button_tables();
 
-    // TODO: L2/R2 ??
-
-    if (X & pressed)
-      this->_state->current_state.buttons[0] |= uhid::SQUARE;
-    if (Y & pressed)
-      this->_state->current_state.buttons[0] |= uhid::TRIANGLE;
-    if (A & pressed)
-      this->_state->current_state.buttons[0] |= uhid::CROSS;
-    if (B & pressed)
-      this->_state->current_state.buttons[0] |= uhid::CIRCLE;
-    if (LEFT_BUTTON & pressed)
-      this->_state->current_state.buttons[1] |= uhid::L1;
-    if (RIGHT_BUTTON & pressed)
-      this->_state->current_state.buttons[1] |= uhid::R1;
-    if (LEFT_STICK & pressed)
-      this->_state->current_state.buttons[1] |= uhid::L3;
-    if (RIGHT_STICK & pressed)
-      this->_state->current_state.buttons[1] |= uhid::R3;
-    if (START & pressed)
-      this->_state->current_state.buttons[1] |= uhid::OPTIONS;
-    if (BACK & pressed)
-      this->_state->current_state.buttons[1] |= uhid::CREATE;
-    if (TOUCHPAD_FLAG & pressed)
-      this->_state->current_state.buttons[2] |= uhid::TOUCHPAD;
-    if (HOME & pressed)
-      this->_state->current_state.buttons[2] |= uhid::PS_HOME;
-    if (MISC_FLAG & pressed)
-      this->_state->current_state.buttons[2] |= uhid::MIC_MUTE;
-  }
-  send_report(*this->_state);
+static void apply_pressed_buttons(PS5JoypadState &state, unsigned int pressed) {
+  // TODO: L2/R2 ??
+  auto buttons = button_tables[0][pressed & 0xFF] | button_tables[1][(pressed >> 8) & 0xFF] |
+                 button_tables[2][(pressed >> 16) & 0xFF] | hat_table[pressed & 0x0F];
+  state.current_state.buttons[0] = static_cast<uint8_t>(buttons);
+  state.current_state.buttons[1] = static_cast<uint8_t>(buttons >> 8);
+  state.current_state.buttons[2] = static_cast<uint8_t>(buttons >> 16);
+  state.current_state.buttons[3] = static_cast<uint8_t>(buttons >> 24);
+}
+
+void PS5Joypad::set_pressed_buttons(unsigned int pressed) {
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::JOYPAD_BUTTONS, pressed);
+  _state->serial.run([state = _state.get(), pressed] {
+    apply_pressed_buttons(*state, pressed);
+    report_changed(*state);
+  });
+}
+
+static void apply_triggers(PS5JoypadState &state, int16_t left, int16_t right) {
+  state.current_state.z = scale_value(left, 0, 255, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
+  state.current_state.rz = scale_value(right, 0, 255, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
 }
+
 void PS5Joypad::set_triggers(int16_t left, int16_t right) {
-  this->_state->current_state.z = scale_value(left, 0, 255, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
-  this->_state->current_state.rz = scale_value(right, 0, 255, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
-  send_report(*this->_state);
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::JOYPAD_TRIGGERS, left, right);
+  _state->serial.run([state = _state.get(), left, right] {
+    apply_triggers(*state, left, right);
+    report_changed(*state);
+  });
 }
-void PS5Joypad::set_stick(Joypad::STICK_POSITION stick_type, short x, short y) {
+
+static void apply_stick(PS5JoypadState &state, Joypad::STICK_POSITION stick_type, short x, short y) {
   switch (stick_type) {
-  case RS: {
-    this->_state->current_state.rx = scale_value(x, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
-    this->_state->current_state.ry = scale_value(-y, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
-    send_report(*this->_state);
+  case Joypad::RS: {
+    state.current_state.rx = scale_value(x, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
+    state.current_state.ry = scale_value(-y, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
     break;
   }
-  case LS: {
-    this->_state->current_state.x = scale_value(x, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
-    this->_state->current_state.y = scale_value(-y, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
-    send_report(*this->_state);
+  case Joypad::LS: {
+    state.current_state.x = scale_value(x, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
+    state.current_state.y = scale_value(-y, -32768, 32767, uhid::PS5_AXIS_MIN, uhid::PS5_AXIS_MAX);
     break;
   }
   }
 }
+
+void PS5Joypad::set_stick(Joypad::STICK_POSITION stick_type, short x, short y) {
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::JOYPAD_STICK, stick_type, x, y);
+  _state->serial.run([state = _state.get(), stick_type, x, y] {
+    apply_stick(*state, stick_type, x, y);
+    report_changed(*state);
+  });
+}
+
+void PS5Joypad::set_state(const GamepadState &gamepad) {
+  trace::record(_state.get(),
+                trace::DeviceKind::PS5_JOYPAD,
+                trace::Op::JOYPAD_STATE,
+                gamepad.buttons,
+                gamepad.left_stick_x,
+                gamepad.left_stick_y,
+                gamepad.right_stick_x,
+                gamepad.right_stick_y,
+                gamepad.left_trigger,
+                gamepad.right_trigger);
+  _state->serial.run([state = _state.get(), gamepad] {
+    apply_pressed_buttons(*state, gamepad.buttons);
+    apply_stick(*state, LS, gamepad.left_stick_x, gamepad.left_stick_y);
+    apply_stick(*state, RS, gamepad.right_stick_x, gamepad.right_stick_y);
+    apply_triggers(*state, gamepad.left_trigger, gamepad.right_trigger);
+    report_changed(*state);
+  });
+}
+
 void PS5Joypad::set_on_rumble(const std::function<void(int, int)> &callback) {
-  this->_state->on_rumble = callback;
+  this->_state->on_rumble.set(callback);
 }
 
-static __le16 to_le_signed(float original, float value) {
-  auto le = htole16(value);
-  if (original < 0) { // adjust sign bit
-    le |= (1 << 15);  // set the last bit (bit 15) to 1
-  }
-  return le;
+/**
+ * The sensors are little endian two's complement: saturate to the int16 range (a float to integer conversion out of
+ * range is undefined) and round to the nearest unit
+ */
+static __le16 to_le_signed(float value) {
+  auto clamped = std::clamp(value, -32768.0f, 32767.0f);
+  auto rounded = static_cast<int16_t>(std::lrint(clamped));
+  return htole16(static_cast<uint16_t>(rounded));
+}
+
+static void apply_acceleration(PS5JoypadState &state, float x, float y, float z) {
+  constexpr float scale = uhid::SDL_STANDARD_GRAVITY * 100;
+  state.current_state.accel[0] = to_le_signed(x * scale);
+  state.current_state.accel[1] = to_le_signed(y * scale);
+  state.current_state.accel[2] = to_le_signed(z * scale);
+}
+
+static void apply_gyroscope(PS5JoypadState &state, float x, float y, float z) {
+  state.current_state.gyro[0] = to_le_signed(x * uhid::gyro_resolution);
+  state.current_state.gyro[1] = to_le_signed(y * uhid::gyro_resolution);
+  state.current_state.gyro[2] = to_le_signed(z * uhid::gyro_resolution);
 }
 
 void PS5Joypad::set_motion(PS5Joypad::MOTION_TYPE type, float x, float y, float z) {
-  switch (type) {
-  case ACCELERATION: {
-    this->_state->current_state.accel[0] = to_le_signed(x, (x * uhid::SDL_STANDARD_GRAVITY * 100));
-    this->_state->current_state.accel[1] = to_le_signed(y, (y * uhid::SDL_STANDARD_GRAVITY * 100));
-    this->_state->current_state.accel[2] = to_le_signed(z, (z * uhid::SDL_STANDARD_GRAVITY * 100));
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::PS5_MOTION, type, x, y, z);
+  _state->serial.run([state = _state.get(), type, x, y, z] {
+    switch (type) {
+    case ACCELERATION: {
+      apply_acceleration(*state, x, y, z);
+      report_changed(*state);
+      break;
+    }
+    case GYROSCOPE: {
+      apply_gyroscope(*state, x, y, z);
+      report_changed(*state);
+      break;
+    }
+    }
+  });
+}
 
-    send_report(*this->_state);
-    break;
+static void apply_sample(PS5JoypadState &state, const PS5Joypad::MotionSample &sample) {
+  apply_acceleration(state, sample.accel_x, sample.accel_y, sample.accel_z);
+  apply_gyroscope(state, sample.gyro_x, sample.gyro_y, sample.gyro_z);
+  state.motion_timestamp = sample.timestamp;
+}
+
+static PS5Joypad::MotionSample pop_sample(PS5JoypadState &state) {
+  auto sample = state.motion_queue[state.motion_queue_head];
+  state.motion_queue_head = (state.motion_queue_head + 1) % PS5JoypadState::MOTION_QUEUE_SIZE;
+  state.motion_queue_count--;
+  return sample;
+}
+
+static void push_sample(PS5JoypadState &state, const PS5Joypad::MotionSample &sample) {
+  if (state.motion_queue_count == PS5JoypadState::MOTION_QUEUE_SIZE) { // Full: the oldest sample is dropped
+    pop_sample(state);
+    state.metrics.add_coalesced();
   }
-  case GYROSCOPE: {
-    this->_state->current_state.gyro[0] = to_le_signed(x, x * uhid::gyro_resolution);
-    this->_state->current_state.gyro[1] = to_le_signed(y, y * uhid::gyro_resolution);
-    this->_state->current_state.gyro[2] = to_le_signed(z, z * uhid::gyro_resolution);
+  auto tail = (state.motion_queue_head + state.motion_queue_count) % PS5JoypadState::MOTION_QUEUE_SIZE;
+  state.motion_queue[tail] = sample;
+  state.motion_queue_count++;
+}
 
-    send_report(*this->_state);
-    break;
+/**
+ * Sends the oldest queued sample, must be called from an operation on `serial`.
+ * When more than half of the queue is used, the two oldest samples are averaged into one report with the timestamp of
+ * the second: the motion stays continuous (the report covers the time of both samples) while the backlog drains.
+ */
+static void send_queued_sample(PS5JoypadState &state) {
+  auto sample = pop_sample(state);
+  if (state.motion_queue_count >= PS5JoypadState::MOTION_QUEUE_SIZE / 2) {
+    auto next = pop_sample(state);
+    sample = {.accel_x = (sample.accel_x + next.accel_x) / 2,
+              .accel_y = (sample.accel_y + next.accel_y) / 2,
+              .accel_z = (sample.accel_z + next.accel_z) / 2,
+              .gyro_x = (sample.gyro_x + next.gyro_x) / 2,
+              .gyro_y = (sample.gyro_y + next.gyro_y) / 2,
+              .gyro_z = (sample.gyro_z + next.gyro_z) / 2,
+              .timestamp = next.timestamp};
+    state.metrics.add_coalesced();
   }
+  apply_sample(state, sample);
+  send_report(state);
+}
+
+/**
+ * Registers the task that sends the next queued sample at `next_motion_report`, must be called from an operation on
+ * `serial`. The reports are spaced out from each other, not from when the samples arrived: after an idle period (or
+ * if the Scheduler was late) the first report goes out right away instead of bursting to catch up.
+ */
+static void schedule_motion_report(PS5JoypadState &state) {
+  auto now = std::chrono::steady_clock::now();
+  if (state.next_motion_report < now) {
+    state.next_motion_report = now;
   }
+  auto delay = std::chrono::duration_cast<std::chrono::microseconds>(state.next_motion_report - now);
+  auto motion_task = [weak_state = state.weak_from_this()]() -> std::optional<std::chrono::microseconds> {
+    if (auto state = weak_state.lock()) {
+      state->serial.run([state = state.get()] {
+        state->motion_task = 0;
+        if (state->motion_queue_count == 0 || !state->dev) {
+          return;
+        }
+        send_queued_sample(*state);
+        state->next_motion_report += state->motion_interval;
+        if (state->motion_queue_count > 0) {
+          schedule_motion_report(*state);
+        }
+      });
+    }
+    return {};
+  };
+  state.motion_task = Scheduler::get().schedule(delay, motion_task);
 }
 
-void PS5Joypad::set_battery(PS5Joypad::BATTERY_STATE state, int percentage) {
-  /*
-   * Each unit of battery data corresponds to 10%
-   * 0 = 0-9%, 1 = 10-19%, .. and 10 = 100%
-   */
-  this->_state->current_state.battery_charge = std::lround((percentage / 10));
-  this->_state->current_state.battery_status = state;
-  send_report(*this->_state);
+void PS5Joypad::set_motion(const MotionSample &sample) {
+  trace::record(_state.get(),
+                trace::DeviceKind::PS5_JOYPAD,
+                trace::Op::PS5_MOTION_SAMPLE,
+                sample.accel_x,
+                sample.accel_y,
+                sample.accel_z,
+                sample.gyro_x,
+                sample.gyro_y,
+                sample.gyro_z,
+                sample.timestamp.count());
+  _state->serial.run([state = _state.get(), sample] {
+    if (state->motion_interval.count() > 0) {
+      push_sample(*state, sample);
+      if (!state->motion_task) {
+        schedule_motion_report(*state);
+      }
+      return;
+    }
+    apply_sample(*state, sample);
+    report_changed(*state);
+  });
+}
+
+void PS5Joypad::set_battery(PS5Joypad::BATTERY_STATE battery_state, int percentage) {
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::PS5_BATTERY, battery_state, percentage);
+  _state->serial.run([state = _state.get(), battery_state, percentage] {
+    /*
+     * Each unit of battery data corresponds to 10%
+     * 0 = 0-9%, 1 = 10-19%, .. and 10 = 100%
+     */
+    state->current_state.battery_charge = std::lround((percentage / 10));
+    state->current_state.battery_status = battery_state;
+    report_changed(*state);
+  });
 }
 
 void PS5Joypad::set_on_led(const std::function<void(int, int, int)> &callback) {
-  this->_state->on_led = callback;
+  this->_state->on_led.set(callback);
 }
 
-void PS5Joypad::place_finger(int finger_nr, uint16_t x, uint16_t y) {
-  if (finger_nr <= 1) {
-    // If this finger was previously unpressed, we should increase the touch id
-    if (this->_state->current_state.points[finger_nr].contact == 1) {
-      this->_state->current_state.points[finger_nr].id = ++this->_state->last_touch_id;
+void PS5Joypad::set_report_rate(int max_rate_hz) {
+  _state->serial.run([state = _state.get(), max_rate_hz] {
+    if (max_rate_hz <= 0) {
+      if (state->report_dirty) {
+        send_report(*state);
+      }
+      state->report_interval = std::chrono::microseconds{0};
+      return;
     }
-    this->_state->current_state.points[finger_nr].contact = 0;
 
-    this->_state->current_state.points[finger_nr].x_lo = static_cast<uint8_t>(x & 0x00FF);
-    this->_state->current_state.points[finger_nr].x_hi = static_cast<uint8_t>((x & 0xFF00) >> 8);
+    state->report_interval = std::chrono::microseconds{1000000 / max_rate_hz};
+  });
+}
 
-    this->_state->current_state.points[finger_nr].y_lo = static_cast<uint8_t>((y & 0x00F0) << 4);
-    this->_state->current_state.points[finger_nr].y_hi = static_cast<uint8_t>(y >> 4);
+void PS5Joypad::set_motion_rate(int rate_hz) {
+  _state->serial.run([state = _state.get(), rate_hz] {
+    if (rate_hz <= 0) {
+      // Skip straight to the latest sample, from now on samples are sent as soon as they arrive
+      if (state->motion_queue_count > 0) {
+        auto last = (state->motion_queue_head + state->motion_queue_count - 1) % PS5JoypadState::MOTION_QUEUE_SIZE;
+        apply_sample(*state, state->motion_queue[last]);
+        for (; state->motion_queue_count > 1; state->motion_queue_count--) {
+          state->metrics.add_coalesced();
+        }
+        state->motion_queue_count = 0;
+        report_changed(*state);
+      }
+      state->motion_interval = std::chrono::microseconds{0};
+      return;
+    }
 
-    send_report(*this->_state);
-  }
+    state->motion_interval = std::chrono::microseconds{1000000 / rate_hz};
+  });
+}
+
+void PS5Joypad::place_finger(int finger_nr, uint16_t x, uint16_t y) {
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::PS5_PLACE_FINGER, finger_nr, x, y);
+  _state->serial.run([state = _state.get(), finger_nr, x, y] {
+    if (finger_nr <= 1) {
+      // If this finger was previously unpressed, we should increase the touch id
+      if (state->current_state.points[finger_nr].contact == 1) {
+        state->current_state.points[finger_nr].id = ++state->last_touch_id;
+      }
+      state->current_state.points[finger_nr].contact = 0;
+
+      state->current_state.points[finger_nr].x_lo = static_cast<uint8_t>(x & 0x00FF);
+      state->current_state.points[finger_nr].x_hi = static_cast<uint8_t>((x & 0xFF00) >> 8);
+
+      // 12 bits each, y is split the other way around: see dualsense_parse_report() in hid-playstation.c
+      state->current_state.points[finger_nr].y_lo = static_cast<uint8_t>(y & 0x000F);
+      state->current_state.points[finger_nr].y_hi = static_cast<uint8_t>(y >> 4);
+
+      report_changed(*state);
+    }
+  });
 }
 
 void PS5Joypad::release_finger(int finger_nr) {
-  if (finger_nr <= 1) {
-    // if it goes above 0x7F we should reset it to 0
-    if (this->_state->last_touch_id >= 0x7E) {
-      this->_state->last_touch_id = 0;
+  trace::record(_state.get(), trace::DeviceKind::PS5_JOYPAD, trace::Op::PS5_RELEASE_FINGER, finger_nr);
+  _state->serial.run([state = _state.get(), finger_nr] {
+    if (finger_nr <= 1) {
+      // if it goes above 0x7F we should reset it to 0
+      if (state->last_touch_id >= 0x7E) {
+        state->last_touch_id = 0;
+      }
+      state->current_state.points[finger_nr].contact = 1;
+      report_changed(*state);
     }
-    this->_state->current_state.points[finger_nr].contact = 1;
-    send_report(*this->_state);
-  }
+  });
 }
 
 } // namespace inputtino
@@ -0,0 +1,197 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <inputtino/backend.hpp>
+#ifdef INPUTTINO_IO_URING
+#include <inputtino/io_uring_backend.hpp>
+#endif
+#include <iostream>
+#include <libevdev/libevdev-uinput.h>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace inputtino {
+
+/**
+ * uinput accepts any number of `input_event` in a single write, see `uinput_inject_events()` in
+ * https://github.com/torvalds/linux/blob/master/drivers/input/misc/uinput.c
+ */
+class UinputOutput : public EvdevOutput {
+public:
+  explicit UinputOutput(libevdev_uinput *device) : device(device), fd(libevdev_uinput_get_fd(device)) {
+    // read_events() must not block; uinput writes never do, so this doesn't change anything for them
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  }
+
+  ~UinputOutput() override {
+    libevdev_uinput_destroy(device);
+  }
+
+  Result<bool> write_frame(const input_event *events, std::size_t count) override {
+    auto bytes = count * sizeof(input_event);
+    ssize_t ret = write(fd, events, bytes);
+    if (ret < 0) {
+      return Error(strerror(errno));
+    } else if (static_cast<std::size_t>(ret) != bytes) {
+      return Error(strerror(EFAULT));
+    }
+    return true;
+  }
+
+  std::size_t read_events(input_event *buffer, std::size_t max) override {
+    ssize_t ret = read(fd, buffer, sizeof(input_event) * max);
+    if (ret < 0) {
+      if (errno != EAGAIN) {
+        std::cerr << "Failed reading uinput fd; ret=" << strerror(errno) << std::endl;
+      }
+      return 0;
+    } else if (ret % sizeof(input_event) != 0) {
+      std::cerr << "Uinput incorrect read size of " << ret << std::endl;
+    }
+    return static_cast<std::size_t>(ret) / sizeof(input_event);
+  }
+
+  int poll_fd() const override {
+    return fd;
+  }
+
+  void begin_ff_upload(uinput_ff_upload &upload) override {
+    ioctl(fd, UI_BEGIN_FF_UPLOAD, &upload);
+  }
+
+  void end_ff_upload(const uinput_ff_upload &upload) override {
+    ioctl(fd, UI_END_FF_UPLOAD, &upload);
+  }
+
+  void begin_ff_erase(uinput_ff_erase &erase) override {
+    ioctl(fd, UI_BEGIN_FF_ERASE, &erase);
+  }
+
+  void end_ff_erase(const uinput_ff_erase &erase) override {
+    ioctl(fd, UI_END_FF_ERASE, &erase);
+  }
+
+  std::string devnode() const override {
+    auto node = libevdev_uinput_get_devnode(device);
+    return node ? node : "";
+  }
+
+  std::string syspath() const override {
+    auto path = libevdev_uinput_get_syspath(device);
+    return path ? path : "";
+  }
+
+private:
+  libevdev_uinput *device;
+  int fd;
+};
+
+/**
+ * The kernel only reads the bytes that we write, so events can be written partially as long as `size` covers
+ * the header and the used part of the payload (see uhid::input2_event_size()).
+ */
+static Result<bool> uhid_write(int fd, const uhid_event &ev, std::size_t size) {
+  ssize_t ret = write(fd, &ev, size);
+  if (ret < 0) {
+    return Error(strerror(errno));
+  } else if (ret != static_cast<ssize_t>(size)) {
+    return Error(strerror(EFAULT));
+  }
+  return true;
+}
+
+class UhidOutput : public HidOutput {
+public:
+  explicit UhidOutput(int fd) : fd(fd) {}
+
+  ~UhidOutput() override {
+    uhid_event ev{};
+    ev.type = UHID_DESTROY;
+    uhid_write(fd, ev, sizeof(ev));
+    close(fd);
+  }
+
+  Result<bool> write(const uhid_event &ev, std::size_t size) override {
+    return uhid_write(fd, ev, size);
+  }
+
+  bool read(uhid_event &ev) override {
+    auto ret = ::read(fd, &ev, sizeof(ev));
+    if (ret < 0) {
+      if (errno != EAGAIN) {
+        std::cerr << "Cannot read uhid-cdev: " << strerror(errno) << std::endl;
+      }
+      return false;
+    } else if (ret != sizeof(ev)) {
+      std::cerr << "Invalid size read from uhid-dev" << ret << " != " << sizeof(ev) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  int poll_fd() const override {
+    return fd;
+  }
+
+private:
+  int fd;
+};
+
+class SystemBackend : public OutputBackend {
+public:
+  Result<evdev_output_ptr> create_evdev(const libevdev *dev) override {
+    libevdev_uinput *uidev;
+    auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
+    if (err != 0) {
+      return Error(strerror(-err));
+    }
+    return evdev_output_ptr{std::make_shared<UinputOutput>(uidev)};
+  }
+
+  Result<hid_output_ptr> create_hid(const uhid_create2_req &definition) override {
+    int fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+      return Error(strerror(errno));
+    }
+
+    uhid_event ev{};
+    ev.type = UHID_CREATE2;
+    ev.u.create2 = definition;
+    if (auto res = uhid_write(fd, ev, sizeof(ev)); !res) {
+      close(fd);
+      return Error(res.getErrorMessage());
+    }
+    return hid_output_ptr{std::make_shared<UhidOutput>(fd)};
+  }
+};
+
+std::shared_ptr<OutputBackend> system_output_backend() {
+  static auto backend = std::make_shared<SystemBackend>();
+  return backend;
+}
+
+static std::shared_ptr<OutputBackend> default_output_backend() {
+#ifdef INPUTTINO_IO_URING
+  static auto backend = io_uring_output_backend();
+  return backend;
+#else
+  return system_output_backend();
+#endif
+}
+
+static std::mutex backend_mutex;
+static std::shared_ptr<OutputBackend> current_backend;
+
+void set_output_backend(std::shared_ptr<OutputBackend> backend) {
+  std::lock_guard lock(backend_mutex);
+  current_backend = std::move(backend);
+}
+
+std::shared_ptr<OutputBackend> get_output_backend() {
+  std::lock_guard lock(backend_mutex);
+  return current_backend ? current_backend : default_output_backend();
+}
+
+} // namespace inputtino
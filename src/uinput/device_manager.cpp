@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <inputtino/device_manager.hpp>
+#include <thread>
+
+namespace inputtino {
+
+static std::size_t slot_index(DeviceManager::Handle handle) {
+  return static_cast<std::size_t>(handle & 0xFFFFFFFF);
+}
+
+static std::uint32_t slot_generation(DeviceManager::Handle handle) {
+  return static_cast<std::uint32_t>(handle >> 32);
+}
+
+DeviceManager::~DeviceManager() {
+  std::vector<AnyDevice> devices;
+  {
+    std::unique_lock lock(m);
+    for (std::size_t index = 0; index < slots.size(); index++) {
+      if (slots[index].used) {
+        devices.push_back(release(index));
+      }
+    }
+    clients.clear();
+  }
+  destroy_in_parallel(std::move(devices));
+}
+
+Result<DeviceManager::Handle> DeviceManager::add(const ClientId &client, AnyDevice device) {
+  std::unique_lock lock(m);
+  std::size_t index;
+  if (!free_slots.empty()) {
+    index = free_slots.back();
+    free_slots.pop_back();
+  } else if (slots.size() < 0xFFFFFFFF) {
+    index = slots.size();
+    slots.emplace_back();
+  } else {
+    return Error("Too many devices");
+  }
+
+  auto &slot = slots[index];
+  slot.generation++; // never 0, so that 0 is never a valid handle
+  slot.used = true;
+  slot.device = std::move(device);
+  slot.client = client;
+  auto handle = (static_cast<Handle>(slot.generation) << 32) | index;
+  clients[client].insert(handle);
+  return handle;
+}
+
+DeviceManager::AnyDevice DeviceManager::get(Handle handle) const {
+  std::shared_lock lock(m);
+  auto index = slot_index(handle);
+  if (index < slots.size() && slots[index].used && slots[index].generation == slot_generation(handle)) {
+    return slots[index].device;
+  }
+  return {};
+}
+
+std::shared_ptr<VirtualDevice> DeviceManager::get_device(Handle handle) const {
+  return std::visit([](const auto &ptr) -> std::shared_ptr<VirtualDevice> { return ptr; }, get(handle));
+}
+
+DeviceManager::AnyDevice DeviceManager::release(std::size_t index) {
+  auto &slot = slots[index];
+  auto device = std::move(slot.device);
+  slot.device = {};
+  slot.client.clear();
+  slot.used = false;
+  if (slot.generation == 0xFFFFFFFF) {
+    slot.generation = 0; // wrapped around, `generation++` in add() will make it 1 again
+  }
+  free_slots.push_back(index);
+  return device;
+}
+
+bool DeviceManager::remove(Handle handle) {
+  AnyDevice device;
+  {
+    std::unique_lock lock(m);
+    auto index = slot_index(handle);
+    if (index >= slots.size() || !slots[index].used || slots[index].generation != slot_generation(handle)) {
+      return false;
+    }
+    if (auto client = clients.find(slots[index].client); client != clients.end()) {
+      client->second.erase(handle);
+      if (client->second.empty()) {
+        clients.erase(client);
+      }
+    }
+    device = release(index);
+  }
+  return true; // `device` is destroyed here, outside of the lock
+}
+
+std::size_t DeviceManager::remove_client(const ClientId &client) {
+  std::vector<AnyDevice> devices;
+  {
+    std::unique_lock lock(m);
+    auto handles = clients.find(client);
+    if (handles == clients.end()) {
+      return 0;
+    }
+    for (auto handle : handles->second) {
+      devices.push_back(release(slot_index(handle)));
+    }
+    clients.erase(handles);
+  }
+  auto count = devices.size();
+  destroy_in_parallel(std::move(devices));
+  return count;
+}
+
+std::vector<DeviceManager::Handle> DeviceManager::handles(const ClientId &client) const {
+  std::shared_lock lock(m);
+  if (auto handles = clients.find(client); handles != clients.end()) {
+    return {handles->second.begin(), handles->second.end()};
+  }
+  return {};
+}
+
+std::size_t DeviceManager::size() const {
+  std::shared_lock lock(m);
+  return slots.size() - free_slots.size();
+}
+
+void DeviceManager::parallel_for(std::size_t count, const std::function<void(std::size_t)> &task) {
+  auto threads_count = std::min<std::size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+  if (threads_count <= 1) {
+    for (std::size_t index = 0; index < count; index++) {
+      task(index);
+    }
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(threads_count);
+  for (std::size_t thread = 0; thread < threads_count; thread++) {
+    threads.emplace_back([thread, threads_count, count, &task]() {
+      for (auto index = thread; index < count; index += threads_count) {
+        task(index);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void DeviceManager::destroy_in_parallel(std::vector<AnyDevice> devices) {
+  // The devices are only destroyed here if nobody else holds a reference, otherwise this is just a refcount drop
+  parallel_for(devices.size(), [&devices](std::size_t index) { devices[index] = {}; });
+}
+
+} // namespace inputtino
@@ -0,0 +1,58 @@
+#include <cstdint>
+#include <inputtino/protected_types.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace inputtino {
+
+/* Past this many different definitions the new ones are built for each device, the cache can't grow unbounded */
+constexpr std::size_t MAX_TEMPLATES = 64;
+
+using TemplateKey = std::tuple<std::uintptr_t, std::string, uint16_t, uint16_t, uint16_t>;
+using evdev_template_ptr = std::shared_ptr<const libevdev>;
+
+static evdev_template_ptr build_template(const DeviceDefinition &device, EnableEvents enable_events) {
+  libevdev *dev = libevdev_new();
+
+  libevdev_set_name(dev, device.name.c_str());
+  libevdev_set_id_vendor(dev, device.vendor_id);
+  libevdev_set_id_product(dev, device.product_id);
+  libevdev_set_id_version(dev, device.version);
+  libevdev_set_id_bustype(dev, BUS_USB);
+
+  enable_events(dev);
+  return evdev_template_ptr(dev, [](const libevdev *dev) { libevdev_free(const_cast<libevdev *>(dev)); });
+}
+
+Result<evdev_output_ptr> create_evdev_device(const DeviceDefinition &device, EnableEvents enable_events) {
+  static std::mutex templates_mutex;
+  static std::map<TemplateKey, evdev_template_ptr> templates;
+
+  TemplateKey key{reinterpret_cast<std::uintptr_t>(enable_events),
+                  device.name,
+                  device.vendor_id,
+                  device.product_id,
+                  device.version};
+  evdev_template_ptr dev;
+  {
+    std::lock_guard lock(templates_mutex);
+    if (auto cached = templates.find(key); cached != templates.end()) {
+      dev = cached->second;
+    }
+  }
+
+  if (!dev) {
+    dev = build_template(device, enable_events);
+    std::lock_guard lock(templates_mutex);
+    if (templates.size() < MAX_TEMPLATES) {
+      templates.emplace(std::move(key), dev);
+    }
+  }
+
+  // The (slow) UI_DEV_CREATE happens outside of the lock, the template is only read
+  return get_output_backend()->create_evdev(dev.get());
+}
+
+} // namespace inputtino
@@ -0,0 +1,123 @@
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <inputtino/event_loop.hpp>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace inputtino {
+
+constexpr int MAX_EPOLL_EVENTS = 32;
+
+EventLoop &EventLoop::get() {
+  static EventLoop instance;
+  return instance;
+}
+
+EventLoop::EventLoop() {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epoll_fd < 0 || wake_fd < 0) {
+    std::cerr << "Unable to create the event loop; " << strerror(errno) << std::endl;
+    return;
+  }
+
+  epoll_event ev{.events = EPOLLIN, .data = {.u64 = 0}}; // 0 is reserved for the wake up fd
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+EventLoop::~EventLoop() {
+  {
+    std::lock_guard lock(m);
+    stop = true;
+  }
+  if (thread.joinable()) {
+    std::uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+    thread.join();
+  }
+  if (wake_fd >= 0) {
+    close(wake_fd);
+  }
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+  }
+}
+
+Result<EventLoop::HandleId> EventLoop::add(int fd, Handler handler, std::uint32_t events) {
+  std::lock_guard lock(m);
+  if (epoll_fd < 0) {
+    return Error("Event loop not available");
+  }
+
+  auto id = next_id++;
+  epoll_event ev{.events = events, .data = {.u64 = id}};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    return Error(strerror(errno));
+  }
+  registrations.emplace(id, Registration{.fd = fd, .handler = std::make_shared<Handler>(std::move(handler))});
+
+  if (!thread.joinable()) {
+    thread = std::thread(&EventLoop::run, this);
+  }
+  return id;
+}
+
+void EventLoop::remove(HandleId id) {
+  std::unique_lock lock(m);
+  if (auto reg = registrations.find(id); reg != registrations.end()) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, reg->second.fd, nullptr);
+    registrations.erase(reg);
+  }
+
+  if (std::this_thread::get_id() != thread.get_id()) {
+    handler_done.wait(lock, [this, id] { return running_id != id; });
+  }
+}
+
+void EventLoop::run() {
+  std::array<epoll_event, MAX_EPOLL_EVENTS> events{};
+  while (true) {
+    int ready = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Failed waiting on the event loop; " << strerror(errno) << std::endl;
+      return;
+    }
+
+    for (int i = 0; i < ready; i++) {
+      auto id = events[i].data.u64;
+      std::shared_ptr<Handler> handler;
+      {
+        std::lock_guard lock(m);
+        if (stop) {
+          return;
+        }
+        auto reg = registrations.find(id);
+        if (reg == registrations.end()) { // wake up fd, or removed since epoll_wait() returned
+          continue;
+        }
+        handler = reg->second.handler;
+        running_id = id;
+      }
+
+      bool keep = (*handler)(events[i].events);
+      handler.reset(); // if it has been removed in the meantime, captures are released before remove() returns
+
+      {
+        std::lock_guard lock(m);
+        running_id = 0;
+        if (auto reg = registrations.find(id); !keep && reg != registrations.end()) {
+          epoll_ctl(epoll_fd, EPOLL_CTL_DEL, reg->second.fd, nullptr);
+          registrations.erase(reg);
+        }
+      }
+      handler_done.notify_all();
+    }
+  }
+}
+
+} // namespace inputtino
@@ -0,0 +1,81 @@
+#include <cerrno>
+#include <cstring>
+#include <inputtino/feedback.hpp>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace inputtino {
+
+Result<std::shared_ptr<FeedbackMailbox>> FeedbackMailbox::create() {
+  int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fd < 0) {
+    return Error(strerror(errno));
+  }
+  return std::shared_ptr<FeedbackMailbox>(new FeedbackMailbox(fd));
+}
+
+FeedbackMailbox::~FeedbackMailbox() {
+  close(event_fd);
+}
+
+void FeedbackMailbox::post_rumble(int low_freq, int high_freq) {
+  rumble.store((static_cast<std::uint64_t>(static_cast<std::uint32_t>(low_freq)) << 32) |
+                   static_cast<std::uint32_t>(high_freq),
+               std::memory_order_relaxed);
+  post(RUMBLE);
+}
+
+void FeedbackMailbox::post_led(int r, int g, int b) {
+  led.store((static_cast<std::uint32_t>(r & 0xFF) << 16) | (static_cast<std::uint32_t>(g & 0xFF) << 8) |
+                static_cast<std::uint32_t>(b & 0xFF),
+            std::memory_order_relaxed);
+  post(LED);
+}
+
+void FeedbackMailbox::post(PENDING what) {
+  // release: the value stored above is visible to whoever sees the flag
+  if (pending.fetch_or(what, std::memory_order_acq_rel) == 0) { // only the first update wakes the consumer up
+    std::uint64_t one = 1;
+    write(event_fd, &one, sizeof(one));
+  }
+}
+
+std::function<void(int, int)> FeedbackMailbox::rumble_callback() {
+  return [mailbox = shared_from_this()](int low_freq, int high_freq) { mailbox->post_rumble(low_freq, high_freq); };
+}
+
+std::function<void(int, int, int)> FeedbackMailbox::led_callback() {
+  return [mailbox = shared_from_this()](int r, int g, int b) { mailbox->post_led(r, g, b); };
+}
+
+FeedbackMailbox::Feedback FeedbackMailbox::take() {
+  // Reset the eventfd first: a post() that comes after the exchange below will make it readable again
+  std::uint64_t count = 0;
+  read(event_fd, &count, sizeof(count));
+
+  Feedback feedback;
+  auto what = pending.exchange(0, std::memory_order_acq_rel);
+  if (what & RUMBLE) {
+    auto value = rumble.load(std::memory_order_relaxed);
+    feedback.rumble = Rumble{.low_freq = static_cast<int>(static_cast<std::uint32_t>(value >> 32)),
+                             .high_freq = static_cast<int>(static_cast<std::uint32_t>(value))};
+  }
+  if (what & LED) {
+    auto value = led.load(std::memory_order_relaxed);
+    feedback.led = Led{.r = static_cast<int>((value >> 16) & 0xFF),
+                       .g = static_cast<int>((value >> 8) & 0xFF),
+                       .b = static_cast<int>(value & 0xFF)};
+  }
+  return feedback;
+}
+
+FeedbackMailbox::Feedback FeedbackMailbox::wait(std::chrono::milliseconds timeout) {
+  if (pending.load(std::memory_order_acquire) == 0) {
+    pollfd fd{.fd = event_fd, .events = POLLIN, .revents = 0};
+    poll(&fd, 1, static_cast<int>(timeout.count()));
+  }
+  return take();
+}
+
+} // namespace inputtino
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <inputtino/result.hpp>
+#include <linux/input.h>
+#include <linux/uhid.h>
+#include <linux/uinput.h>
+#include <memory>
+#include <string>
+
+struct libevdev;
+
+namespace inputtino {
+
+/**
+ * The kernel side of a virtual evdev device: where the frames of a device are written and where the requests for it
+ * (force feedback uploads, rumble, ...) come from.
+ *
+ * The device is destroyed together with the last reference to it.
+ */
+class EvdevOutput {
+public:
+  virtual ~EvdevOutput() = default;
+
+  /**
+   * Writes `count` events with a single call; readers only see them once the SYN_REPORT has been written
+   */
+  virtual Result<bool> write_frame(const input_event *events, std::size_t count) = 0;
+
+  /**
+   * Reads up to `max` of the queued events without blocking, returns how many have been read
+   */
+  virtual std::size_t read_events(input_event *buffer, std::size_t max) = 0;
+
+  /**
+   * Readable while read_events() has something to return, to be watched by the EventLoop; -1 if there's none
+   */
+  virtual int poll_fd() const = 0;
+
+  /**
+   * Retrieves the effect of an UI_FF_UPLOAD request (`upload.request_id` is the value of the EV_UINPUT event), the
+   * request is completed by end_ff_upload() with the `retval` set
+   */
+  virtual void begin_ff_upload(uinput_ff_upload &upload) = 0;
+  virtual void end_ff_upload(const uinput_ff_upload &upload) = 0;
+
+  /**
+   * Same as begin/end_ff_upload() for UI_FF_ERASE requests
+   */
+  virtual void begin_ff_erase(uinput_ff_erase &erase) = 0;
+  virtual void end_ff_erase(const uinput_ff_erase &erase) = 0;
+
+  /**
+   * The /dev/input/eventXX node, empty if the device is not visible to the system (ex: MockBackend)
+   */
+  virtual std::string devnode() const = 0;
+
+  /**
+   * The /sys/devices/virtual/input/inputXX path, empty if the device is not visible to the system
+   */
+  virtual std::string syspath() const = 0;
+};
+
+using evdev_output_ptr = std::shared_ptr<EvdevOutput>;
+
+/**
+ * Same as EvdevOutput for the HID devices that we create through uhid
+ */
+class HidOutput {
+public:
+  virtual ~HidOutput() = default;
+
+  /**
+   * Only the first `size` bytes of `ev` are written, see uhid::input2_event_size()
+   */
+  virtual Result<bool> write(const uhid_event &ev, std::size_t size = sizeof(uhid_event)) = 0;
+
+  /**
+   * Reads one queued event (GET_REPORT, OUTPUT, ...) without blocking, returns false if there was none
+   */
+  virtual bool read(uhid_event &ev) = 0;
+
+  /**
+   * Readable while read() has something to return, to be watched by the EventLoop; -1 if there's none
+   */
+  virtual int poll_fd() const = 0;
+};
+
+using hid_output_ptr = std::shared_ptr<HidOutput>;
+
+/**
+ * Creates the devices: all the device classes go through the current backend (see set_output_backend()) instead of
+ * talking to /dev/uinput and /dev/uhid directly.
+ */
+class OutputBackend {
+public:
+  virtual ~OutputBackend() = default;
+
+  /**
+   * `dev` describes the device (name, ids, enabled events, abs info), it's only used during the call
+   */
+  virtual Result<evdev_output_ptr> create_evdev(const libevdev *dev) = 0;
+
+  virtual Result<hid_output_ptr> create_hid(const uhid_create2_req &definition) = 0;
+};
+
+/**
+ * The default backend: /dev/uinput (through libevdev) and /dev/uhid
+ */
+std::shared_ptr<OutputBackend> system_output_backend();
+
+/**
+ * The backend used for all the devices created from now on, devices that already exist keep their own.
+ * Passing nullptr restores the default: io_uring_output_backend() when built with INPUTTINO_IO_URING,
+ * system_output_backend() otherwise.
+ */
+void set_output_backend(std::shared_ptr<OutputBackend> backend);
+
+std::shared_ptr<OutputBackend> get_output_backend();
+
+} // namespace inputtino
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace inputtino {
+
+/**
+ * A callback that can be replaced while another thread is invoking it, ex: set_on_rumble() while the EventLoop is
+ * serving a force feedback request.
+ *
+ * get() returns a reference counted snapshot: the lock is only held to copy the pointer, never while the callback
+ * runs, so a callback that has just been replaced might still be completing a call on another thread.
+ */
+template <typename Signature> class CallbackSlot {
+public:
+  using Callback = std::function<Signature>;
+
+  void set(const Callback &callback) {
+    auto next = callback ? std::make_shared<const Callback>(callback) : nullptr;
+    std::lock_guard lock(m);
+    current.swap(next); // the previous one is released after the lock, it might run arbitrary destructors
+  }
+
+  /**
+   * nullptr when no callback has been set
+   */
+  std::shared_ptr<const Callback> get() const {
+    std::lock_guard lock(m);
+    return current;
+  }
+
+private:
+  mutable std::mutex m;
+  std::shared_ptr<const Callback> current;
+};
+
+} // namespace inputtino
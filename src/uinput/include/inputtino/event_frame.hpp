@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cerrno>
+#include <cstring>
+#include <inputtino/backend.hpp>
+#include <inputtino/metrics_counters.hpp>
+#include <inputtino/result.hpp>
+#include <linux/input.h>
+
+namespace inputtino {
+
+/**
+ * The last value written for each axis of a device.
+ *
+ * The input core drops ABS events that don't change the current value, so readers can't tell an axis that has been
+ * re-written with the same value from one that hasn't been written at all. Keeping a shadow copy lets us skip those
+ * events on our side and, when nothing has changed, skip the SYN_REPORT and the write() altogether.
+ */
+template <std::size_t N> class AxisShadow {
+public:
+  /**
+   * When set, update() will always report a change: every axis is written on every call
+   */
+  bool force = false;
+
+  /**
+   * Returns true if `value` is different from the last one written to `axis`
+   */
+  bool changed(std::size_t axis, int value) const {
+    return force || !written.test(axis) || values[axis] != value;
+  }
+
+  /**
+   * Returns true if `value` has to be written, the new value is recorded
+   */
+  bool update(std::size_t axis, int value) {
+    if (!changed(axis, value)) {
+      return false;
+    }
+    values[axis] = value;
+    written.set(axis);
+    return true;
+  }
+
+  /**
+   * Forget all the values, the next update() for each axis will always be written
+   */
+  void reset() {
+    written.reset();
+  }
+
+private:
+  std::array<int, N> values = {};
+  std::bitset<N> written;
+};
+
+using AbsShadow = AxisShadow<ABS_CNT>;
+
+/**
+ * Collects the events of one (or more) evdev frames and sends them to the device with a single
+ * EvdevOutput::write_frame(): for uinput, instead of paying one syscall for each REL_X, REL_Y and SYN_REPORT we only
+ * pay one for the whole frame.
+ *
+ * The events are kept in a fixed size buffer (no allocations); if more than N events are added the buffer is
+ * flushed early. This is safe: evdev readers will only see the events once the SYN_REPORT has been written.
+ */
+template <std::size_t N = 32> class EventFrame {
+public:
+  /**
+   * `metrics` (optional) will count every write
+   */
+  explicit EventFrame(EvdevOutput *device, MetricsCounters *metrics = nullptr) : device(device), metrics(metrics) {}
+
+  EventFrame(const EventFrame &) = delete;
+  EventFrame &operator=(const EventFrame &) = delete;
+
+  void add(unsigned short type, unsigned short code, int value) {
+    if (size == N) {
+      flush();
+    }
+    auto &ev = events[size++];
+    ev = {};
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+  }
+
+  /**
+   * Closes the current frame, readers will see all the events added so far as a single state change
+   */
+  void syn() {
+    add(EV_SYN, SYN_REPORT, 0);
+  }
+
+  /**
+   * Adds the ABS event only if the value is different from the last one written, see AxisShadow
+   */
+  template <std::size_t S> void add_abs(AxisShadow<S> &shadow, unsigned short code, int value) {
+    if (shadow.update(code, value)) {
+      add(EV_ABS, code, value);
+    }
+  }
+
+  bool empty() const {
+    return size == 0;
+  }
+
+  /**
+   * Closes the frame and writes it to the device; does nothing if no event has been added (unless `force` is set)
+   */
+  Result<bool> syn_and_flush(bool force = false) {
+    if (empty() && !force) {
+      return true;
+    }
+    syn();
+    return flush();
+  }
+
+  /**
+   * Writes all the pending events to the device
+   */
+  Result<bool> flush() {
+    if (size == 0) {
+      return true;
+    }
+    auto count = size;
+    size = 0;
+    auto res = device ? device->write_frame(events.data(), count) : Result<bool>(Error(strerror(EBADF)));
+    if (metrics) {
+      metrics->add_write(count, static_cast<bool>(res));
+    }
+    return res;
+  }
+
+private:
+  EvdevOutput *device;
+  MetricsCounters *metrics;
+  std::size_t size = 0;
+  std::array<input_event, N> events;
+};
+
+} // namespace inputtino
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <inputtino/result.hpp>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <thread>
+#include <unordered_map>
+
+namespace inputtino {
+
+/**
+ * A single, process wide, epoll thread that dispatches readiness events for the file descriptors of all the devices
+ * (uinput ff requests, uhid output reports, rumble timers, ...).
+ *
+ * The thread is started the first time something gets registered and blocks in epoll_wait() without a timeout,
+ * so it only wakes up when one of the registered fds is actually ready.
+ *
+ * Handlers run on the loop thread: they should be quick and must not block.
+ */
+class EventLoop {
+public:
+  using HandleId = std::uint64_t;
+
+  /**
+   * Called with the `epoll_event::events` mask; return false in order to unregister the fd (ex: on EPOLLHUP)
+   */
+  using Handler = std::function<bool(std::uint32_t events)>;
+
+  static EventLoop &get();
+
+  /**
+   * Starts watching `fd` (level triggered), ids are never 0 so 0 can be used to mark "not registered".
+   * The fd must be kept open until remove() has been called.
+   */
+  Result<HandleId> add(int fd, Handler handler, std::uint32_t events = EPOLLIN);
+
+  /**
+   * Stops watching the fd. When called from outside the loop thread this will also wait for the handler to finish if
+   * it's currently running, so that it's safe to release the resources used by the handler right after.
+   * It's fine to call this with an id that has already been removed.
+   */
+  void remove(HandleId id);
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+private:
+  EventLoop();
+  ~EventLoop();
+
+  void run();
+
+  struct Registration {
+    int fd;
+    std::shared_ptr<Handler> handler;
+  };
+
+  int epoll_fd = -1;
+  int wake_fd = -1;
+
+  std::mutex m;
+  std::condition_variable handler_done;
+  std::unordered_map<HandleId, Registration> registrations;
+  HandleId next_id = 1;
+  HandleId running_id = 0;
+  bool stop = false;
+  std::thread thread;
+};
+
+} // namespace inputtino
@@ -1,19 +1,28 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
 #include <linux/input-event-codes.h>
-#include <map>
+#include <optional>
 
 namespace inputtino::keyboard {
 
 struct KEY_MAP {
-  int linux_code;
-  int scan_code;
+  int linux_code = KEY_RESERVED;
+  int scan_code = 0;
 };
 
 constexpr auto UNKNOWN = 0;
 
+struct VK_MAPPING {
+  short vk;
+  KEY_MAP key;
+};
+
 /**
- * A map of [Moonlight keyboard code] -> {linux_code, scan_code}
+ * A list of [Moonlight keyboard code] -> {linux_code, scan_code}
  */
-static const std::map<short, KEY_MAP> key_mappings = {
+inline constexpr VK_MAPPING key_mappings[] = {
     {0x08, {KEY_BACKSPACE, 0x7002A}},  {0x09, {KEY_TAB, 0x7002B}},
     {0x0C, {KEY_CLEAR, UNKNOWN}},      {0x0D, {KEY_ENTER, 0x70028}},
     {0x10, {KEY_LEFTSHIFT, 0x700E1}},  {0x11, {KEY_LEFTCTRL, 0x700E0}},
@@ -74,4 +83,28 @@ static const std::map<short, KEY_MAP> key_mappings = {
     {0xDE, {KEY_APOSTROPHE, 0x70034}}, {0xE2, {KEY_102ND, 0x70064}},
 };
 
+/**
+ * Moonlight keyboard codes are Windows virtual key codes, so they all fit in a byte
+ */
+constexpr std::size_t VK_TABLE_SIZE = 256;
+
+/**
+ * `key_mappings` directly indexed by the Moonlight keyboard code, built at compile time.
+ * Codes that aren't mapped have `linux_code == KEY_RESERVED`.
+ */
+inline constexpr std::array<KEY_MAP, VK_TABLE_SIZE> key_table = [] {
+  std::array<KEY_MAP, VK_TABLE_SIZE> table{};
+  for (const auto &mapping : key_mappings) {
+    table[mapping.vk] = mapping.key;
+  }
+  return table;
+}();
+
+constexpr std::optional<KEY_MAP> find_key(short key_code) {
+  if (key_code < 0 || key_code >= static_cast<short>(VK_TABLE_SIZE) || key_table[key_code].linux_code == KEY_RESERVED) {
+    return std::nullopt;
+  }
+  return key_table[key_code];
+}
+
 } // namespace wolf::core::input::keyboard
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <inputtino/metrics.hpp>
+
+namespace inputtino {
+
+/**
+ * The counters behind DeviceMetrics, updated on the hot path with relaxed atomics only (readers might see a snapshot
+ * where the counters are slightly out of sync with each other).
+ *
+ * Without INPUTTINO_METRICS the class has no state and all the methods are empty: it compiles down to nothing.
+ */
+class MetricsCounters {
+public:
+  using Clock = std::chrono::steady_clock;
+
+#ifdef INPUTTINO_METRICS
+  /**
+   * One write() of `events` events (or reports); `frame` is false for writes that don't carry input (ex: uhid
+   * GET_REPORT replies)
+   */
+  void add_write(std::size_t events, bool ok, bool frame = true) {
+    syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (ok) {
+      events_written.fetch_add(events, std::memory_order_relaxed);
+    } else {
+      write_errors.fetch_add(1, std::memory_order_relaxed);
+      if (frame) {
+        frames_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void add_coalesced() {
+    frames_coalesced.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void add_ff_effect() {
+    ff_effects_handled.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * The time to be passed to add_rumble_callback()
+   */
+  static Clock::time_point now() {
+    return Clock::now();
+  }
+
+  void add_rumble_callback(Clock::time_point since) {
+    auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now() - since).count());
+    rumble_callbacks.fetch_add(1, std::memory_order_relaxed);
+    rumble_callback_ns_total.fetch_add(ns, std::memory_order_relaxed);
+    auto max = rumble_callback_ns_max.load(std::memory_order_relaxed);
+    while (ns > max && !rumble_callback_ns_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  DeviceMetrics snapshot() const {
+    return {.events_written = events_written.load(std::memory_order_relaxed),
+            .syscalls = syscalls.load(std::memory_order_relaxed),
+            .write_errors = write_errors.load(std::memory_order_relaxed),
+            .frames_coalesced = frames_coalesced.load(std::memory_order_relaxed),
+            .frames_dropped = frames_dropped.load(std::memory_order_relaxed),
+            .ff_effects_handled = ff_effects_handled.load(std::memory_order_relaxed),
+            .rumble_callbacks = rumble_callbacks.load(std::memory_order_relaxed),
+            .rumble_callback_ns_total = rumble_callback_ns_total.load(std::memory_order_relaxed),
+            .rumble_callback_ns_max = rumble_callback_ns_max.load(std::memory_order_relaxed)};
+  }
+
+private:
+  std::atomic<std::uint64_t> events_written{0};
+  std::atomic<std::uint64_t> syscalls{0};
+  std::atomic<std::uint64_t> write_errors{0};
+  std::atomic<std::uint64_t> frames_coalesced{0};
+  std::atomic<std::uint64_t> frames_dropped{0};
+  std::atomic<std::uint64_t> ff_effects_handled{0};
+  std::atomic<std::uint64_t> rumble_callbacks{0};
+  std::atomic<std::uint64_t> rumble_callback_ns_total{0};
+  std::atomic<std::uint64_t> rumble_callback_ns_max{0};
+#else
+  void add_write(std::size_t, bool, bool = true) {}
+
+  void add_coalesced() {}
+
+  void add_ff_effect() {}
+
+  static Clock::time_point now() {
+    return {};
+  }
+
+  void add_rumble_callback(Clock::time_point) {}
+
+  DeviceMetrics snapshot() const {
+    return {};
+  }
+#endif
+};
+
+} // namespace inputtino
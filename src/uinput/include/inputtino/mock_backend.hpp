@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <inputtino/backend.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace inputtino {
+
+/**
+ * Records the frames in a ring buffer instead of sending them anywhere, see MockBackend
+ */
+class MockEvdevOutput : public EvdevOutput {
+public:
+  MockEvdevOutput(std::string name, std::size_t capacity);
+  ~MockEvdevOutput() override;
+
+  const std::string name;
+
+  /**
+   * The events written so far, oldest first; only the last `capacity` events are kept
+   */
+  std::vector<input_event> events() const;
+
+  /**
+   * How many write_frame() calls have been made
+   */
+  std::size_t frames_written() const;
+
+  /**
+   * How many events have been written, including the ones that have been overwritten in the ring
+   */
+  std::size_t events_written() const;
+
+  void clear();
+
+  /**
+   * Queues an event as if it came from the kernel (ex: EV_FF in order to play an uploaded effect)
+   */
+  void inject(unsigned short type, unsigned short code, int value);
+
+  /**
+   * Queues an UI_FF_UPLOAD request for `effect`, as the kernel does when a client uploads an effect
+   */
+  void inject_ff_upload(const ff_effect &effect);
+
+  /**
+   * Queues an UI_FF_ERASE request for `effect_id`
+   */
+  void inject_ff_erase(int effect_id);
+
+  Result<bool> write_frame(const input_event *events, std::size_t count) override;
+  std::size_t read_events(input_event *buffer, std::size_t max) override;
+  int poll_fd() const override;
+  void begin_ff_upload(uinput_ff_upload &upload) override;
+  void end_ff_upload(const uinput_ff_upload &upload) override;
+  void begin_ff_erase(uinput_ff_erase &erase) override;
+  void end_ff_erase(const uinput_ff_erase &erase) override;
+
+  std::string devnode() const override {
+    return {};
+  }
+
+  std::string syspath() const override {
+    return {};
+  }
+
+private:
+  void queue(const input_event &ev);
+
+  mutable std::mutex mutex;
+  std::vector<input_event> ring;
+  std::size_t total_events = 0;
+  std::size_t total_frames = 0;
+
+  /* Kernel side, read_events() drains it; event_fd is readable while it's not empty */
+  std::deque<input_event> pending;
+  int event_fd;
+  int next_request_id = 0;
+  std::map<int, ff_effect> uploads;
+  std::map<int, int> erases;
+};
+
+/**
+ * Same as MockEvdevOutput for the uhid devices: the INPUT2 reports are kept in a ring buffer
+ */
+class MockHidOutput : public HidOutput {
+public:
+  MockHidOutput(const uhid_create2_req &definition, std::size_t capacity);
+  ~MockHidOutput() override;
+
+  const uhid_create2_req definition;
+
+  /**
+   * The payload of the INPUT2 reports written so far, oldest first; only the last `capacity` are kept
+   */
+  std::vector<std::vector<std::uint8_t>> reports() const;
+
+  std::size_t reports_written() const;
+
+  /**
+   * Everything else that has been written (ex: UHID_GET_REPORT_REPLY), oldest first
+   */
+  std::vector<uhid_event> replies() const;
+
+  void clear();
+
+  /**
+   * Queues an event as if it came from the kernel (ex: UHID_OUTPUT with a rumble report)
+   */
+  void inject(const uhid_event &ev);
+
+  Result<bool> write(const uhid_event &ev, std::size_t size) override;
+  bool read(uhid_event &ev) override;
+  int poll_fd() const override;
+
+private:
+  mutable std::mutex mutex;
+  std::vector<std::vector<std::uint8_t>> ring;
+  std::size_t total_reports = 0;
+  std::vector<uhid_event> other_events;
+
+  std::deque<uhid_event> pending;
+  int event_fd;
+};
+
+/**
+ * An OutputBackend that keeps everything in memory: nothing is visible to the system and no access to /dev/uinput or
+ * /dev/uhid is needed, so the devices can be used (and benchmarked) in CI and containers.
+ *
+ *   auto mock = std::make_shared<MockBackend>();
+ *   set_output_backend(mock);
+ *   auto mouse = Mouse::create();
+ *   mouse->move(10, 10);
+ *   mock->evdev_devices()[0]->events(); // REL_X, REL_Y, SYN_REPORT
+ */
+class MockBackend : public OutputBackend {
+public:
+  /**
+   * `capacity`: how many events (or reports) each device keeps
+   */
+  explicit MockBackend(std::size_t capacity = 1024) : capacity(capacity) {}
+
+  Result<evdev_output_ptr> create_evdev(const libevdev *dev) override;
+  Result<hid_output_ptr> create_hid(const uhid_create2_req &definition) override;
+
+  /**
+   * The devices created by this backend that are still alive, in creation order
+   */
+  std::vector<std::shared_ptr<MockEvdevOutput>> evdev_devices() const;
+  std::vector<std::shared_ptr<MockHidOutput>> hid_devices() const;
+
+private:
+  std::size_t capacity;
+  mutable std::mutex mutex;
+  std::vector<std::weak_ptr<MockEvdevOutput>> evdev;
+  std::vector<std::weak_ptr<MockHidOutput>> hid;
+};
+
+} // namespace inputtino
@@ -1,77 +1,278 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <inputtino/backend.hpp>
+#include <inputtino/callback_slot.hpp>
+#include <inputtino/event_frame.hpp>
+#include <inputtino/event_loop.hpp>
 #include <inputtino/input.hpp>
+#include <inputtino/keyboard.hpp>
+#include <inputtino/metrics_counters.hpp>
+#include <inputtino/scheduler.hpp>
+#include <inputtino/serial_queue.hpp>
+#include <inputtino/uevent_monitor.hpp>
 #include <iostream>
-#include <libevdev/libevdev-uinput.h>
 #include <libevdev/libevdev.h>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
 namespace inputtino {
 
-using libevdev_uinput_ptr = std::shared_ptr<libevdev_uinput>;
-using libevdev_event_ptr = std::shared_ptr<input_event>;
-
 /**
- * Given a uinput fd will read all queued events available at this time up to max_events
+ * A view over the events stored in a caller owned buffer, valid until the buffer is reused
  */
-static std::vector<libevdev_event_ptr> fetch_events(int uinput_fd, int max_events = 50) {
-  std::vector<libevdev_event_ptr> events = {};
-  struct input_event ev {};
-  int ret, read_events = 0;
-  while (read_events < max_events && (ret = read(uinput_fd, &ev, sizeof(ev))) == sizeof(ev)) {
-    events.push_back(std::make_shared<input_event>(ev));
-    read_events++;
+struct EventsView {
+  const input_event *first = nullptr;
+  std::size_t count = 0;
+
+  const input_event *begin() const {
+    return first;
+  }
+
+  const input_event *end() const {
+    return first + count;
   }
-  if (ret < 0 && errno != EAGAIN) {
-    std::cerr << "Failed reading uinput fd; ret=" << strerror(errno);
-  } else if (ret > 0) {
-    std::cerr << "Uinput incorrect read size of " << ret;
+
+  bool empty() const {
+    return count == 0;
   }
+};
+
+/**
+ * Reads all the queued events available at this time, up to the size of `buffer`, with a single
+ * EvdevOutput::read_events() call.
+ * Nothing is allocated: the returned view points into `buffer`.
+ */
+template <std::size_t N> static EventsView fetch_events(EvdevOutput &device, std::array<input_event, N> &buffer) {
+  return {buffer.data(), device.read_events(buffer.data(), N)};
+}
 
-  return events;
+/**
+ * Appends the /dev/input node of `device` to `nodes`, devices that are not visible to the system don't have one
+ */
+static void add_devnode(std::vector<std::string> &nodes, const EvdevOutput *device) {
+  if (device) {
+    if (auto node = device->devnode(); !node.empty()) {
+      nodes.push_back(std::move(node));
+    }
+  }
 }
 
+/**
+ * Enables the events, properties and abs info of one kind of device, see create_evdev_device()
+ */
+using EnableEvents = void (*)(libevdev *dev);
+
+/**
+ * Creates an evdev device with the current OutputBackend.
+ *
+ * The libevdev description (name and ids from `device`, then `enable_events`) is only built the first time and kept
+ * for the devices of the same kind and definition that are created later, so the keyboard (one call for each key)
+ * and the joypads don't rebuild it on every session start. The templates are never modified once built, so devices
+ * can still be created from any number of threads at the same time.
+ */
+Result<evdev_output_ptr> create_evdev_device(const DeviceDefinition &device, EnableEvents enable_events);
+
 struct PenTabletState {
-  libevdev_uinput_ptr pen_tablet = nullptr;
+  evdev_output_ptr pen_tablet = nullptr;
+  MetricsCounters metrics; // see get_metrics()
+  /* Runs place_tool() and set_btn(); the fields below are only modified by the operations */
+  SerialQueue<> serial;
   PenTablet::TOOL_TYPE last_tool = PenTablet::SAME_AS_BEFORE;
+  AbsShadow abs_shadow;
 };
 
 struct BaseJoypadState {
-  libevdev_uinput_ptr joy = nullptr;
+  evdev_output_ptr joy = nullptr;
+  MetricsCounters metrics; // see get_metrics()
+  /* Runs set_pressed_buttons(), set_stick() ... the fields below are only accessed by the operations */
+  SerialQueue<> serial;
   int currently_pressed_btns = 0;
+  AbsShadow abs_shadow;
+
+  /* Force feedback requests and the rumble timer are served by the shared EventLoop, see start_event_listener() */
+  EventLoop::HandleId uinput_listener = 0;
+  EventLoop::HandleId rumble_timer_listener = 0;
+  int rumble_timer_fd = -1;
+  /* How often the rumble is updated while an effect is changing over time (envelope, ramp, periodic) */
+  std::atomic<int> rumble_resolution_ms{8};
 
-  bool stop_listening_events = false;
-  std::thread events_thread;
+  /* Set by set_on_rumble() on any thread, invoked on the EventLoop */
+  CallbackSlot<void(int low_freq, int high_freq)> on_rumble;
 
-  std::optional<std::function<void(int low_freq, int high_freq)>> on_rumble = std::nullopt;
+  /* The /dev/input/js* child shows up a bit after the device has been created, see get_child_dev_nodes() */
+  NodesCache nodes;
 };
 
 struct XboxOneJoypadState : BaseJoypadState {};
-struct SwitchJoypadState : BaseJoypadState {};
+struct SwitchJoypadState : BaseJoypadState {
+  /* ZL and ZR are buttons, we only have to send them when they change */
+  bool left_trigger_pressed = false;
+  bool right_trigger_pressed = false;
+};
+
+struct KeyboardState : std::enable_shared_from_this<KeyboardState> {
+  evdev_output_ptr kb = nullptr;
+  MetricsCounters metrics; // see get_metrics()
 
-struct KeyboardState {
-  std::thread repeat_press_t;
-  bool stop_repeat_thread = false;
-  libevdev_uinput_ptr kb = nullptr;
-  std::vector<short> cur_press_keys = {};
+  /* Runs press(), release() and the key repeat; the fields below are only modified by the operations */
+  SerialQueue<> serial;
+  /* Indexed by Moonlight keyboard code, see keyboard::key_table */
+  std::bitset<keyboard::VK_TABLE_SIZE> cur_press_keys = {};
+
+  /**
+   * Key repeat runs on the shared Scheduler, the task is only registered while at least one key is held down
+   */
+  std::chrono::milliseconds repeat_interval{50};
+  std::atomic<Scheduler::TaskId> repeat_task = 0;
 };
 
-struct MouseState {
-  libevdev_uinput_ptr mouse_rel = nullptr;
-  libevdev_uinput_ptr mouse_abs = nullptr;
+struct MouseState : std::enable_shared_from_this<MouseState> {
+  evdev_output_ptr mouse_rel = nullptr;
+  evdev_output_ptr mouse_abs = nullptr;
+  MetricsCounters metrics; // see get_metrics()
+  /* Runs all the public methods and the coalescing flush; the fields below are only modified by the operations */
+  SerialQueue<> serial;
+  AbsShadow abs_shadow;
+  /* When set, zero deltas are written as well, see DeviceDefinition::force_writes */
+  bool force_writes = false;
+
+  /**
+   * Motion coalescing, see Mouse::set_motion_coalescing()
+   * When enabled, pending motion is written out either by the next call that comes after `flush_interval` has passed
+   * or by a task on the shared Scheduler, which is only registered when there's something pending.
+   */
+  std::chrono::microseconds flush_interval{0};
+  std::chrono::steady_clock::time_point last_flush = {};
+
+  bool pending_rel = false;
+  int pending_dx = 0;
+  int pending_dy = 0;
+  bool pending_abs = false;
+  int pending_abs_x = 0;
+  int pending_abs_y = 0;
+  bool pending_scroll = false;
+  int pending_v_scroll = 0; // high resolution
+  int pending_h_scroll = 0;
+
+  /**
+   * The high resolution distance that hasn't been written as a low resolution notch (REL_WHEEL/REL_HWHEEL) yet; it's
+   * carried over to the next scroll so that the notches always add up to the high resolution total.
+   */
+  int v_scroll_remainder = 0;
+  int h_scroll_remainder = 0;
+
+  /* The fractional relative motion that hasn't been written yet, see Mouse::move(double, double) */
+  double rel_remainder_x = 0;
+  double rel_remainder_y = 0;
+
+  /* See Mouse::set_acceleration(), `last_move` is used to compute the speed */
+  std::optional<PointerAcceleration> acceleration;
+  std::chrono::steady_clock::time_point last_move = {};
+  /* Written by set_acceleration(), moved into `acceleration` by the operation it runs: set if there's a new profile */
+  std::mutex pending_acceleration_m;
+  std::optional<std::optional<PointerAcceleration>> pending_acceleration;
+
+  std::atomic<Scheduler::TaskId> flush_task = 0;
+};
+
+/**
+ * Fixed size table that maps finger ids to MT slots, no allocations and no tree lookups.
+ * `used` is a bitmask of the slots that currently hold a finger, new fingers get the lowest free slot so that slots
+ * are correctly reused regardless of the order in which fingers are released.
+ */
+struct FingerSlots {
+  static constexpr int MAX_SLOTS = 16;
+
+  /* ABS_MT_TRACKING_ID goes from 0 to this (a power of two minus one), -1 releases the slot */
+  static constexpr int MAX_TRACKING_ID = 65535;
+
+  std::array<int /* finger_id */, MAX_SLOTS> finger_ids = {};
+  std::uint32_t used = 0;
+  int next_tracking_id = 0;
+
+  /* The MT axes are per slot, so is their shadow; see AxisShadow */
+  enum MT_AXIS { MT_X, MT_Y, MT_PRESSURE, MT_ORIENTATION, MT_AXES };
+  std::array<AxisShadow<MT_AXES>, MAX_SLOTS> axes = {};
+
+  /**
+   * Returns the slot of the given finger, -1 if not found
+   */
+  int find(int finger_id) const {
+    for (auto free = used; free != 0; free &= free - 1) {
+      int slot = __builtin_ctz(free);
+      if (finger_ids[slot] == finger_id) {
+        return slot;
+      }
+    }
+    return -1;
+  }
+
+  /**
+   * Returns the newly assigned slot, -1 if all the slots are taken
+   */
+  int acquire(int finger_id) {
+    auto free = ~used & ((1u << MAX_SLOTS) - 1);
+    if (free == 0) {
+      return -1;
+    }
+    int slot = __builtin_ctz(free);
+    finger_ids[slot] = finger_id;
+    used |= 1u << slot;
+    axes[slot].reset(); // a new contact, let's write all of its axes
+    return slot;
+  }
+
+  void release(int slot) {
+    used &= ~(1u << slot);
+  }
+
+  /**
+   * Returns the ABS_MT_TRACKING_ID for a new contact.
+   * It has to be different from the one the slot had before: a finger released and another one placed in the same
+   * frame end up in the same slot, reusing the id would look like the first finger moving instead of a new contact.
+   */
+  int new_tracking_id() {
+    auto id = next_tracking_id;
+    next_tracking_id = (next_tracking_id + 1) & MAX_TRACKING_ID;
+    return id;
+  }
+
+  int size() const {
+    return __builtin_popcount(used);
+  }
+
+  void set_force_writes(bool force) {
+    for (auto &slot_axes : axes) {
+      slot_axes.force = force;
+    }
+  }
 };
 
+/* Operations carry a whole TouchFrame, they need bigger (and fewer) slots */
+using TouchSerialQueue = SerialQueue<sizeof(std::pair<void *, TouchFrame>), 16>;
+
 struct TouchScreenState {
-  libevdev_uinput_ptr touch_screen = nullptr;
+  evdev_output_ptr touch_screen = nullptr;
+  MetricsCounters metrics; // see get_metrics()
+  /* Runs apply(); the fields below are only modified by the operations */
+  TouchSerialQueue serial;
 
   /**
    * Multi touch protocol type B is stateful; see: https://docs.kernel.org/input/multi-touch-protocol.html
-   * Slots are numbered starting from 0 up to <number of currently connected fingers> (max: 4)
+   * Slots are numbered starting from 0 up to FingerSlots::MAX_SLOTS - 1
    *
    * The way it works:
-   * - first time a new finger_id arrives we'll create a new slot and call MT_TRACKING_ID = slot_number
+   * - first time a new finger_id arrives we'll take the lowest free slot and call MT_TRACKING_ID = new_tracking_id()
    * - we can keep updating ABS_X and ABS_Y as long as the finger_id stays the same
    * - if we want to update a different finger we'll have to call ABS_MT_SLOT = slot_number
    * - when a finger is released we'll call ABS_MT_SLOT = slot_number && MT_TRACKING_ID = -1
@@ -81,19 +282,24 @@ struct TouchScreenState {
    */
   /* The MT_SLOT we are currently updating */
   int current_slot = -1;
-  /* A map of finger_id to MT_SLOT */
-  std::map<int /* finger_id */, int /* MT_SLOT */> fingers;
+  /* finger_id to MT_SLOT */
+  FingerSlots fingers;
+  /* ABS_X, ABS_Y and ABS_PRESSURE (single touch emulation) */
+  AbsShadow abs_shadow;
 };
 
 struct TrackpadState {
-  libevdev_uinput_ptr trackpad = nullptr;
+  evdev_output_ptr trackpad = nullptr;
+  MetricsCounters metrics; // see get_metrics()
+  /* Runs apply() and set_left_btn(); the fields below are only modified by the operations */
+  TouchSerialQueue serial;
 
   /**
    * Multi touch protocol type B is stateful; see: https://docs.kernel.org/input/multi-touch-protocol.html
-   * Slots are numbered starting from 0 up to <number of currently connected fingers> (max: 4)
+   * Slots are numbered starting from 0 up to FingerSlots::MAX_SLOTS - 1
    *
    * The way it works:
-   * - first time a new finger_id arrives we'll create a new slot and call MT_TRACKING_ID = slot_number
+   * - first time a new finger_id arrives we'll take the lowest free slot and call MT_TRACKING_ID = new_tracking_id()
    * - we can keep updating ABS_X and ABS_Y as long as the finger_id stays the same
    * - if we want to update a different finger we'll have to call ABS_MT_SLOT = slot_number
    * - when a finger is released we'll call ABS_MT_SLOT = slot_number && MT_TRACKING_ID = -1
@@ -103,8 +309,10 @@ struct TrackpadState {
    */
   /* The MT_SLOT we are currently updating */
   int current_slot = -1;
-  /* A map of finger_id to MT_SLOT */
-  std::map<int /* finger_id */, int /* MT_SLOT */> fingers;
+  /* finger_id to MT_SLOT */
+  FingerSlots fingers;
+  /* ABS_X, ABS_Y and ABS_PRESSURE (single touch emulation) */
+  AbsShadow abs_shadow;
 };
 
 } // namespace inputtino
\ No newline at end of file
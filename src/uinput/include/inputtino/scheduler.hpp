@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace inputtino {
+
+/**
+ * A single, process wide, timer thread shared by all the devices.
+ *
+ * Tasks are kept in a min-heap ordered by deadline; the thread sleeps until the earliest one is due and doesn't wake
+ * up at all when there's nothing scheduled, so idle devices cost nothing.
+ * The thread is only started the first time something gets scheduled.
+ *
+ * Tasks run on the scheduler thread, they should be quick and must not block.
+ * Tasks that reference a device should capture a `std::weak_ptr` to its state, a task might be about to run while
+ * the device is being destroyed; `cancel_and_wait()` takes care of one that is already running.
+ */
+class Scheduler {
+public:
+  using TaskId = std::uint64_t;
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * Returns the delay after which the task should run again, or an empty optional to stop
+   */
+  using Task = std::function<std::optional<std::chrono::microseconds>()>;
+
+  static Scheduler &get();
+
+  /**
+   * Runs `task` once `delay` has passed; returns an id that can be used to cancel it.
+   * Ids are never 0, so 0 can be used to mark "nothing scheduled".
+   */
+  TaskId schedule(std::chrono::microseconds delay, Task task);
+
+  /**
+   * Removes the task, it's fine to call this with an id that has already completed or has been cancelled.
+   * If the task is running right now it's left to complete, it just won't run again.
+   */
+  void cancel(TaskId id);
+
+  /**
+   * Like cancel(), but if the task is running right now this waits for it to return: meant for the destructors of the
+   * devices, so that a task isn't still using the state while it's being torn down.
+   * It doesn't wait when called from a task (on the scheduler thread); it must not be called from an operation that
+   * the task itself might be waiting for (ex: on a device `serial` queue).
+   */
+  void cancel_and_wait(TaskId id);
+
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+private:
+  Scheduler() = default;
+  ~Scheduler();
+
+  void run();
+
+  struct Deadline {
+    clock::time_point when;
+    TaskId id;
+
+    bool operator>(const Deadline &other) const {
+      return when > other.when;
+    }
+  };
+
+  std::mutex m;
+  std::condition_variable cv;
+  /* The task that is running right now (0 if none), cancel_and_wait() waits on `done` for it */
+  TaskId running = 0;
+  std::condition_variable done;
+  std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> deadlines;
+  std::unordered_map<TaskId, Task> tasks;
+  TaskId next_id = 1;
+  bool stop = false;
+  std::thread thread;
+};
+
+} // namespace inputtino
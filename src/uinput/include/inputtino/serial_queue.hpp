@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace inputtino {
+
+/**
+ * Serialises the operations on a device without taking a lock, so that the same device can be driven from
+ * multiple threads.
+ *
+ * Operations are pushed into a bounded lock free MPSC ring; the thread that finds nothing pending becomes the
+ * "combiner" and runs all the queued operations, including the ones pushed by other threads in the meantime, until
+ * nothing is pending anymore (flat combining).
+ * Operations pushed by the same thread run in order, but they might be run by another thread after run() has
+ * returned; when a device is only used from a single thread everything runs synchronously in the calling thread.
+ *
+ * Operations are stored inline: they must be trivially copyable (ex: a lambda capturing a state pointer and a few
+ * values) and fit in `SlotSize` bytes, nothing is allocated. Operations must not call run() on the same queue.
+ */
+template <std::size_t SlotSize = 64, std::size_t Capacity = 64> class SerialQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  SerialQueue() {
+    for (std::size_t i = 0; i < Capacity; i++) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  SerialQueue(const SerialQueue &) = delete;
+  SerialQueue &operator=(const SerialQueue &) = delete;
+
+  template <typename Operation> void run(const Operation &op) {
+    static_assert(std::is_trivially_copyable_v<Operation>, "Operations are copied around as plain bytes");
+    static_assert(sizeof(Operation) <= SlotSize, "Operation doesn't fit in a slot, increase SlotSize");
+    static_assert(alignof(Operation) <= alignof(std::max_align_t), "Operation is over aligned");
+
+    push(&invoke<Operation>, &op, sizeof(Operation));
+    if (pending.fetch_add(1, std::memory_order_acq_rel) != 0) {
+      return; // Another thread is currently the combiner, it'll run our operation as well
+    }
+
+    do {
+      run_next();
+    } while (pending.fetch_sub(1, std::memory_order_acq_rel) != 1);
+  }
+
+private:
+  using Invoke = void (*)(const void *op);
+
+  template <typename Operation> static void invoke(const void *op) {
+    (*static_cast<const Operation *>(op))();
+  }
+
+  struct Slot {
+    /* Vyukov's bounded queue: == pos when free, == pos + 1 once the operation for `pos` has been written */
+    std::atomic<std::size_t> seq;
+    Invoke invoke;
+    alignas(std::max_align_t) unsigned char op[SlotSize];
+  };
+
+  void push(Invoke invoke, const void *op, std::size_t size) {
+    auto pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      auto &slot = slots[pos & (Capacity - 1)];
+      auto diff = static_cast<std::intptr_t>(slot.seq.load(std::memory_order_acquire)) -
+                  static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.invoke = invoke;
+          std::memcpy(slot.op, op, size);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return;
+        }
+      } else {
+        if (diff < 0) { // Full: the combiner is running, wait for it to make room
+          std::this_thread::yield();
+        }
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Only called by the combiner; the handover of `dequeue_pos` between combiners is ordered by `pending`
+   */
+  void run_next() {
+    auto &slot = slots[dequeue_pos & (Capacity - 1)];
+    while (slot.seq.load(std::memory_order_acquire) != dequeue_pos + 1) {
+      std::this_thread::yield(); // The slot has been claimed but the operation is still being written
+    }
+    slot.invoke(slot.op);
+    slot.seq.store(dequeue_pos + Capacity, std::memory_order_release);
+    dequeue_pos++;
+  }
+
+  alignas(64) std::atomic<std::size_t> enqueue_pos{0};
+  alignas(64) std::atomic<std::size_t> pending{0};
+  std::size_t dequeue_pos = 0;
+  Slot slots[Capacity];
+};
+
+} // namespace inputtino
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <inputtino/event_loop.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace inputtino {
+
+/**
+ * Listens to the kernel uevents (NETLINK_KOBJECT_UEVENT) through the shared EventLoop and keeps track of when input
+ * devices or nodes (ex: /dev/input/js0) have been added or removed.
+ *
+ * This is what allows us to cache the results of a sysfs scan (see NodesCache) instead of walking sysfs on every
+ * get_nodes() call.
+ */
+class UeventMonitor {
+public:
+  static UeventMonitor &get();
+
+  /**
+   * Changes every time something in the input subsystem has been added or removed
+   */
+  std::uint64_t generation() const {
+    return current_generation.load(std::memory_order_acquire);
+  }
+
+  /**
+   * False when uevents aren't available, or when we haven't received any yet: inside a network namespace (ex: a
+   * container) the socket opens just fine but the kernel doesn't deliver anything, so we can't rely on it.
+   */
+  bool is_active() const {
+    return active.load(std::memory_order_acquire);
+  }
+
+  UeventMonitor(const UeventMonitor &) = delete;
+  UeventMonitor &operator=(const UeventMonitor &) = delete;
+
+private:
+  UeventMonitor();
+  ~UeventMonitor();
+
+  bool on_events(std::uint32_t events);
+
+  int netlink_fd = -1;
+  EventLoop::HandleId listener = 0;
+  std::atomic<std::uint64_t> current_generation{0};
+  std::atomic<bool> active{false};
+};
+
+/**
+ * The result of a (slow) sysfs scan, it's only re-computed after UeventMonitor reports that something in the input
+ * subsystem has been added or removed.
+ */
+class NodesCache {
+public:
+  template <typename Scan> std::vector<std::string> get(const Scan &scan) {
+    auto &monitor = UeventMonitor::get();
+    // Read before scanning: if something changes while we are scanning the next call will scan again
+    auto generation = monitor.generation();
+    std::lock_guard lock(m);
+    if (!valid || generation != cached_generation || !monitor.is_active()) {
+      nodes = scan();
+      cached_generation = generation;
+      valid = true;
+    }
+    return nodes;
+  }
+
+private:
+  std::mutex m;
+  bool valid = false;
+  std::uint64_t cached_generation = 0;
+  std::vector<std::string> nodes;
+};
+
+} // namespace inputtino
@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <inputtino/input.hpp>
 #include <inputtino/protected_types.hpp>
+#include <inputtino/trace_hooks.hpp>
 #include <iostream>
 #include <linux/input.h>
 #include <optional>
@@ -10,27 +11,22 @@
 
 namespace inputtino {
 
+DeviceMetrics SwitchJoypad::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> SwitchJoypad::get_nodes() const {
   std::vector<std::string> nodes;
 
   if (auto joy = _state->joy.get()) {
-    auto additional_nodes = get_child_dev_nodes(joy);
+    auto additional_nodes = _state->nodes.get([joy]() { return get_child_dev_nodes(joy); });
     nodes.insert(nodes.end(), additional_nodes.begin(), additional_nodes.end());
   }
 
   return nodes;
 }
 
-Result<libevdev_uinput_ptr> create_nintendo_controller(const DeviceDefinition &device) {
-  libevdev *dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, device.name.c_str());
-  libevdev_set_id_vendor(dev, device.vendor_id);
-  libevdev_set_id_product(dev, device.product_id);
-  libevdev_set_id_version(dev, device.version);
-  libevdev_set_id_bustype(dev, BUS_USB);
-
+static void enable_nintendo_controller_events(libevdev *dev) {
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, BTN_WEST, nullptr);
   libevdev_enable_event_code(dev, EV_KEY, BTN_EAST, nullptr);
@@ -69,28 +65,23 @@ Result<libevdev_uinput_ptr> create_nintendo_controller(const DeviceDefinition &d
   libevdev_enable_event_code(dev, EV_FF, FF_SINE, nullptr);
   libevdev_enable_event_code(dev, EV_FF, FF_RAMP, nullptr);
   libevdev_enable_event_code(dev, EV_FF, FF_GAIN, nullptr);
+}
 
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
-  }
-
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
+Result<evdev_output_ptr> create_nintendo_controller(const DeviceDefinition &device) {
+  return create_evdev_device(device, enable_nintendo_controller_events);
 }
 
 SwitchJoypad::SwitchJoypad() : _state(std::make_shared<SwitchJoypadState>()) {}
 
 SwitchJoypad::~SwitchJoypad() {
   if (_state) {
-    _state->stop_listening_events = true;
-    if (_state->joy.get() != nullptr && _state->events_thread.joinable()) {
-      _state->events_thread.join();
-    }
+    trace::record(_state.get(), trace::DeviceKind::SWITCH_JOYPAD, trace::Op::DEVICE_REMOVED);
+    stop_event_listener(*_state);
   }
 }
 
 Result<SwitchJoypad> SwitchJoypad::create(const DeviceDefinition &device) {
+  UeventMonitor::get(); // start listening before the device (and its js* child) shows up, see get_nodes()
   auto joy_el = create_nintendo_controller(device);
   if (!joy_el) {
     return Error(joy_el.getErrorMessage());
@@ -98,93 +89,117 @@ Result<SwitchJoypad> SwitchJoypad::create(const DeviceDefinition &device) {
 
   SwitchJoypad joypad;
   joypad._state->joy = std::move(*joy_el);
+  joypad._state->abs_shadow.force = device.force_writes;
 
-  auto event_thread = std::thread(event_listener, joypad._state);
-  joypad._state->events_thread = std::move(event_thread);
-  joypad._state->events_thread.detach();
+  start_event_listener(joypad._state);
 
   return joypad;
 }
 
+/* A and B, X and Y are swapped compared to the Xbox layout: the linux codes follow the position of the buttons */
+static constexpr JoypadButtonMapping switch_buttons[] = {
+    {Joypad::START, BTN_START},
+    {Joypad::BACK, BTN_SELECT},
+    {Joypad::LEFT_STICK, BTN_THUMBL},
+    {Joypad::RIGHT_STICK, BTN_THUMBR},
+    {Joypad::LEFT_BUTTON, BTN_TL},
+    {Joypad::RIGHT_BUTTON, BTN_TR},
+    {Joypad::HOME, BTN_MODE},
+    {Joypad::MISC_FLAG, BTN_Z}, // Capture button
+    {Joypad::A, BTN_EAST},
+    {Joypad::B, BTN_SOUTH},
+    {Joypad::X, BTN_NORTH},
+    {Joypad::Y, BTN_WEST},
+};
+static constexpr auto switch_button_codes = make_button_codes(switch_buttons);
+
 void SwitchJoypad::set_pressed_buttons(unsigned int newly_pressed) {
-  // Button flags that have been changed between current and prev
-  auto bf_changed = newly_pressed ^ this->_state->currently_pressed_btns;
-  // Button flags that are only part of the new packet
-  auto bf_new = newly_pressed;
-  if (auto controller = this->_state->joy.get()) {
-
-    if (bf_changed) {
-      if ((DPAD_UP | DPAD_DOWN) & bf_changed) {
-        int button_state = bf_new & DPAD_UP ? -1 : (bf_new & DPAD_DOWN ? 1 : 0);
-
-        libevdev_uinput_write_event(controller, EV_ABS, ABS_HAT0Y, button_state);
-      }
-
-      if ((DPAD_LEFT | DPAD_RIGHT) & bf_changed) {
-        int button_state = bf_new & DPAD_LEFT ? -1 : (bf_new & DPAD_RIGHT ? 1 : 0);
-
-        libevdev_uinput_write_event(controller, EV_ABS, ABS_HAT0X, button_state);
-      }
-
-      if (START & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_START, bf_new & START ? 1 : 0);
-      if (BACK & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_SELECT, bf_new & BACK ? 1 : 0);
-      if (LEFT_STICK & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_THUMBL, bf_new & LEFT_STICK ? 1 : 0);
-      if (RIGHT_STICK & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_THUMBR, bf_new & RIGHT_STICK ? 1 : 0);
-      if (LEFT_BUTTON & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_TL, bf_new & LEFT_BUTTON ? 1 : 0);
-      if (RIGHT_BUTTON & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_TR, bf_new & RIGHT_BUTTON ? 1 : 0);
-      if (HOME & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_MODE, bf_new & HOME ? 1 : 0);
-      if (MISC_FLAG & bf_changed) {
-        // Capture button
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_Z, bf_new & MISC_FLAG ? 1 : 0);
-      }
-      if (A & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_EAST, bf_new & A ? 1 : 0);
-      if (B & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_SOUTH, bf_new & B ? 1 : 0);
-      if (X & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_NORTH, bf_new & X ? 1 : 0);
-      if (Y & bf_changed)
-        libevdev_uinput_write_event(controller, EV_KEY, BTN_WEST, bf_new & Y ? 1 : 0);
+  trace::record(_state.get(), trace::DeviceKind::SWITCH_JOYPAD, trace::Op::JOYPAD_BUTTONS, newly_pressed);
+  _state->serial.run([state = _state.get(), newly_pressed] {
+    if (auto controller = state->joy.get()) {
+      EventFrame frame(controller, &state->metrics);
+      add_pressed_buttons(frame, *state, switch_button_codes, newly_pressed);
+      frame.syn_and_flush(state->abs_shadow.force);
     }
+  });
+}
 
-    libevdev_uinput_write_event(controller, EV_SYN, SYN_REPORT, 0);
+static void
+add_stick(EventFrame<> &frame, SwitchJoypadState &state, Joypad::STICK_POSITION stick_type, short x, short y) {
+  if (stick_type == Joypad::LS) {
+    frame.add_abs(state.abs_shadow, ABS_X, x);
+    frame.add_abs(state.abs_shadow, ABS_Y, -y);
+  } else {
+    frame.add_abs(state.abs_shadow, ABS_RX, x);
+    frame.add_abs(state.abs_shadow, ABS_RY, -y);
   }
-  this->_state->currently_pressed_btns = bf_new;
 }
 
 void SwitchJoypad::set_stick(Joypad::STICK_POSITION stick_type, short x, short y) {
-  if (auto controller = this->_state->joy.get()) {
-    if (stick_type == LS) {
-      libevdev_uinput_write_event(controller, EV_ABS, ABS_X, x);
-      libevdev_uinput_write_event(controller, EV_ABS, ABS_Y, -y);
-    } else {
-      libevdev_uinput_write_event(controller, EV_ABS, ABS_RX, x);
-      libevdev_uinput_write_event(controller, EV_ABS, ABS_RY, -y);
+  trace::record(_state.get(), trace::DeviceKind::SWITCH_JOYPAD, trace::Op::JOYPAD_STICK, stick_type, x, y);
+  _state->serial.run([state = _state.get(), stick_type, x, y] {
+    if (auto controller = state->joy.get()) {
+      EventFrame frame(controller, &state->metrics);
+      add_stick(frame, *state, stick_type, x, y);
+      frame.syn_and_flush();
     }
+  });
+}
 
-    libevdev_uinput_write_event(controller, EV_SYN, SYN_REPORT, 0);
+static void add_triggers(EventFrame<> &frame, SwitchJoypadState &state, int16_t left, int16_t right) {
+  // Nintendo ZL and ZR are just buttons (EV_KEY)
+  bool left_pressed = left > 0;
+  bool right_pressed = right > 0;
+  bool force = state.abs_shadow.force;
+  if (force || left_pressed != state.left_trigger_pressed) {
+    frame.add(EV_KEY, BTN_TL2, left_pressed ? 1 : 0);
+    state.left_trigger_pressed = left_pressed;
+  }
+  if (force || right_pressed != state.right_trigger_pressed) {
+    frame.add(EV_KEY, BTN_TR2, right_pressed ? 1 : 0);
+    state.right_trigger_pressed = right_pressed;
   }
 }
 
 void SwitchJoypad::set_triggers(int16_t left, int16_t right) {
-  if (auto controller = this->_state->joy.get()) {
-    // Nintendo ZL and ZR are just buttons (EV_KEY)
-    libevdev_uinput_write_event(controller, EV_KEY, BTN_TL2, left > 0 ? 1 : 0);
-    libevdev_uinput_write_event(controller, EV_SYN, SYN_REPORT, 0);
+  trace::record(_state.get(), trace::DeviceKind::SWITCH_JOYPAD, trace::Op::JOYPAD_TRIGGERS, left, right);
+  _state->serial.run([state = _state.get(), left, right] {
+    if (auto controller = state->joy.get()) {
+      EventFrame frame(controller, &state->metrics);
+      add_triggers(frame, *state, left, right);
+      frame.syn_and_flush();
+    }
+  });
+}
 
-    libevdev_uinput_write_event(controller, EV_KEY, BTN_TR2, right > 0 ? 1 : 0);
-    libevdev_uinput_write_event(controller, EV_SYN, SYN_REPORT, 0);
-  }
+void SwitchJoypad::set_state(const GamepadState &gamepad) {
+  trace::record(_state.get(),
+                trace::DeviceKind::SWITCH_JOYPAD,
+                trace::Op::JOYPAD_STATE,
+                gamepad.buttons,
+                gamepad.left_stick_x,
+                gamepad.left_stick_y,
+                gamepad.right_stick_x,
+                gamepad.right_stick_y,
+                gamepad.left_trigger,
+                gamepad.right_trigger);
+  _state->serial.run([state = _state.get(), gamepad] {
+    if (auto controller = state->joy.get()) {
+      EventFrame frame(controller, &state->metrics);
+      add_pressed_buttons(frame, *state, switch_button_codes, gamepad.buttons);
+      add_stick(frame, *state, LS, gamepad.left_stick_x, gamepad.left_stick_y);
+      add_stick(frame, *state, RS, gamepad.right_stick_x, gamepad.right_stick_y);
+      add_triggers(frame, *state, gamepad.left_trigger, gamepad.right_trigger);
+      frame.syn_and_flush(state->abs_shadow.force);
+    }
+  });
 }
 
 void SwitchJoypad::set_on_rumble(const std::function<void(int, int)> &callback) {
-  this->_state->on_rumble = callback;
+  this->_state->on_rumble.set(callback);
+}
+
+void SwitchJoypad::set_rumble_resolution(int millis) {
+  this->_state->rumble_resolution_ms = std::max(millis, 1);
 }
 } // namespace inputtino
@@ -1,38 +1,37 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <cstring>
 #include <fcntl.h>
 #include <filesystem>
+#include <inputtino/event_loop.hpp>
 #include <inputtino/input.hpp>
 #include <inputtino/protected_types.hpp>
 #include <iostream>
 #include <linux/input.h>
 #include <linux/uinput.h>
 #include <optional>
-#include <poll.h>
-#include <thread>
+#include <sys/timerfd.h>
 
 namespace inputtino {
 
 using namespace std::chrono_literals;
 
 constexpr long MAX_GAIN = 0xFFFF;
-constexpr int RUMBLE_POLL_TIMEOUT = 500; // ms
+/* How often we update the rumble while an effect is changing over time, see set_rumble_resolution() */
+constexpr auto DEFAULT_RUMBLE_RESOLUTION = std::chrono::milliseconds(8);
 
 /**
  * Joypads will also have one `/dev/input/js*` device as child, we want to expose that as well
  */
-static std::vector<std::string> get_child_dev_nodes(libevdev_uinput *device) {
+static std::vector<std::string> get_child_dev_nodes(const EvdevOutput *device) {
   std::vector<std::string> result;
+  add_devnode(result, device);
 
-  auto dev_path = libevdev_uinput_get_devnode(device);
-  if (dev_path) {
-    result.push_back(dev_path);
-  }
-
-  auto sys_path = libevdev_uinput_get_syspath(device);
-  if (sys_path) {
+  auto sys_path = device->syspath();
+  if (!sys_path.empty()) {
     for (const auto &entry : std::filesystem::directory_iterator(sys_path)) {
       if (entry.is_directory() && entry.path().filename().string().rfind("js", 0) == 0) { // starts with "js"?
         result.push_back("/dev/input/" + entry.path().filename().string());
@@ -43,10 +42,59 @@ static std::vector<std::string> get_child_dev_nodes(libevdev_uinput *device) {
   return result;
 }
 
+/**
+ * Which linux code is sent for each Joypad::CONTROLLER_BTN flag, see make_button_codes()
+ */
+struct JoypadButtonMapping {
+  unsigned int flag;
+  unsigned short code;
+};
+
+/* The linux code of each bit of the buttons mask, 0 for the bits that a pad doesn't map to a key */
+using JoypadButtonCodes = std::array<unsigned short, 32>;
+
+template <std::size_t N> constexpr JoypadButtonCodes make_button_codes(const JoypadButtonMapping (&mappings)[N]) {
+  JoypadButtonCodes codes = {};
+  for (const auto &mapping : mappings) {
+    codes[__builtin_ctz(mapping.flag)] = mapping.code;
+  }
+  return codes;
+}
+
+constexpr unsigned int DPAD_FLAGS = Joypad::DPAD_UP | Joypad::DPAD_DOWN | Joypad::DPAD_LEFT | Joypad::DPAD_RIGHT;
+
+/**
+ * Adds the events for the buttons that changed since the last call: the DPAD goes to the HAT0 axes, every other bit
+ * to the key in `codes`. Only the bits that changed are visited, so an unchanged mask costs nothing.
+ */
+static void add_pressed_buttons(EventFrame<> &frame,
+                                BaseJoypadState &state,
+                                const JoypadButtonCodes &codes,
+                                unsigned int newly_pressed) {
+  auto bf_changed = newly_pressed ^ static_cast<unsigned int>(state.currently_pressed_btns);
+  state.currently_pressed_btns = static_cast<int>(newly_pressed);
+
+  if ((Joypad::DPAD_UP | Joypad::DPAD_DOWN) & bf_changed) {
+    int hat = newly_pressed & Joypad::DPAD_UP ? -1 : (newly_pressed & Joypad::DPAD_DOWN ? 1 : 0);
+    frame.add_abs(state.abs_shadow, ABS_HAT0Y, hat);
+  }
+  if ((Joypad::DPAD_LEFT | Joypad::DPAD_RIGHT) & bf_changed) {
+    int hat = newly_pressed & Joypad::DPAD_LEFT ? -1 : (newly_pressed & Joypad::DPAD_RIGHT ? 1 : 0);
+    frame.add_abs(state.abs_shadow, ABS_HAT0X, hat);
+  }
+
+  for (auto keys = bf_changed & ~DPAD_FLAGS; keys; keys &= keys - 1) {
+    auto bit = __builtin_ctz(keys);
+    if (auto code = codes[bit]) {
+      frame.add(EV_KEY, code, (newly_pressed >> bit) & 1);
+    }
+  }
+}
+
 struct ActiveRumbleEffect {
   std::chrono::steady_clock::time_point start_point;
   std::chrono::steady_clock::time_point end_point;
-  std::chrono::milliseconds length;
+  std::chrono::milliseconds length; // 0 means that the effect will play until stopped
   std::chrono::milliseconds delay;
   ff_envelope envelope;
 
@@ -57,14 +105,60 @@ struct ActiveRumbleEffect {
   struct {
     long weak, strong;
   } end;
+
+  /* FF_PERIODIC only, the magnitude above is modulated by the given waveform; 0 for all the other effects */
+  __u16 waveform = 0;
+  std::chrono::milliseconds period{0};
+  long offset = 0;
+  long phase = 0; // horizontal shift, as a fraction of the period in 1/0x10000 units
 };
 
-static long rumble_magnitude(std::chrono::milliseconds time_left,
-                             std::uint32_t start,
-                             std::uint32_t end,
-                             std::chrono::milliseconds length) {
-  auto rel = end - start;
-  return start + (rel * time_left.count() / length.count());
+static bool is_infinite(const ActiveRumbleEffect &effect) {
+  return effect.length.count() == 0;
+}
+
+static bool is_ramp(const ActiveRumbleEffect &effect) {
+  return !is_infinite(effect) && (effect.start.weak != effect.end.weak || effect.start.strong != effect.end.strong);
+}
+
+/**
+ * Linear interpolation from `start` to `end` at `t` (elapsed since the effect started); ramps can go down as well
+ */
+static long rumble_magnitude(std::chrono::milliseconds t, long start, long end, std::chrono::milliseconds length) {
+  if (length.count() == 0) {
+    return start;
+  }
+  auto rel = static_cast<std::int64_t>(end) - static_cast<std::int64_t>(start);
+  return static_cast<long>(start + (rel * t.count() / length.count()));
+}
+
+/**
+ * Returns the value of the periodic waveform at time `t` in the [-1, 1] range
+ */
+static double periodic_wave(const ActiveRumbleEffect &effect, std::chrono::milliseconds t) {
+  auto period = effect.period.count();
+  auto phase_ms = effect.phase * period / 0x10000;
+  double f = static_cast<double>((t.count() + phase_ms) % period) / static_cast<double>(period); // [0, 1)
+  switch (effect.waveform) {
+  case FF_SQUARE:
+    return f < 0.5 ? 1.0 : -1.0;
+  case FF_TRIANGLE:
+    return f < 0.25 ? 4 * f : (f < 0.75 ? 2 - 4 * f : 4 * f - 4);
+  case FF_SAW_UP:
+    return 2 * f - 1;
+  case FF_SAW_DOWN:
+    return 1 - 2 * f;
+  case FF_SINE:
+  default: // FF_CUSTOM: we don't support custom waveforms, let's use the closest thing to a smooth rumble
+    return std::sin(2 * M_PI * f);
+  }
+}
+
+static long apply_periodic(const ActiveRumbleEffect &effect, long magnitude, std::chrono::milliseconds t) {
+  // rumble motors can't go below 0, so the waveform oscillates between 0 and the full magnitude
+  auto wave = (periodic_wave(effect, t) + 1.0) / 2.0;
+  auto value = effect.offset + static_cast<long>(std::lround(magnitude * wave));
+  return std::clamp(value, 0l, MAX_GAIN);
 }
 
 static std::pair<long, long> simulate_rumble(const ActiveRumbleEffect &effect,
@@ -73,28 +167,61 @@ static std::pair<long, long> simulate_rumble(const ActiveRumbleEffect &effect,
     return {0, 0};
   }
 
-  auto time_left = std::chrono::duration_cast<std::chrono::milliseconds>(effect.end_point - now);
-  auto t = effect.length - time_left;
+  auto t = std::chrono::duration_cast<std::chrono::milliseconds>(now - effect.start_point);
+  auto time_left = is_infinite(effect) ? std::chrono::milliseconds::max() : effect.length - t;
 
   auto weak = rumble_magnitude(t, effect.start.weak, effect.end.weak, effect.length);
   auto strong = rumble_magnitude(t, effect.start.strong, effect.end.strong, effect.length);
 
   if (t.count() < effect.envelope.attack_length) {
-    weak = (effect.envelope.attack_level * t.count() + weak * (effect.envelope.attack_length - t.count())) /
+    weak = (effect.envelope.attack_level * (effect.envelope.attack_length - t.count()) + weak * t.count()) /
            effect.envelope.attack_length;
-    strong = (effect.envelope.attack_level * t.count() + strong * (effect.envelope.attack_length - t.count())) /
+    strong = (effect.envelope.attack_level * (effect.envelope.attack_length - t.count()) + strong * t.count()) /
              effect.envelope.attack_length;
   } else if (time_left.count() < effect.envelope.fade_length) {
-    auto dt = (t - effect.length).count() + effect.envelope.fade_length;
+    auto dt = effect.envelope.fade_length - time_left.count();
 
     weak = (effect.envelope.fade_level * dt + weak * (effect.envelope.fade_length - dt)) / effect.envelope.fade_length;
     strong = (effect.envelope.fade_level * dt + strong * (effect.envelope.fade_length - dt)) /
              effect.envelope.fade_length;
   }
 
+  if (effect.waveform != 0 && effect.period.count() > 0) {
+    weak = apply_periodic(effect, weak, t);
+    strong = apply_periodic(effect, strong, t);
+  }
+
   return {weak, strong};
 }
 
+/**
+ * Returns the next point in time where the output of the effect might change, if any.
+ * While the rumble is continuously changing (envelope, ramp, periodic waveform) it'll be sampled every `resolution`,
+ * otherwise we only have to wake up when the effect starts, stops or starts fading.
+ */
+static std::optional<std::chrono::steady_clock::time_point>
+next_rumble_change(const ActiveRumbleEffect &effect,
+                   const std::chrono::steady_clock::time_point &now,
+                   std::chrono::milliseconds resolution) {
+  if (effect.end_point <= now) { // not playing
+    return {};
+  }
+  if (now < effect.start_point) { // delayed
+    return effect.start_point;
+  }
+
+  auto t = std::chrono::duration_cast<std::chrono::milliseconds>(now - effect.start_point);
+  auto fade_start = is_infinite(effect) ? effect.end_point
+                                        : effect.end_point - std::chrono::milliseconds(effect.envelope.fade_length);
+  bool is_attacking = t.count() < effect.envelope.attack_length;
+  bool is_fading = now >= fade_start;
+  bool is_periodic = effect.waveform != 0 && effect.period.count() > 0;
+  if (is_attacking || is_fading || is_ramp(effect) || is_periodic) {
+    return std::min(effect.end_point, now + resolution);
+  }
+  return std::min(effect.end_point, fade_start);
+}
+
 static ActiveRumbleEffect create_rumble_effect(const ff_effect &effect) {
   // All duration values are expressed in ms. Values above 32767 ms (0x7fff) should not be used
   ActiveRumbleEffect r_effect{
@@ -117,6 +244,10 @@ static ActiveRumbleEffect create_rumble_effect(const ff_effect &effect) {
     r_effect.end.weak = effect.u.periodic.magnitude;
     r_effect.end.strong = effect.u.periodic.magnitude;
     r_effect.envelope = effect.u.periodic.envelope;
+    r_effect.waveform = effect.u.periodic.waveform;
+    r_effect.period = std::chrono::milliseconds{effect.u.periodic.period};
+    r_effect.offset = effect.u.periodic.offset;
+    r_effect.phase = effect.u.periodic.phase;
     break;
   case FF_RAMP:
     r_effect.start.weak = effect.u.ramp.start_level;
@@ -146,81 +277,87 @@ static ActiveRumbleEffect create_rumble_effect(const ff_effect &effect) {
  *    - later on when the rumble has been activated you'll receive an EV_FF in your /dev/input/event**
  *      where the value is the request ID
  *   You can test the virtual devices that we create by simply using the utility `fftest`
+ *
+ * The uinput fd and the rumble timerfd are both served by the shared EventLoop: we only wake up when the kernel has
+ * something for us or while a rumble effect is playing (the timer is disarmed otherwise).
  */
-static void event_listener(const std::shared_ptr<BaseJoypadState> &state) {
-  std::this_thread::sleep_for(100ms); // We have to sleep in order to be able to read from the newly created device
-
-  auto uinput_fd = libevdev_uinput_get_fd(state->joy.get());
-  if (uinput_fd < 0) {
-    std::cerr << "Unable to open uinput device, additional events will be disabled.";
-    return;
-  }
-
-  // We have to add 0_NONBLOCK to the flags in order to be able to read the events
-  int flags = fcntl(uinput_fd, F_GETFL, 0);
-  fcntl(uinput_fd, F_SETFL, flags | O_NONBLOCK);
+struct RumbleListener {
+  std::weak_ptr<BaseJoypadState> state;
+  /* Owned by the joypad state, stop_event_listener() is always called before it's released */
+  EvdevOutput *output;
+  int timer_fd;
 
   /* Local copy of all the uploaded ff effects */
   std::map<int, ActiveRumbleEffect> ff_effects = {};
-  std::pair<std::uint32_t, std::uint32_t> prev_rumble = {0, 0};
+  std::pair<long, long> prev_rumble = {0, 0};
 
   /* This can only be set globally when receiving FF_GAIN */
   unsigned int current_gain = MAX_GAIN;
 
-  std::array<pollfd, 1> pfds = {pollfd{.fd = uinput_fd, .events = POLLIN}};
-  int poll_rs = 0;
-
-  while (!state->stop_listening_events) {
-    poll_rs = poll(pfds.data(), pfds.size(), RUMBLE_POLL_TIMEOUT);
-    if (poll_rs < 0) {
-      std::cerr << "Failed polling uinput fd; ret=" << strerror(errno);
-      return;
-    }
+  /* Reused on every wake up, so that reading the events doesn't allocate */
+  std::array<input_event, 64> events_buffer = {};
 
-    auto events = fetch_events(uinput_fd);
-    for (auto ev : events) {
-      if (ev->type == EV_UINPUT && ev->code == UI_FF_UPLOAD) { // Upload a new FF effect
+  void on_uinput_events() {
+    auto received_at = MetricsCounters::now();
+    auto joypad_state = state.lock();
+    for (const auto &ev : fetch_events(*output, events_buffer)) {
+      if (joypad_state && (ev.type == EV_UINPUT || ev.type == EV_FF)) {
+        joypad_state->metrics.add_ff_effect();
+      }
+      if (ev.type == EV_UINPUT && ev.code == UI_FF_UPLOAD) { // Upload a new FF effect
         uinput_ff_upload upload{};
-        upload.request_id = ev->value;
+        upload.request_id = ev.value;
 
-        ioctl(uinput_fd, UI_BEGIN_FF_UPLOAD, &upload); // retrieve the effect
+        output->begin_ff_upload(upload); // retrieve the effect
 
         auto new_effect = create_rumble_effect(upload.effect);
-        if (ff_effects.find(upload.effect.id) != ff_effects.end()) {
+        if (auto prev_effect = ff_effects.find(upload.effect.id); prev_effect != ff_effects.end()) {
           // We have to keep the original start and end points of the effect
-          new_effect.start_point = ff_effects[upload.effect.id].start_point;
-          new_effect.end_point = ff_effects[upload.effect.id].end_point;
+          new_effect.start_point = prev_effect->second.start_point;
+          new_effect.end_point = prev_effect->second.end_point;
         }
-        ff_effects.insert_or_assign(upload.effect.id, create_rumble_effect(upload.effect));
+        ff_effects.insert_or_assign(upload.effect.id, new_effect);
         upload.retval = 0;
 
-        ioctl(uinput_fd, UI_END_FF_UPLOAD, &upload);
-      } else if (ev->type == EV_UINPUT && ev->code == UI_FF_ERASE) { // Remove an uploaded FF effect
+        output->end_ff_upload(upload);
+      } else if (ev.type == EV_UINPUT && ev.code == UI_FF_ERASE) { // Remove an uploaded FF effect
         uinput_ff_erase erase{};
-        erase.request_id = ev->value;
+        erase.request_id = ev.value;
 
-        ioctl(uinput_fd, UI_BEGIN_FF_ERASE, &erase); // retrieve ff_erase
+        output->begin_ff_erase(erase); // retrieve ff_erase
 
         ff_effects.erase(erase.effect_id);
         erase.retval = 0;
 
-        ioctl(uinput_fd, UI_END_FF_ERASE, &erase);
-      } else if (ev->type == EV_FF && ev->code == FF_GAIN) { // Force feedback set gain
-        current_gain = std::clamp((long)ev->value, 0l, MAX_GAIN);
-      } else if (ev->type == EV_FF) { // Force feedback effect
-        auto effect_id = ev->code;
+        output->end_ff_erase(erase);
+      } else if (ev.type == EV_FF && ev.code == FF_GAIN) { // Force feedback set gain
+        current_gain = std::clamp((long)ev.value, 0l, MAX_GAIN);
+      } else if (ev.type == EV_FF) { // Force feedback effect
+        auto effect_id = ev.code;
         if (auto effect = ff_effects.find(effect_id); effect != ff_effects.end()) {
-          if (ev->value) { // Activate
+          if (ev.value) { // Activate
             auto now = std::chrono::steady_clock::now();
             effect->second.start_point = now + effect->second.delay;
-            effect->second.end_point = now + effect->second.delay + effect->second.length;
+            effect->second.end_point = is_infinite(effect->second)
+                                           ? std::chrono::steady_clock::time_point::max()
+                                           : effect->second.start_point + effect->second.length;
           } else { // Deactivate
             effect->second.end_point = std::chrono::steady_clock::time_point::min();
           }
         }
       }
     }
+    update_rumble(received_at);
+  }
 
+  void on_timer() {
+    auto received_at = MetricsCounters::now();
+    std::uint64_t expirations = 0;
+    read(timer_fd, &expirations, sizeof(expirations));
+    update_rumble(received_at);
+  }
+
+  void update_rumble(MetricsCounters::Clock::time_point received_at) {
     auto now = std::chrono::steady_clock::now();
 
     // Accumulate all rumble effects
@@ -235,11 +372,99 @@ static void event_listener(const std::shared_ptr<BaseJoypadState> &state) {
       prev_rumble.first = current_rumble.first;
       prev_rumble.second = current_rumble.second;
 
-      if (auto callback = state->on_rumble) {
-        callback.value()(static_cast<int>((current_rumble.second * current_gain / MAX_GAIN)),
-                         static_cast<int>((current_rumble.first * current_gain / MAX_GAIN)));
+      if (auto joypad_state = state.lock()) {
+        if (auto callback = joypad_state->on_rumble.get()) {
+          (*callback)(static_cast<int>((current_rumble.second * current_gain / MAX_GAIN)),
+                           static_cast<int>((current_rumble.first * current_gain / MAX_GAIN)));
+          joypad_state->metrics.add_rumble_callback(received_at);
+        }
       }
     }
+
+    auto resolution = DEFAULT_RUMBLE_RESOLUTION;
+    if (auto joypad_state = state.lock()) {
+      resolution = std::chrono::milliseconds{joypad_state->rumble_resolution_ms.load()};
+    }
+    arm_timer(now, resolution);
+  }
+
+  /**
+   * Wakes us up at the next point where the rumble might change, disarms the timer when nothing is playing
+   */
+  void arm_timer(const std::chrono::steady_clock::time_point &now, std::chrono::milliseconds resolution) {
+    auto next_update = std::chrono::steady_clock::time_point::max();
+    for (auto &[_id, effect] : ff_effects) {
+      if (auto next_change = next_rumble_change(effect, now, resolution)) {
+        next_update = std::min(next_update, *next_change);
+      }
+    }
+
+    itimerspec timer{};
+    if (next_update != std::chrono::steady_clock::time_point::max()) {
+      auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(next_update - now);
+      wait = std::max(wait, std::chrono::nanoseconds{1}); // a zero it_value would disarm the timer
+      timer.it_value.tv_sec = static_cast<time_t>(wait.count() / 1000000000);
+      timer.it_value.tv_nsec = static_cast<long>(wait.count() % 1000000000);
+    }
+    timerfd_settime(timer_fd, 0, &timer, nullptr);
+  }
+};
+
+/**
+ * Registers the joypad output (and its rumble timer) with the shared EventLoop
+ */
+static void start_event_listener(const std::shared_ptr<BaseJoypadState> &state) {
+  auto uinput_fd = state->joy ? state->joy->poll_fd() : -1;
+  if (uinput_fd < 0) {
+    std::cerr << "Unable to open uinput device, additional events will be disabled.";
+    return;
+  }
+
+  state->rumble_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (state->rumble_timer_fd < 0) {
+    std::cerr << "Unable to create rumble timer, additional events will be disabled; " << strerror(errno);
+    return;
+  }
+
+  auto listener = std::make_shared<RumbleListener>(
+      RumbleListener{.state = state, .output = state->joy.get(), .timer_fd = state->rumble_timer_fd});
+
+  auto &loop = EventLoop::get();
+  auto uinput_handle = loop.add(uinput_fd, [listener](std::uint32_t events) {
+    if (events & (EPOLLHUP | EPOLLERR)) {
+      return false;
+    }
+    listener->on_uinput_events();
+    return true;
+  });
+  if (!uinput_handle) {
+    std::cerr << "Unable to listen on uinput fd; " << uinput_handle.getErrorMessage();
+    return;
+  }
+  state->uinput_listener = *uinput_handle;
+
+  auto timer_handle = loop.add(state->rumble_timer_fd, [listener](std::uint32_t) {
+    listener->on_timer();
+    return true;
+  });
+  if (timer_handle) {
+    state->rumble_timer_listener = *timer_handle;
+  }
+}
+
+static void stop_event_listener(BaseJoypadState &state) {
+  auto &loop = EventLoop::get();
+  if (state.uinput_listener) {
+    loop.remove(state.uinput_listener);
+    state.uinput_listener = 0;
+  }
+  if (state.rumble_timer_listener) {
+    loop.remove(state.rumble_timer_listener);
+    state.rumble_timer_listener = 0;
+  }
+  if (state.rumble_timer_fd >= 0) {
+    close(state.rumble_timer_fd);
+    state.rumble_timer_fd = -1;
   }
 }
 
@@ -1,71 +1,58 @@
 #include "inputtino/input.hpp"
 
-#include <algorithm>
 #include <cstring>
 #include <inputtino/protected_types.hpp>
 #include <inputtino/keyboard.hpp>
-#include <thread>
+#include <inputtino/trace_hooks.hpp>
 
 namespace inputtino {
 
 using namespace std::string_literals;
 
+DeviceMetrics Keyboard::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> Keyboard::get_nodes() const {
   std::vector<std::string> nodes;
 
-  if (auto kb = _state->kb.get()) {
-    nodes.emplace_back(libevdev_uinput_get_devnode(kb));
-  }
+  add_devnode(nodes, _state->kb.get());
 
   return nodes;
 }
 
-Result<libevdev_uinput_ptr> create_keyboard(const DeviceDefinition &device) {
-  auto dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, device.name.c_str());
-  libevdev_set_id_vendor(dev, device.vendor_id);
-  libevdev_set_id_product(dev, device.product_id);
-  libevdev_set_id_version(dev, device.version);
-  libevdev_set_id_bustype(dev, BUS_USB);
-
+static void enable_keyboard_events(libevdev *dev) {
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, KEY_BACKSPACE, nullptr);
 
-  for (auto ev : keyboard::key_mappings) {
-    libevdev_enable_event_code(dev, EV_KEY, ev.second.linux_code, nullptr);
-  }
-
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
+  for (const auto &mapping : keyboard::key_mappings) {
+    libevdev_enable_event_code(dev, EV_KEY, mapping.key.linux_code, nullptr);
   }
-
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
 }
 
-static std::optional<keyboard::KEY_MAP> press_btn(libevdev_uinput *kb, short key_code) {
-  auto search_key = keyboard::key_mappings.find(key_code);
-  if (search_key != keyboard::key_mappings.end()) {
-    auto mapped_key = search_key->second;
+Result<evdev_output_ptr> create_keyboard(const DeviceDefinition &device) {
+  return create_evdev_device(device, enable_keyboard_events);
+}
 
-    libevdev_uinput_write_event(kb, EV_MSC, MSC_SCAN, mapped_key.scan_code);
-    libevdev_uinput_write_event(kb, EV_KEY, mapped_key.linux_code, 1);
-    libevdev_uinput_write_event(kb, EV_SYN, SYN_REPORT, 0);
-    return mapped_key;
+static std::optional<keyboard::KEY_MAP> press_btn(EvdevOutput *kb, MetricsCounters &metrics, short key_code) {
+  auto mapped_key = keyboard::find_key(key_code);
+  if (mapped_key) {
+    EventFrame frame(kb, &metrics);
+    frame.add(EV_MSC, MSC_SCAN, mapped_key->scan_code);
+    frame.add(EV_KEY, mapped_key->linux_code, 1);
+    frame.syn();
+    frame.flush();
   }
-  return {};
+  return mapped_key;
 }
 
 Keyboard::Keyboard() : _state(std::make_shared<KeyboardState>()) {}
 
 Keyboard::~Keyboard() {
   if (_state) {
-    _state->stop_repeat_thread = true;
-    if (_state->repeat_press_t.joinable()) {
-      _state->repeat_press_t.join();
+    trace::record(_state.get(), trace::DeviceKind::KEYBOARD, trace::Op::DEVICE_REMOVED);
+    if (_state->repeat_task) {
+      Scheduler::get().cancel_and_wait(_state->repeat_task);
     }
   }
 }
@@ -75,46 +62,70 @@ Result<Keyboard> Keyboard::create(const DeviceDefinition &device, int millis_rep
   if (kb_el) {
     Keyboard kb;
     kb._state->kb = std::move(*kb_el);
-    auto repeat_thread = std::thread([state = kb._state, millis_repress_key]() {
-      while (!state->stop_repeat_thread) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(millis_repress_key));
-        for (auto key : state->cur_press_keys) {
-          if (auto keyboard = state->kb.get()) {
-            press_btn(keyboard, key);
-          }
-        }
-      }
-    });
-    kb._state->repeat_press_t = std::move(repeat_thread);
-    kb._state->repeat_press_t.detach();
+    kb._state->repeat_interval = std::chrono::milliseconds(millis_repress_key);
     return kb;
   } else {
     return Error(kb_el.getErrorMessage());
   }
 }
 
-void Keyboard::press(short key_code) {
-  if (auto keyboard = _state->kb.get()) {
-    if (auto key = press_btn(keyboard, key_code)) {
-      _state->cur_press_keys.push_back(key_code);
+/**
+ * Re-sends all the currently pressed keys, the task unregisters itself as soon as no key is held down.
+ * Must be called from an operation on `serial`
+ */
+static void repeat_pressed_keys(KeyboardState &state) {
+  if (state.cur_press_keys.none()) {
+    Scheduler::get().cancel(state.repeat_task);
+    state.repeat_task = 0;
+    return;
+  }
+
+  if (auto keyboard = state.kb.get()) {
+    for (std::size_t key = 0; key < state.cur_press_keys.size(); key++) {
+      if (state.cur_press_keys.test(key)) {
+        press_btn(keyboard, state.metrics, static_cast<short>(key));
+      }
     }
   }
 }
 
+void Keyboard::press(short key_code) {
+  trace::record(_state.get(), trace::DeviceKind::KEYBOARD, trace::Op::KEYBOARD_PRESS, key_code);
+  _state->serial.run([state = _state.get(), key_code] {
+    if (auto keyboard = state->kb.get()) {
+      if (auto key = press_btn(keyboard, state->metrics, key_code)) {
+        state->cur_press_keys.set(key_code);
+        if (!state->repeat_task) {
+          auto repeat_task = [weak_state = state->weak_from_this()]() -> std::optional<std::chrono::microseconds> {
+            auto state = weak_state.lock();
+            if (!state) {
+              return {};
+            }
+            state->serial.run([state = state.get()] { repeat_pressed_keys(*state); });
+            return state->repeat_interval;
+          };
+          state->repeat_task = Scheduler::get().schedule(state->repeat_interval, repeat_task);
+        }
+      }
+    }
+  });
+}
+
 void Keyboard::release(short key_code) {
-  auto search_key = keyboard::key_mappings.find(key_code);
-  if (search_key != keyboard::key_mappings.end()) {
-    if (auto keyboard = _state->kb.get()) {
-      auto mapped_key = search_key->second;
-      this->_state->cur_press_keys.erase(
-          std::remove(this->_state->cur_press_keys.begin(), this->_state->cur_press_keys.end(), key_code),
-          this->_state->cur_press_keys.end());
-
-      libevdev_uinput_write_event(keyboard, EV_MSC, MSC_SCAN, mapped_key.scan_code);
-      libevdev_uinput_write_event(keyboard, EV_KEY, mapped_key.linux_code, 0);
-      libevdev_uinput_write_event(keyboard, EV_SYN, SYN_REPORT, 0);
+  trace::record(_state.get(), trace::DeviceKind::KEYBOARD, trace::Op::KEYBOARD_RELEASE, key_code);
+  _state->serial.run([state = _state.get(), key_code] {
+    if (auto mapped_key = keyboard::find_key(key_code)) {
+      if (auto keyboard = state->kb.get()) {
+        state->cur_press_keys.reset(key_code);
+
+        EventFrame frame(keyboard, &state->metrics);
+        frame.add(EV_MSC, MSC_SCAN, mapped_key->scan_code);
+        frame.add(EV_KEY, mapped_key->linux_code, 0);
+        frame.syn();
+        frame.flush();
+      }
     }
-  }
+  });
 }
 
-} // namespace inputtino
\ No newline at end of file
+} // namespace inputtino
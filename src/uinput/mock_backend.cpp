@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cstring>
+#include <inputtino/mock_backend.hpp>
+#include <libevdev/libevdev.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace inputtino {
+
+/**
+ * The ring keeps inserting at `total % capacity`: once it has wrapped around the oldest element is at that index
+ */
+template <typename T> static std::vector<T> ring_in_order(const std::vector<T> &ring, std::size_t total) {
+  if (total <= ring.size()) {
+    return {ring.begin(), ring.begin() + static_cast<std::ptrdiff_t>(total)};
+  }
+  auto oldest = ring.begin() + static_cast<std::ptrdiff_t>(total % ring.size());
+  std::vector<T> result(oldest, ring.end());
+  result.insert(result.end(), ring.begin(), oldest);
+  return result;
+}
+
+static void signal_fd(int fd) {
+  std::uint64_t one = 1;
+  [[maybe_unused]] auto ret = ::write(fd, &one, sizeof(one));
+}
+
+static void reset_fd(int fd) {
+  std::uint64_t value;
+  [[maybe_unused]] auto ret = ::read(fd, &value, sizeof(value));
+}
+
+MockEvdevOutput::MockEvdevOutput(std::string name, std::size_t capacity)
+    : name(std::move(name)), ring(std::max<std::size_t>(capacity, 1)),
+      event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+MockEvdevOutput::~MockEvdevOutput() {
+  close(event_fd);
+}
+
+std::vector<input_event> MockEvdevOutput::events() const {
+  std::lock_guard lock(mutex);
+  return ring_in_order(ring, total_events);
+}
+
+std::size_t MockEvdevOutput::frames_written() const {
+  std::lock_guard lock(mutex);
+  return total_frames;
+}
+
+std::size_t MockEvdevOutput::events_written() const {
+  std::lock_guard lock(mutex);
+  return total_events;
+}
+
+void MockEvdevOutput::clear() {
+  std::lock_guard lock(mutex);
+  total_events = 0;
+  total_frames = 0;
+}
+
+Result<bool> MockEvdevOutput::write_frame(const input_event *events, std::size_t count) {
+  std::lock_guard lock(mutex);
+  for (std::size_t i = 0; i < count; i++) {
+    ring[total_events++ % ring.size()] = events[i];
+  }
+  total_frames++;
+  return true;
+}
+
+void MockEvdevOutput::queue(const input_event &ev) {
+  pending.push_back(ev);
+  signal_fd(event_fd);
+}
+
+void MockEvdevOutput::inject(unsigned short type, unsigned short code, int value) {
+  std::lock_guard lock(mutex);
+  input_event ev{};
+  ev.type = type;
+  ev.code = code;
+  ev.value = value;
+  queue(ev);
+}
+
+void MockEvdevOutput::inject_ff_upload(const ff_effect &effect) {
+  std::lock_guard lock(mutex);
+  auto request_id = next_request_id++;
+  uploads[request_id] = effect;
+  input_event ev{};
+  ev.type = EV_UINPUT;
+  ev.code = UI_FF_UPLOAD;
+  ev.value = request_id;
+  queue(ev);
+}
+
+void MockEvdevOutput::inject_ff_erase(int effect_id) {
+  std::lock_guard lock(mutex);
+  auto request_id = next_request_id++;
+  erases[request_id] = effect_id;
+  input_event ev{};
+  ev.type = EV_UINPUT;
+  ev.code = UI_FF_ERASE;
+  ev.value = request_id;
+  queue(ev);
+}
+
+std::size_t MockEvdevOutput::read_events(input_event *buffer, std::size_t max) {
+  std::lock_guard lock(mutex);
+  std::size_t count = 0;
+  while (count < max && !pending.empty()) {
+    buffer[count++] = pending.front();
+    pending.pop_front();
+  }
+  if (pending.empty()) {
+    reset_fd(event_fd);
+  }
+  return count;
+}
+
+int MockEvdevOutput::poll_fd() const {
+  return event_fd;
+}
+
+void MockEvdevOutput::begin_ff_upload(uinput_ff_upload &upload) {
+  std::lock_guard lock(mutex);
+  if (auto effect = uploads.find(upload.request_id); effect != uploads.end()) {
+    upload.effect = effect->second;
+    uploads.erase(effect);
+  }
+}
+
+void MockEvdevOutput::end_ff_upload(const uinput_ff_upload &) {}
+
+void MockEvdevOutput::begin_ff_erase(uinput_ff_erase &erase) {
+  std::lock_guard lock(mutex);
+  if (auto effect_id = erases.find(erase.request_id); effect_id != erases.end()) {
+    erase.effect_id = effect_id->second;
+    erases.erase(effect_id);
+  }
+}
+
+void MockEvdevOutput::end_ff_erase(const uinput_ff_erase &) {}
+
+MockHidOutput::MockHidOutput(const uhid_create2_req &definition, std::size_t capacity)
+    : definition(definition), ring(std::max<std::size_t>(capacity, 1)),
+      event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+MockHidOutput::~MockHidOutput() {
+  close(event_fd);
+}
+
+std::vector<std::vector<std::uint8_t>> MockHidOutput::reports() const {
+  std::lock_guard lock(mutex);
+  return ring_in_order(ring, total_reports);
+}
+
+std::size_t MockHidOutput::reports_written() const {
+  std::lock_guard lock(mutex);
+  return total_reports;
+}
+
+std::vector<uhid_event> MockHidOutput::replies() const {
+  std::lock_guard lock(mutex);
+  return other_events;
+}
+
+void MockHidOutput::clear() {
+  std::lock_guard lock(mutex);
+  total_reports = 0;
+  other_events.clear();
+}
+
+Result<bool> MockHidOutput::write(const uhid_event &ev, std::size_t size) {
+  std::lock_guard lock(mutex);
+  if (ev.type == UHID_INPUT2) {
+    // assign() keeps the capacity of the slot: once the ring is full this doesn't allocate anymore
+    ring[total_reports++ % ring.size()].assign(ev.u.input2.data, ev.u.input2.data + ev.u.input2.size);
+  } else {
+    uhid_event copy{};
+    std::memcpy(&copy, &ev, std::min(size, sizeof(copy)));
+    other_events.push_back(copy);
+  }
+  return true;
+}
+
+void MockHidOutput::inject(const uhid_event &ev) {
+  std::lock_guard lock(mutex);
+  pending.push_back(ev);
+  signal_fd(event_fd);
+}
+
+bool MockHidOutput::read(uhid_event &ev) {
+  std::lock_guard lock(mutex);
+  if (pending.empty()) {
+    return false;
+  }
+  ev = pending.front();
+  pending.pop_front();
+  if (pending.empty()) {
+    reset_fd(event_fd);
+  }
+  return true;
+}
+
+int MockHidOutput::poll_fd() const {
+  return event_fd;
+}
+
+Result<evdev_output_ptr> MockBackend::create_evdev(const libevdev *dev) {
+  auto name = libevdev_get_name(dev);
+  auto device = std::make_shared<MockEvdevOutput>(name ? name : "", capacity);
+  std::lock_guard lock(mutex);
+  evdev.push_back(device);
+  return evdev_output_ptr{device};
+}
+
+Result<hid_output_ptr> MockBackend::create_hid(const uhid_create2_req &definition) {
+  auto device = std::make_shared<MockHidOutput>(definition, capacity);
+  std::lock_guard lock(mutex);
+  hid.push_back(device);
+  return hid_output_ptr{device};
+}
+
+template <typename T> static std::vector<std::shared_ptr<T>> alive(const std::vector<std::weak_ptr<T>> &devices) {
+  std::vector<std::shared_ptr<T>> result;
+  for (const auto &device : devices) {
+    if (auto ptr = device.lock()) {
+      result.push_back(std::move(ptr));
+    }
+  }
+  return result;
+}
+
+std::vector<std::shared_ptr<MockEvdevOutput>> MockBackend::evdev_devices() const {
+  std::lock_guard lock(mutex);
+  return alive(evdev);
+}
+
+std::vector<std::shared_ptr<MockHidOutput>> MockBackend::hid_devices() const {
+  std::lock_guard lock(mutex);
+  return alive(hid);
+}
+
+} // namespace inputtino
@@ -1,20 +1,37 @@
 #include "inputtino/input.hpp"
+#include <algorithm>
 #include <cmath>
 #include <inputtino/protected_types.hpp>
+#include <inputtino/trace_hooks.hpp>
 #include <string.h>
 
 namespace inputtino {
 
+PointerAcceleration::PointerAcceleration(const std::function<double(double)> &gain, double max_speed)
+    : samples_per_unit((TABLE_SIZE - 1) / (max_speed > 0 && std::isfinite(max_speed) ? max_speed : DEFAULT_MAX_SPEED)) {
+  for (std::size_t index = 0; index < TABLE_SIZE; index++) {
+    table[index] = static_cast<float>(gain(index / samples_per_unit));
+  }
+}
+
+PointerAcceleration PointerAcceleration::flat(double factor) {
+  return PointerAcceleration([factor](double) { return factor; });
+}
+
+PointerAcceleration PointerAcceleration::linear(double factor, double acceleration, double max_gain) {
+  return PointerAcceleration(
+      [=](double speed) { return std::min(factor + acceleration * speed, max_gain); });
+}
+
+DeviceMetrics Mouse::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> Mouse::get_nodes() const {
   std::vector<std::string> nodes;
 
-  if (auto mouse = _state->mouse_rel.get()) {
-    nodes.emplace_back(libevdev_uinput_get_devnode(mouse));
-  }
-
-  if (auto mouse = _state->mouse_abs.get()) {
-    nodes.emplace_back(libevdev_uinput_get_devnode(mouse));
-  }
+  add_devnode(nodes, _state->mouse_rel.get());
+  add_devnode(nodes, _state->mouse_abs.get());
 
   return nodes;
 }
@@ -22,16 +39,7 @@ std::vector<std::string> Mouse::get_nodes() const {
 constexpr int ABS_MAX_WIDTH = 19200;
 constexpr int ABS_MAX_HEIGHT = 12000;
 
-static Result<libevdev_uinput_ptr> create_mouse(const DeviceDefinition &device) {
-  libevdev *dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, device.name.c_str());
-  libevdev_set_id_vendor(dev, device.vendor_id);
-  libevdev_set_id_product(dev, device.product_id);
-  libevdev_set_id_version(dev, device.version);
-  libevdev_set_id_bustype(dev, BUS_USB);
-
+static void enable_mouse_events(libevdev *dev) {
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, nullptr);
   libevdev_enable_event_code(dev, EV_KEY, BTN_RIGHT, nullptr);
@@ -53,26 +61,13 @@ static Result<libevdev_uinput_ptr> create_mouse(const DeviceDefinition &device)
 
   libevdev_enable_event_type(dev, EV_MSC);
   libevdev_enable_event_code(dev, EV_MSC, MSC_SCAN, nullptr);
-
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
-  }
-
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
 }
 
-static Result<libevdev_uinput_ptr> create_mouse_abs() {
-  libevdev *dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, "Wolf mouse (abs) virtual device");
-  libevdev_set_id_vendor(dev, 0xAB00);
-  libevdev_set_id_product(dev, 0xAB02);
-  libevdev_set_id_version(dev, 0xAB00);
-  libevdev_set_id_bustype(dev, BUS_USB);
+static Result<evdev_output_ptr> create_mouse(const DeviceDefinition &device) {
+  return create_evdev_device(device, enable_mouse_events);
+}
 
+static void enable_mouse_abs_events(libevdev *dev) {
   libevdev_enable_property(dev, INPUT_PROP_DIRECT);
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, nullptr);
@@ -86,26 +81,30 @@ static Result<libevdev_uinput_ptr> create_mouse_abs() {
   libevdev_enable_event_code(dev, EV_ABS, ABS_X, &absinfo);
   absinfo.maximum = ABS_MAX_HEIGHT;
   libevdev_enable_event_code(dev, EV_ABS, ABS_Y, &absinfo);
+}
 
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
-  }
-
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
+static Result<evdev_output_ptr> create_mouse_abs() {
+  static const DeviceDefinition definition = {
+      .name = "Wolf mouse (abs) virtual device", .vendor_id = 0xAB00, .product_id = 0xAB02, .version = 0xAB00};
+  return create_evdev_device(definition, enable_mouse_abs_events);
 }
 
 Mouse::Mouse() : _state(std::make_shared<MouseState>()) {}
 
 Mouse::~Mouse() {
   if (_state) {
+    trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::DEVICE_REMOVED);
+    if (_state->flush_task) {
+      Scheduler::get().cancel_and_wait(_state->flush_task);
+    }
     _state.reset();
   }
 }
 
 Result<Mouse> Mouse::create(const DeviceDefinition &device) {
   auto mouse = Mouse();
+  mouse._state->force_writes = device.force_writes;
+  mouse._state->abs_shadow.force = device.force_writes;
 
   auto mouse_rel_or_error = create_mouse(device);
   if (mouse_rel_or_error) {
@@ -124,23 +123,229 @@ Result<Mouse> Mouse::create(const DeviceDefinition &device) {
   return std::move(mouse);
 }
 
+/**
+ * A zero delta doesn't move the pointer (the input core drops it anyway), no need to write it
+ */
+static void add_motion(EventFrame<> &frame, int delta_x, int delta_y, bool force_writes) {
+  if (delta_x != 0 || force_writes) {
+    frame.add(EV_REL, REL_X, delta_x);
+  }
+  if (delta_y != 0 || force_writes) {
+    frame.add(EV_REL, REL_Y, delta_y);
+  }
+}
+
+/**
+ * Adds `high_res_distance` to the remainder and writes as many whole notches (120) as it now holds, the rest is left
+ * for the next call
+ */
+static void add_scroll(EventFrame<> &frame,
+                       int &remainder,
+                       int high_res_distance,
+                       unsigned short code,
+                       unsigned short high_res_code,
+                       bool force_writes) {
+  remainder += high_res_distance;
+  int notches = remainder / 120;
+  remainder -= notches * 120;
+  if (notches != 0 || force_writes) {
+    frame.add(EV_REL, code, notches);
+  }
+  if (high_res_distance != 0 || force_writes) {
+    frame.add(EV_REL, high_res_code, high_res_distance);
+  }
+}
+
+/**
+ * Adds the pending relative motion to the given frame and writes out the pending absolute position.
+ * Must be called from an operation on `serial`
+ */
+static void flush_pending_motion(MouseState &state, EventFrame<> &rel_frame) {
+  if (!state.pending_rel && !state.pending_scroll && !state.pending_abs) {
+    return;
+  }
+
+  if (state.pending_rel || state.pending_scroll) {
+    if (state.pending_rel) {
+      add_motion(rel_frame, state.pending_dx, state.pending_dy, state.force_writes);
+    }
+    if (state.pending_scroll) {
+      add_scroll(rel_frame, state.v_scroll_remainder, state.pending_v_scroll, REL_WHEEL, REL_WHEEL_HI_RES, false);
+      add_scroll(rel_frame, state.h_scroll_remainder, state.pending_h_scroll, REL_HWHEEL, REL_HWHEEL_HI_RES, false);
+    }
+    if (!rel_frame.empty()) {
+      rel_frame.syn();
+    }
+    state.pending_rel = false;
+    state.pending_dx = 0;
+    state.pending_dy = 0;
+    state.pending_scroll = false;
+    state.pending_v_scroll = 0;
+    state.pending_h_scroll = 0;
+  }
+
+  if (state.pending_abs) {
+    EventFrame abs_frame(state.mouse_abs.get(), &state.metrics);
+    abs_frame.add_abs(state.abs_shadow, ABS_X, state.pending_abs_x);
+    abs_frame.add_abs(state.abs_shadow, ABS_Y, state.pending_abs_y);
+    abs_frame.syn_and_flush();
+    state.pending_abs = false;
+  }
+
+  state.last_flush = std::chrono::steady_clock::now();
+}
+
+/**
+ * If enough time has passed since the last flush, the pending motion is written out immediately,
+ * otherwise we'll register a task on the shared Scheduler that will write it out once `flush_interval` has passed.
+ * Must be called from an operation on `serial`
+ */
+static void flush_or_schedule(MouseState &state) {
+  auto now = std::chrono::steady_clock::now();
+  auto flush_at = state.last_flush + state.flush_interval;
+  if (now >= flush_at) {
+    EventFrame frame(state.mouse_rel.get(), &state.metrics);
+    flush_pending_motion(state, frame);
+    frame.flush();
+  } else if (!state.flush_task) {
+    auto delay = std::chrono::duration_cast<std::chrono::microseconds>(flush_at - now);
+    auto flush_task = [weak_state = state.weak_from_this()]() -> std::optional<std::chrono::microseconds> {
+      if (auto state = weak_state.lock()) {
+        state->serial.run([state = state.get()] {
+          state->flush_task = 0;
+          EventFrame frame(state->mouse_rel.get(), &state->metrics);
+          flush_pending_motion(*state, frame);
+          frame.flush();
+        });
+      }
+      return {};
+    };
+    state.flush_task = Scheduler::get().schedule(delay, flush_task);
+  }
+}
+
+void Mouse::set_motion_coalescing(int max_rate_hz) {
+  _state->serial.run([state = _state.get(), max_rate_hz] {
+    if (max_rate_hz <= 0) {
+      EventFrame frame(state->mouse_rel.get(), &state->metrics);
+      flush_pending_motion(*state, frame);
+      frame.flush();
+      state->flush_interval = std::chrono::microseconds{0};
+      return;
+    }
+
+    state->flush_interval = std::chrono::microseconds{1000000 / max_rate_hz};
+  });
+}
+
+/**
+ * Must be called from an operation on `serial`
+ */
+static void move_rel(MouseState &state, int delta_x, int delta_y) {
+  auto mouse = state.mouse_rel.get();
+  if (!mouse) {
+    return;
+  }
+
+  if (state.flush_interval.count() > 0) {
+    if (state.pending_rel) {
+      state.metrics.add_coalesced();
+    }
+    state.pending_rel = true;
+    state.pending_dx += delta_x;
+    state.pending_dy += delta_y;
+    flush_or_schedule(state);
+    return;
+  }
+
+  EventFrame frame(mouse, &state.metrics);
+  add_motion(frame, delta_x, delta_y, state.force_writes);
+  frame.syn_and_flush();
+}
+
+/**
+ * Applies the acceleration (if any), adds the motion to the remainder and moves by the whole units that it now holds.
+ * Must be called from an operation on `serial`
+ */
+static void move_fractional(MouseState &state, double delta_x, double delta_y) {
+  if (state.acceleration) {
+    auto now = std::chrono::steady_clock::now();
+    // The first move after a pause is slow, no matter how long the pause has been
+    auto elapsed_ms = std::clamp(std::chrono::duration<double, std::milli>(now - state.last_move).count(), 1.0, 100.0);
+    state.last_move = now;
+    auto gain = state.acceleration->gain(std::hypot(delta_x, delta_y) / elapsed_ms);
+    delta_x *= gain;
+    delta_y *= gain;
+  }
+
+  state.rel_remainder_x += delta_x;
+  state.rel_remainder_y += delta_y;
+  auto whole_x = std::trunc(state.rel_remainder_x);
+  auto whole_y = std::trunc(state.rel_remainder_y);
+  state.rel_remainder_x -= whole_x;
+  state.rel_remainder_y -= whole_y;
+  if (whole_x != 0 || whole_y != 0) { // Less than a unit: nothing to write yet, even with force_writes
+    move_rel(state, static_cast<int>(whole_x), static_cast<int>(whole_y));
+  }
+}
+
 void Mouse::move(int delta_x, int delta_y) {
-  if (auto mouse = _state->mouse_rel.get()) {
-    libevdev_uinput_write_event(mouse, EV_REL, REL_X, delta_x);
-    libevdev_uinput_write_event(mouse, EV_REL, REL_Y, delta_y);
-    libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_MOVE, delta_x, delta_y);
+  _state->serial.run([state = _state.get(), delta_x, delta_y] {
+    if (state->acceleration) {
+      move_fractional(*state, delta_x, delta_y);
+    } else {
+      move_rel(*state, delta_x, delta_y);
+    }
+  });
+}
+
+void Mouse::move(double delta_x, double delta_y) {
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_MOVE_FRACTIONAL, delta_x, delta_y);
+  _state->serial.run([state = _state.get(), delta_x, delta_y] { move_fractional(*state, delta_x, delta_y); });
+}
+
+void Mouse::set_acceleration(const std::optional<PointerAcceleration> &profile) {
+  // Operations must be trivially copyable and the table doesn't fit in one: it's left in the state, the operation only
+  // picks up the latest one (nothing to free if it never runs)
+  {
+    std::lock_guard lock(_state->pending_acceleration_m);
+    _state->pending_acceleration = profile;
   }
+  _state->serial.run([state = _state.get()] {
+    std::lock_guard lock(state->pending_acceleration_m);
+    if (state->pending_acceleration) {
+      state->acceleration = *state->pending_acceleration;
+      state->pending_acceleration.reset();
+    }
+  });
 }
 
 void Mouse::move_abs(int x, int y, int screen_width, int screen_height) {
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_MOVE_ABS, x, y, screen_width, screen_height);
   int scaled_x = (int)std::lround((ABS_MAX_WIDTH / (double)screen_width) * x);
   int scaled_y = (int)std::lround((ABS_MAX_HEIGHT / (double)screen_height) * y);
 
-  if (auto mouse = _state->mouse_abs.get()) {
-    libevdev_uinput_write_event(mouse, EV_ABS, ABS_X, scaled_x);
-    libevdev_uinput_write_event(mouse, EV_ABS, ABS_Y, scaled_y);
-    libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
-  }
+  _state->serial.run([state = _state.get(), scaled_x, scaled_y] {
+    if (auto mouse = state->mouse_abs.get()) {
+      if (state->flush_interval.count() > 0) {
+        // Only the latest absolute position matters
+        if (state->pending_abs) {
+          state->metrics.add_coalesced();
+        }
+        state->pending_abs = true;
+        state->pending_abs_x = scaled_x;
+        state->pending_abs_y = scaled_y;
+        flush_or_schedule(*state);
+        return;
+      }
+
+      EventFrame frame(mouse, &state->metrics);
+      frame.add_abs(state->abs_shadow, ABS_X, scaled_x);
+      frame.add_abs(state->abs_shadow, ABS_Y, scaled_y);
+      frame.syn_and_flush();
+    }
+  });
 }
 
 static std::pair<int, int> btn_to_uinput(Mouse::MOUSE_BUTTON button) {
@@ -159,41 +364,77 @@ static std::pair<int, int> btn_to_uinput(Mouse::MOUSE_BUTTON button) {
 }
 
 void Mouse::press(Mouse::MOUSE_BUTTON button) {
-  if (auto mouse = _state->mouse_rel.get()) {
-    auto [btn_type, scan_code] = btn_to_uinput(button);
-    libevdev_uinput_write_event(mouse, EV_MSC, MSC_SCAN, scan_code);
-    libevdev_uinput_write_event(mouse, EV_KEY, btn_type, 1);
-    libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
-  }
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_PRESS, button);
+  _state->serial.run([state = _state.get(), button] {
+    if (auto mouse = state->mouse_rel.get()) {
+      auto [btn_type, scan_code] = btn_to_uinput(button);
+      EventFrame frame(mouse, &state->metrics);
+      flush_pending_motion(*state, frame);
+      frame.add(EV_MSC, MSC_SCAN, scan_code);
+      frame.add(EV_KEY, btn_type, 1);
+      frame.syn();
+      frame.flush();
+    }
+  });
 }
 
 void Mouse::release(Mouse::MOUSE_BUTTON button) {
-  if (auto mouse = _state->mouse_rel.get()) {
-    auto [btn_type, scan_code] = btn_to_uinput(button);
-    libevdev_uinput_write_event(mouse, EV_MSC, MSC_SCAN, scan_code);
-    libevdev_uinput_write_event(mouse, EV_KEY, btn_type, 0);
-    libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
-  }
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_RELEASE, button);
+  _state->serial.run([state = _state.get(), button] {
+    if (auto mouse = state->mouse_rel.get()) {
+      auto [btn_type, scan_code] = btn_to_uinput(button);
+      EventFrame frame(mouse, &state->metrics);
+      flush_pending_motion(*state, frame);
+      frame.add(EV_MSC, MSC_SCAN, scan_code);
+      frame.add(EV_KEY, btn_type, 0);
+      frame.syn();
+      frame.flush();
+    }
+  });
 }
 
-void Mouse::horizontal_scroll(int high_res_distance) {
-  int distance = high_res_distance / 120;
+/**
+ * With coalescing enabled the distance is added to the pending scroll (and written together with the pending
+ * motion), otherwise it's written right away; either way the low resolution notches carry over the remainder.
+ * Must be called from an operation on `serial`
+ */
+static void scroll(MouseState &state, bool vertical, int high_res_distance) {
+  auto mouse = state.mouse_rel.get();
+  if (!mouse) {
+    return;
+  }
 
-  if (auto mouse = _state->mouse_rel.get()) {
-    libevdev_uinput_write_event(mouse, EV_REL, REL_HWHEEL, distance);
-    libevdev_uinput_write_event(mouse, EV_REL, REL_HWHEEL_HI_RES, high_res_distance);
-    libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
+  if (state.flush_interval.count() > 0) {
+    if (state.pending_scroll) {
+      state.metrics.add_coalesced();
+    }
+    state.pending_scroll = true;
+    (vertical ? state.pending_v_scroll : state.pending_h_scroll) += high_res_distance;
+    flush_or_schedule(state);
+    return;
   }
+
+  EventFrame frame(mouse, &state.metrics);
+  flush_pending_motion(state, frame);
+  if (vertical) {
+    add_scroll(frame, state.v_scroll_remainder, high_res_distance, REL_WHEEL, REL_WHEEL_HI_RES, state.force_writes);
+  } else {
+    add_scroll(frame, state.h_scroll_remainder, high_res_distance, REL_HWHEEL, REL_HWHEEL_HI_RES, state.force_writes);
+  }
+  if (!frame.empty()) {
+    frame.syn();
+  }
+  frame.flush();
 }
 
-void Mouse::vertical_scroll(int high_res_distance) {
-  int distance = high_res_distance / 120;
+void Mouse::horizontal_scroll(int high_res_distance) {
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_SCROLL_H, high_res_distance);
+  _state->serial.run([state = _state.get(), high_res_distance] { scroll(*state, false, high_res_distance); });
+}
 
-  if (auto mouse = _state->mouse_rel.get()) {
-    libevdev_uinput_write_event(mouse, EV_REL, REL_WHEEL, distance);
-    libevdev_uinput_write_event(mouse, EV_REL, REL_WHEEL_HI_RES, high_res_distance);
-    libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
-  }
+void Mouse::vertical_scroll(int high_res_distance) {
+  trace::record(_state.get(), trace::DeviceKind::MOUSE, trace::Op::MOUSE_SCROLL_V, high_res_distance);
+  _state->serial.run([state = _state.get(), high_res_distance] { scroll(*state, true, high_res_distance); });
 }
 
 } // namespace inputtino
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <cstring>
 #include <inputtino/protected_types.hpp>
+#include <inputtino/trace_hooks.hpp>
 
 namespace inputtino {
 
@@ -27,16 +28,7 @@ static constexpr int PRESSURE_MAX = 4096;
 static constexpr int DISTANCE_MAX = 1024;
 static constexpr int RESOLUTION = 28;
 
-Result<libevdev_uinput_ptr> create_tablet(const DeviceDefinition &device) {
-  libevdev *dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, device.name.c_str());
-  libevdev_set_id_vendor(dev, device.vendor_id);
-  libevdev_set_id_product(dev, device.product_id);
-  libevdev_set_id_version(dev, device.version);
-  libevdev_set_id_bustype(dev, BUS_USB);
-
+static void enable_tablet_events(libevdev *dev) {
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, BTN_TOUCH, nullptr);
   libevdev_enable_event_code(dev, EV_KEY, BTN_STYLUS, nullptr);
@@ -67,19 +59,17 @@ Result<libevdev_uinput_ptr> create_tablet(const DeviceDefinition &device) {
   // https://docs.kernel.org/input/event-codes.html#tablets
   libevdev_enable_property(dev, INPUT_PROP_POINTER);
   libevdev_enable_property(dev, INPUT_PROP_DIRECT);
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
-  }
+}
 
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
+Result<evdev_output_ptr> create_tablet(const DeviceDefinition &device) {
+  return create_evdev_device(device, enable_tablet_events);
 }
 
 PenTablet::PenTablet() : _state(std::make_shared<PenTabletState>()) {}
 
 PenTablet::~PenTablet() {
   if (_state) {
+    trace::record(_state.get(), trace::DeviceKind::PEN_TABLET, trace::Op::DEVICE_REMOVED);
     _state.reset();
   }
 }
@@ -89,18 +79,21 @@ Result<PenTablet> PenTablet::create(const DeviceDefinition &device) {
   if (tablet) {
     PenTablet pt;
     pt._state->pen_tablet = std::move(*tablet);
+    pt._state->abs_shadow.force = device.force_writes;
     return std::move(pt);
   } else {
     return Error(tablet.getErrorMessage());
   }
 }
 
+DeviceMetrics PenTablet::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> PenTablet::get_nodes() const {
   std::vector<std::string> nodes;
 
-  if (auto kb = _state->pen_tablet.get()) {
-    nodes.emplace_back(libevdev_uinput_get_devnode(kb));
-  }
+  add_devnode(nodes, _state->pen_tablet.get());
 
   return nodes;
 }
@@ -111,52 +104,71 @@ static inline float deg2rad(float degree) {
 
 void PenTablet::place_tool(
     PenTablet::TOOL_TYPE tool_type, float x, float y, float pressure, float distance, float tilt_x, float tilt_y) {
-  if (auto tablet = _state->pen_tablet.get()) {
-    if (tool_type != PenTablet::SAME_AS_BEFORE && tool_type != _state->last_tool) {
-      libevdev_uinput_write_event(tablet, EV_KEY, tool_to_linux.at(tool_type), 1);
-
-      if (_state->last_tool != PenTablet::SAME_AS_BEFORE)
-        libevdev_uinput_write_event(tablet, EV_KEY, tool_to_linux.at(_state->last_tool), 0);
-
-      _state->last_tool = tool_type;
-    }
-
-    int scaled_x = (int)std::lround(MAX_X * x);
-    int scaled_y = (int)std::lround(MAX_Y * y);
-    libevdev_uinput_write_event(tablet, EV_ABS, ABS_X, scaled_x);
-    libevdev_uinput_write_event(tablet, EV_ABS, ABS_Y, scaled_y);
-
-    if (pressure >= 0) {
-      int scaled_pressure = (int)std::lround(pressure * PRESSURE_MAX);
-      libevdev_uinput_write_event(tablet, EV_ABS, ABS_PRESSURE, scaled_pressure);
-      // when there's pressure, the tool must be touching the tablet
-      libevdev_uinput_write_event(tablet, EV_ABS, ABS_DISTANCE, 0);
+  trace::record(_state.get(),
+                trace::DeviceKind::PEN_TABLET,
+                trace::Op::PEN_PLACE_TOOL,
+                tool_type,
+                x,
+                y,
+                pressure,
+                distance,
+                tilt_x,
+                tilt_y);
+  _state->serial.run([state = _state.get(), tool_type, x, y, pressure, distance, tilt_x, tilt_y] {
+    if (auto tablet = state->pen_tablet.get()) {
+      EventFrame frame(tablet, &state->metrics);
+      if (tool_type != PenTablet::SAME_AS_BEFORE && tool_type != state->last_tool) {
+        frame.add(EV_KEY, tool_to_linux.at(tool_type), 1);
+
+        if (state->last_tool != PenTablet::SAME_AS_BEFORE)
+          frame.add(EV_KEY, tool_to_linux.at(state->last_tool), 0);
+
+        state->last_tool = tool_type;
+      }
+
+      int scaled_x = (int)std::lround(MAX_X * x);
+      int scaled_y = (int)std::lround(MAX_Y * y);
+      auto &shadow = state->abs_shadow;
+      frame.add_abs(shadow, ABS_X, scaled_x);
+      frame.add_abs(shadow, ABS_Y, scaled_y);
+
+      if (pressure >= 0) {
+        int scaled_pressure = (int)std::lround(pressure * PRESSURE_MAX);
+        frame.add_abs(shadow, ABS_PRESSURE, scaled_pressure);
+        // when there's pressure, the tool must be touching the tablet
+        frame.add_abs(shadow, ABS_DISTANCE, 0);
+      }
+
+      if (distance >= 0) {
+        int scaled_distance = (int)std::lround(distance * DISTANCE_MAX);
+        frame.add_abs(shadow, ABS_DISTANCE, scaled_distance);
+        // when there's distance, the tool can't be touching the tablet
+        frame.add_abs(shadow, ABS_PRESSURE, 0);
+      }
+
+      auto scaled_tilt_x = std::clamp(tilt_x, -90.0f, 90.0f);
+      scaled_tilt_x = deg2rad(scaled_tilt_x * RESOLUTION);
+      frame.add_abs(shadow, ABS_TILT_X, (int)std::lround(scaled_tilt_x));
+
+      auto scaled_tilt_y = std::clamp(tilt_y, -90.0f, 90.0f);
+      scaled_tilt_y = deg2rad(scaled_tilt_y * RESOLUTION);
+      frame.add_abs(shadow, ABS_TILT_Y, (int)std::lround(scaled_tilt_y));
+
+      frame.syn_and_flush();
     }
-
-    if (distance >= 0) {
-      int scaled_distance = (int)std::lround(distance * DISTANCE_MAX);
-      libevdev_uinput_write_event(tablet, EV_ABS, ABS_DISTANCE, scaled_distance);
-      // when there's distance, the tool can't be touching the tablet
-      libevdev_uinput_write_event(tablet, EV_ABS, ABS_PRESSURE, 0);
-    }
-
-    auto scaled_tilt_x = std::clamp(tilt_x, -90.0f, 90.0f);
-    scaled_tilt_x = deg2rad(scaled_tilt_x * RESOLUTION);
-    libevdev_uinput_write_event(tablet, EV_ABS, ABS_TILT_X, (int)std::lround(scaled_tilt_x));
-
-    auto scaled_tilt_y = std::clamp(tilt_y, -90.0f, 90.0f);
-    scaled_tilt_y = deg2rad(scaled_tilt_y * RESOLUTION);
-    libevdev_uinput_write_event(tablet, EV_ABS, ABS_TILT_Y, (int)std::lround(scaled_tilt_y));
-
-    libevdev_uinput_write_event(tablet, EV_SYN, SYN_REPORT, 0);
-  }
+  });
 }
 
 void PenTablet::set_btn(PenTablet::BTN_TYPE btn, bool pressed) {
-  if (auto tablet = _state->pen_tablet.get()) {
-    libevdev_uinput_write_event(tablet, EV_KEY, btn_to_linux.at(btn), pressed ? 1 : 0);
-    libevdev_uinput_write_event(tablet, EV_SYN, SYN_REPORT, 0);
-  }
+  trace::record(_state.get(), trace::DeviceKind::PEN_TABLET, trace::Op::PEN_BTN, btn, pressed);
+  _state->serial.run([state = _state.get(), btn, pressed] {
+    if (auto tablet = state->pen_tablet.get()) {
+      EventFrame frame(tablet, &state->metrics);
+      frame.add(EV_KEY, btn_to_linux.at(btn), pressed ? 1 : 0);
+      frame.syn();
+      frame.flush();
+    }
+  });
 }
 
 } // namespace inputtino
@@ -0,0 +1,92 @@
+#include <inputtino/scheduler.hpp>
+
+namespace inputtino {
+
+Scheduler &Scheduler::get() {
+  static Scheduler instance;
+  return instance;
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard lock(m);
+    stop = true;
+  }
+  cv.notify_one();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+Scheduler::TaskId Scheduler::schedule(std::chrono::microseconds delay, Task task) {
+  std::lock_guard lock(m);
+  auto id = next_id++;
+  auto when = clock::now() + delay;
+  bool is_earliest = deadlines.empty() || when < deadlines.top().when;
+  tasks.emplace(id, std::move(task));
+  deadlines.push({when, id});
+
+  if (!thread.joinable()) {
+    thread = std::thread(&Scheduler::run, this);
+  } else if (is_earliest) {
+    cv.notify_one();
+  }
+  return id;
+}
+
+void Scheduler::cancel(TaskId id) {
+  std::lock_guard lock(m);
+  tasks.erase(id);
+  // The stale deadline will be skipped once it reaches the top of the heap
+}
+
+void Scheduler::cancel_and_wait(TaskId id) {
+  std::unique_lock lock(m);
+  tasks.erase(id);
+  if (std::this_thread::get_id() != thread.get_id()) {
+    done.wait(lock, [this, id] { return running != id; });
+  }
+}
+
+void Scheduler::run() {
+  std::unique_lock lock(m);
+  while (!stop) {
+    if (deadlines.empty()) {
+      cv.wait(lock, [this] { return stop || !deadlines.empty(); });
+      continue;
+    }
+
+    auto next = deadlines.top();
+    if (clock::now() < next.when) {
+      cv.wait_until(lock, next.when);
+      continue; // something earlier might have been scheduled in the meantime
+    }
+    deadlines.pop();
+
+    auto task_it = tasks.find(next.id);
+    if (task_it == tasks.end()) { // cancelled
+      continue;
+    }
+
+    // Run the task without holding the lock so that it (or other threads) can schedule/cancel in the meantime
+    auto task = task_it->second;
+    running = next.id;
+    lock.unlock();
+    auto reschedule_in = task();
+    lock.lock();
+    running = 0;
+    done.notify_all();
+
+    task_it = tasks.find(next.id);
+    if (task_it == tasks.end()) { // cancelled while running
+      continue;
+    }
+    if (reschedule_in) {
+      deadlines.push({clock::now() + *reschedule_in, next.id});
+    } else {
+      tasks.erase(task_it);
+    }
+  }
+}
+
+} // namespace inputtino
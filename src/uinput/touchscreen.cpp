@@ -3,34 +3,28 @@
 #include <cmath>
 #include <cstring>
 #include <inputtino/protected_types.hpp>
+#include <inputtino/trace_hooks.hpp>
 
 namespace inputtino {
 
+DeviceMetrics TouchScreen::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> TouchScreen::get_nodes() const {
   std::vector<std::string> nodes;
 
-  if (auto kb = _state->touch_screen.get()) {
-    nodes.emplace_back(libevdev_uinput_get_devnode(kb));
-  }
+  add_devnode(nodes, _state->touch_screen.get());
 
   return nodes;
 }
 
 static constexpr int TOUCH_MAX_X = 19200;
 static constexpr int TOUCH_MAX_Y = 10800;
-static constexpr int NUM_FINGERS = 16;
+static constexpr int NUM_FINGERS = FingerSlots::MAX_SLOTS;
 static constexpr int PRESSURE_MAX = 253;
 
-Result<libevdev_uinput_ptr> create_touch_screen(const DeviceDefinition &device) {
-  libevdev *dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, device.name.c_str());
-  libevdev_set_id_vendor(dev, device.vendor_id);
-  libevdev_set_id_product(dev, device.product_id);
-  libevdev_set_id_version(dev, device.version);
-  libevdev_set_id_bustype(dev, BUS_USB);
-
+static void enable_touch_screen_events(libevdev *dev) {
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, nullptr);
   libevdev_enable_event_code(dev, EV_KEY, BTN_TOUCH, nullptr);
@@ -47,7 +41,7 @@ Result<libevdev_uinput_ptr> create_touch_screen(const DeviceDefinition &device)
   libevdev_enable_event_code(dev, EV_ABS, ABS_Y, &abs_y);
   libevdev_enable_event_code(dev, EV_ABS, ABS_MT_POSITION_Y, &abs_y);
 
-  input_absinfo tracking{0, 0, 65535, 0, 0, 0};
+  input_absinfo tracking{0, 0, FingerSlots::MAX_TRACKING_ID, 0, 0, 0};
   libevdev_enable_event_code(dev, EV_ABS, ABS_MT_TRACKING_ID, &tracking);
 
   input_absinfo abs_pressure{0, 0, PRESSURE_MAX, 0, 0, 0};
@@ -62,20 +56,17 @@ Result<libevdev_uinput_ptr> create_touch_screen(const DeviceDefinition &device)
 
   // https://docs.kernel.org/input/event-codes.html#touchscreens
   libevdev_enable_property(dev, INPUT_PROP_DIRECT);
+}
 
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
-  }
-
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
+Result<evdev_output_ptr> create_touch_screen(const DeviceDefinition &device) {
+  return create_evdev_device(device, enable_touch_screen_events);
 }
 
 TouchScreen::TouchScreen() : _state(std::make_shared<TouchScreenState>()) {}
 
 TouchScreen::~TouchScreen() {
   if (_state) {
+    trace::record(_state.get(), trace::DeviceKind::TOUCH_SCREEN, trace::Op::DEVICE_REMOVED);
     _state.reset();
   }
 }
@@ -85,57 +76,100 @@ Result<TouchScreen> TouchScreen::create(const DeviceDefinition &device) {
   if (touch_screen) {
     TouchScreen ts;
     ts._state->touch_screen = std::move(*touch_screen);
+    ts._state->abs_shadow.force = device.force_writes;
+    ts._state->fingers.set_force_writes(device.force_writes);
     return ts;
   } else {
     return Error(touch_screen.getErrorMessage());
   }
 }
 
-void TouchScreen::place_finger(int finger_nr, float x, float y, float pressure, int orientation) {
-  if (auto ts = this->_state->touch_screen.get()) {
-    int scaled_x = (int)std::lround(TOUCH_MAX_X * x);
-    int scaled_y = (int)std::lround(TOUCH_MAX_Y * y);
-    int scaled_orientation = std::clamp(orientation, -90, 90);
-
-    if (_state->fingers.find(finger_nr) == _state->fingers.end()) {
-      // Wow, a wild finger appeared!
-      auto finger_slot = _state->fingers.size() + 1;
-      _state->fingers[finger_nr] = finger_slot;
-      libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_SLOT, finger_slot);
-      libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_TRACKING_ID, finger_slot);
-    } else {
-      // I already know this finger, let's check the slot
-      auto finger_slot = _state->fingers[finger_nr];
-      if (_state->current_slot != finger_slot) {
-        libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_SLOT, finger_slot);
-        _state->current_slot = finger_slot;
+void TouchScreen::apply(const TouchFrame &touch_frame) {
+  trace::record(_state.get(), trace::DeviceKind::TOUCH_SCREEN, touch_frame);
+  _state->serial.run([state = _state.get(), touch_frame] {
+    if (auto ts = state->touch_screen.get()) {
+      EventFrame frame(ts, &state->metrics);
+
+      for (const auto &contact : touch_frame) {
+        auto finger_slot = state->fingers.find(contact.finger_nr);
+
+        if (contact.released) {
+          if (finger_slot < 0) { // Unknown finger, nothing to release
+            continue;
+          }
+          if (state->current_slot != finger_slot) {
+            frame.add(EV_ABS, ABS_MT_SLOT, finger_slot);
+            state->current_slot = finger_slot;
+          }
+          state->fingers.release(finger_slot);
+          frame.add(EV_ABS, ABS_MT_TRACKING_ID, -1);
+          continue;
+        }
+
+        if (finger_slot < 0) {
+          // Wow, a wild finger appeared!
+          finger_slot = state->fingers.acquire(contact.finger_nr);
+          if (finger_slot < 0) { // All slots are taken, there's nothing we can do
+            continue;
+          }
+          frame.add(EV_ABS, ABS_MT_SLOT, finger_slot);
+          frame.add(EV_ABS, ABS_MT_TRACKING_ID, state->fingers.new_tracking_id());
+          state->current_slot = finger_slot;
+        }
+
+        int scaled_x = (int)std::lround(TOUCH_MAX_X * contact.x);
+        int scaled_y = (int)std::lround(TOUCH_MAX_Y * contact.y);
+        int scaled_pressure = (int)std::lround(contact.pressure * PRESSURE_MAX);
+        int scaled_orientation = std::clamp(contact.orientation, -90, 90);
+
+        auto &slot_axes = state->fingers.axes[finger_slot];
+        if (!slot_axes.changed(FingerSlots::MT_X, scaled_x) && !slot_axes.changed(FingerSlots::MT_Y, scaled_y) &&
+            !slot_axes.changed(FingerSlots::MT_PRESSURE, scaled_pressure) &&
+            !slot_axes.changed(FingerSlots::MT_ORIENTATION, scaled_orientation)) {
+          continue; // This finger hasn't moved, no need to switch slot
+        }
+
+        if (state->current_slot != finger_slot) {
+          // I already know this finger, let's check the slot
+          frame.add(EV_ABS, ABS_MT_SLOT, finger_slot);
+          state->current_slot = finger_slot;
+        }
+
+        frame.add_abs(state->abs_shadow, ABS_X, scaled_x);
+        if (slot_axes.update(FingerSlots::MT_X, scaled_x)) {
+          frame.add(EV_ABS, ABS_MT_POSITION_X, scaled_x);
+        }
+        frame.add_abs(state->abs_shadow, ABS_Y, scaled_y);
+        if (slot_axes.update(FingerSlots::MT_Y, scaled_y)) {
+          frame.add(EV_ABS, ABS_MT_POSITION_Y, scaled_y);
+        }
+        frame.add_abs(state->abs_shadow, ABS_PRESSURE, scaled_pressure);
+        if (slot_axes.update(FingerSlots::MT_PRESSURE, scaled_pressure)) {
+          frame.add(EV_ABS, ABS_MT_PRESSURE, scaled_pressure);
+        }
+        if (slot_axes.update(FingerSlots::MT_ORIENTATION, scaled_orientation)) {
+          frame.add(EV_ABS, ABS_MT_ORIENTATION, scaled_orientation);
+        }
       }
-    }
 
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_X, scaled_x);
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_POSITION_X, scaled_x);
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_Y, scaled_y);
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_POSITION_Y, scaled_y);
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_PRESSURE, (int)std::lround(pressure * PRESSURE_MAX));
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_PRESSURE, (int)std::lround(pressure * PRESSURE_MAX));
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_ORIENTATION, scaled_orientation);
+      if (!frame.empty()) {
+        frame.syn();
+        frame.flush();
+      }
+    }
+  });
+}
 
-    libevdev_uinput_write_event(ts, EV_SYN, SYN_REPORT, 0);
-  }
+void TouchScreen::place_finger(int finger_nr, float x, float y, float pressure, int orientation) {
+  TouchFrame frame;
+  frame.place_finger(finger_nr, x, y, pressure, orientation);
+  apply(frame);
 }
 
 void TouchScreen::release_finger(int finger_nr) {
-  if (auto ts = this->_state->touch_screen.get()) {
-    auto finger_slot = _state->fingers[finger_nr];
-    if (_state->current_slot != finger_slot) {
-      libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_SLOT, finger_slot);
-      _state->current_slot = -1;
-    }
-    _state->fingers.erase(finger_nr);
-    libevdev_uinput_write_event(ts, EV_ABS, ABS_MT_TRACKING_ID, -1);
-
-    libevdev_uinput_write_event(ts, EV_SYN, SYN_REPORT, 0);
-  }
+  TouchFrame frame;
+  frame.release_finger(finger_nr);
+  apply(frame);
 }
 
 } // namespace inputtino
\ No newline at end of file
@@ -3,15 +3,18 @@
 #include <cmath>
 #include <cstring>
 #include <inputtino/protected_types.hpp>
+#include <inputtino/trace_hooks.hpp>
 
 namespace inputtino {
 
+DeviceMetrics Trackpad::get_metrics() const {
+  return _state ? _state->metrics.snapshot() : DeviceMetrics{};
+}
+
 std::vector<std::string> Trackpad::get_nodes() const {
   std::vector<std::string> nodes;
 
-  if (auto kb = _state->trackpad.get()) {
-    nodes.emplace_back(libevdev_uinput_get_devnode(kb));
-  }
+  add_devnode(nodes, _state->trackpad.get());
 
   return nodes;
 }
@@ -19,19 +22,10 @@ std::vector<std::string> Trackpad::get_nodes() const {
 static constexpr int TOUCH_MAX_X = 19200;
 static constexpr int TOUCH_MAX_Y = 10800;
 // static constexpr int TOUCH_MAX = 1020;
-static constexpr int NUM_FINGERS = 16; // Apple's touchpads support 16 touches
+static constexpr int NUM_FINGERS = FingerSlots::MAX_SLOTS; // Apple's touchpads support 16 touches
 static constexpr int PRESSURE_MAX = 253;
 
-Result<libevdev_uinput_ptr> create_trackpad(const DeviceDefinition &device) {
-  libevdev *dev = libevdev_new();
-  libevdev_uinput *uidev;
-
-  libevdev_set_name(dev, device.name.c_str());
-  libevdev_set_id_vendor(dev, device.vendor_id);
-  libevdev_set_id_product(dev, device.product_id);
-  libevdev_set_id_version(dev, device.version);
-  libevdev_set_id_bustype(dev, BUS_USB);
-
+static void enable_trackpad_events(libevdev *dev) {
   libevdev_enable_event_type(dev, EV_KEY);
   libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, nullptr);
   libevdev_enable_event_code(dev, EV_KEY, BTN_TOUCH, nullptr);
@@ -53,7 +47,7 @@ Result<libevdev_uinput_ptr> create_trackpad(const DeviceDefinition &device) {
   libevdev_enable_event_code(dev, EV_ABS, ABS_Y, &abs_y);
   libevdev_enable_event_code(dev, EV_ABS, ABS_MT_POSITION_Y, &abs_y);
 
-  input_absinfo tracking{0, 0, 65535, 0, 0, 0};
+  input_absinfo tracking{0, 0, FingerSlots::MAX_TRACKING_ID, 0, 0, 0};
   libevdev_enable_event_code(dev, EV_ABS, ABS_MT_TRACKING_ID, &tracking);
 
   input_absinfo abs_pressure{0, 0, PRESSURE_MAX, 0, 0, 0};
@@ -69,19 +63,16 @@ Result<libevdev_uinput_ptr> create_trackpad(const DeviceDefinition &device) {
   // https://docs.kernel.org/input/event-codes.html#trackpads
   libevdev_enable_property(dev, INPUT_PROP_POINTER);
   libevdev_enable_property(dev, INPUT_PROP_BUTTONPAD);
+}
 
-  auto err = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
-  libevdev_free(dev);
-  if (err != 0) {
-    return Error(strerror(-err));
-  }
-
-  return libevdev_uinput_ptr{uidev, ::libevdev_uinput_destroy};
+Result<evdev_output_ptr> create_trackpad(const DeviceDefinition &device) {
+  return create_evdev_device(device, enable_trackpad_events);
 }
 
 Trackpad::Trackpad() : _state(std::make_shared<TrackpadState>()) {}
 Trackpad::~Trackpad() {
   if (_state) {
+    trace::record(_state.get(), trace::DeviceKind::TRACKPAD, trace::Op::DEVICE_REMOVED);
     _state.reset();
   }
 }
@@ -91,102 +82,151 @@ Result<Trackpad> Trackpad::create(const DeviceDefinition &device) {
   if (trackpad_el) {
     Trackpad trackpad;
     trackpad._state->trackpad = std::move(*trackpad_el);
+    trackpad._state->abs_shadow.force = device.force_writes;
+    trackpad._state->fingers.set_force_writes(device.force_writes);
     return std::move(trackpad);
   } else {
     return Error(trackpad_el.getErrorMessage());
   }
 }
 
-void Trackpad::place_finger(int finger_nr, float x, float y, float pressure, int orientation) {
-  if (auto touchpad = this->_state->trackpad.get()) {
-    int scaled_x = (int)std::lround(TOUCH_MAX_X * x);
-    int scaled_y = (int)std::lround(TOUCH_MAX_Y * y);
-    int scaled_orientation = std::clamp(orientation, -90, 90);
-
-    if (_state->fingers.find(finger_nr) == _state->fingers.end()) {
-      // Wow, a wild finger appeared!
-      auto finger_slot = _state->fingers.size() + 1;
-      _state->fingers[finger_nr] = finger_slot;
-      libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_SLOT, finger_slot);
-      libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_TRACKING_ID, finger_slot);
-      auto nr_fingers = _state->fingers.size();
-      { // Update number of fingers pressed
-        if (nr_fingers == 1) {
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_FINGER, 1);
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOUCH, 1);
-        } else if (nr_fingers == 2) {
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_FINGER, 0);
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_DOUBLETAP, 1);
-        } else if (nr_fingers == 3) {
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_DOUBLETAP, 0);
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_TRIPLETAP, 1);
-        } else if (nr_fingers == 4) {
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_TRIPLETAP, 0);
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_QUADTAP, 1);
-        } else if (nr_fingers == 5) {
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_QUADTAP, 0);
-          libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_QUINTTAP, 1);
+/**
+ * The BTN_TOOL_* key that tells readers how many fingers are currently on the trackpad
+ * EX: enabling BTN_TOOL_DOUBLETAP will result in scrolling instead of moving the mouse
+ */
+static int tool_for_fingers(int nr_fingers) {
+  switch (nr_fingers) {
+  case 0:
+    return 0;
+  case 1:
+    return BTN_TOOL_FINGER;
+  case 2:
+    return BTN_TOOL_DOUBLETAP;
+  case 3:
+    return BTN_TOOL_TRIPLETAP;
+  case 4:
+    return BTN_TOOL_QUADTAP;
+  default:
+    return BTN_TOOL_QUINTTAP;
+  }
+}
+
+void Trackpad::apply(const TouchFrame &touch_frame) {
+  trace::record(_state.get(), trace::DeviceKind::TRACKPAD, touch_frame);
+  _state->serial.run([state = _state.get(), touch_frame] {
+    if (auto touchpad = state->trackpad.get()) {
+      EventFrame frame(touchpad, &state->metrics);
+      auto nr_fingers_before = state->fingers.size();
+
+      for (const auto &contact : touch_frame) {
+        auto finger_slot = state->fingers.find(contact.finger_nr);
+
+        if (contact.released) {
+          if (finger_slot < 0) { // Unknown finger, nothing to release
+            continue;
+          }
+          if (state->current_slot != finger_slot) {
+            frame.add(EV_ABS, ABS_MT_SLOT, finger_slot);
+            state->current_slot = finger_slot;
+          }
+          state->fingers.release(finger_slot);
+          frame.add(EV_ABS, ABS_MT_TRACKING_ID, -1);
+          continue;
+        }
+
+        if (finger_slot < 0) {
+          // Wow, a wild finger appeared!
+          finger_slot = state->fingers.acquire(contact.finger_nr);
+          if (finger_slot < 0) { // All slots are taken, there's nothing we can do
+            continue;
+          }
+          frame.add(EV_ABS, ABS_MT_SLOT, finger_slot);
+          frame.add(EV_ABS, ABS_MT_TRACKING_ID, state->fingers.new_tracking_id());
+          state->current_slot = finger_slot;
+        }
+
+        int scaled_x = (int)std::lround(TOUCH_MAX_X * contact.x);
+        int scaled_y = (int)std::lround(TOUCH_MAX_Y * contact.y);
+        int scaled_pressure = (int)std::lround(contact.pressure * PRESSURE_MAX);
+        int scaled_orientation = std::clamp(contact.orientation, -90, 90);
+
+        auto &slot_axes = state->fingers.axes[finger_slot];
+        if (!slot_axes.changed(FingerSlots::MT_X, scaled_x) && !slot_axes.changed(FingerSlots::MT_Y, scaled_y) &&
+            !slot_axes.changed(FingerSlots::MT_PRESSURE, scaled_pressure) &&
+            !slot_axes.changed(FingerSlots::MT_ORIENTATION, scaled_orientation)) {
+          continue; // This finger hasn't moved, no need to switch slot
+        }
+
+        if (state->current_slot != finger_slot) {
+          // I already know this finger, let's check the slot
+          frame.add(EV_ABS, ABS_MT_SLOT, finger_slot);
+          state->current_slot = finger_slot;
+        }
+
+        frame.add_abs(state->abs_shadow, ABS_X, scaled_x);
+        if (slot_axes.update(FingerSlots::MT_X, scaled_x)) {
+          frame.add(EV_ABS, ABS_MT_POSITION_X, scaled_x);
+        }
+        frame.add_abs(state->abs_shadow, ABS_Y, scaled_y);
+        if (slot_axes.update(FingerSlots::MT_Y, scaled_y)) {
+          frame.add(EV_ABS, ABS_MT_POSITION_Y, scaled_y);
+        }
+        frame.add_abs(state->abs_shadow, ABS_PRESSURE, scaled_pressure);
+        if (slot_axes.update(FingerSlots::MT_PRESSURE, scaled_pressure)) {
+          frame.add(EV_ABS, ABS_MT_PRESSURE, scaled_pressure);
+        }
+        if (slot_axes.update(FingerSlots::MT_ORIENTATION, scaled_orientation)) {
+          frame.add(EV_ABS, ABS_MT_ORIENTATION, scaled_orientation);
+        }
+      }
+
+      { // Update number of fingers pressed, only once per frame
+        auto nr_fingers = state->fingers.size();
+        auto prev_tool = tool_for_fingers(nr_fingers_before);
+        auto tool = tool_for_fingers(nr_fingers);
+        if (prev_tool != tool) {
+          if (prev_tool) {
+            frame.add(EV_KEY, prev_tool, 0);
+          }
+          if (tool) {
+            frame.add(EV_KEY, tool, 1);
+          }
+        }
+        if ((nr_fingers_before > 0) != (nr_fingers > 0)) {
+          frame.add(EV_KEY, BTN_TOUCH, nr_fingers > 0 ? 1 : 0);
         }
       }
-    } else {
-      // I already know this finger, let's check the slot
-      auto finger_slot = _state->fingers[finger_nr];
-      if (_state->current_slot != finger_slot) {
-        libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_SLOT, finger_slot);
-        _state->current_slot = finger_slot;
+
+      if (!frame.empty()) {
+        frame.syn();
+        frame.flush();
       }
     }
+  });
+}
 
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_X, scaled_x);
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_POSITION_X, scaled_x);
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_Y, scaled_y);
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_POSITION_Y, scaled_y);
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_PRESSURE, (int)std::lround(pressure * PRESSURE_MAX));
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_PRESSURE, (int)std::lround(pressure * PRESSURE_MAX));
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_ORIENTATION, scaled_orientation);
-
-    libevdev_uinput_write_event(touchpad, EV_SYN, SYN_REPORT, 0);
-  }
+void Trackpad::place_finger(int finger_nr, float x, float y, float pressure, int orientation) {
+  TouchFrame frame;
+  frame.place_finger(finger_nr, x, y, pressure, orientation);
+  apply(frame);
 }
 
 void Trackpad::release_finger(int finger_nr) {
-  if (auto touchpad = this->_state->trackpad.get()) {
-    auto finger_slot = _state->fingers[finger_nr];
-    if (_state->current_slot != finger_slot) {
-      libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_SLOT, finger_slot);
-      _state->current_slot = -1;
-    }
-    _state->fingers.erase(finger_nr);
-    libevdev_uinput_write_event(touchpad, EV_ABS, ABS_MT_TRACKING_ID, -1);
-    auto nr_fingers = _state->fingers.size();
-    { // Update number of fingers pressed
-      if (nr_fingers == 0) {
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_FINGER, 0);
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOUCH, 0);
-      } else if (nr_fingers == 1) {
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_FINGER, 1);
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_DOUBLETAP, 0);
-      } else if (nr_fingers == 2) {
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_DOUBLETAP, 1);
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_TRIPLETAP, 0);
-      } else if (nr_fingers == 3) {
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_TRIPLETAP, 1);
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_QUADTAP, 0);
-      } else if (nr_fingers == 4) {
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_QUADTAP, 1);
-        libevdev_uinput_write_event(touchpad, EV_KEY, BTN_TOOL_QUINTTAP, 0);
-      }
-    }
-
-    libevdev_uinput_write_event(touchpad, EV_SYN, SYN_REPORT, 0);
-  }
+  TouchFrame frame;
+  frame.release_finger(finger_nr);
+  apply(frame);
 }
 
 void Trackpad::set_left_btn(bool pressed) {
-  if (auto touchpad = this->_state->trackpad.get()) {
-    libevdev_uinput_write_event(touchpad, EV_KEY, BTN_LEFT, pressed ? 1 : 0);
-    libevdev_uinput_write_event(touchpad, EV_SYN, SYN_REPORT, 0);
-  }
+  trace::record(_state.get(), trace::DeviceKind::TRACKPAD, trace::Op::TRACKPAD_LEFT_BTN, pressed);
+  _state->serial.run([state = _state.get(), pressed] {
+    if (auto touchpad = state->trackpad.get()) {
+      EventFrame frame(touchpad, &state->metrics);
+      frame.add(EV_KEY, BTN_LEFT, pressed ? 1 : 0);
+      frame.syn();
+      frame.flush();
+    }
+  });
 }
 
 } // namespace inputtino
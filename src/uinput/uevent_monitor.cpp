@@ -0,0 +1,107 @@
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <inputtino/uevent_monitor.hpp>
+#include <iostream>
+#include <linux/netlink.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace inputtino {
+
+/* Kernel uevents are multicast to group 1, group 2 is used by udev for the already processed events */
+constexpr unsigned int KERNEL_UEVENTS_GROUP = 1;
+
+UeventMonitor &UeventMonitor::get() {
+  static UeventMonitor instance;
+  return instance;
+}
+
+UeventMonitor::UeventMonitor() {
+  netlink_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+  if (netlink_fd < 0) {
+    std::cerr << "Unable to open uevent socket, device nodes will not be cached; " << strerror(errno) << std::endl;
+    return;
+  }
+
+  sockaddr_nl addr{};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = KERNEL_UEVENTS_GROUP;
+  if (bind(netlink_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    std::cerr << "Unable to bind uevent socket, device nodes will not be cached; " << strerror(errno) << std::endl;
+    close(netlink_fd);
+    netlink_fd = -1;
+    return;
+  }
+
+  auto handle = EventLoop::get().add(netlink_fd, [this](std::uint32_t events) { return on_events(events); });
+  if (!handle) {
+    std::cerr << "Unable to listen for uevents; " << handle.getErrorMessage() << std::endl;
+    close(netlink_fd);
+    netlink_fd = -1;
+    return;
+  }
+  listener = *handle;
+}
+
+UeventMonitor::~UeventMonitor() {
+  if (listener) {
+    EventLoop::get().remove(listener);
+  }
+  if (netlink_fd >= 0) {
+    close(netlink_fd);
+  }
+}
+
+/**
+ * A kernel uevent looks like: "add@/devices/virtual/input/input42\0ACTION=add\0...\0SUBSYSTEM=input\0..."
+ */
+static bool is_input_add_or_remove(std::string_view message) {
+  bool is_input = false;
+  bool is_add_or_remove = false;
+  for (std::size_t pos = message.find('\0'); pos != std::string_view::npos && pos + 1 < message.size();) {
+    auto end = message.find('\0', pos + 1);
+    auto field = message.substr(pos + 1, end == std::string_view::npos ? std::string_view::npos : end - pos - 1);
+    if (field == "SUBSYSTEM=input") {
+      is_input = true;
+    } else if (field == "ACTION=add" || field == "ACTION=remove") {
+      is_add_or_remove = true;
+    }
+    pos = end;
+  }
+  return is_input && is_add_or_remove;
+}
+
+bool UeventMonitor::on_events(std::uint32_t events) {
+  if (events & EPOLLERR) {
+    // The socket buffer overflowed (ENOBUFS) and we've lost some messages, we have to assume that anything changed
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(netlink_fd, SOL_SOCKET, SO_ERROR, &error, &len);
+    current_generation.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  std::array<char, 8192> buffer{};
+  while (true) {
+    auto size = recv(netlink_fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+    if (size < 0) {
+      if (errno == ENOBUFS) {
+        current_generation.fetch_add(1, std::memory_order_acq_rel);
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::cerr << "Failed reading uevents; " << strerror(errno) << std::endl;
+      }
+      break;
+    }
+
+    active.store(true, std::memory_order_release);
+    if (is_input_add_or_remove(std::string_view(buffer.data(), size))) {
+      current_generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+  }
+  return true;
+}
+
+} // namespace inputtino
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <inputtino/mock_backend.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Installs a MockBackend for the duration of a test, even if a REQUIRE fails.
+ * Calls made from the test thread are applied before they return (see SerialQueue), only what is served by the
+ * EventLoop or the Scheduler (force feedback, rate limiting...) has to be waited for with eventually().
+ */
+struct MockBackendFixture {
+  std::shared_ptr<inputtino::MockBackend> backend = std::make_shared<inputtino::MockBackend>();
+
+  MockBackendFixture() {
+    inputtino::set_output_backend(backend);
+  }
+
+  ~MockBackendFixture() {
+    inputtino::set_output_backend(nullptr);
+  }
+};
+
+/**
+ * Polls `condition` until it holds or `timeout` expires, for the things that happen on the EventLoop or Scheduler thread
+ */
+template <typename Condition>
+static bool eventually(Condition condition, std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+static bool has_event(const std::vector<input_event> &events, unsigned short type, unsigned short code, int value) {
+  return std::any_of(events.begin(), events.end(), [&](const input_event &ev) {
+    return ev.type == type && ev.code == code && ev.value == value;
+  });
+}
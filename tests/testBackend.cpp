@@ -0,0 +1,56 @@
+#include "catch2/catch_all.hpp"
+#include "mock_fixture.hpp"
+#include <inputtino/input.hpp>
+
+using namespace inputtino;
+using namespace std::chrono_literals;
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: mouse frames", "[MOCK]") {
+  auto mouse = std::move(*Mouse::create());
+  REQUIRE(mouse.get_nodes().empty()); // not visible to the system
+  REQUIRE(backend->evdev_devices().size() == 2); // relative and absolute
+
+  auto mouse_rel = backend->evdev_devices()[0];
+  mouse.move(10, -5);
+  mouse.press(Mouse::LEFT);
+
+  REQUIRE(mouse_rel->frames_written() == 2);
+  auto events = mouse_rel->events();
+  REQUIRE(events.size() >= 5);
+  REQUIRE(events[0].type == EV_REL);
+  REQUIRE(events[0].code == REL_X);
+  REQUIRE(events[0].value == 10);
+  REQUIRE(events[1].code == REL_Y);
+  REQUIRE(events[1].value == -5);
+  REQUIRE(events[2].type == EV_SYN);
+  REQUIRE(has_event(events, EV_KEY, BTN_LEFT, 1));
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: device templates", "[MOCK]") {
+  DeviceDefinition other = {.name = "Another keyboard", .vendor_id = 0xAB00, .product_id = 0xAB05, .version = 0xAB00};
+  auto first = std::move(*Keyboard::create());
+  auto second = std::move(*Keyboard::create());
+  auto renamed = std::move(*Keyboard::create(other));
+
+  // The second keyboard reuses the description built for the first one, a different definition gets its own
+  auto devices = backend->evdev_devices();
+  REQUIRE(devices.size() == 3);
+  REQUIRE(devices[0]->name == devices[1]->name);
+  REQUIRE(devices[2]->name == "Another keyboard");
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: ring buffer", "[MOCK]") {
+  backend = std::make_shared<MockBackend>(8);
+  set_output_backend(backend);
+  auto keyboard = std::move(*Keyboard::create());
+  auto kb = backend->evdev_devices()[0];
+
+  for (int i = 0; i < 10; i++) {
+    keyboard.press(0x41);
+    keyboard.release(0x41);
+  }
+
+  REQUIRE(kb->events_written() == 10 * 2 * 3); // MSC_SCAN, EV_KEY, SYN_REPORT
+  REQUIRE(kb->events().size() == 8);           // only the last ones are kept
+  REQUIRE(kb->events().back().type == EV_SYN);
+}
@@ -1,4 +1,5 @@
 #include "catch2/catch_all.hpp"
+#include "mock_fixture.hpp"
 #include <filesystem>
 #include <inputtino/input.h>
 #include <thread>
@@ -19,6 +20,16 @@ TEST_CASE("C Mouse API", "[C-API]") {
   REQUIRE(std::filesystem::exists(nodes[0]));
   REQUIRE(std::filesystem::exists(nodes[1]));
 
+  char buffer[256];
+  const char *copied_nodes[4];
+  REQUIRE(inputtino_mouse_copy_nodes(mouse, buffer, sizeof(buffer), copied_nodes, 4) == 2);
+  REQUIRE(std::string(copied_nodes[0]) == nodes[0]);
+  REQUIRE(std::string(copied_nodes[1]) == nodes[1]);
+  REQUIRE(copied_nodes[2] == nullptr);
+  REQUIRE(inputtino_mouse_copy_nodes(mouse, buffer, sizeof(buffer), copied_nodes, 1) == 2); // doesn't fit
+  REQUIRE(inputtino_mouse_copy_nodes(mouse, buffer, 4, copied_nodes, 4) == 2);
+  REQUIRE(copied_nodes[0] == nullptr);
+
   { // TODO: test that this actually work
     inputtino_mouse_move(mouse, 100, 100);
     inputtino_mouse_move_absolute(mouse, 100, 100, 1920, 1080);
@@ -209,3 +220,34 @@ TEST_CASE("C PS5 API", "[C-API]") {
   delete[] nodes;
   inputtino_joypad_ps5_destroy(ps_pad);
 }
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: C API batches", "[MOCK]") {
+  InputtinoErrorHandler error_handler = {.eh = [](const char *message, void *_data) { FAIL(message); },
+                                         .user_data = nullptr};
+  InputtinoDeviceDefinition def = {};
+  auto mouse = inputtino_mouse_create(&def, &error_handler);
+  REQUIRE(mouse != nullptr);
+  auto mouse_rel = backend->evdev_devices()[0];
+
+  InputtinoMouseEvent events[] = {
+      {.type = INPUTTINO_MOUSE_MOVE, .x = 10, .y = -5},
+      {.type = INPUTTINO_MOUSE_PRESS, .button = INPUTTINO_MOUSE_BUTTON::LEFT},
+      {.type = INPUTTINO_MOUSE_RELEASE, .button = INPUTTINO_MOUSE_BUTTON::LEFT},
+  };
+  inputtino_mouse_apply_events(mouse, events, 3);
+  REQUIRE(mouse_rel->frames_written() == 3);
+  REQUIRE(has_event(mouse_rel->events(), EV_REL, REL_X, 10));
+  REQUIRE(has_event(mouse_rel->events(), EV_KEY, BTN_LEFT, 1));
+  REQUIRE(has_event(mouse_rel->events(), EV_KEY, BTN_LEFT, 0));
+  inputtino_mouse_destroy(mouse);
+
+  auto joypad = inputtino_joypad_xone_create(&def, &error_handler);
+  REQUIRE(joypad != nullptr);
+  auto joy = backend->evdev_devices().back(); // the mouse might still be around, it's destroyed asynchronously
+  InputtinoJoypadState state = {.buttons = INPUTTINO_JOYPAD_BTN::A, .left_stick_x = 1000, .right_trigger = 255};
+  inputtino_joypad_xone_set_state(joypad, &state);
+  REQUIRE(joy->frames_written() == 1);
+  REQUIRE(has_event(joy->events(), EV_KEY, BTN_SOUTH, 1));
+  REQUIRE(has_event(joy->events(), EV_ABS, ABS_X, 1000));
+  inputtino_joypad_xone_destroy(joypad);
+}
@@ -0,0 +1,69 @@
+#include "catch2/catch_all.hpp"
+#include <inputtino/device_manager.hpp>
+#include <inputtino/mock_backend.hpp>
+
+using namespace inputtino;
+
+struct DeviceManagerFixture {
+  std::shared_ptr<MockBackend> backend = std::make_shared<MockBackend>();
+
+  DeviceManagerFixture() {
+    set_output_backend(backend);
+  }
+
+  ~DeviceManagerFixture() {
+    set_output_backend(nullptr);
+  }
+};
+
+TEST_CASE_METHOD(DeviceManagerFixture, "DeviceManager: handles", "[DeviceManager]") {
+  DeviceManager manager;
+  auto mouse = manager.create<Mouse>("client");
+  REQUIRE(mouse);
+  REQUIRE(*mouse != 0);
+  REQUIRE(manager.size() == 1);
+  REQUIRE(manager.get<Mouse>(*mouse));
+  REQUIRE(manager.get_device(*mouse));
+  REQUIRE_FALSE(manager.get<Keyboard>(*mouse)); // wrong type
+
+  REQUIRE(manager.remove(*mouse));
+  REQUIRE_FALSE(manager.remove(*mouse));
+  REQUIRE_FALSE(manager.get<Mouse>(*mouse));
+  REQUIRE(backend->evdev_devices().empty());
+
+  // The slot is reused, the old handle must not resolve to the new device
+  auto keyboard = manager.create<Keyboard>("client");
+  REQUIRE(keyboard);
+  REQUIRE(*keyboard != *mouse);
+  REQUIRE_FALSE(manager.get_device(*mouse));
+  REQUIRE(manager.get<Keyboard>(*keyboard));
+  REQUIRE_FALSE(manager.get_device(0));
+}
+
+TEST_CASE_METHOD(DeviceManagerFixture, "DeviceManager: per client lifecycle", "[DeviceManager]") {
+  DeviceManager manager;
+  auto pads = manager.create_many<XboxOneJoypad>("first", 16);
+  REQUIRE(pads.size() == 16);
+  for (const auto &pad : pads) {
+    REQUIRE(pad);
+  }
+  REQUIRE(manager.create<Keyboard>("second"));
+  REQUIRE(manager.size() == 17);
+  REQUIRE(manager.handles("first").size() == 16);
+  REQUIRE(backend->evdev_devices().size() == 17);
+
+  REQUIRE(manager.remove_client("first") == 16);
+  REQUIRE(manager.remove_client("first") == 0);
+  REQUIRE(manager.size() == 1);
+  REQUIRE(manager.handles("first").empty());
+  REQUIRE_FALSE(manager.get_device(*pads[0]));
+  REQUIRE(backend->evdev_devices().size() == 1);
+
+  // A device that is still referenced outlives its removal
+  auto handle = manager.handles("second")[0];
+  auto keyboard = manager.get<Keyboard>(handle);
+  REQUIRE(manager.remove(handle));
+  REQUIRE(backend->evdev_devices().size() == 1);
+  keyboard.reset();
+  REQUIRE(backend->evdev_devices().empty());
+}
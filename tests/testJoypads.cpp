@@ -1,6 +1,7 @@
 #include "catch2/catch_all.hpp"
 #include <filesystem>
 #include <fstream>
+#include <inputtino/device_pool.hpp>
 #include <inputtino/input.hpp>
 #include <iostream>
 #include <SDL.h>
@@ -337,6 +338,32 @@ TEST_CASE_METHOD(SDLTestsFixture, "PS Joypad", "[SDL]") {
     REQUIRE_THAT(event.csensor.data[1], WithinAbs(gyro_data[1], 0.01f));
     REQUIRE_THAT(event.csensor.data[2], WithinAbs(gyro_data[2], 0.01f));
   }
+  { // test rate limited motion samples
+    joypad.set_report_rate(250);
+    flush_sdl_events();
+
+    joypad.set_motion({.accel_x = 9.8f,
+                       .accel_y = 0.0f,
+                       .accel_z = 20.0f,
+                       .gyro_x = 0.0f,
+                       .gyro_y = M_PI_2f,
+                       .gyro_z = M_PIf,
+                       .timestamp = 1000us});
+    std::this_thread::sleep_for(10ms); // wait for the report to be sent out
+
+    SDL_GameControllerUpdate();
+    SDL_SensorUpdate();
+    std::array<float, 3> accel{}, gyro{};
+    REQUIRE(SDL_GameControllerGetSensorData(gc, SDL_SENSOR_ACCEL, accel.data(), 3) == 0);
+    REQUIRE(SDL_GameControllerGetSensorData(gc, SDL_SENSOR_GYRO, gyro.data(), 3) == 0);
+    REQUIRE_THAT(accel[0], WithinAbs(9.8f, 0.9f));
+    REQUIRE_THAT(accel[2], WithinAbs(20.0f, 0.9f));
+    REQUIRE_THAT(gyro[1], WithinAbs(M_PI_2f, 0.01f));
+    REQUIRE_THAT(gyro[2], WithinAbs(M_PIf, 0.01f));
+
+    joypad.set_report_rate(0);
+    flush_sdl_events();
+  }
 
   { // Test touchpad
     // TODO: sysjoystick is lacking implementation, force hidapi
@@ -475,6 +502,32 @@ TEST_CASE_METHOD(SDLTestsFixture, "XBOX Joypad", "[SDL]") {
     REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_TRIGGERRIGHT) == 0);
   }
 
+  { // Full state
+    joypad.set_state({.buttons = Joypad::A | Joypad::DPAD_UP,
+                      .left_stick_x = -1000,
+                      .left_stick_y = 500,
+                      .right_stick_x = 3000,
+                      .right_stick_y = -4000,
+                      .left_trigger = 10,
+                      .right_trigger = 20});
+    flush_sdl_events();
+    REQUIRE(SDL_GameControllerGetButton(gc, SDL_CONTROLLER_BUTTON_A) == SDL_PRESSED);
+    REQUIRE(SDL_GameControllerGetButton(gc, SDL_CONTROLLER_BUTTON_DPAD_UP) == SDL_PRESSED);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_LEFTX) == -1000);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_LEFTY) == -500);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_RIGHTX) == 3000);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_RIGHTY) == 4000);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_TRIGGERLEFT) == 1284);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_TRIGGERRIGHT) == 2569);
+
+    joypad.set_state({});
+    flush_sdl_events();
+    REQUIRE(SDL_GameControllerGetButton(gc, SDL_CONTROLLER_BUTTON_A) == SDL_RELEASED);
+    REQUIRE(SDL_GameControllerGetButton(gc, SDL_CONTROLLER_BUTTON_DPAD_UP) == SDL_RELEASED);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_LEFTX) == 0);
+    REQUIRE(SDL_GameControllerGetAxis(gc, SDL_CONTROLLER_AXIS_TRIGGERLEFT) == 0);
+  }
+
   SDL_GameControllerClose(gc);
 }
 
@@ -551,3 +604,27 @@ TEST_CASE_METHOD(SDLTestsFixture, "Nintendo Joypad", "[SDL]") {
 
   SDL_GameControllerClose(gc);
 }
+
+TEST_CASE("Joypads device pool", "[SDL]") {
+  DevicePool<XboxOneJoypad> pool({.name = "Wolf X-Box One (pooled) pad",
+                                  .vendor_id = 0x045E,
+                                  .product_id = 0x02EA,
+                                  .version = 0x0408},
+                                 2);
+  REQUIRE(pool.size() == 2);
+
+  auto first = pool.checkout();
+  REQUIRE(first);
+  auto second = pool.checkout();
+  REQUIRE(second);
+  REQUIRE(pool.size() == 2); // Both have been replaced
+
+  std::this_thread::sleep_for(150ms);
+  REQUIRE_THAT((*first).get_nodes(), SizeIs(2));
+  REQUIRE_THAT((*second).get_nodes(), SizeIs(2));
+  REQUIRE((*first).get_nodes() != (*second).get_nodes());
+
+  auto async_joypad = create_async<XboxOneJoypad>({});
+  auto joypad = async_joypad.get();
+  REQUIRE(joypad);
+}
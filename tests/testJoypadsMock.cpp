@@ -0,0 +1,181 @@
+#include "catch2/catch_all.hpp"
+#include "mock_fixture.hpp"
+#include <atomic>
+#include <inputtino/feedback.hpp>
+#include <inputtino/input.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace inputtino;
+using namespace std::chrono_literals;
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: joypad buttons", "[MOCK]") {
+  auto xbox = std::move(*XboxOneJoypad::create());
+  auto xbox_joy = backend->evdev_devices().back();
+  auto nintendo = std::move(*SwitchJoypad::create());
+  auto switch_joy = backend->evdev_devices().back();
+
+  xbox.set_pressed_buttons(Joypad::A | Joypad::DPAD_UP | Joypad::START);
+  nintendo.set_pressed_buttons(Joypad::A | Joypad::MISC_FLAG);
+
+  REQUIRE(xbox_joy->frames_written() == 1);
+  auto events = xbox_joy->events();
+  REQUIRE(events.size() == 4); // HAT0Y, 2 keys, SYN_REPORT
+  REQUIRE(has_event(events, EV_ABS, ABS_HAT0Y, -1));
+  REQUIRE(has_event(events, EV_KEY, BTN_SOUTH, 1));
+  REQUIRE(has_event(events, EV_KEY, BTN_START, 1));
+
+  events = switch_joy->events();
+  REQUIRE(has_event(events, EV_KEY, BTN_EAST, 1)); // The Switch A button is on the right
+  REQUIRE(has_event(events, EV_KEY, BTN_Z, 1));
+
+  // Only the buttons that changed are sent, nothing at all if the mask is the same
+  xbox_joy->clear();
+  xbox.set_pressed_buttons(Joypad::A | Joypad::DPAD_UP | Joypad::START);
+  xbox.set_pressed_buttons(Joypad::A | Joypad::B);
+
+  REQUIRE(xbox_joy->frames_written() == 1);
+  events = xbox_joy->events();
+  REQUIRE(events.size() == 4); // HAT0Y, START, B, SYN_REPORT
+  REQUIRE(has_event(events, EV_ABS, ABS_HAT0Y, 0));
+  REQUIRE(has_event(events, EV_KEY, BTN_START, 0));
+  REQUIRE(has_event(events, EV_KEY, BTN_EAST, 1));
+  REQUIRE(!has_event(events, EV_KEY, BTN_SOUTH, 1));
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: joypad rumble", "[MOCK]") {
+  auto joypad = std::move(*XboxOneJoypad::create());
+  auto joy = backend->evdev_devices()[0];
+
+  auto rumble_data = std::make_shared<std::pair<std::atomic<int>, std::atomic<int>>>();
+  joypad.set_on_rumble([rumble_data](int low_freq, int high_freq) {
+    rumble_data->first = low_freq;
+    rumble_data->second = high_freq;
+  });
+
+  ff_effect effect{};
+  effect.type = FF_RUMBLE;
+  effect.id = 1;
+  effect.u.rumble.strong_magnitude = 100;
+  effect.u.rumble.weak_magnitude = 200;
+  effect.replay.length = 1000;
+  joy->inject_ff_upload(effect);
+  joy->inject(EV_FF, 1, 1); // play
+  REQUIRE(eventually([&]() { return rumble_data->first == 100 && rumble_data->second == 200; }));
+
+  joy->inject(EV_FF, 1, 0); // stop
+  REQUIRE(eventually([&]() { return rumble_data->first == 0 && rumble_data->second == 0; }));
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: replacing the rumble callback", "[MOCK]") {
+  auto joypad = std::move(*XboxOneJoypad::create());
+  auto joy = backend->evdev_devices()[0];
+
+  // The callback is replaced on one thread while the EventLoop invokes it on another
+  auto calls = std::make_shared<std::atomic<int>>(0);
+  std::atomic<bool> done = false;
+  std::thread setter([&]() {
+    while (!done) {
+      joypad.set_on_rumble([calls](int, int) { (*calls)++; });
+    }
+  });
+
+  ff_effect effect{};
+  effect.type = FF_RUMBLE;
+  effect.id = 1;
+  effect.u.rumble.strong_magnitude = 100;
+  effect.replay.length = 1000;
+  joy->inject_ff_upload(effect);
+  for (int i = 0; i < 20; i++) {
+    joy->inject(EV_FF, 1, (i & 1) ? 0 : 1); // play, stop...
+    std::this_thread::sleep_for(1ms);
+  }
+  REQUIRE(eventually([&]() { return *calls > 0; }));
+
+  done = true;
+  setter.join();
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: joypad rumble ramp down", "[MOCK]") {
+  auto joypad = std::move(*XboxOneJoypad::create());
+  auto joy = backend->evdev_devices()[0];
+
+  // Every value the ramp goes through, however fast or slow the EventLoop gets to them
+  struct Samples {
+    std::mutex m;
+    std::vector<int> values;
+  };
+  auto samples = std::make_shared<Samples>();
+  joypad.set_on_rumble([samples](int low_freq, int) {
+    std::lock_guard lock(samples->m);
+    samples->values.push_back(low_freq);
+  });
+  auto values = [&]() {
+    std::lock_guard lock(samples->m);
+    return samples->values;
+  };
+
+  ff_effect effect{};
+  effect.type = FF_RAMP;
+  effect.id = 1;
+  effect.u.ramp.start_level = 0x7000;
+  effect.u.ramp.end_level = 0;
+  effect.replay.length = 400;
+  joy->inject_ff_upload(effect);
+  joy->inject(EV_FF, 1, 1); // play
+
+  // Once the effect is over the rumble goes back to 0
+  REQUIRE(eventually([&]() {
+    auto seen = values();
+    return seen.size() >= 2 && seen.back() == 0;
+  }));
+  // Fading out: never above the start level and only going down, not wrapping around
+  auto seen = values();
+  REQUIRE(seen.front() > 0);
+  REQUIRE(seen.front() <= 0x7000);
+  for (std::size_t i = 1; i < seen.size(); i++) {
+    REQUIRE(seen[i] <= seen[i - 1]);
+    REQUIRE(seen[i] >= 0);
+  }
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: feedback mailbox", "[MOCK]") {
+  auto joypad = std::move(*XboxOneJoypad::create());
+  auto joy = backend->evdev_devices()[0];
+  auto mailbox = *FeedbackMailbox::create();
+  joypad.set_on_rumble(mailbox->rumble_callback());
+  REQUIRE(!mailbox->take());
+
+  ff_effect effect{};
+  effect.type = FF_RUMBLE;
+  effect.id = 1;
+  effect.u.rumble.strong_magnitude = 100;
+  effect.u.rumble.weak_magnitude = 200;
+  effect.replay.length = 1000;
+  joy->inject_ff_upload(effect);
+  joy->inject(EV_FF, 1, 1); // play
+
+  auto feedback = mailbox->wait(1s);
+  REQUIRE(feedback.rumble);
+  REQUIRE(feedback.rumble->low_freq == 100);
+  REQUIRE(feedback.rumble->high_freq == 200);
+  REQUIRE(!feedback.led);
+  REQUIRE(!mailbox->take()); // already taken
+
+  // Updates that haven't been taken yet are replaced by the latest one
+  mailbox->post_led(10, 20, 30);
+  mailbox->post_led(255, 0, 128);
+  feedback = mailbox->wait(1s);
+  REQUIRE(!feedback.rumble);
+  REQUIRE(feedback.led);
+  REQUIRE(feedback.led->r == 255);
+  REQUIRE(feedback.led->g == 0);
+  REQUIRE(feedback.led->b == 128);
+
+  joy->inject(EV_FF, 1, 0); // stop
+  feedback = mailbox->wait(1s);
+  REQUIRE(feedback.rumble);
+  REQUIRE(feedback.rumble->low_freq == 0);
+  REQUIRE(feedback.rumble->high_freq == 0);
+}
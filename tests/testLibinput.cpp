@@ -125,6 +125,49 @@ TEST_CASE("virtual mouse relative", "[LIBINPUT]") {
     }
 }
 
+TEST_CASE("virtual mouse motion coalescing", "[LIBINPUT]") {
+    auto mouse = std::move(*Mouse::create());
+    mouse.set_motion_coalescing(10);
+    auto li = create_libinput_context({mouse.get_nodes()[0]});
+    auto event = get_event(li);
+    REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_DEVICE_ADDED);
+
+    { // The first move goes out immediately, the following ones are summed up
+        mouse.move(10, 10);
+        mouse.move(10, 10);
+        mouse.move(10, 10);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_POINTER_MOTION);
+        auto p_event = libinput_event_get_pointer_event(event.get());
+        REQUIRE(libinput_event_pointer_get_dx_unaccelerated(p_event) == 10);
+        REQUIRE(libinput_event_pointer_get_dy_unaccelerated(p_event) == 10);
+
+        std::this_thread::sleep_for(150ms);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_POINTER_MOTION);
+        p_event = libinput_event_get_pointer_event(event.get());
+        REQUIRE(libinput_event_pointer_get_dx_unaccelerated(p_event) == 20);
+        REQUIRE(libinput_event_pointer_get_dy_unaccelerated(p_event) == 20);
+    }
+
+    { // Pressing a button flushes the pending motion first
+        mouse.move(5, 5);
+        mouse.press(Mouse::LEFT);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_POINTER_MOTION);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_POINTER_BUTTON);
+    }
+
+    if constexpr (metrics_enabled()) {
+        auto metrics = mouse.get_metrics();
+        REQUIRE(metrics.syscalls >= 4);
+        REQUIRE(metrics.events_written >= 3 * 4);
+        REQUIRE(metrics.write_errors == 0);
+        REQUIRE(metrics.frames_coalesced >= 1);
+    }
+}
+
 TEST_CASE("virtual mouse absolue", "[LIBINPUT]") {
     auto mouse = std::move(*Mouse::create());
     auto li = create_libinput_context({mouse.get_nodes()[1]});
@@ -166,6 +209,12 @@ TEST_CASE("virtual mouse absolue", "[LIBINPUT]") {
       REQUIRE_THAT(libinput_event_pointer_get_absolute_x_transformed(p_event, TARGET_WIDTH),
                    WithinRel(TARGET_WIDTH, 0.001f));
     }
+
+    { // Moving to the same position again doesn't write anything
+      mouse.move_abs(TARGET_WIDTH, TARGET_HEIGHT, TARGET_WIDTH, TARGET_HEIGHT);
+      event = get_event(li);
+      REQUIRE(event.get() == nullptr);
+    }
 }
 
 TEST_CASE("virtual touch screen", "[LIBINPUT]") {
@@ -182,7 +231,7 @@ TEST_CASE("virtual touch screen", "[LIBINPUT]") {
         event = get_event(li);
         REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_DOWN);
         auto t_event = libinput_event_get_touch_event(event.get());
-        REQUIRE(libinput_event_touch_get_slot(t_event) == 1);
+        REQUIRE(libinput_event_touch_get_slot(t_event) == 0);
         REQUIRE_THAT(libinput_event_touch_get_x_transformed(t_event, TARGET_WIDTH),
                      WithinRel(TARGET_WIDTH * 0.1f, 0.5f));
         REQUIRE_THAT(libinput_event_touch_get_y_transformed(t_event, TARGET_HEIGHT),
@@ -196,7 +245,7 @@ TEST_CASE("virtual touch screen", "[LIBINPUT]") {
         event = get_event(li);
         REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_DOWN);
         auto t_event = libinput_event_get_touch_event(event.get());
-        REQUIRE(libinput_event_touch_get_slot(t_event) == 2);
+        REQUIRE(libinput_event_touch_get_slot(t_event) == 1);
         REQUIRE_THAT(libinput_event_touch_get_x_transformed(t_event, TARGET_WIDTH),
                      WithinRel(TARGET_WIDTH * 0.2f, 0.5f));
         REQUIRE_THAT(libinput_event_touch_get_y_transformed(t_event, TARGET_HEIGHT),
@@ -210,7 +259,25 @@ TEST_CASE("virtual touch screen", "[LIBINPUT]") {
         event = get_event(li);
         REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_UP);
         auto t_event = libinput_event_get_touch_event(event.get());
-        REQUIRE(libinput_event_touch_get_slot(t_event) == 1);
+        REQUIRE(libinput_event_touch_get_slot(t_event) == 0);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
+    }
+
+    { // A new finger should take the slot that has just been freed
+        touch.place_finger(2, 0.3, 0.3, 0.3, 0);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_DOWN);
+        auto t_event = libinput_event_get_touch_event(event.get());
+        REQUIRE(libinput_event_touch_get_slot(t_event) == 0);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
+
+        touch.release_finger(2);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_UP);
+        t_event = libinput_event_get_touch_event(event.get());
+        REQUIRE(libinput_event_touch_get_slot(t_event) == 0);
         event = get_event(li);
         REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
     }
@@ -220,7 +287,61 @@ TEST_CASE("virtual touch screen", "[LIBINPUT]") {
         event = get_event(li);
         REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_UP);
         auto t_event = libinput_event_get_touch_event(event.get());
-        REQUIRE(libinput_event_touch_get_slot(t_event) == 2);
+        REQUIRE(libinput_event_touch_get_slot(t_event) == 1);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
+    }
+}
+
+TEST_CASE("virtual touch screen frames", "[LIBINPUT]") {
+    auto touch = std::move(*TouchScreen::create());
+    auto li = create_libinput_context(touch.get_nodes());
+    auto event = get_event(li);
+    REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_DEVICE_ADDED);
+
+    { // Two fingers down at once, a single frame
+        TouchFrame frame;
+        frame.place_finger(0, 0.1, 0.1, 0.3, 0);
+        frame.place_finger(1, 0.2, 0.2, 0.3, 0);
+        touch.apply(frame);
+
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_DOWN);
+        REQUIRE(libinput_event_touch_get_slot(libinput_event_get_touch_event(event.get())) == 0);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_DOWN);
+        REQUIRE(libinput_event_touch_get_slot(libinput_event_get_touch_event(event.get())) == 1);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
+    }
+
+    { // Move one and lift the other
+        TouchFrame frame;
+        frame.place_finger(0, 0.15, 0.15, 0.3, 0);
+        frame.release_finger(1);
+        touch.apply(frame);
+
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_MOTION);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_UP);
+        REQUIRE(libinput_event_touch_get_slot(libinput_event_get_touch_event(event.get())) == 1);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
+    }
+
+    { // Lift one and place a new one in the same frame: it reuses the slot, it has to be a new contact
+        TouchFrame frame;
+        frame.release_finger(0);
+        frame.place_finger(2, 0.3, 0.3, 0.3, 0);
+        touch.apply(frame);
+
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_UP);
+        REQUIRE(libinput_event_touch_get_slot(libinput_event_get_touch_event(event.get())) == 0);
+        event = get_event(li);
+        REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_DOWN);
+        REQUIRE(libinput_event_touch_get_slot(libinput_event_get_touch_event(event.get())) == 0);
         event = get_event(li);
         REQUIRE(libinput_event_get_type(event.get()) == LIBINPUT_EVENT_TOUCH_FRAME);
     }
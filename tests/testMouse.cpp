@@ -0,0 +1,89 @@
+#include "catch2/catch_all.hpp"
+#include "mock_fixture.hpp"
+#include <cmath>
+#include <inputtino/input.hpp>
+
+using namespace inputtino;
+using namespace std::chrono_literals;
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: smooth scrolling", "[MOCK]") {
+  auto mouse = std::move(*Mouse::create());
+  auto mouse_rel = backend->evdev_devices()[0];
+
+  auto notches = [&](unsigned short code) {
+    int total = 0;
+    for (const auto &ev : mouse_rel->events()) {
+      if (ev.type == EV_REL && ev.code == code) {
+        total += ev.value;
+      }
+    }
+    return total;
+  };
+
+  // 12 * 30 = 360 (3 notches), none of the calls is a whole notch on its own
+  for (int i = 0; i < 12; i++) {
+    mouse.vertical_scroll(30);
+  }
+  REQUIRE(notches(REL_WHEEL) == 3);
+  REQUIRE(notches(REL_WHEEL_HI_RES) == 360);
+  REQUIRE(mouse_rel->frames_written() == 12);
+
+  // With coalescing, a burst is merged into (at most) the frame that goes out right away and a delayed one
+  mouse_rel->clear();
+  mouse.set_motion_coalescing(10); // 100ms apart, plenty of margin for a slow test thread
+  for (int i = 0; i < 10; i++) {
+    mouse.horizontal_scroll(-18);
+  }
+  REQUIRE(eventually([&]() { return notches(REL_HWHEEL_HI_RES) == -180; }));
+  REQUIRE(mouse_rel->frames_written() <= 2);
+  REQUIRE(notches(REL_HWHEEL) == -1); // -180, 60 are carried over
+
+  mouse.horizontal_scroll(-60);
+  REQUIRE(eventually([&]() { return notches(REL_HWHEEL) == -2; }));
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: fractional motion", "[MOCK]") {
+  auto mouse = std::move(*Mouse::create());
+  auto mouse_rel = backend->evdev_devices()[0];
+
+  auto total = [&](unsigned short code) {
+    int total = 0;
+    for (const auto &ev : mouse_rel->events()) {
+      if (ev.type == EV_REL && ev.code == code) {
+        total += ev.value;
+      }
+    }
+    return total;
+  };
+
+  for (int i = 0; i < 10; i++) {
+    mouse.move(0.25, -0.5);
+  }
+  REQUIRE(total(REL_X) == 2); // 2.5, the 0.5 left is carried over
+  REQUIRE(total(REL_Y) == -5);
+  REQUIRE(mouse_rel->frames_written() == 5); // only the moves that add up to a whole unit are written
+
+  mouse.move(0.5, 0.0);
+  REQUIRE(total(REL_X) == 3);
+
+  mouse_rel->clear();
+  mouse.set_acceleration(PointerAcceleration::flat(2.5));
+  mouse.move(2, 0);
+  mouse.move(2, 0);
+  REQUIRE(total(REL_X) == 10);
+
+  auto linear = PointerAcceleration::linear(1.0, 0.5, 3.0);
+  REQUIRE(linear.gain(0) == 1.0);
+  REQUIRE(std::abs(linear.gain(2) - 2.0) < 0.05);
+  REQUIRE(linear.gain(1000) == 3.0);
+  REQUIRE(linear.gain(INFINITY) == 3.0);
+  REQUIRE(linear.gain(NAN) == 1.0);
+  REQUIRE(linear.gain(-1) == 1.0);
+  auto no_max = PointerAcceleration([](double speed) { return speed; }, 0); // falls back to the default max speed
+  REQUIRE(no_max.gain(1000) == static_cast<float>(PointerAcceleration::DEFAULT_MAX_SPEED));
+
+  mouse_rel->clear();
+  mouse.set_acceleration(std::nullopt);
+  mouse.move(2, 0);
+  REQUIRE(total(REL_X) == 2);
+}
@@ -0,0 +1,157 @@
+#include "catch2/catch_all.hpp"
+#include "mock_fixture.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <inputtino/input.hpp>
+#include <uhid/ps5.hpp>
+
+using namespace inputtino;
+using namespace std::chrono_literals;
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: PS5 joypad", "[MOCK]") {
+  auto joypad = std::move(*PS5Joypad::create());
+  REQUIRE(backend->hid_devices().size() == 1);
+  auto hid = backend->hid_devices()[0];
+
+  joypad.set_stick(Joypad::LS, 1000, 2000);
+  REQUIRE(hid->reports_written() >= 1);
+
+  { // GET_REPORT is answered on the same output
+    uhid_event ev{};
+    ev.type = UHID_GET_REPORT;
+    ev.u.get_report.id = 42;
+    ev.u.get_report.rnum = uhid::PS5_REPORT_TYPES::CALIBRATION;
+    hid->inject(ev); // served on the EventLoop
+    REQUIRE(eventually([&]() { return !hid->replies().empty(); }));
+    auto replies = hid->replies();
+    REQUIRE(replies.size() == 1);
+    REQUIRE(replies[0].type == UHID_GET_REPORT_REPLY);
+    REQUIRE(replies[0].u.get_report_reply.id == 42);
+    REQUIRE(replies[0].u.get_report_reply.size == sizeof(uhid::ps5_calibration_info));
+  }
+
+  { // Rumble
+    auto rumble_data = std::make_shared<std::pair<std::atomic<int>, std::atomic<int>>>();
+    joypad.set_on_rumble([rumble_data](int low_freq, int high_freq) {
+      rumble_data->first = low_freq;
+      rumble_data->second = high_freq;
+    });
+
+    uhid_event ev{};
+    ev.type = UHID_OUTPUT;
+    auto report = reinterpret_cast<uhid::dualsense_output_report_usb *>(ev.u.output.data);
+    report->valid_flag0 = uhid::MOTOR_OR_COMPATIBLE_VIBRATION;
+    report->motor_left = 255;
+    report->motor_right = 0;
+    ev.u.output.size = sizeof(*report);
+    hid->inject(ev);
+    REQUIRE(eventually([&]() { return rumble_data->first == 0xFFFF; }));
+    REQUIRE(rumble_data->second == 0);
+  }
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: PS5 report encoding", "[MOCK]") {
+  auto joypad = std::move(*PS5Joypad::create());
+  auto hid = backend->hid_devices()[0];
+  auto last_report = [&]() {
+    uhid::dualsense_input_report_usb report;
+    auto data = hid->reports().back();
+    std::memcpy(&report, data.data(), std::min(sizeof(report), data.size()));
+    return report;
+  };
+
+  joypad.set_pressed_buttons(Joypad::A | Joypad::DPAD_UP | Joypad::DPAD_LEFT | Joypad::START | Joypad::HOME);
+  auto report = last_report();
+  REQUIRE(report.buttons[0] == (uhid::CROSS | uhid::HAT_NW));
+  REQUIRE(report.buttons[1] == uhid::OPTIONS);
+  REQUIRE(report.buttons[2] == uhid::PS_HOME);
+
+  joypad.set_pressed_buttons(0);
+  report = last_report();
+  REQUIRE(report.buttons[0] == uhid::HAT_NEUTRAL);
+  REQUIRE(report.buttons[1] == 0);
+
+  joypad.set_motion(PS5Joypad::ACCELERATION, -1.0f, 0.0f, 1000.0f);
+  report = last_report();
+  REQUIRE(static_cast<int16_t>(le16toh(report.accel[0])) == -981); // -1 * 9.80665 * 100
+  REQUIRE(report.accel[1] == 0);
+  REQUIRE(static_cast<int16_t>(le16toh(report.accel[2])) == 32767); // saturated
+
+  joypad.place_finger(0, 1234, 567);
+  report = last_report();
+  REQUIRE(((report.points[0].x_hi << 8) | report.points[0].x_lo) == 1234);
+  REQUIRE(((report.points[0].y_hi << 4) | report.points[0].y_lo) == 567);
+
+  REQUIRE(joypad.get_mac_address().size() == 17);
+
+  // The timestamp of a sample is only used for the report that carries it, the next ones keep moving forward
+  joypad.set_motion({.accel_x = 0,
+                     .accel_y = 0,
+                     .accel_z = 9.8f,
+                     .gyro_x = 0,
+                     .gyro_y = 0,
+                     .gyro_z = 0,
+                     .timestamp = std::chrono::microseconds(1000)});
+  report = last_report();
+  auto sample_timestamp = le32toh(report.sensor_timestamp);
+  REQUIRE(sample_timestamp == 1000000 / 333);
+  joypad.set_pressed_buttons(Joypad::A);
+  report = last_report();
+  auto button_timestamp = le32toh(report.sensor_timestamp);
+  REQUIRE(button_timestamp > sample_timestamp);
+  REQUIRE(button_timestamp < sample_timestamp + 1000000000 / 333); // same time base: less than a second later
+}
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: PS5 motion pacing", "[MOCK]") {
+  auto joypad = std::move(*PS5Joypad::create());
+  auto hid = backend->hid_devices()[0];
+  auto report_at = [&](std::size_t index) {
+    uhid::dualsense_input_report_usb report;
+    auto data = hid->reports()[index];
+    std::memcpy(&report, data.data(), std::min(sizeof(report), data.size()));
+    return report;
+  };
+  auto sample = [](float gyro_x, int timestamp_us) {
+    return PS5Joypad::MotionSample{.accel_x = 0,
+                                   .accel_y = 0,
+                                   .accel_z = 0,
+                                   .gyro_x = gyro_x,
+                                   .gyro_y = 0,
+                                   .gyro_z = 0,
+                                   .timestamp = std::chrono::microseconds(timestamp_us)};
+  };
+
+  joypad.set_motion_rate(4); // one report every 250ms, plenty of margin for a slow test thread
+  for (int i = 1; i <= 3; i++) {
+    joypad.set_motion(sample(static_cast<float>(i), i * 4000)); // a burst of samples taken 4ms apart
+  }
+  // The first one right away (from the Scheduler thread), the others are paced
+  REQUIRE(eventually([&]() { return !hid->reports().empty(); }));
+  REQUIRE(hid->reports().size() == 1);
+
+  REQUIRE(eventually([&]() { return hid->reports().size() == 3; }));
+  for (std::size_t i = 0; i < 3; i++) {
+    auto report = report_at(i);
+    // Each report carries its own sample and timestamp (in 0.33us units)
+    REQUIRE(le32toh(report.sensor_timestamp) == (i + 1) * 4000 * 1000 / 333);
+    REQUIRE(static_cast<int16_t>(le16toh(report.gyro[0])) ==
+            static_cast<int16_t>(std::lrint((i + 1) * uhid::gyro_resolution)));
+  }
+
+  // A backlog is merged and trimmed instead of growing the latency
+  hid->clear();
+  for (int i = 0; i < 100; i++) {
+    joypad.set_motion(sample(1.0f, 100000 + i * 1000));
+  }
+  joypad.set_motion_rate(0); // skips to the last sample
+  // The pacing task might be running the serial queue right now, in which case this is applied by it
+  REQUIRE(eventually([&]() {
+    auto reports = hid->reports().size();
+    return reports > 0 && le32toh(report_at(reports - 1).sensor_timestamp) == 199000ull * 1000 / 333;
+  }));
+  REQUIRE(hid->reports().size() <= 2);
+  if constexpr (metrics_enabled()) { // every sample is either sent or merged into a report
+    REQUIRE(joypad.get_metrics().frames_coalesced + hid->reports().size() == 100);
+  }
+}
@@ -0,0 +1,56 @@
+#include "catch2/catch_all.hpp"
+
+#include <atomic>
+#include <inputtino/scheduler.hpp>
+#include <thread>
+
+using namespace inputtino;
+using namespace std::chrono_literals;
+
+TEST_CASE("scheduler runs and reschedules tasks", "[SCHEDULER]") {
+  std::atomic<int> runs = 0;
+  Scheduler::get().schedule(5ms, [&runs]() -> std::optional<std::chrono::microseconds> {
+    if (++runs < 3) {
+      return 5ms;
+    }
+    return {};
+  });
+
+  std::this_thread::sleep_for(100ms);
+  REQUIRE(runs == 3);
+}
+
+TEST_CASE("scheduler cancel", "[SCHEDULER]") {
+  std::atomic<int> runs = 0;
+  auto id = Scheduler::get().schedule(20ms, [&runs]() -> std::optional<std::chrono::microseconds> {
+    runs++;
+    return 20ms;
+  });
+  Scheduler::get().cancel(id);
+
+  std::this_thread::sleep_for(50ms);
+  REQUIRE(runs == 0);
+}
+
+TEST_CASE("scheduler cancel_and_wait waits for a running task", "[SCHEDULER]") {
+  std::atomic<bool> started = false;
+  std::atomic<bool> finished = false;
+  auto id = Scheduler::get().schedule(0ms, [&]() -> std::optional<std::chrono::microseconds> {
+    started = true;
+    std::this_thread::sleep_for(50ms);
+    finished = true;
+    return 1ms;
+  });
+
+  auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (!started && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  REQUIRE(started);
+  Scheduler::get().cancel_and_wait(id);
+  REQUIRE(finished);
+
+  finished = false;
+  std::this_thread::sleep_for(20ms);
+  REQUIRE(!finished); // and it hasn't been rescheduled
+}
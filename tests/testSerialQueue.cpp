@@ -0,0 +1,53 @@
+#include "catch2/catch_all.hpp"
+
+#include <array>
+#include <inputtino/serial_queue.hpp>
+#include <thread>
+#include <vector>
+
+using namespace inputtino;
+
+TEST_CASE("serial queue runs synchronously on a single thread", "[SERIAL_QUEUE]") {
+  SerialQueue<> queue;
+  int value = 0;
+  queue.run([ptr = &value] { *ptr = 1; });
+  REQUIRE(value == 1);
+  queue.run([ptr = &value] { *ptr += 41; });
+  REQUIRE(value == 42);
+}
+
+TEST_CASE("serial queue from multiple threads", "[SERIAL_QUEUE]") {
+  constexpr int THREADS = 8;
+  constexpr int OPS_PER_THREAD = 20000;
+
+  struct Counters {
+    int total = 0;
+    int running = 0;
+    bool overlapped = false;
+    bool out_of_order = false;
+    std::array<int, THREADS> last = {};
+  } counters;
+
+  SerialQueue<64, 8> queue; // Small capacity so that producers will also have to wait for a full queue
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&queue, &counters, t] {
+      for (int i = 1; i <= OPS_PER_THREAD; i++) {
+        queue.run([c = &counters, t, i] {
+          c->overlapped |= ++c->running != 1;
+          c->out_of_order |= c->last[t] != i - 1;
+          c->last[t] = i;
+          c->total++;
+          c->running--;
+        });
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE(counters.total == THREADS * OPS_PER_THREAD);
+  REQUIRE_FALSE(counters.overlapped);
+  REQUIRE_FALSE(counters.out_of_order);
+}
@@ -1,8 +1,14 @@
 #include "catch2/catch_all.hpp"
+#include <fcntl.h>
 #include <filesystem>
 #include <immer/atom.hpp>
 #include <server/json_serialization.hpp>
 #include <server/rest.hpp>
+#include <server/shm.hpp>
+#include <server/stream.hpp>
+#include <server/workers.hpp>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 using namespace Catch::Matchers;
 
@@ -160,10 +166,321 @@ TEST_CASE_METHOD(HTTPServerFixture, "Test REST server", "[server]") {
     }
   }
 
+  { // Test wrong ids
+    auto res = client.Post("/api/v1.0/devices/add", json{{"type", "KEYBOARD"}}.dump(), "application/json");
+    REQUIRE(res);
+    std::string keyboard_id = json::parse(res->body)["device_id"];
+
+    res = client.Post("/api/v1.0/devices/mouse/" + keyboard_id + "/move_rel", "{}", "application/json");
+    REQUIRE(res);
+    REQUIRE(res->status == 400);
+    REQUIRE_THAT(res->body, ContainsSubstring("Wrong device type"));
+
+    res = client.Post("/api/v1.0/devices/mouse/not-a-number/move_rel", "{}", "application/json");
+    REQUIRE(res);
+    REQUIRE(res->status == 400);
+
+    // Malformed payloads are rejected before the event is queued
+    res = client.Post("/api/v1.0/devices/keyboard/" + keyboard_id + "/press", "{}", "application/json");
+    REQUIRE(res);
+    REQUIRE(res->status == 400);
+    REQUIRE_THAT(res->body, ContainsSubstring("Invalid payload"));
+    res = client.Post("/api/v1.0/devices/keyboard/" + keyboard_id + "/press",
+                      json{{"key", "A"}}.dump(),
+                      "application/json");
+    REQUIRE(res);
+    REQUIRE(res->status == 400);
+
+    res = client.Delete("/api/v1.0/devices/" + keyboard_id);
+    REQUIRE(res);
+    REQUIRE(res->status == 200);
+    res = client.Post("/api/v1.0/devices/keyboard/" + keyboard_id + "/press",
+                      json{{"key", 41}}.dump(),
+                      "application/json");
+    REQUIRE(res);
+    REQUIRE(res->status == 404); // stale ids are never resolved
+  }
+
   { // Test POST /devices/add without type
     auto res = client.Post("/api/v1.0/devices/add", "{}", "application/json");
     REQUIRE(res);
     REQUIRE(res->status == 500);
     REQUIRE_THAT(res->body, ContainsSubstring("key 'type' not found"));
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE_METHOD(HTTPServerFixture, "Test joypad feedback stream", "[server]") {
+  httplib::Client client(this->rest_ip, this->rest_port);
+
+  auto res = client.Post("/api/v1.0/devices/add",
+                         json{{"type", "JOYPAD"}, {"joypad_type", "xbox"}}.dump(),
+                         "application/json");
+  REQUIRE(res);
+  REQUIRE(res->status == 200);
+  auto new_device = json::parse(res->body);
+  REQUIRE_THAT(new_device["type"], Equals("JOYPAD"));
+  std::string device_id = new_device["device_id"];
+
+  std::mutex m;
+  std::string events;
+  std::thread stream([&]() {
+    httplib::Client stream_client(this->rest_ip, this->rest_port);
+    stream_client.Get("/api/v1.0/devices/joypad/" + device_id + "/feedback", [&](const char *data, std::size_t size) {
+      std::lock_guard lock(m);
+      events.append(data, size);
+      return true;
+    });
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // There can only be one stream for each joypad
+  res = client.Get("/api/v1.0/devices/joypad/" + device_id + "/feedback");
+  REQUIRE(res);
+  REQUIRE(res->status == 409);
+
+  // Play a rumble effect, as a game would
+  std::string event_node;
+  for (std::string node : new_device["device_nodes"]) {
+    if (node.find("event") != std::string::npos) {
+      event_node = node;
+    }
+  }
+  REQUIRE(!event_node.empty());
+  int fd = open(event_node.c_str(), O_RDWR);
+  REQUIRE(fd >= 0);
+  ff_effect effect{};
+  effect.type = FF_RUMBLE;
+  effect.id = -1;
+  effect.u.rumble.strong_magnitude = 0x8000;
+  effect.replay.length = 1000;
+  REQUIRE(ioctl(fd, EVIOCSFF, &effect) == 0);
+  input_event play{.time = {}, .type = EV_FF, .code = static_cast<unsigned short>(effect.id), .value = 1};
+  REQUIRE(write(fd, &play, sizeof(play)) == sizeof(play));
+
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    {
+      std::lock_guard lock(m);
+      if (events.find("event: rumble") != std::string::npos) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  close(fd);
+
+  // Removing the joypad ends the stream
+  res = client.Delete("/api/v1.0/devices/" + device_id);
+  REQUIRE(res);
+  REQUIRE(res->status == 200);
+  stream.join();
+  REQUIRE_THAT(events, ContainsSubstring("event: rumble") && ContainsSubstring("\"low_freq\":32768"));
+
+  res = client.Get("/api/v1.0/devices/joypad/" + device_id + "/feedback");
+  REQUIRE(res);
+  REQUIRE(res->status == 404);
+}
+
+static void append_message(std::vector<std::uint8_t> &buffer,
+                           std::uint8_t opcode,
+                           std::uint64_t device_id,
+                           const std::vector<std::uint8_t> &payload) {
+  buffer.push_back(opcode);
+  buffer.push_back(static_cast<std::uint8_t>(payload.size()));
+  for (int i = 0; i < 8; i++) {
+    buffer.push_back(static_cast<std::uint8_t>(device_id >> (8 * i)));
+  }
+  buffer.insert(buffer.end(), payload.begin(), payload.end());
+}
+
+TEST_CASE("Test stream server", "[server]") {
+  auto mouse = std::make_shared<inputtino::Mouse>(std::move(*inputtino::Mouse::create()));
+  auto local_state = ServerState{};
+  auto mouse_id = *local_state.handles->add(mouse);
+  local_state.devices = {{mouse_id, LocalDevice{.type = DeviceType::MOUSE, .device_id = mouse_id, .device = mouse}}};
+  auto state = std::make_shared<immer::atom<ServerState>>(local_state);
+
+  StreamServer server(state);
+  REQUIRE(server.listen("127.0.0.1", 19998));
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{.sin_family = AF_INET, .sin_port = htons(19998)};
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  REQUIRE(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+
+  std::vector<std::uint8_t> batch;
+  append_message(batch, stream::MOUSE_MOVE_REL, mouse_id, {10, 0, 0xF6, 0xFF}); // +10, -10
+  append_message(batch, 0x7F, mouse_id, {1, 2, 3});                             // unknown opcode, skipped
+  append_message(batch, stream::MOUSE_PRESS, mouse_id, {inputtino::Mouse::LEFT});
+  append_message(batch, stream::MOUSE_RELEASE, mouse_id, {inputtino::Mouse::LEFT});
+  append_message(batch, stream::KEYBOARD_PRESS, mouse_id, {41, 0}); // not a keyboard, skipped
+  append_message(batch, stream::SYNC, 0, {0x01, 0x02, 0x03, 0x04});
+
+  // Split the batch in the middle of a message, the server has to wait for the rest of it
+  REQUIRE(send(fd, batch.data(), 7, 0) == 7);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  REQUIRE(send(fd, batch.data() + 7, batch.size() - 7, 0) == static_cast<ssize_t>(batch.size() - 7));
+
+  // Only SYNC gets a reply, once everything before it has been applied
+  std::array<std::uint8_t, stream::HEADER_SIZE + 4> reply{};
+  REQUIRE(recv(fd, reply.data(), reply.size(), MSG_WAITALL) == static_cast<ssize_t>(reply.size()));
+  REQUIRE(reply[0] == stream::SYNC);
+  REQUIRE(reply[1] == 4);
+  REQUIRE(stream::read_u32(reply.data() + stream::HEADER_SIZE) == 0x04030201);
+
+  close(fd);
+  server.stop();
+}
+
+TEST_CASE("Test shared memory server", "[server]") {
+  auto mouse = std::make_shared<inputtino::Mouse>(std::move(*inputtino::Mouse::create()));
+  auto local_state = ServerState{};
+  auto mouse_id = *local_state.handles->add(mouse);
+  local_state.devices = {{mouse_id, LocalDevice{.type = DeviceType::MOUSE, .device_id = mouse_id, .device = mouse}}};
+  auto state = std::make_shared<immer::atom<ServerState>>(local_state);
+
+  auto socket_path = (std::filesystem::temp_directory_path() / "inputtino-test-shm.sock").string();
+  ShmServer server(state, std::make_shared<WorkerPool>(1), 256); // a tiny ring, so that messages wrap around
+  REQUIRE(server.listen(socket_path));
+
+  auto producer = shm::Producer::connect(socket_path);
+  REQUIRE(producer);
+
+  std::vector<std::uint8_t> batch;
+  append_message(batch, stream::MOUSE_MOVE_REL, mouse_id, {10, 0, 0xF6, 0xFF}); // +10, -10
+  append_message(batch, stream::MOUSE_PRESS, mouse_id, {inputtino::Mouse::LEFT});
+  append_message(batch, stream::MOUSE_RELEASE, mouse_id, {inputtino::Mouse::LEFT});
+
+  // Many more messages than the ring can hold: the producer waits for the server to catch up
+  constexpr std::uint32_t SYNCS = 100;
+  for (std::uint32_t sequence = 0; sequence < SYNCS; sequence++) {
+    auto messages = batch;
+    append_message(messages,
+                   stream::SYNC,
+                   0,
+                   {static_cast<std::uint8_t>(sequence), static_cast<std::uint8_t>(sequence >> 8), 0, 0});
+    while (!producer->write(messages.data(), messages.size())) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Each SYNC is answered once everything before it has been applied, in order
+  for (std::uint32_t sequence = 0; sequence < SYNCS; sequence++) {
+    std::array<std::uint8_t, stream::HEADER_SIZE + 4> reply{};
+    REQUIRE(recv(producer->sync_fd(), reply.data(), reply.size(), 0) == static_cast<ssize_t>(reply.size()));
+    REQUIRE(reply[0] == stream::SYNC);
+    REQUIRE(stream::read_u32(reply.data() + stream::HEADER_SIZE) == sequence);
+  }
+
+  producer.reset();
+  server.stop();
+  REQUIRE(!std::filesystem::exists(socket_path));
+}
+
+TEST_CASE("Test shared memory ring capacity", "[server]") {
+  auto server_ring = shm::Ring::create(256);
+  REQUIRE(server_ring);
+  auto producer_ring = shm::Ring::open(dup(server_ring->fd()));
+  REQUIRE(producer_ring);
+  REQUIRE(producer_ring->capacity() == 256);
+
+  // The header is writable by the producer, the server only trusts the size of its own mapping
+  producer_ring->header()->capacity = std::uint64_t(1) << 40;
+  REQUIRE(server_ring->capacity() == 256);
+  REQUIRE(!shm::Ring::open(dup(server_ring->fd())));
+}
+
+TEST_CASE("Test worker pool", "[server]") {
+  WorkerPool workers(1, {}, 4);
+
+  // Block the only worker while we queue up events
+  std::atomic<bool> unblock = false;
+  REQUIRE(workers.submit("busy", [&]() {
+    while (!unblock) {
+      std::this_thread::yield();
+    }
+  }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::mutex m;
+  std::vector<std::string> served;
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(workers.submit("busy", [&]() {
+      std::lock_guard lock(m);
+      served.push_back("busy");
+    }));
+  }
+  REQUIRE(!workers.submit("busy", []() {})); // too many pending events for this client
+  REQUIRE(workers.submit("other", [&]() {
+    std::lock_guard lock(m);
+    served.push_back("other");
+  }));
+
+  unblock = true;
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    {
+      std::lock_guard lock(m);
+      if (served.size() == 5) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Clients are served in turn: the backlog of "busy" doesn't delay "other"
+  std::lock_guard lock(m);
+  REQUIRE_THAT(served, Equals(std::vector<std::string>{"busy", "other", "busy", "busy", "busy"}));
+
+  REQUIRE_THAT(WorkerPool::parse_cpus("0,2,4-6"), Equals(std::vector<int>{0, 2, 4, 5, 6}));
+}
+
+TEST_CASE("Test worker pool priorities", "[server]") {
+  WorkerPool workers(1, {}, 8);
+
+  std::atomic<bool> unblock = false;
+  REQUIRE(workers.submit("busy", [&]() {
+    while (!unblock) {
+      std::this_thread::yield();
+    }
+  }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::mutex m;
+  std::vector<std::string> served;
+  auto serve = [&](std::string name) {
+    return [&, name]() {
+      std::lock_guard lock(m);
+      served.push_back(name);
+    };
+  };
+  auto motion = WorkerPool::Priority::MOTION;
+  auto critical = WorkerPool::Priority::CRITICAL;
+
+  bool coalesced = false;
+  REQUIRE(workers.submit("client", serve("motion 1"), motion, 1, &coalesced));
+  REQUIRE(!coalesced);
+  REQUIRE(workers.submit("client", serve("motion 2"), motion, 1, &coalesced));
+  REQUIRE(coalesced); // replaces "motion 1"
+  REQUIRE(workers.submit("client", serve("press"), critical));
+  coalesced = false;
+  REQUIRE(workers.submit("client", serve("motion 3"), motion, 1, &coalesced));
+  REQUIRE(!coalesced); // can't go past "press"
+  REQUIRE(workers.submit("other", serve("other press"), critical));
+
+  unblock = true;
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    {
+      std::lock_guard lock(m);
+      if (served.size() == 4) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // "other" jumps ahead of the pending motion, but the events of a client are still applied in order
+  std::lock_guard lock(m);
+  REQUIRE_THAT(served, Equals(std::vector<std::string>{"other press", "motion 2", "press", "motion 3"}));
+}
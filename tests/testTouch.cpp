@@ -0,0 +1,35 @@
+#include "catch2/catch_all.hpp"
+#include "mock_fixture.hpp"
+#include <inputtino/input.hpp>
+#include <vector>
+
+using namespace inputtino;
+using namespace std::chrono_literals;
+
+TEST_CASE_METHOD(MockBackendFixture, "Mock backend: touch tracking ids", "[MOCK]") {
+  auto touch = std::move(*TouchScreen::create());
+  auto ts = backend->evdev_devices()[0];
+  auto tracking_ids = [&]() {
+    std::vector<int> ids;
+    for (const auto &ev : ts->events()) {
+      if (ev.type == EV_ABS && ev.code == ABS_MT_TRACKING_ID) {
+        ids.push_back(ev.value);
+      }
+    }
+    return ids;
+  };
+
+  touch.place_finger(0, 0.1, 0.1, 0.3, 0);
+
+  // The new finger takes the slot that has just been freed, with a new id
+  TouchFrame frame;
+  frame.release_finger(0);
+  frame.place_finger(1, 0.2, 0.2, 0.3, 0);
+  touch.apply(frame);
+
+  auto ids = tracking_ids();
+  REQUIRE(ids.size() == 3);
+  REQUIRE(ids[1] == -1);
+  REQUIRE(ids[2] != ids[0]);
+  REQUIRE(ids[2] >= 0);
+}
@@ -0,0 +1,58 @@
+#include "catch2/catch_all.hpp"
+#include <filesystem>
+#include <fstream>
+#include <inputtino/trace.hpp>
+
+using namespace inputtino;
+
+TEST_CASE("Record and replay a trace", "[TRACE]") {
+  auto path = (std::filesystem::temp_directory_path() / "inputtino-test.trace").string();
+
+  {
+    auto mouse = std::move(*Mouse::create());
+    auto recorder = TraceRecorder::start(path);
+    REQUIRE(recorder);
+    REQUIRE_FALSE(TraceRecorder::start(path)); // only one recording at a time
+
+    for (int i = 0; i < 10; i++) {
+      mouse.move(i, -i);
+    }
+    mouse.press(Mouse::LEFT);
+    mouse.release(Mouse::LEFT);
+    (*recorder)->stop();
+    REQUIRE((*recorder)->dropped() == 0);
+
+    mouse.move(1, 1); // not recorded
+  }
+
+  auto replayer_result = TraceReplayer::open(path);
+  REQUIRE(replayer_result);
+  auto &replayer = *replayer_result;
+  REQUIRE(replayer.devices().size() == 1);
+  REQUIRE(replayer.devices()[0].kind == trace::DeviceKind::MOUSE);
+
+  auto keyboard = std::move(*Keyboard::create());
+  REQUIRE_FALSE(replayer.bind(replayer.devices()[0].id, keyboard));
+  REQUIRE(replayer.replay(0) == 0); // nothing has been bound
+
+  auto mouse = std::move(*Mouse::create());
+  REQUIRE(replayer.bind(replayer.devices()[0].id, mouse));
+  REQUIRE(replayer.replay(0) == 12);
+  REQUIRE(replayer.replay(100) == 12);
+
+  { // A truncated trace is replayed up to the last complete call
+    auto size = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, size - 1);
+    auto truncated = TraceReplayer::open(path);
+    REQUIRE(truncated);
+    REQUIRE((*truncated).bind((*truncated).devices()[0].id, mouse));
+    REQUIRE((*truncated).replay(0) == 11);
+  }
+
+  {
+    std::ofstream(path) << "not a trace";
+    REQUIRE_FALSE(TraceReplayer::open(path));
+  }
+
+  std::filesystem::remove(path);
+}